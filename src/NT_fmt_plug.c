@@ -128,6 +128,8 @@ static void swap(unsigned int *x, unsigned int *y, int count)
 	JTR_ALIGN(16) unsigned int nt_buffer8x[16*NT_NUM_KEYS];
 	JTR_ALIGN(16) unsigned int output8x[4*NT_NUM_KEYS];
 
+	/* The SSE2 assembly code in x86-64.S, which has no AVX2 or AVX-512
+	 * version; the nt2 format uses the wider vectors */
 	#define ALGORITHM_NAME		"128/128 X2 SSE2-16"
 	#define NT_CRYPT_FUN		nt_crypt_all_x86_64
 	extern int nt_crypt_all_x86_64(int *pcount, struct db_salt *salt);
@@ -257,6 +259,7 @@ static void fmt_NT_init(struct fmt_main *self)
 #endif
 		/* This avoids an if clause for every set_key */
 		fmt_NT.methods.set_key = set_key_utf8;
+		fmt_NT.methods.set_key_range = NULL;
 		/* kick it up from 27. We will 'adjust' in the setkey_utf8 function.  */
 		fmt_NT.params.plaintext_length = 3 * PLAINTEXT_LENGTH;
 		tests[1].plaintext = "\xC3\xBC";         // German u-umlaut in UTF-8
@@ -275,6 +278,7 @@ static void fmt_NT_init(struct fmt_main *self)
 #endif
 		} else {
 			fmt_NT.methods.set_key = set_key_encoding;
+			fmt_NT.methods.set_key_range = NULL;
 		}
 		if (CP_to_Unicode[0xfc] == 0x00fc) {
 			tests[1].plaintext = "\xFC";         // German u-umlaut in UTF-8
@@ -726,6 +730,71 @@ static void set_key(char *_key, int index)
 #endif
 }
 
+// Key buffer, its interleave factor and the offset of its length word
+static inline unsigned int *key_buffer(int index, unsigned int *xBuf,
+                                       unsigned int *lenStoreOffset)
+{
+#if defined(NT_X86_64)
+	*xBuf = 8;
+	*lenStoreOffset = 112;
+	return &nt_buffer8x[128 * (index >> 3) + index % 8];
+#elif defined(NT_SSE2)
+	if(index < NT_NUM_KEYS4) {
+		*xBuf = 4;
+		*lenStoreOffset = 56;
+		return &nt_buffer4x[64 * (index >> 2) + index % 4];
+	}
+	*xBuf = 1;
+	*lenStoreOffset = 14;
+	return &nt_buffer1x[16 * (index - NT_NUM_KEYS4)];
+#else
+	*xBuf = 1;
+	*lenStoreOffset = 14;
+	return &nt_buffer1x[index << 4];
+#endif
+}
+
+// Set the UCS-2 character at pos, for the non-UTF8 ISO-8859-1 set_key only
+static inline void set_key_char(unsigned int *keybuffer, unsigned int xBuf,
+                                int pos, unsigned char c)
+{
+	unsigned int shift = (pos & 1) << 4;
+	unsigned int *word = &keybuffer[(pos >> 1) * xBuf];
+
+	*word = (*word & ~(0xffffU << shift)) | ((unsigned int)c << shift);
+}
+
+// Set the first key as usual, then copy its words over for the others
+static void set_key_range(char *_key, int index, int pos,
+                          unsigned char *chars, int count)
+{
+	unsigned int *src, *dst, sxBuf, dxBuf, sLen, dLen;
+	unsigned int i, md4_size, words;
+	int j;
+
+	set_key(_key, index);
+	src = key_buffer(index, &sxBuf, &sLen);
+	set_key_char(src, sxBuf, pos, chars[0]);
+	md4_size = src[sLen] >> 4;
+	words = (md4_size >> 1) + 1;
+
+	for (j = 1; j < count; j++) {
+		int idx = index + j;
+
+		dst = key_buffer(idx, &dxBuf, &dLen);
+		for (i = 0; i < words; i++)
+			dst[i * dxBuf] = src[i * sxBuf];
+		for (i *= dxBuf; i <= last_i[idx]; i += dxBuf)
+			dst[i] = 0;
+		if (dxBuf == 1)
+			last_i[idx] = (md4_size >> 1) + 1;
+		else
+			last_i[idx] = md4_size << (dxBuf >> 2);
+		dst[dLen] = md4_size << 4;
+		set_key_char(dst, dxBuf, pos, chars[j]);
+	}
+}
+
 // UTF-8 conversion right into key buffer
 // This is common code for the SSE/MMX/generic variants
 static inline void set_key_helper_utf8(unsigned int * keybuffer, unsigned int xBuf,
@@ -1073,7 +1142,8 @@ struct fmt_main fmt_NT = {
 		},
 		cmp_all,
 		cmp_one,
-		cmp_exact
+		cmp_exact,
+		set_key_range
 	}
 };
 
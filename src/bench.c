@@ -57,6 +57,7 @@
 #include "unicode.h"
 #include "config.h"
 #include "common-gpu.h"
+#include "path.h"
 
 #ifndef BENCH_BUILD
 #include "options.h"
@@ -73,10 +74,15 @@
 
 #if FMT_MAIN_VERSION > 11
 static char cost_msg[128 * FMT_TUNABLE_COSTS];
+/* Tunable costs of the two test vectors used by the last benchmark */
+static unsigned int t_cost[2][FMT_TUNABLE_COSTS];
 #endif
 
 long clk_tck = 0;
 
+/* Whether to print the usual human-readable results to stdout */
+static int bench_text = 1;
+
 void clk_tck_init(void)
 {
 	if (clk_tck) return;
@@ -196,7 +202,7 @@ char *benchmark_format(struct fmt_main *format, int salts,
 	void *salt, *two_salts[2];
 	int index, max;
 #if FMT_MAIN_VERSION > 11
-	unsigned int i, t_cost[2][FMT_TUNABLE_COSTS];
+	unsigned int i;
 	int ntests, pruned;
 #endif
 	clk_tck_init();
@@ -480,10 +486,416 @@ void gather_results(struct bench_results *results)
 }
 #endif
 
+#ifndef BENCH_BUILD
+/*
+ * Machine-readable results (--bench-format, --bench-output) and comparison
+ * against such results saved earlier (--bench-baseline, --bench-regress).
+ */
+#define BENCH_OUT_TEXT			0
+#define BENCH_OUT_CSV			1
+#define BENCH_OUT_JSON			2
+
+static int bench_out_type;
+static FILE *bench_out;
+static int bench_out_count;
+
+struct bench_baseline {
+	struct bench_baseline *next;
+	char *label, *test;
+	unsigned long long cps;
+};
+
+static struct bench_baseline *bench_baseline;
+static unsigned int bench_regressed;
+
+static unsigned long long bench_cps_value(int64 *crypts, clock_t time)
+{
+	unsigned long long cps;
+
+	cps = ((unsigned long long)crypts->hi << 32) + crypts->lo;
+	cps *= clk_tck;
+	cps /= time;
+
+	return cps;
+}
+
+/*
+ * Splits one CSV line into fields in place, handling quoted fields the way
+ * bench_csv_str() writes them.  Returns the number of fields.
+ */
+static int bench_csv_split(char *line, char **fields, int max)
+{
+	char *p = line, *q;
+	int count = 0;
+
+	while (count < max) {
+		if (*p == '"') {
+			fields[count++] = q = ++p;
+			while (*p && (*p != '"' || p[1] == '"')) {
+				if (*p == '"')
+					p++;
+				*q++ = *p++;
+			}
+			if (*p == '"')
+				p++;
+			*q = 0;
+		} else {
+			fields[count++] = p;
+			p += strcspn(p, ",\r\n");
+		}
+		if (*p != ',') {
+			*p = 0;
+			break;
+		}
+		*p++ = 0;
+	}
+
+	return count;
+}
+
+/*
+ * Gets a string or number field from a JSON record as bench_json_record()
+ * writes them.  Returns NULL if there's no such field.
+ */
+static char *bench_json_field(char *line, char *name)
+{
+	static char value[PLAINTEXT_BUFFER_SIZE];
+	char key[64], *p, *q;
+
+	snprintf(key, sizeof(key), "\"%s\":", name);
+	if (!(p = strstr(line, key)))
+		return NULL;
+	p += strlen(key);
+
+	q = value;
+	if (*p == '"') {
+		p++;
+		while (*p && *p != '"' && q < &value[sizeof(value) - 1]) {
+			if (*p == '\\' && p[1])
+				p++;
+			*q++ = *p++;
+		}
+	} else
+		while (*p && !strchr(",}", *p) &&
+		    q < &value[sizeof(value) - 1])
+			*q++ = *p++;
+	*q = 0;
+
+	return value;
+}
+
+static void bench_add_baseline(char *label, char *test, char *cps)
+{
+	struct bench_baseline *entry;
+
+	if (!label || !test || !cps || !*cps)
+		return;
+
+	entry = mem_alloc_tiny(sizeof(*entry), MEM_ALIGN_WORD);
+	entry->label = str_alloc_copy(label);
+	entry->test = str_alloc_copy(test);
+	entry->cps = strtoull(cps, NULL, 10);
+	entry->next = bench_baseline;
+	bench_baseline = entry;
+}
+
+static void bench_load_baseline(char *name)
+{
+	FILE *file;
+	char line[LINE_BUFFER_SIZE], *fields[32];
+	int count, i, label = -1, test = -1, cps = -1;
+
+	if (!(file = fopen(path_expand(name), "r")))
+		pexit("fopen: %s", path_expand(name));
+
+	while (fgets(line, sizeof(line), file)) {
+		char *p = line;
+
+		while (*p == ' ' || *p == '\t' || *p == ',' || *p == '[')
+			p++;
+		if (*p == '{') {
+			char label_copy[PLAINTEXT_BUFFER_SIZE];
+			char test_copy[64];
+			char *value;
+
+			if (!(value = bench_json_field(p, "label")))
+				continue;
+			strnzcpy(label_copy, value, sizeof(label_copy));
+			if (!(value = bench_json_field(p, "test")))
+				continue;
+			strnzcpy(test_copy, value, sizeof(test_copy));
+			bench_add_baseline(label_copy, test_copy,
+			    bench_json_field(p, "cps_real"));
+			continue;
+		}
+
+		count = bench_csv_split(line, fields, 32);
+		if (label < 0) {
+			for (i = 0; i < count; i++)
+			if (!strcmp(fields[i], "label"))
+				label = i;
+			else if (!strcmp(fields[i], "test"))
+				test = i;
+			else if (!strcmp(fields[i], "cps_real"))
+				cps = i;
+			if (test < 0 || cps < 0)
+				label = -1;
+			continue;
+		}
+		if (count > label && count > test && count > cps)
+			bench_add_baseline(fields[label], fields[test],
+			    fields[cps]);
+	}
+
+	if (ferror(file))
+		pexit("fgets");
+	fclose(file);
+
+	if (!bench_baseline) {
+		fprintf(stderr, "No benchmark results found in %s\n", name);
+		error();
+	}
+}
+
+static struct bench_baseline *bench_find_baseline(char *label, char *test)
+{
+	struct bench_baseline *entry;
+
+	for (entry = bench_baseline; entry; entry = entry->next)
+	if (!strcmp(entry->label, label) && !strcmp(entry->test, test))
+		return entry;
+
+	return NULL;
+}
+
+static void bench_init_output(void)
+{
+	if (!john_main_process)
+		return;
+
+	if (options.bench_format) {
+		if (!strcasecmp(options.bench_format, "csv"))
+			bench_out_type = BENCH_OUT_CSV;
+		else if (!strcasecmp(options.bench_format, "json"))
+			bench_out_type = BENCH_OUT_JSON;
+		else {
+			fprintf(stderr, "Invalid --bench-format \"%s\", "
+			    "valid ones are csv and json\n",
+			    options.bench_format);
+			error();
+		}
+	}
+
+	if (options.bench_output) {
+		if (!bench_out_type)
+			bench_out_type = BENCH_OUT_CSV;
+		if (!(bench_out = fopen(path_expand(options.bench_output),
+		    "w")))
+			pexit("fopen: %s", path_expand(options.bench_output));
+	} else if (bench_out_type) {
+		bench_out = stdout;
+		bench_text = 0;
+	}
+
+	if (options.bench_regress < 0 || options.bench_regress > 100) {
+		fprintf(stderr, "Invalid --bench-regress %d, must be 0..100\n",
+		    options.bench_regress);
+		error();
+	}
+
+	if (options.bench_baseline)
+		bench_load_baseline(options.bench_baseline);
+
+	if (bench_out_type == BENCH_OUT_CSV)
+		fprintf(bench_out, "label,algorithm,test,salts,threads,"
+		    "max_keys_per_crypt,costs,status,cps_real,cps_virtual,"
+		    "time_real,time_virtual,crypts,"
+		    "baseline_cps,change_percent,regressed\n");
+	else if (bench_out_type == BENCH_OUT_JSON)
+		fputs("[\n", bench_out);
+}
+
+static void bench_done_output(void)
+{
+	if (!bench_out)
+		return;
+
+	if (bench_out_type == BENCH_OUT_JSON)
+		fputs(bench_out_count ? "\n]\n" : "]\n", bench_out);
+
+	if (bench_out == stdout)
+		fflush(stdout);
+	else if (fclose(bench_out))
+		pexit("fclose");
+	bench_out = NULL;
+}
+
+static void bench_csv_str(char *str)
+{
+	fputc('"', bench_out);
+	while (*str) {
+		if (*str == '"')
+			fputc('"', bench_out);
+		fputc(*str++, bench_out);
+	}
+	fputc('"', bench_out);
+}
+
+static void bench_json_str(char *name, char *str)
+{
+	fprintf(bench_out, "\"%s\":\"", name);
+	while (*str) {
+		unsigned char c = *str++;
+
+		if (c == '"' || c == '\\')
+			fprintf(bench_out, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(bench_out, "\\u%04x", c);
+		else
+			fputc(c, bench_out);
+	}
+	fputc('"', bench_out);
+}
+
+/*
+ * Compares a result against the baseline, printing the difference along with
+ * the human-readable results.  Returns the baseline entry, if any.
+ */
+static struct bench_baseline *bench_compare(struct fmt_main *format,
+	char *test, struct bench_results *results, int *regressed)
+{
+	struct bench_baseline *entry;
+	unsigned long long cps;
+
+	*regressed = 0;
+	if (!bench_baseline || !benchmark_time ||
+	    !(entry = bench_find_baseline(format->params.label, test)) ||
+	    !entry->cps)
+		return NULL;
+
+	cps = bench_cps_value(&results->crypts, results->real);
+	if (cps * 100 < entry->cps * (100 - options.bench_regress)) {
+		*regressed = 1;
+		bench_regressed++;
+	}
+
+	if (bench_text && john_main_process) {
+		int64 crypts;
+		char s_cps[64];
+
+		crypts.lo = (unsigned int)entry->cps;
+		crypts.hi = (unsigned int)(entry->cps >> 32);
+		benchmark_cps(&crypts, clk_tck, s_cps);
+		printf("Baseline:\t%s c/s real, %+.1f%%%s\n", s_cps,
+		    ((double)cps - entry->cps) * 100 / entry->cps,
+		    *regressed ? " (REGRESSION)" : "");
+	}
+
+	return entry;
+}
+
+/*
+ * Writes out one result (or a self-test failure, if status isn't "PASS").
+ */
+static void bench_record(struct fmt_main *format, char *test, int salts,
+	int threads, char *status, struct bench_results *results)
+{
+	struct bench_baseline *entry = NULL;
+	unsigned long long cps_real = 0, cps_virtual = 0;
+	double change = 0;
+	int regressed = 0, speed;
+	char costs[16 * FMT_TUNABLE_COSTS] = "";
+	char s_status[128];
+#if FMT_MAIN_VERSION > 11
+	int i, n = 0;
+
+	for (i = 0; i < FMT_TUNABLE_COSTS &&
+	     format->methods.tunable_cost_value[i] != NULL; i++)
+		n += sprintf(costs + n, "%s%u", i ? ";" : "", t_cost[0][i]);
+#endif
+
+	strnzcpy(s_status, status, sizeof(s_status));
+	s_status[strcspn(s_status, "\n")] = 0;
+	status = s_status;
+
+	speed = results && benchmark_time;
+	if (speed) {
+		cps_real = bench_cps_value(&results->crypts, results->real);
+		cps_virtual = bench_cps_value(&results->crypts,
+		    results->virtual);
+		entry = bench_compare(format, test, results, &regressed);
+		if (entry)
+			change = ((double)cps_real - entry->cps) * 100 /
+			    entry->cps;
+	}
+
+	if (!bench_out)
+		return;
+
+	if (bench_out_type == BENCH_OUT_CSV) {
+		bench_csv_str(format->params.label);
+		fputc(',', bench_out);
+		bench_csv_str(format->params.algorithm_name);
+		fprintf(bench_out, ",%s,%d,%d,%d,%s,", test, salts, threads,
+		    format->params.max_keys_per_crypt, costs);
+		bench_csv_str(status);
+		if (speed)
+			fprintf(bench_out, ",%llu,%llu,%.2f,%.2f,%llu",
+			    cps_real, cps_virtual,
+			    (double)results->real / clk_tck,
+			    (double)results->virtual / clk_tck,
+			    ((unsigned long long)results->crypts.hi << 32) +
+			    results->crypts.lo);
+		else
+			fputs(",,,,,", bench_out);
+		if (entry)
+			fprintf(bench_out, ",%llu,%.1f,%d\n",
+			    entry->cps, change, regressed);
+		else
+			fputs(",,,\n", bench_out);
+	} else {
+		if (bench_out_count++)
+			fputs(",\n", bench_out);
+		fputc('{', bench_out);
+		bench_json_str("label", format->params.label);
+		fputc(',', bench_out);
+		bench_json_str("algorithm", format->params.algorithm_name);
+		fprintf(bench_out, ",\"test\":\"%s\",\"salts\":%d,"
+		    "\"threads\":%d,\"max_keys_per_crypt\":%d,\"costs\":[",
+		    test, salts, threads, format->params.max_keys_per_crypt);
+#if FMT_MAIN_VERSION > 11
+		for (i = 0; i < FMT_TUNABLE_COSTS &&
+		     format->methods.tunable_cost_value[i] != NULL; i++) {
+			fprintf(bench_out, "%s{", i ? "," : "");
+			bench_json_str("name",
+			    format->params.tunable_cost_name[i]);
+			fprintf(bench_out, ",\"value\":%u}", t_cost[0][i]);
+		}
+#endif
+		fputs("],", bench_out);
+		bench_json_str("status", status);
+		if (speed)
+			fprintf(bench_out, ",\"cps_real\":%llu,"
+			    "\"cps_virtual\":%llu,\"time_real\":%.2f,"
+			    "\"time_virtual\":%.2f,\"crypts\":%llu",
+			    cps_real, cps_virtual,
+			    (double)results->real / clk_tck,
+			    (double)results->virtual / clk_tck,
+			    ((unsigned long long)results->crypts.hi << 32) +
+			    results->crypts.lo);
+		if (entry)
+			fprintf(bench_out, ",\"baseline_cps\":%llu,"
+			    "\"change_percent\":%.1f,\"regressed\":%s",
+			    entry->cps, change, regressed ? "true" : "false");
+		fputc('}', bench_out);
+	}
+}
+#endif
+
 int benchmark_all(void)
 {
 	struct fmt_main *format;
-	char *result, *msg_1, *msg_m;
+	char *result, *msg_1, *msg_m, *test_1, *test_m;
 	struct bench_results results_1, results_m;
 	char s_real[64], s_virtual[64];
 #if defined(HAVE_OPENCL) || defined(HAVE_CUDA)
@@ -493,6 +905,7 @@ int benchmark_all(void)
 	const char *s_gpu = "";
 #endif
 	unsigned int total, failed;
+	int threads;
 	MEMDBG_HANDLE memHand;
 
 #ifdef _OPENMP
@@ -513,6 +926,7 @@ int benchmark_all(void)
 #endif
 
 #ifndef BENCH_BUILD
+	bench_init_output();
 AGAIN:
 #endif
 	total = failed = 0;
@@ -565,14 +979,18 @@ AGAIN:
 			strcmp(format->params.label, "crypt")==0 )
 			fmt_init(format);
 
+		threads = 1;
 #ifdef _OPENMP
 		// MPIOMPmutex may have capped the number of threads
 		ompt = omp_get_max_threads();
+		if (format->params.flags & FMT_OMP)
+			threads = ompt;
 #endif /* _OPENMP */
 
 #ifdef HAVE_MPI
 		if (john_main_process)
 #endif
+		if (bench_text)
 		printf("%s: %s%s%s%s [%s]%s... ",
 		    benchmark_time ? "Benchmarking" : "Testing",
 		    format->params.label,
@@ -590,7 +1008,7 @@ AGAIN:
 		fflush(stdout);
 
 #ifdef HAVE_MPI
-		if (john_main_process) {
+		if (john_main_process && bench_text) {
 			if (mpi_p > 1) {
 				printf("(%uxMPI", mpi_p);
 #ifdef _OPENMP
@@ -613,7 +1031,7 @@ AGAIN:
 #ifdef HAVE_MPI
 		if (john_main_process)
 #endif
-		if (format->params.flags & FMT_OMP && ompt > 1)
+		if (format->params.flags & FMT_OMP && ompt > 1 && bench_text)
 			printf("(%dxOMP) ", ompt);
 		fflush(stdout);
 #endif /* _OPENMP */
@@ -624,6 +1042,8 @@ AGAIN:
 			if (format->params.tests[1].ciphertext) {
 				msg_m = "Many salts";
 				msg_1 = "Only one salt";
+				test_m = "many";
+				test_1 = "one";
 				break;
 			}
 			/* fall through */
@@ -632,11 +1052,15 @@ AGAIN:
 		case -1001:
 			msg_m = "Raw";
 			msg_1 = NULL;
+			test_m = "raw";
+			test_1 = NULL;
 			break;
 
 		default:
 			msg_m = "Short";
 			msg_1 = "Long";
+			test_m = "short";
+			test_1 = "long";
 		}
 
 		total++;
@@ -644,14 +1068,27 @@ AGAIN:
 		if ((result = benchmark_format(format,
 		    format->params.salt_size ? BENCHMARK_MANY : 1,
 		    &results_m))) {
-			puts(result);
+			if (bench_text)
+				puts(result);
+#ifndef BENCH_BUILD
+			if (*result)
+				bench_record(format, test_m,
+				    format->params.salt_size ?
+				    BENCHMARK_MANY : 1, threads, result, NULL);
+#endif
 			failed++;
 			goto next;
 		}
 
 		if (msg_1)
 		if ((result = benchmark_format(format, 1, &results_1))) {
-			puts(result);
+			if (bench_text)
+				puts(result);
+#ifndef BENCH_BUILD
+			if (*result)
+				bench_record(format, test_1, 1, threads,
+				    result, NULL);
+#endif
 			failed++;
 			goto next;
 		}
@@ -686,6 +1123,7 @@ AGAIN:
 #ifdef HAVE_MPI
 		if (john_main_process)
 #endif
+		if (bench_text)
 			printf(benchmark_time ? "DONE%s\n" : "PASS%s\n", s_gpu);
 #ifdef _OPENMP
 		// reset this in case format capped it (we may be testing more formats)
@@ -693,7 +1131,7 @@ AGAIN:
 #endif
 
 #if FMT_MAIN_VERSION > 11
-		if (john_main_process && benchmark_time &&
+		if (john_main_process && benchmark_time && bench_text &&
 		    *cost_msg && options.verbosity >= 3)
 			puts(cost_msg);
 #endif
@@ -709,23 +1147,29 @@ AGAIN:
 #ifdef HAVE_MPI
 		if (john_main_process)
 #endif
-		if (benchmark_time)
+		if (benchmark_time && bench_text)
 		printf("%s:\t%s c/s real, %s c/s virtual\n",
 			msg_m, s_real, s_virtual);
 #else
 #ifdef HAVE_MPI
 		if (john_main_process)
 #endif
-		if (benchmark_time)
+		if (benchmark_time && bench_text)
 		printf("%s:\t%s c/s\n",
 			msg_m, s_real);
 #endif
+#ifndef BENCH_BUILD
+		if (john_main_process)
+			bench_record(format, test_m,
+			    format->params.salt_size ? BENCHMARK_MANY : 1,
+			    threads, "PASS", &results_m);
+#endif
 
 		if (!msg_1) {
 #ifdef HAVE_MPI
 			if (john_main_process)
 #endif
-			if (benchmark_time)
+			if (benchmark_time && bench_text)
 			putchar('\n');
 			goto next;
 		}
@@ -736,14 +1180,24 @@ AGAIN:
 		if (john_main_process)
 #endif
 #if !defined(__DJGPP__) && !defined(__BEOS__) && !defined(__MINGW32__) && !defined (_MSC_VER)
-		if (benchmark_time)
-		printf("%s:\t%s c/s real, %s c/s virtual\n\n",
+		if (benchmark_time && bench_text)
+		printf("%s:\t%s c/s real, %s c/s virtual\n",
 			msg_1, s_real, s_virtual);
 #else
-		if (benchmark_time)
-		printf("%s:\t%s c/s\n\n",
+		if (benchmark_time && bench_text)
+		printf("%s:\t%s c/s\n",
 			msg_1, s_real);
 #endif
+#ifndef BENCH_BUILD
+		if (john_main_process)
+			bench_record(format, test_1, 1, threads, "PASS",
+			    &results_1);
+#endif
+#ifdef HAVE_MPI
+		if (john_main_process)
+#endif
+		if (benchmark_time && bench_text)
+			putchar('\n');
 
 next:
 		fflush(stdout);
@@ -756,16 +1210,26 @@ next:
 #endif
 	} while ((format = format->next) && !event_abort);
 
-	if (failed && total > 1 && !event_abort)
+	if (failed && total > 1 && !event_abort && bench_text)
 		printf("%u out of %u tests have FAILED\n", failed, total);
-	else if (total > 1 && !event_abort)
+	else if (total > 1 && !event_abort && bench_text)
 		if (john_main_process)
 			printf("All %u formats passed self-tests!\n", total);
 
 #ifndef BENCH_BUILD
 	if (options.flags & FLG_LOOPTEST && !event_abort)
 		goto AGAIN;
-#endif
 
+	bench_done_output();
+
+	if (bench_regressed && john_main_process)
+		fprintf(stderr, "%u benchmark%s regressed by more than %d%% "
+		    "against %s\n", bench_regressed,
+		    bench_regressed == 1 ? "" : "s", options.bench_regress,
+		    options.bench_baseline);
+
+	return failed || event_abort || bench_regressed;
+#else
 	return failed || event_abort;
+#endif
 }
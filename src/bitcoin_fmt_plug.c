@@ -65,8 +65,11 @@ static int omp_t = 1;
 #define SALT_ALIGN			sizeof(int)
 #define SALT_SIZE		sizeof(struct custom_salt)
 #ifdef MMX_COEF_SHA512
-#define MIN_KEYS_PER_CRYPT	MMX_COEF_SHA512
-#define MAX_KEYS_PER_CRYPT	MMX_COEF_SHA512
+#define MIN_KEYS_PER_CRYPT	(MMX_COEF_SHA512*SHA512_SSE_PARA)
+#define MAX_KEYS_PER_CRYPT	(MMX_COEF_SHA512*SHA512_SSE_PARA)
+// word i of key index in the SHA512_SSE_PARA blocks of MMX_COEF_SHA512 lanes
+#define GETPOS(i, index)	(((index)/MMX_COEF_SHA512)*SHA512_BUF_SIZ*MMX_COEF_SHA512 + \
+	(i)*MMX_COEF_SHA512 + ((index)&(MMX_COEF_SHA512-1)))
 #else
 #define MIN_KEYS_PER_CRYPT	1
 #define MAX_KEYS_PER_CRYPT	1
@@ -261,7 +264,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		// the above alignment was crashing on OMP build on some 32 bit linux (compiler bug?? not aligning).
 		// so the alignment was done using raw buffer, and aligning at runtime to get 16 byte alignment.
 		// that works, and should cause no noticeable overhead differences.
-		char unaligned_buf[MMX_COEF_SHA512*SHA512_BUF_SIZ*sizeof(ARCH_WORD_64)+16];
+		char unaligned_buf[MAX_KEYS_PER_CRYPT*SHA512_BUF_SIZ*sizeof(ARCH_WORD_64)+16];
 		ARCH_WORD_64 *key_iv = (ARCH_WORD_64*)mem_align(unaligned_buf, 16);
 		JTR_ALIGN(8)  unsigned char hash1[SHA512_DIGEST_LENGTH];            // 512 bits
 		int index2;
@@ -274,21 +277,21 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 			SHA512_Final(hash1, &sha_ctx);
 
 			// We need to set ONE time, the upper half of the data buffer.  We put the 0x80 byte (in BE format), at offset
-			// 512-bits (SHA512_DIGEST_LENGTH) multiplied by the MMX_COEF_SHA512 (same as MAX_KEYS_PER_CRYPT), then zero
+			// 512-bits (SHA512_DIGEST_LENGTH) of this key's lane, then zero
 			// out the rest of the buffer, putting 512 (#bits) at the end.  Once this part of the buffer is set up, we never
 			// touch it again, for the rest of the crypt.  We simply overwrite the first half of this buffer, over and over
 			// again, with BE results of the prior hash.
-			key_iv[ SHA512_DIGEST_LENGTH/sizeof(ARCH_WORD_64) * MMX_COEF_SHA512 + index2 ] = 0x8000000000000000ULL;
-			for (i = (SHA512_DIGEST_LENGTH/sizeof(ARCH_WORD_64)+1) * MMX_COEF_SHA512 + index2; i < 15*MMX_COEF_SHA512; i += MMX_COEF_SHA512)
-				key_iv[i] = 0;
-			key_iv[15*MMX_COEF_SHA512 + index2] = (SHA512_DIGEST_LENGTH << 3);
+			key_iv[GETPOS(SHA512_DIGEST_LENGTH/sizeof(ARCH_WORD_64), index2)] = 0x8000000000000000ULL;
+			for (i = SHA512_DIGEST_LENGTH/sizeof(ARCH_WORD_64)+1; i < 15; i++)
+				key_iv[GETPOS(i, index2)] = 0;
+			key_iv[GETPOS(15, index2)] = (SHA512_DIGEST_LENGTH << 3);
 
 			// Now copy and convert hash1 from flat into MMX_COEF_SHA512 buffers.
 			for (i = 0; i < SHA512_DIGEST_LENGTH/sizeof(ARCH_WORD_64); ++i) {
 #if COMMON_DIGEST_FOR_OPENSSL
-				key_iv[MMX_COEF_SHA512*i + index2] = sha_ctx.hash[i];  // this is in BE format
+				key_iv[GETPOS(i, index2)] = sha_ctx.hash[i];  // this is in BE format
 #else
-				key_iv[MMX_COEF_SHA512*i + index2] = sha_ctx.h[i];
+				key_iv[GETPOS(i, index2)] = sha_ctx.h[i];
 #endif
 			}
 		}
@@ -298,7 +301,8 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 
 		// We must fixup final results.  We have been working in BE (NOT switching out of, just to switch back into it at every loop).
 		// Convert the first 6 words (48 bytes, all we need) of each hash back to LE.
-		alter_endianity_to_BE64(key_iv, 6 * MAX_KEYS_PER_CRYPT);
+		for (index2 = 0; index2 < SHA512_SSE_PARA; index2++)
+			alter_endianity_to_BE64(&key_iv[index2*SHA512_BUF_SIZ*MMX_COEF_SHA512], 6 * MMX_COEF_SHA512);
 
 		for (index2 = 0; index2 < MAX_KEYS_PER_CRYPT; index2++) {
 			unsigned char key[32];
@@ -306,9 +310,9 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 
 			// Copy and convert from MMX_COEF_SHA512 buffers back into flat buffers
 			for (i = 0; i < sizeof(key)/sizeof(ARCH_WORD_64); i++)  // the derived key
-				((ARCH_WORD_64 *)key)[i] = key_iv[MMX_COEF_SHA512*i + index2];
+				((ARCH_WORD_64 *)key)[i] = key_iv[GETPOS(i, index2)];
 			for (i = 0; i < sizeof(iv)/sizeof(ARCH_WORD_64); i++)   // the derived iv
-				((ARCH_WORD_64 *)iv)[i]  = key_iv[MMX_COEF_SHA512*(sizeof(key)/sizeof(ARCH_WORD_64) + i) + index2];
+				((ARCH_WORD_64 *)iv)[i]  = key_iv[GETPOS(sizeof(key)/sizeof(ARCH_WORD_64) + i, index2)];
 
 			/* NOTE: write our code instead of using following high-level OpenSSL functions */
 			EVP_CIPHER_CTX_init(&ctx);
@@ -8,8 +8,13 @@
  * There's ABSOLUTELY NO WARRANTY, express or implied.
  */
 
+#if AC_BUILT
+#include "autoconfig.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
@@ -23,6 +28,18 @@
 
 #undef PRINT_INSNS
 
+#if defined(__x86_64__) && !defined(__ILP32__) && defined(__GNUC__) && \
+    defined(HAVE_MMAP) && !defined(_WIN32) && !defined(__CYGWIN__) && \
+    !defined(PRINT_INSNS)
+#define C_NATIVE			1
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS			MAP_ANON
+#endif
+#else
+#define C_NATIVE			0
+#endif
+
 char *c_errors[] = {
 	NULL,	/* No error */
 	"Unknown identifier",
@@ -74,6 +91,11 @@ static struct c_fixup *c_break_fixups = NULL;
 
 static struct c_ident *c_funcs = NULL;
 
+#if C_NATIVE
+static void c_free_native(void);
+static void (**c_native_funcs)(void);
+#endif
+
 static char c_unget_buffer[C_UNGET_SIZE];
 static int c_unget_count;
 
@@ -360,6 +382,9 @@ static void c_free_fixup(struct c_fixup *list, union c_insn *pc)
 }
 
 void c_cleanup() {
+#if C_NATIVE
+	c_free_native();
+#endif
 	MEM_FREE(c_code_start);
 	MEM_FREE(c_data_start);
 	c_free_ident(c_funcs, NULL);
@@ -842,6 +867,9 @@ int c_compile(int (*ext_getchar)(void), void (*ext_rewind)(void),
 	c_ext_getchar = ext_getchar;
 	c_ext_rewind = ext_rewind;
 
+#if C_NATIVE
+	c_free_native();
+#endif
 	MEM_FREE(c_code_start);
 	MEM_FREE(c_data_start);
 	c_free_ident(c_funcs, NULL);
@@ -879,6 +907,945 @@ void *c_lookup(char *name)
 	return NULL;
 }
 
+#if C_NATIVE
+/*
+ * Native code generation for x86-64.
+ *
+ * The threaded code is translated one instruction at a time, keeping track
+ * of the expression stack at compile time: constants and variables are used
+ * in place, the most recent result is kept in %eax, and other values are
+ * only stored to the stack frame when they would get in the way.  Values of
+ * variables are loaded when they're used rather than when they're pushed, so
+ * any such pending loads are done before every store.  The stack is always
+ * empty between statements, which is where all branches go.
+ *
+ * Like c_compile(), this is done in two passes, the first one only finding
+ * the code size and the offsets of the instructions, which the second one
+ * then uses for forward branches.
+ */
+
+#define C_NATIVE_DEPTH			(C_STACK_SIZE / 2)
+#define C_NATIVE_FRAME			(C_NATIVE_DEPTH * 16)
+
+/* Registers */
+#define R_AX				0
+#define R_CX				1
+#define R_DX				2
+#define R_SP				4
+#define R_8				8
+
+/* Where a stack entry's lvalue is */
+#define LV_NONE				0
+#define LV_ADDR				1
+#define LV_PTR				2
+
+/* Where its value is */
+#define V_IMM				0
+#define V_LOAD				1
+#define V_AX				2
+#define V_FRAME				3
+
+/* Operations */
+#define N_INDEX				1
+#define N_ASSIGN			2
+#define N_ADD				3
+#define N_SUB				4
+#define N_MUL				5
+#define N_DIV				6
+#define N_MOD				7
+#define N_OR				8
+#define N_XOR				9
+#define N_AND				10
+#define N_SHL				11
+#define N_SHR				12
+#define N_AND_B				13
+#define N_EQ				14
+#define N_GT				15
+#define N_LT				16
+#define N_GE				17
+#define N_LE				18
+#define N_NOT_B				19
+#define N_NOT_I				20
+#define N_NEG				21
+#define N_INC_L				22
+#define N_DEC_L				23
+#define N_INC_R				24
+#define N_DEC_R				25
+#define N_ASSIGN_OP			0x100
+
+static struct {
+	char *name;
+	int class;
+	int code;
+} c_native_ops[] = {
+	{"[", C_CLASS_BINARY, N_INDEX},
+	{"=", C_CLASS_BINARY, N_ASSIGN},
+	{"+=", C_CLASS_BINARY, N_ASSIGN_OP | N_ADD},
+	{"-=", C_CLASS_BINARY, N_ASSIGN_OP | N_SUB},
+	{"*=", C_CLASS_BINARY, N_ASSIGN_OP | N_MUL},
+	{"/=", C_CLASS_BINARY, N_ASSIGN_OP | N_DIV},
+	{"%=", C_CLASS_BINARY, N_ASSIGN_OP | N_MOD},
+	{"|=", C_CLASS_BINARY, N_ASSIGN_OP | N_OR},
+	{"^=", C_CLASS_BINARY, N_ASSIGN_OP | N_XOR},
+	{"&=", C_CLASS_BINARY, N_ASSIGN_OP | N_AND},
+	{"<<=", C_CLASS_BINARY, N_ASSIGN_OP | N_SHL},
+	{">>=", C_CLASS_BINARY, N_ASSIGN_OP | N_SHR},
+/* These two are the same as "|" and "-", respectively */
+	{"||", C_CLASS_BINARY, N_OR},
+	{"!=", C_CLASS_BINARY, N_SUB},
+	{"&&", C_CLASS_BINARY, N_AND_B},
+	{"!", C_CLASS_LEFT, N_NOT_B},
+	{"==", C_CLASS_BINARY, N_EQ},
+	{">", C_CLASS_BINARY, N_GT},
+	{"<", C_CLASS_BINARY, N_LT},
+	{">=", C_CLASS_BINARY, N_GE},
+	{"<=", C_CLASS_BINARY, N_LE},
+	{"|", C_CLASS_BINARY, N_OR},
+	{"^", C_CLASS_BINARY, N_XOR},
+	{"&", C_CLASS_BINARY, N_AND},
+	{"<<", C_CLASS_BINARY, N_SHL},
+	{">>", C_CLASS_BINARY, N_SHR},
+	{"+", C_CLASS_BINARY, N_ADD},
+	{"-", C_CLASS_BINARY, N_SUB},
+	{"*", C_CLASS_BINARY, N_MUL},
+	{"/", C_CLASS_BINARY, N_DIV},
+	{"%", C_CLASS_BINARY, N_MOD},
+	{"~", C_CLASS_LEFT, N_NOT_I},
+	{"-", C_CLASS_LEFT, N_NEG},
+	{"++", C_CLASS_LEFT, N_INC_L},
+	{"--", C_CLASS_LEFT, N_DEC_L},
+	{"++", C_CLASS_RIGHT, N_INC_R},
+	{"--", C_CLASS_RIGHT, N_DEC_R},
+	{NULL}
+};
+
+struct c_native_entry {
+	int lv, val;
+	c_int *addr;
+	c_int imm;
+};
+
+/* An instruction operand: immediate, register, or memory */
+struct c_native_arg {
+	int type;
+	c_int imm;
+	int reg, base, disp;
+};
+
+#define A_IMM				0
+#define A_REG				1
+#define A_MEM				2
+
+static unsigned char *c_native_code;
+static size_t c_native_size, c_native_pos;
+static int *c_native_offsets;
+
+static struct c_native_entry c_native_stack[C_NATIVE_DEPTH];
+static int c_native_depth, c_native_ax;
+
+static void c_free_native(void)
+{
+	if (c_native_code)
+		munmap(c_native_code, c_native_size);
+	c_native_code = NULL;
+	MEM_FREE(c_native_offsets);
+	MEM_FREE(c_native_funcs);
+}
+
+static void c_emit(unsigned int byte)
+{
+	if (c_native_code)
+		c_native_code[c_native_pos] = byte;
+	c_native_pos++;
+}
+
+static void c_emit32(unsigned int value)
+{
+	c_emit(value);
+	c_emit(value >> 8);
+	c_emit(value >> 16);
+	c_emit(value >> 24);
+}
+
+static void c_emit64(unsigned long long value)
+{
+	c_emit32(value);
+	c_emit32(value >> 32);
+}
+
+static void c_emit_opcode(int w, unsigned int opcode, int reg, int rm)
+{
+	unsigned int rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+
+	if (rex != 0x40)
+		c_emit(rex);
+	if (opcode > 0xff)
+		c_emit(opcode >> 8);
+	c_emit(opcode & 0xff);
+}
+
+/* op reg, rm */
+static void c_emit_rr(int w, unsigned int opcode, int reg, int rm)
+{
+	c_emit_opcode(w, opcode, reg, rm);
+	c_emit(0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* op reg, [base + disp] */
+static void c_emit_mem(int w, unsigned int opcode, int reg, int base, int disp)
+{
+	c_emit_opcode(w, opcode, reg, base);
+	if (base == R_DX && !disp) {
+		c_emit(((reg & 7) << 3) | R_DX);
+		return;
+	}
+	c_emit(0x80 | ((reg & 7) << 3) | (base & 7));
+	if ((base & 7) == R_SP)
+		c_emit(0x24);
+	c_emit32(disp);
+}
+
+static void c_emit_jump(unsigned int opcode, union c_insn *target)
+{
+	int to = c_native_offsets[target - c_code_start];
+
+	if (opcode > 0xff)
+		c_emit(opcode >> 8);
+	c_emit(opcode & 0xff);
+	c_emit32(to - (int)(c_native_pos + 4));
+}
+
+#define FRAME_VALUE(i)			((i) * 16)
+#define FRAME_PTR(i)			((i) * 16 + 8)
+
+/*
+ * Loads the address of an entry's lvalue into %rdx.
+ */
+static void c_native_address(int i)
+{
+	struct c_native_entry *e = &c_native_stack[i];
+	ptrdiff_t offset;
+
+	if (e->lv == LV_PTR) {
+		c_emit_mem(1, 0x8b, R_DX, R_SP, FRAME_PTR(i));
+		return;
+	}
+
+	offset = (char *)e->addr - (char *)c_data_start;
+	if (offset == (int)offset) {
+		c_emit_mem(1, 0x8d, R_DX, R_8, offset);
+		return;
+	}
+
+	c_emit_opcode(1, 0xb8 + R_DX, 0, 0);
+	c_emit64((size_t)e->addr);
+}
+
+/*
+ * Gets an entry's lvalue as base + disp, which is relative to %r8 (the data
+ * section) for variables within its reach and to %rdx otherwise.
+ */
+static void c_native_lvalue(int i, int *base, int *disp)
+{
+	struct c_native_entry *e = &c_native_stack[i];
+	ptrdiff_t offset;
+
+	if (e->lv == LV_ADDR) {
+		offset = (char *)e->addr - (char *)c_data_start;
+		if (offset == (int)offset) {
+			*base = R_8;
+			*disp = offset;
+			return;
+		}
+	}
+
+	c_native_address(i);
+	*base = R_DX;
+	*disp = 0;
+}
+
+static void c_native_arg(int i, struct c_native_arg *arg)
+{
+	struct c_native_entry *e = &c_native_stack[i];
+
+	switch (e->val) {
+	case V_IMM:
+		arg->type = A_IMM;
+		arg->imm = e->imm;
+		break;
+
+	case V_AX:
+		arg->type = A_REG;
+		arg->reg = R_AX;
+		break;
+
+	case V_FRAME:
+		arg->type = A_MEM;
+		arg->base = R_SP;
+		arg->disp = FRAME_VALUE(i);
+		break;
+
+	default:
+		arg->type = A_MEM;
+		c_native_lvalue(i, &arg->base, &arg->disp);
+	}
+}
+
+static void c_native_load(int reg, int i)
+{
+	struct c_native_arg arg;
+
+	c_native_arg(i, &arg);
+	if (arg.type == A_IMM) {
+		c_emit(0xb8 + reg);
+		c_emit32(arg.imm);
+	} else if (arg.type == A_REG) {
+		if (arg.reg != reg)
+			c_emit_rr(0, 0x89, arg.reg, reg);
+	} else
+		c_emit_mem(0, 0x8b, reg, arg.base, arg.disp);
+}
+
+/*
+ * Moves the value in %eax to the frame.
+ */
+static void c_native_spill(void)
+{
+	if (c_native_ax < 0)
+		return;
+
+	c_emit_mem(0, 0x89, R_AX, R_SP, FRAME_VALUE(c_native_ax));
+	c_native_stack[c_native_ax].val = V_FRAME;
+	c_native_ax = -1;
+}
+
+/*
+ * Gets an entry's value into %eax.
+ */
+static void c_native_to_ax(int i)
+{
+	if (c_native_ax == i)
+		return;
+
+	c_native_spill();
+	c_native_load(R_AX, i);
+	c_native_stack[i].val = V_AX;
+	c_native_ax = i;
+}
+
+/*
+ * Gets an entry's value into %ecx, consuming it.
+ */
+static void c_native_to_cx(int i)
+{
+	c_native_load(R_CX, i);
+	if (c_native_ax == i)
+		c_native_ax = -1;
+}
+
+/*
+ * Does the pending loads of entries below i, before a store.
+ */
+static void c_native_fix(int i)
+{
+	int j;
+
+	for (j = 0; j < i; j++) {
+		if (c_native_stack[j].val != V_LOAD)
+			continue;
+		c_native_load(R_CX, j);
+		c_emit_mem(0, 0x89, R_CX, R_SP, FRAME_VALUE(j));
+		c_native_stack[j].val = V_FRAME;
+	}
+}
+
+static int c_native_push(int lv, c_int *addr, c_int imm)
+{
+	struct c_native_entry *e;
+
+	if (c_native_depth >= C_NATIVE_DEPTH)
+		return -1;
+
+	e = &c_native_stack[c_native_depth++];
+	e->lv = lv;
+	e->addr = addr;
+	e->val = lv ? V_LOAD : V_IMM;
+	e->imm = imm;
+
+	return 0;
+}
+
+static void c_native_pop(void)
+{
+	if (c_native_ax == --c_native_depth)
+		c_native_ax = -1;
+}
+
+static int c_native_fold(int code, c_int x, c_int y, c_int *result)
+{
+	unsigned int ux = x, uy = y;
+
+	switch (code) {
+	case N_ADD:
+		*result = ux + uy;
+		break;
+	case N_SUB:
+		*result = ux - uy;
+		break;
+	case N_MUL:
+		*result = ux * uy;
+		break;
+	case N_DIV:
+	case N_MOD:
+		if (!y || (y == -1 && ux == 0x80000000U))
+			return 0;
+		*result = (code == N_DIV) ? x / y : x % y;
+		break;
+	case N_OR:
+		*result = x | y;
+		break;
+	case N_XOR:
+		*result = x ^ y;
+		break;
+	case N_AND:
+		*result = x & y;
+		break;
+	case N_SHL:
+		*result = ux << (uy & 31);
+		break;
+	case N_SHR:
+		*result = x >> (uy & 31);
+		break;
+	case N_AND_B:
+		*result = x && y;
+		break;
+	case N_EQ:
+		*result = x == y;
+		break;
+	case N_GT:
+		*result = x > y;
+		break;
+	case N_LT:
+		*result = x < y;
+		break;
+	case N_GE:
+		*result = x >= y;
+		break;
+	case N_LE:
+		*result = x <= y;
+		break;
+	case N_NOT_B:
+		*result = !x;
+		break;
+	case N_NOT_I:
+		*result = ~x;
+		break;
+	case N_NEG:
+		*result = 0U - ux;
+		break;
+	default:
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Applies a binary operation to %eax and the argument (which must be %ecx or
+ * an immediate for division, shifts, and "&&").
+ */
+static void c_native_op(int code, struct c_native_arg *arg)
+{
+	static const unsigned char alu[][2] = {
+		{N_ADD, 0}, {N_OR, 1}, {N_AND, 4}, {N_SUB, 5}, {N_XOR, 6},
+		{N_EQ, 7}, {N_GT, 7}, {N_LT, 7}, {N_GE, 7}, {N_LE, 7}
+	};
+	static const unsigned char setcc[][2] = {
+		{N_EQ, 0x94}, {N_GT, 0x9f}, {N_LT, 0x9c}, {N_GE, 0x9d},
+		{N_LE, 0x9e}
+	};
+	int i;
+
+	switch (code) {
+	case N_MUL:
+		if (arg->type == A_IMM) {
+			c_emit_rr(0, 0x69, R_AX, R_AX);
+			c_emit32(arg->imm);
+		} else if (arg->type == A_REG)
+			c_emit_rr(0, 0x0faf, R_AX, arg->reg);
+		else
+			c_emit_mem(0, 0x0faf, R_AX, arg->base, arg->disp);
+		return;
+
+	case N_DIV:
+	case N_MOD:
+		c_emit(0x99); /* cdq */
+		c_emit_rr(0, 0xf7, 7, R_CX);
+		if (code == N_MOD)
+			c_emit_rr(0, 0x89, R_DX, R_AX);
+		return;
+
+	case N_SHL:
+	case N_SHR:
+		i = (code == N_SHL) ? 4 : 7;
+		if (arg->type == A_IMM) {
+			c_emit_rr(0, 0xc1, i, R_AX);
+			c_emit(arg->imm & 31);
+		} else
+			c_emit_rr(0, 0xd3, i, R_AX);
+		return;
+
+	case N_AND_B:
+		c_emit_rr(0, 0x85, R_AX, R_AX);
+		c_emit_rr(0, 0x0f95, 0, R_AX);
+		c_emit_rr(0, 0x85, R_CX, R_CX);
+		c_emit_rr(0, 0x0f95, 0, R_CX);
+		c_emit_rr(0, 0x22, R_AX, R_CX);
+		c_emit_rr(0, 0x0fb6, R_AX, R_AX);
+		return;
+	}
+
+	for (i = 0; alu[i][0] != code; i++);
+	if (arg->type == A_IMM) {
+		if (arg->imm == (signed char)arg->imm) {
+			c_emit_rr(0, 0x83, alu[i][1], R_AX);
+			c_emit(arg->imm);
+		} else {
+			c_emit_rr(0, 0x81, alu[i][1], R_AX);
+			c_emit32(arg->imm);
+		}
+	} else if (arg->type == A_REG)
+		c_emit_rr(0, alu[i][1] * 8 + 3, R_AX, arg->reg);
+	else
+		c_emit_mem(0, alu[i][1] * 8 + 3, R_AX, arg->base, arg->disp);
+
+	if (alu[i][1] != 7)
+		return;
+
+	for (i = 0; setcc[i][0] != code; i++);
+	c_emit_rr(0, 0x0f00 | setcc[i][1], 0, R_AX);
+	c_emit_rr(0, 0x0fb6, R_AX, R_AX);
+}
+
+static int c_native_binary(int code)
+{
+	int i = c_native_depth - 2;
+	struct c_native_entry *b = &c_native_stack[i];
+	struct c_native_entry *t = &c_native_stack[i + 1];
+	struct c_native_arg arg;
+	c_int result;
+
+	if (b->val == V_IMM && t->val == V_IMM &&
+	    c_native_fold(code, b->imm, t->imm, &result)) {
+		b->lv = LV_NONE;
+		b->imm = result;
+		c_native_depth--;
+		return 0;
+	}
+
+	if ((code == N_SHL || code == N_SHR) && t->val == V_IMM) {
+		arg.type = A_IMM;
+		arg.imm = t->imm;
+		c_native_to_ax(i);
+	} else if (code == N_DIV || code == N_MOD || code == N_SHL ||
+	    code == N_SHR || code == N_AND_B || t->val == V_AX) {
+		c_native_to_cx(i + 1);
+		arg.type = A_REG;
+		arg.reg = R_CX;
+		c_native_to_ax(i);
+	} else {
+		c_native_to_ax(i);
+		c_native_arg(i + 1, &arg);
+	}
+	c_native_op(code, &arg);
+
+	b->lv = LV_NONE;
+	c_native_depth--;
+
+	return 0;
+}
+
+static int c_native_unary(int code)
+{
+	int i = c_native_depth - 1;
+	struct c_native_entry *t = &c_native_stack[i];
+	c_int result;
+
+	if (t->val == V_IMM && c_native_fold(code, t->imm, 0, &result)) {
+		t->lv = LV_NONE;
+		t->imm = result;
+		return 0;
+	}
+
+	c_native_to_ax(i);
+	t->lv = LV_NONE;
+	switch (code) {
+	case N_NOT_B:
+		c_emit_rr(0, 0x85, R_AX, R_AX);
+		c_emit_rr(0, 0x0f94, 0, R_AX);
+		c_emit_rr(0, 0x0fb6, R_AX, R_AX);
+		break;
+	case N_NOT_I:
+		c_emit_rr(0, 0xf7, 2, R_AX);
+		break;
+	default:
+		c_emit_rr(0, 0xf7, 3, R_AX);
+	}
+
+	return 0;
+}
+
+static int c_native_index(void)
+{
+	int i = c_native_depth - 2;
+	struct c_native_entry *b = &c_native_stack[i];
+	struct c_native_entry *t = &c_native_stack[i + 1];
+
+	if (b->lv == LV_NONE)
+		return -1;
+
+	if (c_native_ax == i)
+		c_native_ax = -1;
+
+	if (b->lv == LV_ADDR && t->val == V_IMM) {
+		b->addr += t->imm;
+	} else {
+		c_native_to_cx(i + 1);
+		c_emit_rr(1, 0x63, R_CX, R_CX); /* movsxd */
+		c_native_address(i);
+/* lea (%rdx,%rcx,4), %rdx */
+		c_emit(0x48);
+		c_emit(0x8d);
+		c_emit(0x14);
+		c_emit(0x8a);
+		c_emit_mem(1, 0x89, R_DX, R_SP, FRAME_PTR(i));
+		b->lv = LV_PTR;
+	}
+
+	b->val = V_LOAD;
+	c_native_depth--;
+
+	return 0;
+}
+
+static int c_native_assign(int code)
+{
+	int i = c_native_depth - 2;
+	struct c_native_entry *b = &c_native_stack[i];
+	struct c_native_entry *t = &c_native_stack[i + 1];
+	struct c_native_arg arg;
+	int base, disp;
+
+	if (b->lv == LV_NONE)
+		return -1;
+
+	if (c_native_ax == i)
+		c_native_ax = -1;
+	c_native_fix(i);
+
+	if (code == N_ASSIGN) {
+		if (t->val != V_IMM)
+			c_native_to_ax(i + 1);
+		c_native_lvalue(i, &base, &disp);
+		if (t->val == V_IMM) {
+			c_emit_mem(0, 0xc7, 0, base, disp);
+			c_emit32(t->imm);
+			b->val = V_IMM;
+			b->imm = t->imm;
+		} else {
+			c_emit_mem(0, 0x89, R_AX, base, disp);
+			b->val = V_AX;
+			c_native_ax = i;
+		}
+		c_native_depth--;
+		return 0;
+	}
+
+	if (t->val == V_IMM && code != N_DIV && code != N_MOD) {
+		arg.type = A_IMM;
+		arg.imm = t->imm;
+	} else {
+		c_native_to_cx(i + 1);
+		arg.type = A_REG;
+		arg.reg = R_CX;
+	}
+
+	c_native_spill();
+	c_native_lvalue(i, &base, &disp);
+	c_emit_mem(0, 0x8b, R_AX, base, disp);
+	c_native_op(code, &arg);
+	if (base == R_DX && (code == N_DIV || code == N_MOD))
+		c_native_lvalue(i, &base, &disp);
+	c_emit_mem(0, 0x89, R_AX, base, disp);
+
+	b->val = V_AX;
+	c_native_ax = i;
+	c_native_depth--;
+
+	return 0;
+}
+
+static int c_native_inc(int code)
+{
+	int i = c_native_depth - 1;
+	int base, disp;
+
+	if (c_native_stack[i].lv == LV_NONE)
+		return -1;
+
+	c_native_fix(i);
+	c_native_to_ax(i);
+	c_native_lvalue(i, &base, &disp);
+
+	switch (code) {
+	case N_INC_L:
+		c_emit_rr(0, 0x83, 0, R_AX);
+		c_emit(1);
+		c_emit_mem(0, 0x89, R_AX, base, disp);
+		break;
+	case N_DEC_L:
+		c_emit_rr(0, 0x83, 5, R_AX);
+		c_emit(1);
+		c_emit_mem(0, 0x89, R_AX, base, disp);
+		break;
+	default:
+/* lea +-1(%rax), %ecx */
+		c_emit(0x8d);
+		c_emit(0x48);
+		c_emit(code == N_INC_R ? 0x01 : 0xff);
+		c_emit_mem(0, 0x89, R_CX, base, disp);
+	}
+
+	return 0;
+}
+
+static int c_native_branch(union c_insn *target, int cond)
+{
+	struct c_native_entry *e = &c_native_stack[0];
+	int base, disp;
+
+	if (c_native_depth != cond)
+		return -1;
+	c_native_depth = 0;
+	c_native_ax = -1;
+
+	if (cond && e->val == V_IMM) {
+		if (e->imm)
+			return 0;
+		cond = 0;
+	}
+
+	if (!cond) {
+		c_emit_jump(0xe9, target);
+		return 0;
+	}
+
+	if (e->val == V_AX)
+		c_emit_rr(0, 0x85, R_AX, R_AX);
+	else {
+		if (e->val == V_FRAME) {
+			base = R_SP;
+			disp = FRAME_VALUE(0);
+		} else
+			c_native_lvalue(0, &base, &disp);
+		c_emit_mem(0, 0x83, 7, base, disp);
+		c_emit(0);
+	}
+	c_emit_jump(0x0f84, target);
+
+	return 0;
+}
+
+static int c_native_insn(void (*op)(void))
+{
+	int i, j;
+
+	for (i = 0; c_ops[i].prec > 0; i++)
+	if (c_ops[i].op == op)
+		for (j = 0; c_native_ops[j].name; j++)
+		if (c_ops[i].class == c_native_ops[j].class &&
+		    !strcmp(c_ops[i].name, c_native_ops[j].name))
+			return c_native_ops[j].code;
+
+	return 0;
+}
+
+static int c_native_is_func(union c_insn *pc)
+{
+	struct c_ident *f;
+
+	for (f = c_funcs; f; f = f->next)
+	if (f->addr == pc)
+		return 1;
+
+	return 0;
+}
+
+static int c_native_pass(void)
+{
+	union c_insn *pc = c_code_start;
+	void (*op)(void);
+	int index, code, error = 0;
+
+	c_native_pos = 0;
+	c_native_depth = 0;
+	c_native_ax = -1;
+
+	while (pc < c_code_ptr && !error) {
+		index = pc - c_code_start;
+
+		if (c_native_is_func(pc)) {
+			if (c_native_depth)
+				return -1;
+			if (c_native_code)
+				c_native_funcs[index] = (void (*)(void))
+					(c_native_code + c_native_pos);
+			c_emit_rr(1, 0x81, 5, R_SP);
+			c_emit32(C_NATIVE_FRAME);
+			c_emit_opcode(1, 0xb8, 0, R_8);
+			c_emit64((size_t)c_data_start);
+		}
+
+		if (c_native_code && c_native_offsets[index] != c_native_pos)
+			return -1;
+		c_native_offsets[index] = c_native_pos;
+
+		op = (pc++)->op;
+
+		if (op == c_op_push_imm) {
+			error = c_native_push(LV_NONE, NULL, (pc++)->imm);
+		} else if (op == c_op_push_mem) {
+			error = c_native_push(LV_ADDR, (pc++)->mem, 0);
+		} else if (op == c_op_push_imm_imm) {
+			error = c_native_push(LV_NONE, NULL, pc[0].imm) ||
+				c_native_push(LV_NONE, NULL, pc[1].imm);
+			pc += 2;
+		} else if (op == c_op_push_imm_mem) {
+			error = c_native_push(LV_NONE, NULL, pc[0].imm) ||
+				c_native_push(LV_ADDR, pc[1].mem, 0);
+			pc += 2;
+		} else if (op == c_op_push_mem_imm) {
+			error = c_native_push(LV_ADDR, pc[0].mem, 0) ||
+				c_native_push(LV_NONE, NULL, pc[1].imm);
+			pc += 2;
+		} else if (op == c_op_push_mem_mem) {
+			error = c_native_push(LV_ADDR, pc[0].mem, 0) ||
+				c_native_push(LV_ADDR, pc[1].mem, 0);
+			pc += 2;
+		} else if (op == c_op_push_mem_mem_mem) {
+			error = c_native_push(LV_ADDR, pc[0].mem, 0) ||
+				c_native_push(LV_ADDR, pc[1].mem, 0) ||
+				c_native_push(LV_ADDR, pc[2].mem, 0);
+			pc += 3;
+		} else if (op == c_op_push_mem_mem_mem_imm) {
+			error = c_native_push(LV_ADDR, pc[0].mem, 0) ||
+				c_native_push(LV_ADDR, pc[1].mem, 0) ||
+				c_native_push(LV_ADDR, pc[2].mem, 0) ||
+				c_native_push(LV_NONE, NULL, pc[3].imm);
+			pc += 4;
+		} else if (op == c_op_push_mem_mem_mem_mem) {
+			error = c_native_push(LV_ADDR, pc[0].mem, 0) ||
+				c_native_push(LV_ADDR, pc[1].mem, 0) ||
+				c_native_push(LV_ADDR, pc[2].mem, 0) ||
+				c_native_push(LV_ADDR, pc[3].mem, 0);
+			pc += 4;
+		} else if (op == c_op_pop) {
+			if (c_native_depth < 1)
+				return -1;
+			c_native_pop();
+		} else if (op == c_op_assign_pop) {
+			if (c_native_depth < 2)
+				return -1;
+			error = c_native_assign(N_ASSIGN);
+			c_native_pop();
+		} else if (op == c_op_bz) {
+			error = c_native_branch((pc++)->pc, 1);
+		} else if (op == c_op_ba) {
+			error = c_native_branch((pc++)->pc, 0);
+		} else if (op == c_op_return) {
+			if (c_native_depth)
+				return -1;
+			c_emit_rr(1, 0x81, 0, R_SP);
+			c_emit32(C_NATIVE_FRAME);
+			c_emit(0xc3);
+		} else {
+			code = c_native_insn(op);
+			if (!code)
+				return -1;
+
+			if (code >= N_NOT_B && !(code & N_ASSIGN_OP)) {
+				if (c_native_depth < 1)
+					return -1;
+				if (code >= N_INC_L)
+					error = c_native_inc(code);
+				else
+					error = c_native_unary(code);
+			} else {
+				if (c_native_depth < 2)
+					return -1;
+				if (code == N_INDEX)
+					error = c_native_index();
+				else if (code == N_ASSIGN)
+					error = c_native_assign(code);
+				else if (code & N_ASSIGN_OP)
+					error = c_native_assign(code &
+					    ~N_ASSIGN_OP);
+				else
+					error = c_native_binary(code);
+			}
+		}
+	}
+
+	if (error || c_native_depth)
+		return -1;
+
+	return 0;
+}
+
+int c_compile_native(void)
+{
+	size_t count;
+	void *code;
+
+	c_free_native();
+
+	if (c_errno || !c_code_start)
+		return -1;
+
+	count = c_code_ptr - c_code_start;
+	c_native_offsets = mem_calloc((count + 1) * sizeof(*c_native_offsets));
+	c_native_funcs = mem_calloc((count + 1) * sizeof(*c_native_funcs));
+
+	if (c_native_pass())
+		goto fail;
+
+	c_native_size = c_native_pos;
+	code = mmap(NULL, c_native_size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+		goto fail;
+	c_native_code = code;
+
+	if (c_native_pass() || c_native_pos != c_native_size ||
+	    mprotect(code, c_native_size, PROT_READ | PROT_EXEC))
+		goto fail;
+
+	return 0;
+
+fail:
+	c_free_native();
+	return -1;
+}
+
+#else
+
+int c_compile_native(void)
+{
+	return -1;
+}
+
+#endif
+
 #if !defined(__GNUC__) || defined(PRINT_INSNS)
 
 void c_execute_fast(void *addr)
@@ -993,6 +1960,13 @@ void c_execute_fast(void *addr)
 		return;
 	}
 
+#if C_NATIVE
+	if (c_native_funcs) {
+		c_native_funcs[pc - c_code_start]();
+		return;
+	}
+#endif
+
 	goto *(pc++)->op;
 
 op_return:
@@ -72,6 +72,14 @@ struct c_ident {
 extern int c_compile(int (*ext_getchar)(void), void (*ext_rewind)(void),
 	struct c_ident *externs);
 
+/*
+ * Translates the program last compiled with c_compile() to native code, to
+ * be used by c_execute() from now on.  Returns 0 on success, or -1 if that's
+ * not supported here (x86-64 only) or for this program, in which case it
+ * remains interpreted.
+ */
+extern int c_compile_native(void);
+
 /*
  * Returns the function's address or NULL if not found.
  */
@@ -318,6 +318,28 @@ int cfg_print_subsections(char *section, char *function, char *notfunction, int
 	} while ((current = current->next));
 	return ret;
 }
+
+char *cfg_get_subsection(char *section, char *last)
+{
+	struct cfg_section *current;
+	char *p1, *p2;
+
+	if ((current = cfg_database))
+	do {
+		p1 = current->name; p2 = section;
+		while (*p1 && *p1 == tolower((int)(unsigned char)*p2)) {
+			p1++; p2++;
+		}
+		if (*p1++ != ':') continue;
+		if (!*p1 || *p2) continue;
+		if (!last)
+			return p1;
+		if (p1 == last)
+			last = NULL;
+	} while ((current = current->next));
+
+	return NULL;
+}
 #endif
 char *cfg_get_param(char *section, char *subsection, char *param)
 {
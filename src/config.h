@@ -110,6 +110,13 @@ int cfg_print_section_list_lines(char *section, char *subsection);
  */
 int cfg_print_subsections(char *section, char *function, char *notfunction, int print_heading);
 
+/*
+ * Returns the name of the subsection of section that follows last in the
+ * configuration, or of the first one if last is NULL.  Returns NULL when
+ * there are no more.
+ */
+char *cfg_get_subsection(char *section, char *last);
+
 /*
  * Searches for a section with the supplied name and a parameter within the
  * section, and returns the parameter's value, or NULL if not found.
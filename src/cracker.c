@@ -7,10 +7,10 @@
 
 #define NEED_OS_TIMER
 #define NEED_OS_FLOCK
+#define NEED_OS_FORK
 #include "os.h"
 
 #include <string.h>
-#include <assert.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -59,6 +59,21 @@
 #if HAVE_LIBDL && defined(HAVE_CUDA) || defined(HAVE_OPENCL)
 #include "common-gpu.h"
 #endif
+#include "config.h"
+#include "crackq.h"
+
+#if OS_FORK && defined(HAVE_MMAP)
+#define CRK_WORKERS			1
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <poll.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS			MAP_ANON
+#endif
+#else
+#define CRK_WORKERS			0
+#endif
+
 #include "memdbg.h"
 
 #ifdef index
@@ -69,6 +84,12 @@
 static clock_t salt_time = 0;
 #endif
 
+#if defined(__GNUC__) || defined(__clang__)
+#define CRK_PREFETCH(addr)		__builtin_prefetch(addr)
+#else
+#define CRK_PREFETCH(addr)
+#endif
+
 static struct db_main *crk_db;
 static struct fmt_params crk_params;
 static struct fmt_methods crk_methods;
@@ -80,6 +101,38 @@ static int64 *crk_timestamps;
 static char crk_stdout_key[PLAINTEXT_BUFFER_SIZE];
 int64_t crk_pot_pos;
 
+/*
+ * Indices and hashes of computed hashes still possibly present in a salt's
+ * bitmaps, see crk_filter().  Counters are per bitmap level, the last one
+ * being the main bitmap, and crk_filter_hits is how many of the computed
+ * hashes that passed each level then matched a loaded one with cmp_one().
+ */
+static int *crk_filter_index, *crk_filter_hash;
+static uint64_t crk_filter_probes[PASSWORD_PREFILTER_LEVELS + 1];
+static uint64_t crk_filter_passes[PASSWORD_PREFILTER_LEVELS + 1];
+static uint64_t crk_filter_hits[PASSWORD_PREFILTER_LEVELS + 1];
+
+/*
+ * Salt workers, see crk_init_workers().  crk_worker_id is 0 in the main
+ * process and 1 to crk_worker_count in the workers, which count the salts
+ * and hashes they've computed in crk_worker_salts and crk_worker_hashes
+ * instead of updating the status.
+ */
+static int crk_worker_count, crk_worker_id;
+static unsigned int crk_worker_salts, crk_worker_hashes;
+
+#if CRK_WORKERS
+static void crk_init_workers(void);
+#endif
+
+/*
+ * Salts by sequential_id, for removing hashes cracked by other --fork'ed
+ * processes (see crackq.h), and a buffer for their binaries.
+ */
+static struct db_salt **crk_salt_by_id;
+static int crk_salt_ids;
+static void *crk_crackq_binary;
+
 static void crk_dummy_set_salt(void *salt)
 {
 }
@@ -96,6 +149,25 @@ static void crk_init_salt(void)
 	}
 }
 
+static void crk_init_crackq(void)
+{
+	struct db_salt *salt;
+
+	crk_salt_ids = 0;
+	for (salt = crk_db->salts; salt; salt = salt->next)
+		if (salt->sequential_id >= crk_salt_ids)
+			crk_salt_ids = salt->sequential_id + 1;
+
+	MEM_FREE(crk_salt_by_id);
+	crk_salt_by_id = mem_calloc(crk_salt_ids * sizeof(*crk_salt_by_id));
+	for (salt = crk_db->salts; salt; salt = salt->next)
+		crk_salt_by_id[salt->sequential_id] = salt;
+
+	if (!crk_crackq_binary)
+		crk_crackq_binary = mem_alloc_tiny(crk_params.binary_size,
+		    MEM_ALIGN_SIMD);
+}
+
 static void crk_help(void)
 {
 	static int printed = 0;
@@ -170,6 +242,17 @@ void crk_init(struct db_main *db, void (*fix_state)(void),
 		size = crk_params.max_keys_per_crypt * sizeof(int64);
 		memset(crk_timestamps = mem_alloc_tiny(size, sizeof(int64)),
 		       -1, size);
+
+		size = crk_params.max_keys_per_crypt * sizeof(int);
+		crk_filter_index = mem_alloc_tiny(size, MEM_ALIGN_CACHE);
+		crk_filter_hash = mem_alloc_tiny(size, MEM_ALIGN_CACHE);
+
+		if (crackq_enabled)
+			crk_init_crackq();
+
+#if CRK_WORKERS
+		crk_init_workers();
+#endif
 	} else
 		crk_stdout_key[0] = 0;
 
@@ -221,7 +304,8 @@ static void crk_remove_salt(struct db_salt *salt)
 static void crk_remove_hash(struct db_salt *salt, struct db_password *pw)
 {
 	struct db_password **current;
-	int hash, count;
+	unsigned int hash, slot;
+	int count;
 
 	crk_db->password_count--;
 
@@ -232,8 +316,8 @@ static void crk_remove_hash(struct db_salt *salt, struct db_password *pw)
 	}
 
 /*
- * If there's no bitmap for this salt, assume that next_hash fields are unused
- * and don't need to be updated.  Only bother with the list.
+ * If there's no bitmap for this salt, there's no hash table either.  Only
+ * bother with the list.
  */
 	if (!salt->bitmap) {
 		current = &salt->list;
@@ -245,26 +329,26 @@ static void crk_remove_hash(struct db_salt *salt, struct db_password *pw)
 	}
 
 	hash = crk_db->format->methods.binary_hash[salt->hash_size](pw->binary);
-	count = 0;
-	current = &salt->hash[hash >> PASSWORD_HASH_SHR];
-	do {
-		if (crk_db->format->methods.binary_hash[salt->hash_size]
-		    ((*current)->binary) == hash)
-			count++;
-		if (*current == pw)
-			*current = pw->next_hash;
-		else
-			current = &(*current)->next_hash;
-	} while (*current);
-
-	assert(count >= 1);
 
 /*
- * If we have removed the last entry with the exact hash value from this hash
- * bucket (which could also contain entries with nearby hash values in case
- * PASSWORD_HASH_SHR is non-zero), we must also reset the corresponding bit.
+ * Leave a tombstone in the hash table, so that probe sequences going past
+ * this slot still work, and see if there are other entries with the exact
+ * same hash value left in the table.
  */
-	if (count == 1)
+	count = 0;
+	slot = PASSWORD_TABLE_SLOT(salt, hash);
+	while (salt->table_hash[slot] != PASSWORD_TABLE_EMPTY) {
+		if (salt->table_hash[slot] == hash && salt->table_pw[slot]) {
+			if (salt->table_pw[slot] == pw)
+				salt->table_pw[slot] = NULL;
+			else
+				count++;
+		}
+		slot = PASSWORD_TABLE_NEXT(salt, slot);
+	}
+
+/* If there are none, we must also reset the corresponding bit */
+	if (!count)
 		salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] &=
 		    ~(1U << (hash % (sizeof(*salt->bitmap) * 8)));
 
@@ -276,6 +360,92 @@ static void crk_remove_hash(struct db_salt *salt, struct db_password *pw)
 	pw->binary = NULL;
 }
 
+#if CRK_WORKERS
+/*
+ * Command from the main process to a salt worker: the number of keys in shared
+ * memory, and in "single crack" mode the one salt to try them against.
+ */
+struct crk_worker_cmd {
+	struct db_salt *salt;
+	int count;
+};
+
+/*
+ * Message from a salt worker to the main process: a guess (if pw is set), with
+ * the number of salts and of their hashes computed by the worker since its
+ * previous message.  The last message for a batch of keys has last set.
+ */
+struct crk_worker_msg {
+	struct db_salt *salt;
+	struct db_password *pw;
+	int index, last;
+	unsigned int salts, hashes;
+};
+
+/*
+ * In "single crack" mode, each worker has its own keys in shared memory, and
+ * salt is set while it's busy with count of them.
+ */
+static struct crk_worker {
+	pid_t pid;
+	FILE *cmd, *res;
+	struct db_salt *salt;
+	int count;
+} *crk_workers;
+static char *crk_worker_keys;
+static size_t crk_worker_key_size, crk_worker_keys_size;
+static FILE *crk_worker_out;
+
+/*
+ * Set in shared memory when we're aborting (or have no hashes left), for the
+ * workers to stop between salts instead of finishing their batches.
+ */
+static volatile int *crk_worker_stop;
+
+/*
+ * Keys of the batch a worker's guesses are being processed for, when these
+ * aren't the ones we've set in our copy of the format.
+ */
+static char *crk_guess_keys;
+
+#define CRK_WORKER_KEYS(i) \
+	(crk_guesses ? &crk_worker_keys[(i) * crk_worker_keys_size] : \
+	crk_worker_keys)
+
+static void crk_worker_put(struct db_salt *salt, struct db_password *pw,
+	int index, int last)
+{
+	struct crk_worker_msg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.salt = salt;
+	msg.pw = pw;
+	msg.index = index;
+	msg.last = last;
+	msg.salts = crk_worker_salts;
+	msg.hashes = crk_worker_hashes;
+	crk_worker_salts = crk_worker_hashes = 0;
+
+	if (fwrite(&msg, sizeof(msg), 1, crk_worker_out) != 1)
+		_exit(1);
+}
+
+/*
+ * Called instead of crk_process_guess() in a salt worker.  The guess is left
+ * for the main process to report, we only stop looking for it ourselves.
+ */
+static int crk_worker_guess(struct db_salt *salt, struct db_password *pw,
+	int index)
+{
+	crk_worker_put(salt, pw, index, 0);
+
+	if (!(crk_params.flags & FMT_NOT_EXACT))
+		crk_remove_hash(salt, pw);
+
+	return 0;
+}
+#endif
+
 /* Negative index is not counted/reported (got it from pot sync) */
 static int crk_process_guess(struct db_salt *salt, struct db_password *pw,
 	int index)
@@ -286,6 +456,11 @@ static int crk_process_guess(struct db_salt *salt, struct db_password *pw,
 	int dupe;
 	char *key, *utf8key, *repkey, *replogin;
 
+#if CRK_WORKERS
+	if (crk_worker_id)
+		return crk_worker_guess(salt, pw, index);
+#endif
+
 	if (index >= 0 && index < crk_params.max_keys_per_crypt) {
 		dupe = !memcmp(&crk_timestamps[index],
 		               &status.crypts, sizeof(int64));
@@ -293,6 +468,11 @@ static int crk_process_guess(struct db_salt *salt, struct db_password *pw,
 	} else
 		dupe = 0;
 
+#if CRK_WORKERS
+	if (index >= 0 && crk_guess_keys)
+		repkey = key = &crk_guess_keys[index * crk_worker_key_size];
+	else
+#endif
 	repkey = key = index < 0 ? "" : crk_methods.get_key(index);
 	replogin = pw->login;
 
@@ -352,6 +532,9 @@ static int crk_process_guess(struct db_salt *salt, struct db_password *pw,
 		}
 	}
 
+	if (index >= 0 && crackq_enabled)
+		crackq_put(salt->sequential_id, pw->binary);
+
 	if (!(crk_params.flags & FMT_NOT_EXACT))
 		crk_remove_hash(salt, pw);
 
@@ -435,17 +618,22 @@ static int crk_remove_pot_entry(char *ciphertext)
 		} while ((pw = pw->next));
 	}
 	else {
-		int hash;
+		unsigned int hash, slot;
 
 		hash = crk_methods.binary_hash[salt->hash_size](binary);
 		if (!(salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] &
 		      (1U << (hash % (sizeof(*salt->bitmap) * 8)))))
 			return 0;
 
-		if ((pw = salt->hash[hash >> PASSWORD_HASH_SHR]))
-		do {
+		slot = PASSWORD_TABLE_SLOT(salt, hash);
+		for (; salt->table_hash[slot] != PASSWORD_TABLE_EMPTY;
+		    slot = PASSWORD_TABLE_NEXT(salt, slot)) {
 			char *source;
 
+			if (salt->table_hash[slot] != hash ||
+			    !(pw = salt->table_pw[slot]))
+				continue;
+
 			source = crk_methods.source(pw->source, pw->binary);
 
 			if (!strcmp(source, ciphertext)) {
@@ -455,7 +643,7 @@ static int crk_remove_pot_entry(char *ciphertext)
 				if (!(crk_db->options->flags & DB_WORDS))
 					break;
 			}
-		} while ((pw = pw->next_hash));
+		}
 	}
 
 	return 0;
@@ -559,6 +747,74 @@ int crk_reload_pot(void)
 	return (!crk_db->salts);
 }
 
+/*
+ * Removes the hashes with this binary from a salt, as cracked by another
+ * --fork'ed process.  Returns non-zero if there are no hashes left at all.
+ */
+static int crk_remove_cracked(struct db_salt *salt, void *binary)
+{
+	struct db_password *pw, *next;
+	size_t size = crk_params.binary_size;
+
+	if (!salt->bitmap) {
+		for (pw = salt->list; pw && salt->count; pw = next) {
+			next = pw->next;
+			if (pw->binary && !memcmp(pw->binary, binary, size) &&
+			    crk_process_guess(salt, pw, -1))
+				return 1;
+		}
+	} else {
+		unsigned int hash, slot;
+
+		hash = crk_methods.binary_hash[salt->hash_size](binary);
+		slot = PASSWORD_TABLE_SLOT(salt, hash);
+		for (; salt->table_hash[slot] != PASSWORD_TABLE_EMPTY &&
+		    salt->count; slot = PASSWORD_TABLE_NEXT(salt, slot)) {
+			if (salt->table_hash[slot] != hash ||
+			    !(pw = salt->table_pw[slot]) ||
+			    memcmp(&salt->table_binary[
+			    (size_t)slot * salt->table_stride], binary, size))
+				continue;
+			if (crk_process_guess(salt, pw, -1))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Picks up the hashes cracked by other --fork'ed processes since we last
+ * looked.  If we've fallen too far behind, the pot file is reloaded instead.
+ */
+static int crk_reload_crackq(void)
+{
+	struct db_salt *salt;
+	int salt_id, got, total = crk_db->password_count, others;
+
+	while ((got = crackq_get(&salt_id, crk_crackq_binary))) {
+		if (got < 0) {
+			event_reload = 1;
+			continue;
+		}
+
+		if (salt_id < 0 || salt_id >= crk_salt_ids ||
+		    !(salt = crk_salt_by_id[salt_id]) || !salt->count)
+			continue;
+
+		if (crk_remove_cracked(salt, crk_crackq_binary))
+			return 1;
+	}
+
+	others = total - crk_db->password_count;
+
+	if (others)
+		log_event("+ Removed %d hashes cracked by other processes; %s",
+		          others, crk_loaded_counts());
+
+	return 0;
+}
+
 #ifdef HAVE_MPI
 static void crk_mpi_probe(void)
 {
@@ -664,9 +920,70 @@ static int crk_process_event(void)
 		crk_poll_files();
 	}
 
+	if (crackq_enabled && crk_reload_crackq())
+		return 1;
+
 	return event_abort;
 }
 
+/*
+ * Checks the first count computed hashes listed in crk_filter_index[] against
+ * one bitmap and keeps only those with the bit set, along with their hash
+ * values in crk_filter_hash[].  The hashes are computed and the bitmap words
+ * prefetched for the whole batch before any of them is tested, so that cache
+ * misses on a large bitmap overlap.  Returns the number of survivors.
+ */
+static int crk_filter(unsigned int *bitmap, int (*get_hash)(int index),
+	int count, int level)
+{
+	int i, hash, passed;
+
+	for (i = 0; i < count; i++) {
+		hash = crk_filter_hash[i] = get_hash(crk_filter_index[i]);
+		CRK_PREFETCH(&bitmap[hash / (sizeof(*bitmap) * 8)]);
+	}
+
+	passed = 0;
+	for (i = 0; i < count; i++) {
+		hash = crk_filter_hash[i];
+		if (bitmap[hash / (sizeof(*bitmap) * 8)] &
+		    (1U << (hash % (sizeof(*bitmap) * 8)))) {
+			crk_filter_index[passed] = crk_filter_index[i];
+			crk_filter_hash[passed++] = hash;
+		}
+	}
+
+	crk_filter_probes[level] += count;
+	crk_filter_passes[level] += passed;
+
+	return passed;
+}
+
+static void crk_log_filter_stats(void)
+{
+	char name[32];
+	int level;
+
+	for (level = 0; level <= PASSWORD_PREFILTER_LEVELS; level++) {
+		uint64_t probes = crk_filter_probes[level];
+		uint64_t passes = crk_filter_passes[level];
+		uint64_t hits = crk_filter_hits[level];
+
+		if (!probes)
+			continue;
+
+		if (level < PASSWORD_PREFILTER_LEVELS)
+			sprintf(name, "Bitmap prefilter %d", level + 1);
+		else
+			strcpy(name, "Main bitmap");
+
+		log_event("- %s: %llu of %llu computed hashes passed, "
+		    "%.4f%% false positives", name,
+		    (unsigned long long)passes, (unsigned long long)probes,
+		    passes > hits ? 100.0 * (passes - hits) / probes : 0.0);
+	}
+}
+
 static int crk_password_loop(struct db_salt *salt)
 {
 	struct db_password *pw;
@@ -678,14 +995,21 @@ static int crk_password_loop(struct db_salt *salt)
 
 	idle_yield();
 
-	if (event_pending && crk_process_event())
+	if (event_pending && !crk_worker_id && crk_process_event())
 		return -1;
 
+/* Hashes cracked by other processes may have just removed this salt */
+	if (!salt->list)
+		return 0;
+
 	count = crk_key_index;
 	match = crk_methods.crypt_all(&count, salt);
 	crk_last_key = count;
 
-	{
+	if (crk_worker_id) {
+		crk_worker_salts++;
+		crk_worker_hashes += salt->count;
+	} else {
 		int64 effective_count;
 		mul32by32(&effective_count, salt->count, count);
 		status_update_crypts(&effective_count, count);
@@ -710,44 +1034,437 @@ static int crk_password_loop(struct db_salt *salt)
 				}
 			}
 		} while ((pw = pw->next));
-	} else
-	for (index = 0; index < match; index++) {
-		int hash = salt->index(index);
-		if (salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] &
-		    (1U << (hash % (sizeof(*salt->bitmap) * 8)))) {
-			pw = salt->hash[hash >> PASSWORD_HASH_SHR];
-			do {
-				if (crk_methods.cmp_one(pw->binary, index))
-				if (crk_methods.cmp_exact(crk_methods.source(
-				    pw->source, pw->binary), index))
-				if (crk_process_guess(salt, pw, index))
-					return 1;
-			} while ((pw = pw->next_hash));
+	} else {
+		int level, left, i;
+
+		for (index = 0; index < match; index++)
+			crk_filter_index[index] = index;
+
+		left = match;
+		for (level = 0; level < salt->prefilter_levels && left; level++)
+			left = crk_filter(salt->prefilter[level],
+			    salt->prefilter_index[level], left, level);
+		if (left)
+			left = crk_filter(salt->bitmap, salt->index, left,
+			    PASSWORD_PREFILTER_LEVELS);
+
+		for (i = 0; i < left; i++)
+			CRK_PREFETCH(&salt->table_hash[
+			    PASSWORD_TABLE_SLOT(salt, crk_filter_hash[i])]);
+
+		for (i = 0; i < left; i++) {
+			unsigned int hash = crk_filter_hash[i];
+			unsigned int slot = PASSWORD_TABLE_SLOT(salt, hash);
+			int hit = 0;
+
+			index = crk_filter_index[i];
+			for (; salt->table_hash[slot] != PASSWORD_TABLE_EMPTY;
+			    slot = PASSWORD_TABLE_NEXT(salt, slot)) {
+				if (salt->table_hash[slot] != hash ||
+				    !(pw = salt->table_pw[slot]))
+					continue;
+				if (crk_methods.cmp_one(&salt->table_binary[
+				    (size_t)slot * salt->table_stride],
+				    index)) {
+/* It got through all of this salt's levels, count it once for each */
+					if (!hit++) {
+						for (level = 0; level <
+						    salt->prefilter_levels;
+						    level++)
+							crk_filter_hits[level]++;
+						crk_filter_hits[
+						    PASSWORD_PREFILTER_LEVELS]++;
+					}
+					if (crk_methods.cmp_exact(
+					    crk_methods.source(pw->source,
+					    pw->binary), index))
+					if (crk_process_guess(salt, pw, index))
+						return 1;
+				}
+			}
 		}
 	}
 
 	return 0;
 }
 
+#if CRK_WORKERS
+static void crk_worker_failed(void)
+{
+	fprintf(stderr, "Salt worker process failed\n");
+	error();
+}
+
+/*
+ * Runs in a salt worker until the main process closes the pipe: gets the keys
+ * for each batch from shared memory and tries them against our share of the
+ * salts, or against the one salt they're for in "single crack" mode.
+ */
+static void crk_worker_main(FILE *file)
+{
+	struct crk_worker_cmd cmd;
+	struct db_salt *salt;
+	char *keys = CRK_WORKER_KEYS(crk_worker_id - 1);
+	int index;
+
+	while (fread(&cmd, sizeof(cmd), 1, file) == 1) {
+		crk_methods.clear_keys();
+		for (index = 0; index < cmd.count; index++)
+			crk_methods.set_key(&keys[index * crk_worker_key_size],
+			    index);
+		crk_key_index = cmd.count;
+
+		if ((salt = cmd.salt)) {
+/* The last of its hashes may have been cracked since */
+			if (salt->count && !*crk_worker_stop) {
+				crk_methods.set_salt(salt->salt);
+				crk_password_loop(salt);
+			}
+		} else
+		for (salt = crk_db->salts; salt; salt = salt->next) {
+			if (salt->sequential_id % (crk_worker_count + 1) !=
+			    crk_worker_id)
+				continue;
+			if (*crk_worker_stop)
+				break;
+			crk_methods.set_salt(salt->salt);
+			crk_password_loop(salt);
+		}
+
+		crk_worker_put(NULL, NULL, 0, 1);
+		if (fflush(crk_worker_out))
+			_exit(1);
+	}
+
+	_exit(0);
+}
+
+/*
+ * Forks salt workers if configured to.  Formats keep their state in static
+ * variables, so instead of threads sharing a format instance we use processes
+ * that each get a private copy of it (and a copy-on-write one of the loaded
+ * hashes).  The keys are still generated by this process only and passed to
+ * the workers in shared memory, one batch at a time.  Each process tries them
+ * against the salts with its own sequential_id modulo the process count, and
+ * the workers report their guesses back to us to be processed in our copy of
+ * the database.  In "single crack" mode, each salt's buffered keys go to the
+ * process for that salt instead, and we carry on without waiting for the
+ * worker until we have more keys for it.
+ */
+static void crk_init_workers(void)
+{
+	char *label = crk_db->format->params.label;
+	int count, i, j;
+
+	crk_worker_count = 0;
+
+	if ((count = options.salt_workers) < 0)
+		count = cfg_get_int(SECTION_OPTIONS, NULL, "SaltWorkers");
+	if (count > CRK_WORKERS_MAX)
+		count = CRK_WORKERS_MAX;
+	if (count > crk_db->salt_count / CRK_WORKERS_MIN_SALTS - 1)
+		count = crk_db->salt_count / CRK_WORKERS_MIN_SALTS - 1;
+
+/* GPUs don't fork well */
+	if (count < 1 || strstr(label, "-opencl") || strstr(label, "-cuda"))
+		return;
+
+/* "Single crack" mode has different keys for each salt, so for each worker */
+	crk_worker_key_size = crk_params.plaintext_length + 1;
+	crk_worker_keys_size =
+	    crk_worker_key_size * crk_params.max_keys_per_crypt;
+	crk_worker_keys = mmap(NULL, crk_worker_keys_size *
+	    (crk_guesses ? count : 1),
+	    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (crk_worker_keys == MAP_FAILED) {
+		log_event("! Can't start salt workers: mmap: %s",
+		    strerror(errno));
+		crk_worker_keys = NULL;
+		return;
+	}
+
+	crk_worker_stop = mmap(NULL, sizeof(*crk_worker_stop),
+	    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (crk_worker_stop == MAP_FAILED) {
+		log_event("! Can't start salt workers: mmap: %s",
+		    strerror(errno));
+		munmap(crk_worker_keys, crk_worker_keys_size *
+		    (crk_guesses ? count : 1));
+		crk_worker_keys = NULL;
+		crk_worker_stop = NULL;
+		return;
+	}
+	*crk_worker_stop = 0;
+
+	crk_workers = mem_calloc(count * sizeof(*crk_workers));
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < count; i++) {
+		int cmd[2], res[2];
+		FILE *file;
+
+		if (pipe(cmd) || pipe(res))
+			pexit("pipe");
+
+		switch ((crk_workers[i].pid = fork())) {
+		case -1:
+			pexit("fork");
+
+		case 0:
+			for (j = 0; j < i; j++) {
+				close(fileno(crk_workers[j].cmd));
+				close(fileno(crk_workers[j].res));
+			}
+			close(cmd[1]);
+			close(res[0]);
+			signal(SIGINT, SIG_IGN);
+			signal(SIGTERM, SIG_IGN);
+			john_main_process = 0;
+			crk_worker_count = count;
+			crk_worker_id = i + 1;
+			if (!(file = fdopen(cmd[0], "rb")) ||
+			    !(crk_worker_out = fdopen(res[1], "wb")))
+				_exit(1);
+			crk_worker_main(file);
+		}
+
+		close(cmd[0]);
+		close(res[1]);
+		if (!(crk_workers[i].cmd = fdopen(cmd[1], "wb")) ||
+		    !(crk_workers[i].res = fdopen(res[0], "rb")))
+			pexit("fdopen");
+/* Nothing may be left buffered when we poll() in crk_wait_worker() */
+		setvbuf(crk_workers[i].res, NULL, _IONBF, 0);
+	}
+
+	crk_worker_count = count;
+
+	log_event("- Splitting %d salts between %d processes",
+	    crk_db->salt_count, count + 1);
+}
+
+static void crk_done_workers(void)
+{
+	int i;
+
+	for (i = 0; i < crk_worker_count; i++) {
+		int status;
+
+		fclose(crk_workers[i].cmd);
+		fclose(crk_workers[i].res);
+		if (waitpid(crk_workers[i].pid, &status, 0) !=
+		    crk_workers[i].pid ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			crk_worker_failed();
+	}
+
+	if (crk_worker_keys)
+		munmap(crk_worker_keys, crk_worker_keys_size *
+		    (crk_guesses ? crk_worker_count : 1));
+	crk_worker_keys = NULL;
+	if (crk_worker_stop)
+		munmap((void *)crk_worker_stop, sizeof(*crk_worker_stop));
+	crk_worker_stop = NULL;
+	MEM_FREE(crk_workers);
+	crk_worker_count = 0;
+}
+
+/*
+ * Has the salt workers start on the current batch of keys, which they find in
+ * shared memory.
+ */
+static void crk_start_worker(int i, struct db_salt *salt, int count)
+{
+	struct crk_worker_cmd cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.salt = salt;
+	cmd.count = count;
+
+	if (fwrite(&cmd, sizeof(cmd), 1, crk_workers[i].cmd) != 1 ||
+	    fflush(crk_workers[i].cmd))
+		crk_worker_failed();
+}
+
+static void crk_start_workers(void)
+{
+	int i;
+
+	for (i = 0; i < crk_worker_count; i++)
+		crk_start_worker(i, NULL, crk_key_index);
+}
+
+/*
+ * Adds the salts computed by a worker to the status, like crk_password_loop()
+ * would have, for a batch of count keys.
+ */
+static void crk_worker_crypts(unsigned int salts, unsigned int hashes,
+	unsigned int count)
+{
+	unsigned int max = ~0U / count;
+	int64 combs;
+
+	combs.lo = combs.hi = 0;
+	while (salts > max) {
+		status_update_crypts(&combs, max * count);
+		salts -= max;
+	}
+
+	mul32by32(&combs, hashes, count);
+	status_update_crypts(&combs, salts * count);
+}
+
+/*
+ * Waits for a message from a salt worker, passing an abort (such as Ctrl-C or
+ * --max-run-time, which the workers ignore) on to them as soon as we see it.
+ */
+static void crk_wait_worker(int i)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fileno(crk_workers[i].res);
+	pfd.events = POLLIN;
+
+	while (1) {
+#if !OS_TIMER
+		sig_timer_emu_tick();
+#endif
+		if (event_abort)
+			*crk_worker_stop = 1;
+
+		switch (poll(&pfd, 1, 1000)) {
+		case -1:
+			if (errno != EINTR)
+				crk_worker_failed();
+			break;
+		case 0:
+			break;
+		default:
+			return;
+		}
+	}
+}
+
+/*
+ * Waits for a salt worker to finish its batch of count keys and processes its
+ * guesses, in the order reported, skipping the ones we've already removed
+ * meanwhile (e.g. with a pot sync).  Returns non-zero if there are no hashes
+ * left to crack.
+ */
+static int crk_collect_worker(int i, int count)
+{
+	struct crk_worker_msg msg;
+	int done = 0;
+
+	if (crk_guesses)
+		crk_guess_keys = CRK_WORKER_KEYS(i);
+
+	do {
+		crk_wait_worker(i);
+		if (fread(&msg, sizeof(msg), 1, crk_workers[i].res) != 1)
+			crk_worker_failed();
+
+		if (msg.salts)
+			crk_worker_crypts(msg.salts, msg.hashes, count);
+
+		if (msg.pw && !done && msg.salt->count && msg.pw->binary)
+			done = crk_process_guess(msg.salt, msg.pw, msg.index);
+	} while (!msg.last);
+
+	crk_guess_keys = NULL;
+	crk_workers[i].salt = NULL;
+
+	return done;
+}
+
+static int crk_collect_workers(void)
+{
+	int i, done = 0;
+
+	for (i = 0; i < crk_worker_count; i++)
+		if (crk_collect_worker(i, crk_key_index))
+			done = 1;
+
+	return done;
+}
+
+/*
+ * Has the salt's worker try its buffered keys in "single crack" mode, once
+ * it's done with the previous batch we gave it.
+ */
+static int crk_process_salt_worker(struct db_salt *salt, int i)
+{
+	struct crk_worker *worker = &crk_workers[i];
+	char *keys = CRK_WORKER_KEYS(i);
+	char *ptr = salt->keys->buffer;
+	int count = salt->keys->count, index;
+	int not_from_guesses = count - salt->keys->count_from_guesses;
+
+	if (worker->salt && crk_collect_worker(i, worker->count))
+		return 1;
+
+	if (!salt->list)
+		return 0;
+
+	for (index = 0; index < count; index++) {
+		strnzcpy(&keys[index * crk_worker_key_size], ptr,
+		    crk_params.plaintext_length + 1);
+		ptr += crk_params.plaintext_length;
+	}
+
+	crk_start_worker(i, salt, count);
+	worker->salt = salt;
+	worker->count = count;
+
+/* As if the keys were all processed now, see crk_process_salt() */
+	if (not_from_guesses > 0)
+		add32to64(&status.cands, not_from_guesses);
+
+	return 0;
+}
+#endif
+
 static int crk_salt_loop(void)
 {
 	int done;
 	struct db_salt *salt;
 
+	if (crackq_enabled && crk_reload_crackq())
+		return 1;
+
 	if (event_reload && crk_reload_pot())
 		return 1;
 
+#if CRK_WORKERS
+	if (crk_worker_count)
+		crk_start_workers();
+#endif
+
+	done = 0;
 	salt = crk_db->salts;
 	do {
+		if (salt->sequential_id % (crk_worker_count + 1))
+			continue;
 		crk_methods.set_salt(salt->salt);
 		if ((done = crk_password_loop(salt)))
 			break;
 	} while ((salt = salt->next));
 
+#if CRK_WORKERS
+	if (crk_worker_count) {
+		if (done)
+			*crk_worker_stop = 1;
+		if (crk_collect_workers() && !done)
+			done = 1;
+	}
+#endif
+
 	if (done >= 0)
 		add32to64(&status.cands, crk_key_index);
 
-	if (salt)
+	if (done)
 		return 1;
 
 	crk_key_index = 0;
@@ -774,6 +1491,12 @@ static int crk_salt_loop(void)
 int crk_process_key(char *key)
 {
 	if (crk_db->loaded) {
+#if CRK_WORKERS
+		if (crk_worker_count)
+			strnzcpy(&crk_worker_keys[
+			    crk_key_index * crk_worker_key_size],
+			    key, crk_worker_key_size);
+#endif
 		crk_methods.set_key(key, crk_key_index++);
 
 		if (crk_key_index >= crk_params.max_keys_per_crypt)
@@ -812,6 +1535,25 @@ int crk_process_key(char *key)
 	return ext_abort;
 }
 
+int crk_key_range_room(void)
+{
+	if (!crk_db->loaded || !crk_methods.set_key_range || crk_worker_count)
+		return 0;
+
+	return crk_params.max_keys_per_crypt - crk_key_index;
+}
+
+int crk_process_key_range(char *key, int pos, unsigned char *chars, int count)
+{
+	crk_methods.set_key_range(key, crk_key_index, pos, chars, count);
+	crk_key_index += count;
+
+	if (crk_key_index >= crk_params.max_keys_per_crypt)
+		return crk_salt_loop();
+
+	return 0;
+}
+
 /* This function is used by single.c only */
 int crk_process_salt(struct db_salt *salt)
 {
@@ -824,6 +1566,12 @@ int crk_process_salt(struct db_salt *salt)
 		crk_guesses->ptr = crk_guesses->buffer;
 	}
 
+#if CRK_WORKERS
+	if (crk_worker_count &&
+	    (index = salt->sequential_id % (crk_worker_count + 1)))
+		return crk_process_salt_worker(salt, index - 1);
+#endif
+
 	if (crk_last_salt != salt->salt)
 		crk_methods.set_salt(crk_last_salt = salt->salt);
 
@@ -871,6 +1619,27 @@ int crk_process_salt(struct db_salt *salt)
 	return 0;
 }
 
+int crk_wait_salt(void)
+{
+#if CRK_WORKERS
+	int i;
+
+	for (i = 0; i < crk_worker_count; i++) {
+		if (!crk_workers[i].salt)
+			continue;
+
+		if (crk_guesses) {
+			crk_guesses->count = 0;
+			crk_guesses->ptr = crk_guesses->buffer;
+		}
+
+		return crk_collect_worker(i, crk_workers[i].count);
+	}
+#endif
+
+	return -1;
+}
+
 char *crk_get_key1(void)
 {
 	if (options.secure)
@@ -899,8 +1668,16 @@ char *crk_get_key2(void)
 void crk_done(void)
 {
 	if (crk_db->loaded) {
-		if (crk_key_index && crk_db->salts && !event_abort)
+		if (crk_key_index && crk_db->salts && !event_abort &&
+		    !crk_guesses)
 			crk_salt_loop();
+#if CRK_WORKERS
+/* Have guesses from batches still in progress reported */
+		while (!crk_wait_salt())
+			;
+		crk_done_workers();
+#endif
+		crk_log_filter_stats();
 	}
 	c_cleanup();
 }
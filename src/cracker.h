@@ -33,12 +33,35 @@ extern void crk_init(struct db_main *db, void (*fix_state)(void),
  */
 extern int crk_process_key(char *key);
 
+/*
+ * Returns how many more keys may be passed to crk_process_key_range() before
+ * the keys buffer gets processed, or zero if the format has no
+ * set_key_range() method or there are no hashes loaded (--stdout).
+ */
+extern int crk_key_range_room(void);
+
+/*
+ * Same as calling crk_process_key() for count keys which only differ in the
+ * character at position pos, taken from chars[] (see set_key_range() in
+ * formats.h).  count must be at least 1 and at most crk_key_range_room().
+ */
+extern int crk_process_key_range(char *key, int pos, unsigned char *chars,
+	int count);
+
 /*
  * Resets the guessed keys buffer and processes all the buffered keys for
  * this salt. The return value is the same as for crk_process_key().
  */
 extern int crk_process_salt(struct db_salt *salt);
 
+/*
+ * With salt workers, crk_process_salt() may leave the keys to be processed in
+ * the background.  This waits for one such batch, if any, resetting the
+ * guessed keys buffer and adding the batch's guesses to it.  Returns -1 if
+ * there was none, or else the same as crk_process_salt().
+ */
+extern int crk_wait_salt(void);
+
 /*
  * Return current keys range, crk_get_key2() may return NULL if there's only
  * one key. Note: these functions may share a static result buffer.
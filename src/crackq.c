@@ -0,0 +1,173 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+#if AC_BUILT
+#include "autoconfig.h"
+#endif
+
+#define NEED_OS_FORK
+#include "os.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#if OS_FORK && defined(HAVE_MMAP) && defined(__GNUC__)
+#define CRACKQ_SHARED			1
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS			MAP_ANON
+#endif
+#else
+#define CRACKQ_SHARED			0
+#endif
+
+#include "arch.h"
+#include "misc.h"
+#include "params.h"
+#include "formats.h"
+#include "loader.h"
+#include "options.h"
+#include "config.h"
+#include "logger.h"
+#include "crackq.h"
+#include "memdbg.h"
+
+int crackq_enabled = 0;
+
+#if CRACKQ_SHARED
+/*
+ * The shared memory holds the number of entries ever published, followed by
+ * CRACKQ_SIZE entries.  Entry n goes to slot n % CRACKQ_SIZE and has its seq
+ * set to n + 1 once it's completely written, so that readers can tell when
+ * it's ready and when it has been overwritten with a later one.
+ */
+struct crackq_entry {
+	volatile unsigned long long seq;
+	int node, salt_id;
+	char binary[1];
+};
+
+static volatile unsigned long long *crackq_head;
+static char *crackq_slots;
+static size_t crackq_stride, crackq_binary_size;
+static unsigned long long crackq_next;
+
+#define CRACKQ_ENTRY(n) \
+	((struct crackq_entry *)&crackq_slots[((n) % CRACKQ_SIZE) * \
+	crackq_stride])
+
+void crackq_init(struct db_main *db)
+{
+	struct fmt_main *format = db->format;
+	size_t size;
+	void *shared;
+
+	if (options.fork < 2 || !db->loaded ||
+	    !cfg_get_bool(SECTION_OPTIONS, NULL, "ShareCracked", 1))
+		return;
+
+/* We can't tell apart hashes with no binary or with colliding ones */
+	if (!format->params.binary_size ||
+	    format->params.binary_size > CRACKQ_BINARY_MAX ||
+	    (format->params.flags & FMT_NOT_EXACT))
+		return;
+
+	crackq_binary_size = format->params.binary_size;
+	crackq_stride = (sizeof(struct crackq_entry) + crackq_binary_size +
+	    sizeof(long long) - 1) & ~(sizeof(long long) - 1);
+	size = sizeof(*crackq_head) + CRACKQ_SIZE * crackq_stride;
+	shared = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		log_event("! Can't share cracked hashes: mmap: %s",
+		    strerror(errno));
+		return;
+	}
+
+	memset(shared, 0, size);
+	crackq_head = shared;
+	crackq_slots = (char *)shared + sizeof(*crackq_head);
+	crackq_next = 0;
+	crackq_enabled = 1;
+
+	log_event("- Will share cracked hashes between processes");
+}
+
+void crackq_put(int salt_id, void *binary)
+{
+	unsigned long long n = __sync_fetch_and_add(crackq_head, 1);
+	struct crackq_entry *entry = CRACKQ_ENTRY(n);
+
+	entry->node = options.node_min;
+	entry->salt_id = salt_id;
+	memcpy(entry->binary, binary, crackq_binary_size);
+	__sync_synchronize();
+	entry->seq = n + 1;
+}
+
+int crackq_get(int *salt_id, void *binary)
+{
+	unsigned long long head, seq;
+	struct crackq_entry *entry;
+	int node;
+
+	do {
+		head = *crackq_head;
+		if (crackq_next >= head)
+			return 0;
+
+		if (head - crackq_next > CRACKQ_SIZE) {
+			crackq_next = head - CRACKQ_SIZE;
+			return -1;
+		}
+
+		entry = CRACKQ_ENTRY(crackq_next);
+		seq = entry->seq;
+		__sync_synchronize();
+/* Still being written, try again later */
+		if (seq < crackq_next + 1)
+			return 0;
+		if (seq > crackq_next + 1) {
+			crackq_next++;
+			return -1;
+		}
+
+		node = entry->node;
+		*salt_id = entry->salt_id;
+		memcpy(binary, entry->binary, crackq_binary_size);
+		__sync_synchronize();
+/* Overwritten while we were copying it */
+		if (entry->seq != seq) {
+			crackq_next++;
+			return -1;
+		}
+
+		crackq_next++;
+	} while (node == options.node_min);
+
+	return 1;
+}
+
+#else
+
+void crackq_init(struct db_main *db)
+{
+}
+
+void crackq_put(int salt_id, void *binary)
+{
+}
+
+int crackq_get(int *salt_id, void *binary)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+/*
+ * Sharing of cracked hashes between --fork'ed processes.
+ *
+ * Each process publishes the hashes it cracks (as salt sequential_id and
+ * binary) to a ring buffer in shared memory.  The other processes pick them
+ * up from there and remove the hashes from their copies of the database,
+ * without waiting for a pot file reload.
+ */
+
+#ifndef _JOHN_CRACKQ_H
+#define _JOHN_CRACKQ_H
+
+#include "loader.h"
+
+/*
+ * Set if the ring buffer is in use for this session.
+ */
+extern int crackq_enabled;
+
+/*
+ * Sets up the ring buffer for the loaded database if the "ShareCracked"
+ * option is enabled.  Must be called before forking.
+ */
+extern void crackq_init(struct db_main *db);
+
+/*
+ * Publishes a cracked hash to the other processes.
+ */
+extern void crackq_put(int salt_id, void *binary);
+
+/*
+ * Gets the next hash cracked by another process into salt_id and binary
+ * (which must have room for the format's binary_size).  Returns 1 if there
+ * was one, 0 if there are none (yet), or -1 if some were overwritten before
+ * we could read them, in which case the caller should reload the pot file.
+ */
+extern int crackq_get(int *salt_id, void *binary);
+
+#endif
@@ -102,14 +102,11 @@ john_register_one(&fmt_cryptsha256);
 #include "johnswap.h"
 #include "sse-intrinsics.h"
 
-#ifdef MMX_COEF_SHA256
-// there are problems with SSE OMP builds.  Until found, simply do not allow OMP.
-//#undef _OPENMP
-//#undef FMT_OMP
-//#define FMT_OMP 0
-// Well, I tried by turning of OMP, but the run still failed.  So, I will simply
-// leave OMP on, but turn off SSE in an OMP build, until I get this figured out.
-//#undef MMX_COEF_SHA256
+// OpenSSL's code for the SHA extensions is about twice as fast as 4 SSE lanes,
+// but not as fast as the wider AVX2 and AVX-512 vectors
+#if defined(MMX_COEF_SHA256) && SHA256_SSE_PARA == 1 && defined(__SHA__) && \
+	!defined(GENERIC_SHA2)
+#undef MMX_COEF_SHA256
 #endif
 
 #ifdef _OPENMP
@@ -138,7 +135,6 @@ john_register_one(&fmt_cryptsha256);
 // then let the threads go on ALL data, without caring about the length, since each thread will only
 // be working on passwords in a single MMX buffer that all match, at any given moment.
 //
-#undef MMX_COEF_SHA256
 #ifdef MMX_COEF_SHA256
 #ifdef _OPENMP
 #define MMX_COEF_SCALE      (128/MMX_COEF_SHA256)
@@ -166,7 +162,7 @@ john_register_one(&fmt_cryptsha256);
 
 #define MIN_KEYS_PER_CRYPT		1
 #ifdef MMX_COEF_SHA256
-#define MAX_KEYS_PER_CRYPT		MMX_COEF_SHA256
+#define MAX_KEYS_PER_CRYPT		(MMX_COEF_SHA256*SHA256_SSE_PARA)
 #else
 #define MAX_KEYS_PER_CRYPT		1
 #endif
@@ -200,7 +196,7 @@ john_register_one(&fmt_cryptsha256);
 #ifndef MMX_COEF_SHA256
 #define BLKS 1
 #else
-#define BLKS MMX_COEF_SHA256
+#define BLKS MAX_KEYS_PER_CRYPT
 #endif
 
 typedef struct cryptloopstruct_t {
@@ -227,7 +223,7 @@ static int max_crypts;
 
 /* these 2 values are used in setup of the cryptloopstruct, AND to do our SHA256_Init() calls, in the inner loop */
 static const unsigned char padding[128] = { 0x80, 0 /* 0,0,0,0.... */ };
-#ifndef JTR_INC_COMMON_CRYPTO_SHA2
+#if !defined(JTR_INC_COMMON_CRYPTO_SHA2) && !defined(MMX_COEF_SHA256)
 static const ARCH_WORD_32 ctx_init[8] =
 	{0x6A09E667,0xBB67AE85,0x3C6EF372,0xA54FF53A,0x510E527F,0x9B05688C,0x1F83D9AB,0x5BE0CD19};
 #endif
@@ -247,11 +243,9 @@ static void init(struct fmt_main *self)
 #endif
 	max_crypts = MMX_COEF_SCALE * omp_t * MAX_KEYS_PER_CRYPT;
 	self->params.max_keys_per_crypt = max_crypts;
-	// we allocate 1 more than needed, and use that 'extra' value as a zero length PW to fill in the
-	// tail groups in MMX mode.
-	saved_key_length = mem_calloc_tiny(sizeof(*saved_key_length) * (1+max_crypts), MEM_ALIGN_WORD);
-	saved_key = mem_calloc_tiny(sizeof(*saved_key) * (1+max_crypts), MEM_ALIGN_WORD);
-	crypt_out = mem_calloc_tiny(sizeof(*crypt_out) * (1+max_crypts), MEM_ALIGN_WORD);
+	saved_key_length = mem_calloc_tiny(sizeof(*saved_key_length) * max_crypts, MEM_ALIGN_WORD);
+	saved_key = mem_calloc_tiny(sizeof(*saved_key) * max_crypts, MEM_ALIGN_WORD);
+	crypt_out = mem_calloc_tiny(sizeof(*crypt_out) * max_crypts, MEM_ALIGN_WORD);
 }
 
 static int get_hash_0(int index) { return crypt_out[index][0] & 0xf; }
@@ -329,6 +323,7 @@ static void LoadCryptStruct(cryptloopstruct *crypt_struct, int index, int idx, c
 
 	// Adjust cp for idx;
 #ifdef MMX_COEF_SHA256
+	cp += idx*2*64;
 	next_cp = cp + (2*64*BLKS);
 #endif
 
@@ -500,7 +495,7 @@ static void LoadCryptStruct(cryptloopstruct *crypt_struct, int index, int idx, c
 	pstr->cptr[idx][20] = cp + off_pc;
 	memcpy(cp, p_bytes, plen); cp += (plen+BINARY_SIZE);
 	if (!idx) pstr->datlen[21] = dlen_pc;
-	memcpy(cp, padding, tot_psc-2-len_pc);
+	memcpy(cp, padding, tot_pc-2-len_pc);
 	pstr->bufs[idx][21][tot_pc-2] = (len_pc<<3)>>8;
 	pstr->bufs[idx][21][tot_pc-1] = (len_pc<<3)&0xFF;
 
@@ -590,6 +585,23 @@ static void LoadCryptStruct(cryptloopstruct *crypt_struct, int index, int idx, c
 	if (!idx) pstr->datlen[41] = dlen_ppsc;
 }
 
+#ifdef MMX_COEF_SHA256
+/*
+ * The number of the pc, psc, ppc and pspc buffers which take 2 blocks for a
+ * key of this length and the current salt.  Each of these only grows with
+ * the key length, so keys with the same count share all of the block counts.
+ */
+static int block_group(int plen)
+{
+	int slen = cur_salt->len;
+
+	return (plen + BINARY_SIZE > 55) +
+		(plen + slen + BINARY_SIZE > 55) +
+		((plen<<1) + BINARY_SIZE > 55) +
+		((plen<<1) + slen + BINARY_SIZE > 55);
+}
+#endif
+
 static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	int count = *pcount;
@@ -604,23 +616,23 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 //	}
 
 #ifdef MMX_COEF_SHA256
-	// group based upon size splits.
-	MixOrder = mem_alloc(sizeof(int)*(count+5*MMX_COEF_SHA256));
+	// group based upon how many of the buffer types take 2 blocks.  The
+	// tail of each group is filled up with copies of its last key.
+	MixOrder = mem_alloc(sizeof(int)*(count+5*MAX_KEYS_PER_CRYPT));
 	{
-		const int lens[6] = {0,4,8,12,24,36};
 		int j;
 		tot_todo = 0;
-		saved_key_length[count] = 0; // point all 'tail' MMX buffer elements to this location.
 		for (j = 0; j < 5; ++j) {
 			for (index = 0; index < count; ++index) {
-				if (saved_key_length[index] >= lens[j] && saved_key_length[index] < lens[j+1])
+				if (block_group(saved_key_length[index]) == j)
 					MixOrder[tot_todo++] = index;
 			}
-			while (tot_todo & (MMX_COEF_SHA256-1))
-				MixOrder[tot_todo++] = count;
+			while (tot_todo % MAX_KEYS_PER_CRYPT) {
+				MixOrder[tot_todo] = MixOrder[tot_todo-1];
+				++tot_todo;
+			}
 		}
 	}
-	printf ("tot_todo=%d count+5*MMX_COEF_SHA256=%d\n", tot_todo, count+5*MMX_COEF_SHA256);
 #else
 	// no need to mix. just run them one after the next, in any order.
 	MixOrder = mem_alloc(sizeof(int)*count);
@@ -649,7 +661,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		char s_bytes[PLAINTEXT_LENGTH+1];
 		JTR_ALIGN(16) cryptloopstruct crypt_struct;
 #ifdef MMX_COEF_SHA256
-		JTR_ALIGN(16) ARCH_WORD_32 sse_out[64];
+		JTR_ALIGN(16) ARCH_WORD_32 sse_out[8*BLKS];
 #endif
 
 		for (idx = 0; idx < MAX_KEYS_PER_CRYPT; ++idx)
@@ -762,10 +774,11 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 				break;
 			{
 				int j, k;
-				for (k = 0; k < MMX_COEF_SHA256; ++k) {
+				for (k = 0; k < BLKS; ++k) {
 					ARCH_WORD_32 *o = (ARCH_WORD_32 *)crypt_struct.cptr[k][idx];
+					ARCH_WORD_32 *p = &sse_out[(k/MMX_COEF_SHA256)*8*MMX_COEF_SHA256+(k&(MMX_COEF_SHA256-1))];
 					for (j = 0; j < 8; ++j)
-						*o++ = JOHNSWAP(sse_out[(j<<(MMX_COEF_SHA256>>1))+k]);
+						*o++ = JOHNSWAP(p[j*MMX_COEF_SHA256]);
 				}
 			}
 			if (++idx == 42)
@@ -773,10 +786,11 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		}
 		{
 			int j, k;
-			for (k = 0; k < MMX_COEF_SHA256; ++k) {
+			for (k = 0; k < BLKS; ++k) {
 				ARCH_WORD_32 *o = (ARCH_WORD_32 *)crypt_out[MixOrder[index+k]];
+				ARCH_WORD_32 *p = &sse_out[(k/MMX_COEF_SHA256)*8*MMX_COEF_SHA256+(k&(MMX_COEF_SHA256-1))];
 				for (j = 0; j < 8; ++j)
-					*o++ = JOHNSWAP(sse_out[(j<<(MMX_COEF_SHA256>>1))+k]);
+					*o++ = JOHNSWAP(p[j*MMX_COEF_SHA256]);
 			}
 		}
 #else
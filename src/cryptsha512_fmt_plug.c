@@ -7,6 +7,10 @@
  * general public under the following terms:  Redistribution and use in source
  * and binary forms, with or without modification, are permitted.
  *
+ * SIMD version: the keys of a crypt_all() are grouped so that all lanes of an
+ * SSE bundle take the same number of SHA-512 blocks in every round, and the 8
+ * buffer layouts used by the rounds are built once per key.  Keys too long
+ * for 2 block buffers are still done one at a time.
  */
 
 #if FMT_EXTERNS_H
@@ -27,6 +31,8 @@ john_register_one(&fmt_cryptsha512);
 #include "params.h"
 #include "common.h"
 #include "formats.h"
+#include "johnswap.h"
+#include "sse-intrinsics.h"
 // these MUST be defined prior to loading cryptsha512_valid.h
 #define BINARY_SIZE			64
 #define SALT_LENGTH			16
@@ -36,7 +42,9 @@ john_register_one(&fmt_cryptsha512);
 
 #define FORMAT_LABEL			"sha512crypt"
 
-#if ARCH_BITS >= 64
+#ifdef MMX_COEF_SHA512
+#define ALGORITHM_NAME			SHA512_ALGORITHM_NAME
+#elif ARCH_BITS >= 64
 #define ALGORITHM_NAME			"64/" ARCH_BITS_STR " " SHA2_LIB
 #else
 #define ALGORITHM_NAME			"32/" ARCH_BITS_STR " " SHA2_LIB
@@ -49,7 +57,17 @@ john_register_one(&fmt_cryptsha512);
 #define SALT_ALIGN			4
 
 #define MIN_KEYS_PER_CRYPT		1
+#ifdef MMX_COEF_SHA512
+#define MAX_KEYS_PER_CRYPT		(MMX_COEF_SHA512*SHA512_SSE_PARA)
+// get more keys than lanes, so that they can be grouped by length
+#ifdef _OPENMP
+#define MMX_COEF_SCALE			1
+#else
+#define MMX_COEF_SCALE			16
+#endif
+#else
 #define MAX_KEYS_PER_CRYPT		1
+#endif
 
 static struct fmt_tests tests[] = {
 	{"$6$LKO/Ute40T3FNF95$6S/6T2YuOIHY0N3XpLKABJ3soYcXD9mB7uVbtEZDj/LNscVhZoZ9DEH.sBciDrMsHOWOoASbNLTypH/5X26gN0", "U*U*U*U*"},
@@ -107,6 +125,9 @@ static void init(struct fmt_main *self)
 	self->params.min_keys_per_crypt *= omp_t;
 	omp_t *= OMP_SCALE;
 	self->params.max_keys_per_crypt *= omp_t;
+#endif
+#ifdef MMX_COEF_SHA512
+	self->params.max_keys_per_crypt *= MMX_COEF_SCALE;
 #endif
 	saved_key_length = mem_calloc_tiny(sizeof(*saved_key_length) * self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
 	saved_key = mem_calloc_tiny(sizeof(*saved_key) * self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
@@ -136,136 +157,312 @@ static char *get_key(int index)
 	return saved_key[index];
 }
 
-static int crypt_all(int *pcount, struct db_salt *salt)
+/* Everything up to and including the P and S byte sequences */
+static void sha512crypt_prepare(int index, char *p_bytes, char *s_bytes)
 {
-	int count = *pcount;
-	int index = 0;
-#ifdef _OPENMP
-#pragma omp parallel for
-	for (index = 0; index < count; index++)
-#endif
-	{
-		// portably align temp_result char * pointer machine word size.
-		union xx {
-			unsigned char c[BINARY_SIZE];
-			ARCH_WORD a[BINARY_SIZE/sizeof(ARCH_WORD)];
-		} u;
-		unsigned char *temp_result = u.c;
-		SHA512_CTX ctx;
-		SHA512_CTX alt_ctx;
-		size_t cnt;
-		char *cp;
-		char p_bytes[PLAINTEXT_LENGTH+1];
-		char s_bytes[PLAINTEXT_LENGTH+1];
+	// portably align temp_result char * pointer machine word size.
+	union xx {
+		unsigned char c[BINARY_SIZE];
+		ARCH_WORD a[BINARY_SIZE/sizeof(ARCH_WORD)];
+	} u;
+	unsigned char *temp_result = u.c;
+	SHA512_CTX ctx;
+	SHA512_CTX alt_ctx;
+	size_t cnt;
+	char *cp;
+
+	/* Prepare for the real work.  */
+	SHA512_Init(&ctx);
+
+	/* Add the key string.  */
+	SHA512_Update(&ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+
+	/* The last part is the salt string.  This must be at most 16
+	   characters and it ends at the first `$' character (for
+	   compatibility with existing implementations).  */
+	SHA512_Update(&ctx, cur_salt->salt, cur_salt->len);
+
+
+	/* Compute alternate SHA512 sum with input KEY, SALT, and KEY.  The
+	   final result will be added to the first context.  */
+	SHA512_Init(&alt_ctx);
+
+	/* Add key.  */
+	SHA512_Update(&alt_ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+
+	/* Add salt.  */
+	SHA512_Update(&alt_ctx, cur_salt->salt, cur_salt->len);
+
+	/* Add key again.  */
+	SHA512_Update(&alt_ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+
+	/* Now get result of this (64 bytes) and add it to the other
+	   context.  */
+	SHA512_Final((unsigned char*)crypt_out[index], &alt_ctx);
+
+	/* Add for any character in the key one byte of the alternate sum.  */
+	for (cnt = saved_key_length[index]; cnt > BINARY_SIZE; cnt -= BINARY_SIZE)
+		SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
+	SHA512_Update(&ctx, (unsigned char*)crypt_out[index], cnt);
+
+	/* Take the binary representation of the length of the key and for every
+	   1 add the alternate sum, for every 0 the key.  */
+	for (cnt = saved_key_length[index]; cnt > 0; cnt >>= 1)
+		if ((cnt & 1) != 0)
+			SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
+		else
+			SHA512_Update(&ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
 
-		/* Prepare for the real work.  */
-		SHA512_Init(&ctx);
+	/* Create intermediate result.  */
+	SHA512_Final((unsigned char*)crypt_out[index], &ctx);
 
-		/* Add the key string.  */
-		SHA512_Update(&ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+	/* Start computation of P byte sequence.  */
+	SHA512_Init(&alt_ctx);
 
-		/* The last part is the salt string.  This must be at most 16
-		   characters and it ends at the first `$' character (for
-		   compatibility with existing implementations).  */
-		SHA512_Update(&ctx, cur_salt->salt, cur_salt->len);
+	/* For every character in the password add the entire password.  */
+	for (cnt = 0; cnt < saved_key_length[index]; ++cnt)
+		SHA512_Update(&alt_ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
 
+	/* Finish the digest.  */
+	SHA512_Final(temp_result, &alt_ctx);
 
-		/* Compute alternate SHA512 sum with input KEY, SALT, and KEY.  The
-		   final result will be added to the first context.  */
-		SHA512_Init(&alt_ctx);
+	/* Create byte sequence P.  */
+	cp = p_bytes;
+	for (cnt = saved_key_length[index]; cnt >= BINARY_SIZE; cnt -= BINARY_SIZE)
+		cp = (char *) memcpy (cp, temp_result, BINARY_SIZE) + BINARY_SIZE;
+	memcpy (cp, temp_result, cnt);
 
-		/* Add key.  */
-		SHA512_Update(&alt_ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+	/* Start computation of S byte sequence.  */
+	SHA512_Init(&alt_ctx);
 
-		/* Add salt.  */
+	/* For every character in the password add the entire password.  */
+	for (cnt = 0; cnt < 16 + ((unsigned char*)crypt_out[index])[0]; ++cnt)
 		SHA512_Update(&alt_ctx, cur_salt->salt, cur_salt->len);
 
-		/* Add key again.  */
-		SHA512_Update(&alt_ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+	/* Finish the digest.  */
+	SHA512_Final(temp_result, &alt_ctx);
+
+	/* Create byte sequence S.  */
+	cp = s_bytes;
+	for (cnt = cur_salt->len; cnt >= BINARY_SIZE; cnt -= BINARY_SIZE)
+		cp = (char *) memcpy (cp, temp_result, BINARY_SIZE) + BINARY_SIZE;
+	memcpy (cp, temp_result, cnt);
+}
 
-		/* Now get result of this (64 bytes) and add it to the other
-		   context.  */
-		SHA512_Final((unsigned char*)crypt_out[index], &alt_ctx);
+static void sha512crypt_rounds(int index, char *p_bytes, char *s_bytes)
+{
+	SHA512_CTX ctx;
+	size_t cnt;
 
-		/* Add for any character in the key one byte of the alternate sum.  */
-		for (cnt = saved_key_length[index]; cnt > BINARY_SIZE; cnt -= BINARY_SIZE)
-			SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
-		SHA512_Update(&ctx, (unsigned char*)crypt_out[index], cnt);
+	/* Repeatedly run the collected hash value through SHA512 to
+	   burn CPU cycles.  */
+	for (cnt = 0; cnt < cur_salt->rounds; ++cnt)
+		{
+			/* New context.  */
+			SHA512_Init(&ctx);
+
+			/* Add key or last result.  */
+			if ((cnt & 1) != 0)
+				SHA512_Update(&ctx, p_bytes, saved_key_length[index]);
+			else
+				SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
+
+			/* Add salt for numbers not divisible by 3.  */
+			if (cnt % 3 != 0)
+				SHA512_Update(&ctx, s_bytes, cur_salt->len);
 
-		/* Take the binary representation of the length of the key and for every
-		   1 add the alternate sum, for every 0 the key.  */
-		for (cnt = saved_key_length[index]; cnt > 0; cnt >>= 1)
+			/* Add key for numbers not divisible by 7.  */
+			if (cnt % 7 != 0)
+				SHA512_Update(&ctx, p_bytes, saved_key_length[index]);
+
+			/* Add key or last result.  */
 			if ((cnt & 1) != 0)
 				SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
 			else
-				SHA512_Update(&ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
-
-		/* Create intermediate result.  */
-		SHA512_Final((unsigned char*)crypt_out[index], &ctx);
-
-		/* Start computation of P byte sequence.  */
-		SHA512_Init(&alt_ctx);
-
-		/* For every character in the password add the entire password.  */
-		for (cnt = 0; cnt < saved_key_length[index]; ++cnt)
-			SHA512_Update(&alt_ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
-
-		/* Finish the digest.  */
-		SHA512_Final(temp_result, &alt_ctx);
-
-		/* Create byte sequence P.  */
-		cp = p_bytes;
-		for (cnt = saved_key_length[index]; cnt >= BINARY_SIZE; cnt -= BINARY_SIZE)
-			cp = (char *) memcpy (cp, temp_result, BINARY_SIZE) + BINARY_SIZE;
-		memcpy (cp, temp_result, cnt);
-
-		/* Start computation of S byte sequence.  */
-		SHA512_Init(&alt_ctx);
-
-		/* For every character in the password add the entire password.  */
-		for (cnt = 0; cnt < 16 + ((unsigned char*)crypt_out[index])[0]; ++cnt)
-			SHA512_Update(&alt_ctx, cur_salt->salt, cur_salt->len);
-
-		/* Finish the digest.  */
-		SHA512_Final(temp_result, &alt_ctx);
-
-		/* Create byte sequence S.  */
-		cp = s_bytes;
-		for (cnt = cur_salt->len; cnt >= BINARY_SIZE; cnt -= BINARY_SIZE)
-			cp = (char *) memcpy (cp, temp_result, BINARY_SIZE) + BINARY_SIZE;
-		memcpy (cp, temp_result, cnt);
-
-		/* Repeatedly run the collected hash value through SHA512 to
-		   burn CPU cycles.  */
-		for (cnt = 0; cnt < cur_salt->rounds; ++cnt)
-			{
-				/* New context.  */
-				SHA512_Init(&ctx);
-
-				/* Add key or last result.  */
-				if ((cnt & 1) != 0)
-					SHA512_Update(&ctx, p_bytes, saved_key_length[index]);
-				else
-					SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
-
-				/* Add salt for numbers not divisible by 3.  */
-				if (cnt % 3 != 0)
-					SHA512_Update(&ctx, s_bytes, cur_salt->len);
-
-				/* Add key for numbers not divisible by 7.  */
-				if (cnt % 7 != 0)
-					SHA512_Update(&ctx, p_bytes, saved_key_length[index]);
-
-				/* Add key or last result.  */
-				if ((cnt & 1) != 0)
-					SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
-				else
-					SHA512_Update(&ctx, p_bytes, saved_key_length[index]);
-
-				/* Create intermediate [SIC] result.  */
-				SHA512_Final((unsigned char*)crypt_out[index], &ctx);
+				SHA512_Update(&ctx, p_bytes, saved_key_length[index]);
+
+			/* Create intermediate [SIC] result.  */
+			SHA512_Final((unsigned char*)crypt_out[index], &ctx);
+		}
+}
+
+#ifdef MMX_COEF_SHA512
+/*
+ * The rounds only use 8 different buffer layouts, one for each combination
+ * of odd round (result last instead of first), salt added (round number not
+ * divisible by 3) and key added (not divisible by 7).  Each one is kept as a
+ * padded 1 or 2 block message per lane, and the previous result is stored
+ * into it before the round.
+ */
+#define LAYOUT(cnt) \
+	((((cnt) & 1) << 2) | (((cnt) % 3 != 0) << 1) | ((cnt) % 7 != 0))
+
+typedef struct cryptloopstruct_t {
+	unsigned char buf[8][MAX_KEYS_PER_CRYPT][2*128];
+	int blocks[8];
+	int c_off[8][MAX_KEYS_PER_CRYPT];	// where the previous result goes
+} cryptloopstruct;
+
+/*
+ * 0 to 4 for the number of the layouts which take 2 blocks for a key of this
+ * length and the current salt, or 5 if some would take 3.  Each layout only
+ * grows with the key length, so keys with the same number share all of the
+ * block counts.  The length field makes 111 bytes fit in 1 block, 239 in 2.
+ */
+static int block_group(int plen)
+{
+	int slen = cur_salt->len;
+
+	if ((plen<<1) + slen + BINARY_SIZE > 239)
+		return 5;
+	return (plen + BINARY_SIZE > 111) +
+		(plen + slen + BINARY_SIZE > 111) +
+		((plen<<1) + BINARY_SIZE > 111) +
+		((plen<<1) + slen + BINARY_SIZE > 111);
+}
+
+static void LoadCryptStruct(cryptloopstruct *crypt_struct, int idx,
+                            char *p_bytes, int plen, char *s_bytes)
+{
+	int slen = cur_salt->len;
+	int l;
+
+	for (l = 0; l < 8; ++l) {
+		unsigned char *buf = crypt_struct->buf[l][idx];
+		unsigned char *cp = buf;
+		int len, tot;
+
+		memset(buf, 0, sizeof(crypt_struct->buf[l][idx]));
+		if (l & 4) {
+			memcpy(cp, p_bytes, plen); cp += plen;
+		} else
+			cp += BINARY_SIZE;
+		if (l & 2) {
+			memcpy(cp, s_bytes, slen); cp += slen;
+		}
+		if (l & 1) {
+			memcpy(cp, p_bytes, plen); cp += plen;
+		}
+		if (l & 4) {
+			crypt_struct->c_off[l][idx] = cp - buf;
+			cp += BINARY_SIZE;
+		} else {
+			crypt_struct->c_off[l][idx] = 0;
+			memcpy(cp, p_bytes, plen); cp += plen;
+		}
+		len = cp - buf;
+		tot = (len <= 111) ? 128 : 256;
+		*cp = 0x80;
+		buf[tot-2] = (len<<3)>>8;
+		buf[tot-1] = (len<<3)&0xFF;
+		crypt_struct->blocks[l] = tot / 128;
+	}
+}
+
+static void sha512crypt_rounds_simd(cryptloopstruct *crypt_struct, int *MixOrder)
+{
+	JTR_ALIGN(16) ARCH_WORD_64 sse_out[8*MAX_KEYS_PER_CRYPT];
+	size_t cnt;
+	int j, k;
+
+// the output of each block of MMX_COEF_SHA512 lanes follows the previous one
+#define SSE_OUT(j, k) sse_out[((k)/MMX_COEF_SHA512)*8*MMX_COEF_SHA512 + \
+	(j)*MMX_COEF_SHA512 + ((k)&(MMX_COEF_SHA512-1))]
+
+	for (cnt = 0; cnt < cur_salt->rounds; ++cnt) {
+		int l = LAYOUT(cnt % 42);
+
+		for (k = 0; k < MAX_KEYS_PER_CRYPT; ++k) {
+			unsigned char *o = &crypt_struct->buf[l][k][crypt_struct->c_off[l][k]];
+
+			if (!cnt)
+				memcpy(o, crypt_out[MixOrder[k]], BINARY_SIZE);
+			else
+			for (j = 0; j < 8; ++j) {
+				ARCH_WORD_64 w = JOHNSWAP64(SSE_OUT(j, k));
+				memcpy(&o[j<<3], &w, 8);
+			}
+		}
+		SSESHA512body((__m128i *)crypt_struct->buf[l], sse_out, NULL, SSEi_FLAT_IN|SSEi_2BUF_INPUT_FIRST_BLK);
+		if (crypt_struct->blocks[l] == 2)
+			SSESHA512body((__m128i *)&crypt_struct->buf[l][0][128], sse_out, sse_out, SSEi_FLAT_IN|SSEi_2BUF_INPUT_FIRST_BLK|SSEi_RELOAD);
+	}
+	for (k = 0; k < MAX_KEYS_PER_CRYPT; ++k) {
+		ARCH_WORD_64 *o = (ARCH_WORD_64 *)crypt_out[MixOrder[k]];
+		for (j = 0; j < 8; ++j)
+			o[j] = JOHNSWAP64(SSE_OUT(j, k));
+	}
+#undef SSE_OUT
+}
+#endif
+
+static int crypt_all(int *pcount, struct db_salt *salt)
+{
+	int count = *pcount;
+	int index = 0;
+	int *MixOrder, tot_todo;
+
+#ifdef MMX_COEF_SHA512
+	// group based upon block_group().  The tail of each group is filled
+	// up with copies of its last key.
+	MixOrder = mem_alloc(sizeof(int)*(count+6*MAX_KEYS_PER_CRYPT));
+	{
+		int j;
+		tot_todo = 0;
+		for (j = 0; j < 6; ++j) {
+			for (index = 0; index < count; ++index) {
+				if (block_group(saved_key_length[index]) == j)
+					MixOrder[tot_todo++] = index;
+			}
+			while (tot_todo % MAX_KEYS_PER_CRYPT) {
+				MixOrder[tot_todo] = MixOrder[tot_todo-1];
+				++tot_todo;
 			}
+		}
 	}
+#else
+	// no need to mix. just run them one after the next, in any order.
+	MixOrder = mem_alloc(sizeof(int)*count);
+	for (index = 0; index < count; ++index)
+		MixOrder[index] = index;
+	tot_todo = count;
+#endif
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for (index = 0; index < tot_todo; index += MAX_KEYS_PER_CRYPT)
+	{
+		char p_bytes[PLAINTEXT_LENGTH+1];
+		char s_bytes[PLAINTEXT_LENGTH+1];
+		int idx;
+#ifdef MMX_COEF_SHA512
+		JTR_ALIGN(16) cryptloopstruct crypt_struct;
+		int simd = block_group(saved_key_length[MixOrder[index]]) < 5;
+#endif
+
+		for (idx = 0; idx < MAX_KEYS_PER_CRYPT; ++idx)
+		{
+			int i = MixOrder[index+idx];
+
+#ifdef MMX_COEF_SHA512
+			if (!simd && idx && i == MixOrder[index+idx-1])
+				continue;
+#endif
+			sha512crypt_prepare(i, p_bytes, s_bytes);
+#ifdef MMX_COEF_SHA512
+			if (simd)
+				LoadCryptStruct(&crypt_struct, idx, p_bytes, saved_key_length[i], s_bytes);
+			else
+#endif
+			sha512crypt_rounds(i, p_bytes, s_bytes);
+		}
+#ifdef MMX_COEF_SHA512
+		if (simd)
+			sha512crypt_rounds_simd(&crypt_struct, &MixOrder[index]);
+#endif
+	}
+	MEM_FREE(MixOrder);
 	return count;
 }
 
@@ -306,10 +503,9 @@ static void *get_salt(char *ciphertext)
 
 static int cmp_all(void *binary, int count)
 {
-	int index = 0;
-#ifdef _OPENMP
-	for (; index < count; index++)
-#endif
+	int index;
+
+	for (index = 0; index < count; index++)
 		if (!memcmp(binary, crypt_out[index], BINARY_SIZE))
 			return 1;
 	return 0;
@@ -0,0 +1,171 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+#if AC_BUILT
+#include "autoconfig.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "arch.h"
+#include "misc.h"
+#include "params.h"
+#include "memory.h"
+#include "options.h"
+#include "config.h"
+#include "logger.h"
+#include "dedupe.h"
+#include "memdbg.h"
+
+int dedupe_enabled = 0;
+
+/*
+ * Each generation is an array of blocks the size of a cache line.  A key
+ * only ever touches one block per generation, in which DEDUPE_HASHES bits
+ * are set.
+ */
+static void *dedupe_mem;
+static unsigned char *dedupe_gen[2];
+static unsigned int dedupe_blocks, dedupe_current;
+static unsigned long long dedupe_capacity, dedupe_stored;
+static unsigned long long dedupe_total, dedupe_skipped;
+
+static MAYBE_INLINE unsigned long long dedupe_hash(char *key)
+{
+	unsigned char *p = (unsigned char *)key;
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+
+	while (*p) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+void dedupe_init(void)
+{
+	int size = cfg_get_int(SECTION_OPTIONS, NULL, "RulesDupeFilterSize");
+	int bits = cfg_get_int(SECTION_OPTIONS, NULL, "RulesDupeFilterBits");
+	size_t bytes;
+
+	dedupe_enabled = 0;
+
+/* Output must not depend on the filter's false positives */
+	if (options.flags & FLG_STDOUT)
+		return;
+
+	if (size < 0)
+		size = DEDUPE_DEFAULT_SIZE;
+	if (!size)
+		return;
+	if (size > DEDUPE_MAX_SIZE)
+		size = DEDUPE_MAX_SIZE;
+	if (bits < 0)
+		bits = DEDUPE_DEFAULT_BITS;
+	if (bits < DEDUPE_MIN_BITS)
+		bits = DEDUPE_MIN_BITS;
+	if (bits > DEDUPE_MAX_BITS)
+		bits = DEDUPE_MAX_BITS;
+
+	bytes = (size_t)size << 20;
+	dedupe_blocks = bytes / 2 / DEDUPE_BLOCK_SIZE;
+	dedupe_mem = mem_alloc(bytes + DEDUPE_BLOCK_SIZE);
+	dedupe_gen[0] = mem_align(dedupe_mem, DEDUPE_BLOCK_SIZE);
+	dedupe_gen[1] = dedupe_gen[0] +
+		(size_t)dedupe_blocks * DEDUPE_BLOCK_SIZE;
+	memset(dedupe_gen[0], 0, bytes);
+
+	dedupe_current = 0;
+	dedupe_capacity = (unsigned long long)dedupe_blocks *
+		DEDUPE_BLOCK_SIZE * 8 / bits;
+	dedupe_stored = dedupe_total = dedupe_skipped = 0;
+
+	dedupe_enabled = 1;
+
+	log_event("- Rules dupe filter: %d MB, %d bits per key, "
+		"up to %llu recent candidates", size, bits, dedupe_capacity * 2);
+}
+
+int dedupe_seen(char *key)
+{
+	unsigned long long hash, bits;
+	size_t offset;
+	unsigned char *current, *old;
+	unsigned int index[DEDUPE_HASHES];
+	unsigned char mask[DEDUPE_HASHES];
+	int i, in_current = 1, in_old = 1;
+
+	dedupe_total++;
+
+	hash = dedupe_hash(key);
+	offset = (size_t)(((hash >> 32) * dedupe_blocks) >> 32) *
+		DEDUPE_BLOCK_SIZE;
+	current = dedupe_gen[dedupe_current] + offset;
+	old = dedupe_gen[dedupe_current ^ 1] + offset;
+
+	bits = (hash ^ (hash >> 31)) * 0x94d049bb133111ebULL;
+	for (i = 0; i < DEDUPE_HASHES; i++) {
+		unsigned int bit = bits & (DEDUPE_BLOCK_SIZE * 8 - 1);
+
+		index[i] = bit >> 3;
+		mask[i] = 1 << (bit & 7);
+		in_current &= (current[index[i]] & mask[i]) != 0;
+		in_old &= (old[index[i]] & mask[i]) != 0;
+		bits >>= 9;
+	}
+
+	if (in_current) {
+		dedupe_skipped++;
+		return 1;
+	}
+
+/* Keys still in use are carried over into the current generation */
+	for (i = 0; i < DEDUPE_HASHES; i++)
+		current[index[i]] |= mask[i];
+
+	if (++dedupe_stored >= dedupe_capacity) {
+		memset(dedupe_gen[dedupe_current ^ 1], 0,
+			(size_t)dedupe_blocks * DEDUPE_BLOCK_SIZE);
+		dedupe_current ^= 1;
+		dedupe_stored = 0;
+	}
+
+	if (in_old) {
+		dedupe_skipped++;
+		return 1;
+	}
+
+	return 0;
+}
+
+void dedupe_done(void)
+{
+	if (!dedupe_mem)
+		return;
+
+	log_event("- Rules dupe filter skipped %llu of %llu candidates "
+		"(%.2f%%)", dedupe_skipped, dedupe_total,
+		dedupe_total ? 100.0 * dedupe_skipped / dedupe_total : 0.0);
+	if (options.verbosity > 3)
+		fprintf(stderr, "Rules dupe filter skipped %llu of %llu "
+			"candidates (%.2f%%)\n", dedupe_skipped, dedupe_total,
+			dedupe_total ? 100.0 * dedupe_skipped / dedupe_total :
+			0.0);
+
+	MEM_FREE(dedupe_mem);
+	dedupe_enabled = 0;
+}
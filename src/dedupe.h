@@ -0,0 +1,52 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+/*
+ * Suppression of duplicate candidates produced by different wordlist rules.
+ *
+ * Recently tried candidates are remembered in a fixed size Bloom filter made
+ * of two generations: when the current one fills up, the older one is
+ * cleared and takes its place.  A candidate is skipped if it's found in
+ * either.  Being probabilistic, this may also skip a very small fraction of
+ * candidates that have not actually been tried.
+ */
+
+#ifndef _JOHN_DEDUPE_H
+#define _JOHN_DEDUPE_H
+
+/*
+ * Set while the filter is in use.
+ */
+extern int dedupe_enabled;
+
+/*
+ * Sets up the filter as configured with the "RulesDupeFilterSize" and
+ * "RulesDupeFilterBits" options, unless it's disabled or we're just
+ * printing candidates.
+ */
+extern void dedupe_init(void);
+
+/*
+ * Returns 1 if the key has (probably) been seen recently, or remembers it
+ * and returns 0 if not.
+ */
+extern int dedupe_seen(char *key);
+
+/*
+ * Logs the statistics and frees the filter.
+ */
+extern void dedupe_done(void);
+
+/*
+ * Checks the key against the filter if it's in use.
+ */
+#define dedupe_skip(key) \
+	(dedupe_enabled && dedupe_seen(key))
+
+#endif
@@ -1509,7 +1509,11 @@ void DynamicFunc__SHA1_crypt_input2_to_output1_FINAL(DYNA_OMP_PARAMS){
  *******************************************************************/
 #ifdef MMX_COEF_SHA256
 
-static const int sha256_inc = MMX_COEF_SHA256;
+// SSESHA256body() does SHA256_SSE_PARA blocks of MMX_COEF_SHA256 lanes
+#define SHA256_LANES (MMX_COEF_SHA256*SHA256_SSE_PARA)
+#define SHA256_OUT(j, i) (((i)/MMX_COEF_SHA256)*8*MMX_COEF_SHA256+(j)*MMX_COEF_SHA256+((i)&(MMX_COEF_SHA256-1)))
+
+static const int sha256_inc = SHA256_LANES;
 
 static inline uint32_t DoSHA256_FixBufferLen32(unsigned char *input_buf, int total_len) {
 	uint32_t *p;
@@ -1542,11 +1546,11 @@ static inline uint32_t DoSHA256_FixBufferLen32(unsigned char *input_buf, int tot
 	p[(ret*16)-1] = JOHNSWAP(total_len<<3);
 	return ret;
 }
-static void DoSHA256_crypt_f_sse(void *in, int len[MMX_COEF_SHA256], void *out, int isSHA256) {
-	JTR_ALIGN(16) ARCH_WORD_32 a[(32*MMX_COEF_SHA256)/sizeof(ARCH_WORD_32)];
-	unsigned int i, j, loops[MMX_COEF_SHA256], bMore, cnt;
+static void DoSHA256_crypt_f_sse(void *in, int len[SHA256_LANES], void *out, int isSHA256) {
+	JTR_ALIGN(16) ARCH_WORD_32 a[(32*SHA256_LANES)/sizeof(ARCH_WORD_32)];
+	unsigned int i, j, loops[SHA256_LANES], bMore, cnt;
 	unsigned char *cp = (unsigned char*)in;
-	for (i = 0; i < MMX_COEF_SHA256; ++i) {
+	for (i = 0; i < SHA256_LANES; ++i) {
 		loops[i] = DoSHA256_FixBufferLen32(cp, len[i]);
 		cp += 256;
 	}
@@ -1556,10 +1560,10 @@ static void DoSHA256_crypt_f_sse(void *in, int len[MMX_COEF_SHA256], void *out,
 	while (bMore) {
 		SSESHA256body(cp, a, a, SSEi_FLAT_IN|(isSHA256?0:SSEi_CRYPT_SHA224)|SSEi_4BUF_INPUT_FIRST_BLK|(cnt==1?0:SSEi_RELOAD));
 		bMore = 0;
-		for (i = 0; i < MMX_COEF_SHA256; ++i) {
+		for (i = 0; i < SHA256_LANES; ++i) {
 			if (cnt == loops[i]) {
 				for (j = 0; j < 4; ++j) {
-					((ARCH_WORD_32*)out)[(i<<2)+j] = JOHNSWAP(a[(j<<2)+i]);
+					((ARCH_WORD_32*)out)[(i<<2)+j] = JOHNSWAP(a[SHA256_OUT(j, i)]);
 				}
 			} else if (cnt < loops[i])
 				bMore = 1;
@@ -1568,12 +1572,12 @@ static void DoSHA256_crypt_f_sse(void *in, int len[MMX_COEF_SHA256], void *out,
 		++cnt;
 	}
 }
-static void DoSHA256_crypt_sse(void *in, int ilen[MMX_COEF_SHA256], void *out[MMX_COEF_SHA256], unsigned int *tot_len, int isSHA256, int tid) {
-	JTR_ALIGN(16) ARCH_WORD_32 a[(32*MMX_COEF_SHA256)/sizeof(ARCH_WORD_32)];
+static void DoSHA256_crypt_sse(void *in, int ilen[SHA256_LANES], void *out[SHA256_LANES], unsigned int *tot_len, int isSHA256, int tid) {
+	JTR_ALIGN(16) ARCH_WORD_32 a[(32*SHA256_LANES)/sizeof(ARCH_WORD_32)];
 	union yy { unsigned char u[32]; ARCH_WORD_32 a[32/sizeof(ARCH_WORD_32)]; } y;
-	unsigned int i, j, loops[MMX_COEF_SHA256], bMore, cnt;
+	unsigned int i, j, loops[SHA256_LANES], bMore, cnt;
 	unsigned char *cp = (unsigned char*)in;
-	for (i = 0; i < MMX_COEF_SHA256; ++i) {
+	for (i = 0; i < SHA256_LANES; ++i) {
 		loops[i] = DoSHA256_FixBufferLen32(cp, ilen[i]);
 		cp += 256;
 	}
@@ -1583,10 +1587,10 @@ static void DoSHA256_crypt_sse(void *in, int ilen[MMX_COEF_SHA256], void *out[MM
 	while (bMore) {
 		SSESHA256body(cp, a, a, SSEi_FLAT_IN|(isSHA256?0:SSEi_CRYPT_SHA224)|SSEi_4BUF_INPUT_FIRST_BLK|(cnt==1?0:SSEi_RELOAD));
 		bMore = 0;
-		for (i = 0; i < MMX_COEF_SHA256; ++i) {
+		for (i = 0; i < SHA256_LANES; ++i) {
 			if (cnt == loops[i]) {
 				for (j = 0; j < 8; ++j) {
-					y.a[j] =JOHNSWAP(a[(j<<2)+i]);
+					y.a[j] =JOHNSWAP(a[SHA256_OUT(j, i)]);
 				}
 				*(tot_len+i) += large_hash_output(y.u, &(((unsigned char*)out[i])[*(tot_len+i)]), isSHA256?32:28, tid);
 			} else if (cnt < loops[i])
@@ -1639,9 +1643,9 @@ void DynamicFunc__SHA224_crypt_input1_append_input2(DYNA_OMP_PARAMS) {
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1674,9 +1678,9 @@ void DynamicFunc__SHA256_crypt_input1_append_input2(DYNA_OMP_PARAMS) {
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1709,9 +1713,9 @@ void DynamicFunc__SHA224_crypt_input2_append_input1(DYNA_OMP_PARAMS) {
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len2_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1744,9 +1748,9 @@ void DynamicFunc__SHA256_crypt_input2_append_input1(DYNA_OMP_PARAMS) {
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len2_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1779,10 +1783,10 @@ void DynamicFunc__SHA224_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		unsigned int x[MMX_COEF_SHA256];
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		unsigned int x[SHA256_LANES];
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1793,7 +1797,7 @@ void DynamicFunc__SHA224_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS){
 			x[j] = 0;
 		}
 		DoSHA256_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, x, 0, tid);
-		for (j = 0; j < MMX_COEF_SHA256; ++j)
+		for (j = 0; j < SHA256_LANES; ++j)
 			total_len_X86[i+j] = x[j];
 #else
 		unsigned int x = 0;
@@ -1820,10 +1824,10 @@ void DynamicFunc__SHA256_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		unsigned int x[MMX_COEF_SHA256];
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		unsigned int x[SHA256_LANES];
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1834,7 +1838,7 @@ void DynamicFunc__SHA256_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS){
 			x[j] = 0;
 		}
 		DoSHA256_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, x, 1, tid);
-		for (j = 0; j < MMX_COEF_SHA256; ++j)
+		for (j = 0; j < SHA256_LANES; ++j)
 			total_len_X86[i+j] = x[j];
 #else
 		unsigned int x = 0;
@@ -1861,10 +1865,10 @@ void DynamicFunc__SHA224_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		unsigned int x[MMX_COEF_SHA256];
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		unsigned int x[SHA256_LANES];
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1875,7 +1879,7 @@ void DynamicFunc__SHA224_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS){
 			x[j] = 0;
 		}
 		DoSHA256_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, x, 0, tid);
-		for (j = 0; j < MMX_COEF_SHA256; ++j)
+		for (j = 0; j < SHA256_LANES; ++j)
 			total_len2_X86[i+j] = x[j];
 #else
 		unsigned int x = 0;
@@ -1902,10 +1906,10 @@ void DynamicFunc__SHA256_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til;i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		unsigned int x[MMX_COEF_SHA256];
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		unsigned int x[SHA256_LANES];
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1916,7 +1920,7 @@ void DynamicFunc__SHA256_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS){
 			x[j] = 0;
 		}
 		DoSHA256_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, x, 1, tid);
-		for (j = 0; j < MMX_COEF_SHA256; ++j)
+		for (j = 0; j < SHA256_LANES; ++j)
 			total_len2_X86[i+j] = x[j];
 #else
 		unsigned int x = 0;
@@ -1943,10 +1947,10 @@ void DynamicFunc__SHA224_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		unsigned int x[MMX_COEF_SHA256];
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		unsigned int x[SHA256_LANES];
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len2_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1957,7 +1961,7 @@ void DynamicFunc__SHA224_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS){
 			x[j] = 0;
 		}
 		DoSHA256_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, x, 0, tid);
-		for (j = 0; j < MMX_COEF_SHA256; ++j)
+		for (j = 0; j < SHA256_LANES; ++j)
 			total_len_X86[i+j] = x[j];
 #else
 		unsigned int x = 0;
@@ -1984,10 +1988,10 @@ void DynamicFunc__SHA256_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		unsigned int x[MMX_COEF_SHA256];
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		unsigned int x[SHA256_LANES];
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len2_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -1998,7 +2002,7 @@ void DynamicFunc__SHA256_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS){
 			x[j] = 0;
 		}
 		DoSHA256_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, x, 1, tid);
-		for (j = 0; j < MMX_COEF_SHA256; ++j)
+		for (j = 0; j < SHA256_LANES; ++j)
 			total_len_X86[i+j] = x[j];
 #else
 		unsigned int x = 0;
@@ -2025,10 +2029,10 @@ void DynamicFunc__SHA224_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		unsigned int x[MMX_COEF_SHA256];
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		unsigned int x[SHA256_LANES];
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len2_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -2039,7 +2043,7 @@ void DynamicFunc__SHA224_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS){
 			x[j] = 0;
 		}
 		DoSHA256_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, x, 0, tid);
-		for (j = 0; j < MMX_COEF_SHA256; ++j)
+		for (j = 0; j < SHA256_LANES; ++j)
 			total_len2_X86[i+j] = x[j];
 #else
 		unsigned int x = 0;
@@ -2066,10 +2070,10 @@ void DynamicFunc__SHA256_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-		int len[MMX_COEF_SHA256], j;
-		unsigned int x[MMX_COEF_SHA256];
-		void *out[MMX_COEF_SHA256];
-		for (j = 0; j < MMX_COEF_SHA256; ++j) {
+		int len[SHA256_LANES], j;
+		unsigned int x[SHA256_LANES];
+		void *out[SHA256_LANES];
+		for (j = 0; j < SHA256_LANES; ++j) {
 			len[j] = total_len2_X86[i+j];
 			#if (MD5_X2)
 			if (j&1)
@@ -2080,7 +2084,7 @@ void DynamicFunc__SHA256_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS){
 			x[j] = 0;
 		}
 		DoSHA256_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, x, 1, tid);
-		for (j = 0; j < MMX_COEF_SHA256; ++j)
+		for (j = 0; j < SHA256_LANES; ++j)
 			total_len2_X86[i+j] = x[j];
 #else
 		unsigned int x = 0;
@@ -2106,8 +2110,8 @@ void DynamicFunc__SHA224_crypt_input1_to_output1_FINAL(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-	int len[MMX_COEF_SHA256], j;
-	for (j = 0; j < MMX_COEF_SHA256; ++j)
+	int len[SHA256_LANES], j;
+	for (j = 0; j < SHA256_LANES; ++j)
 		len[j] = total_len_X86[i+j];
 	DoSHA256_crypt_f_sse(input_buf_X86[i>>MD5_X2].x1.b, len, crypt_key_X86[i>>MD5_X2].x1.b, 0);
 #else
@@ -2132,8 +2136,8 @@ void DynamicFunc__SHA256_crypt_input1_to_output1_FINAL(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-	int len[MMX_COEF_SHA256], j;
-	for (j = 0; j < MMX_COEF_SHA256; ++j)
+	int len[SHA256_LANES], j;
+	for (j = 0; j < SHA256_LANES; ++j)
 		len[j] = total_len_X86[i+j];
 	DoSHA256_crypt_f_sse(input_buf_X86[i>>MD5_X2].x1.b, len, crypt_key_X86[i>>MD5_X2].x1.b, 1);
 #else
@@ -2158,8 +2162,8 @@ void DynamicFunc__SHA224_crypt_input2_to_output1_FINAL(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til;  i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-	int len[MMX_COEF_SHA256], j;
-	for (j = 0; j < MMX_COEF_SHA256; ++j)
+	int len[SHA256_LANES], j;
+	for (j = 0; j < SHA256_LANES; ++j)
 		len[j] = total_len2_X86[i+j];
 	DoSHA256_crypt_f_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, crypt_key_X86[i>>MD5_X2].x1.b, 0);
 #else
@@ -2184,8 +2188,8 @@ void DynamicFunc__SHA256_crypt_input2_to_output1_FINAL(DYNA_OMP_PARAMS){
 #endif
 	for (; i < til; i += sha256_inc) {
 #ifdef MMX_COEF_SHA256
-	int len[MMX_COEF_SHA256], j;
-	for (j = 0; j < MMX_COEF_SHA256; ++j)
+	int len[SHA256_LANES], j;
+	for (j = 0; j < SHA256_LANES; ++j)
 		len[j] = total_len2_X86[i+j];
 	DoSHA256_crypt_f_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, crypt_key_X86[i>>MD5_X2].x1.b, 1);
 #else
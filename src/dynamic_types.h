@@ -159,6 +159,10 @@ typedef struct private_subformat_data
 #    define BY_X			288
 #   elif MD5_SSE_PARA==6
 #    define BY_X			240
+#   elif MD5_SSE_PARA==8
+#    define BY_X			192
+#   elif MD5_SSE_PARA==12
+#    define BY_X			128
 #   endif
 #  endif
 # else
@@ -176,27 +180,31 @@ typedef struct private_subformat_data
 #    define BY_X			6
 #   elif MD5_SSE_PARA==6
 #    define BY_X			5
+#   elif MD5_SSE_PARA==8
+#    define BY_X			4
+#   elif MD5_SSE_PARA==12
+#    define BY_X			2
 #   endif
 # endif
 # endif
 # define LOOP_STR
 # if MMX_COEF == 4
 #  ifdef MD5_SSE_PARA
-#   define ALGORITHM_NAME		"128/128 " MD5_SSE_type  " " STRINGIZE(BY_X) "x4x" STRINGIZE(MD5_SSE_PARA)
+#   define ALGORITHM_NAME		SSE_bits MD5_SSE_type  " " STRINGIZE(BY_X) "x4x" STRINGIZE(MD5_SSE_PARA)
 #   define BSD_BLKS (MD5_SSE_PARA)
 #  else
-#   define ALGORITHM_NAME		"128/128 " MD5_SSE_type  " " STRINGIZE(BY_X) "x4"
+#   define ALGORITHM_NAME		SSE_bits MD5_SSE_type  " " STRINGIZE(BY_X) "x4"
 #   define BSD_BLKS 1
 #  endif
 #  ifdef SHA1_SSE_PARA
-#   define ALGORITHM_NAME_S		"128/128 " SHA1_SSE_type " " STRINGIZE(BY_X) "x4x" STRINGIZE(SHA1_SSE_PARA)
+#   define ALGORITHM_NAME_S		SSE_bits SHA1_SSE_type " " STRINGIZE(BY_X) "x4x" STRINGIZE(SHA1_SSE_PARA)
 #  else
-#   define ALGORITHM_NAME_S		"128/128 " SHA1_SSE_type " " STRINGIZE(BY_X) "x4"
+#   define ALGORITHM_NAME_S		SSE_bits SHA1_SSE_type " " STRINGIZE(BY_X) "x4"
 #  endif
 #  ifdef MD4_SSE_PARA
-#   define ALGORITHM_NAME_4		"128/128 " MD4_SSE_type  " " STRINGIZE(BY_X) "x4x" STRINGIZE(MD4_SSE_PARA)
+#   define ALGORITHM_NAME_4		SSE_bits MD4_SSE_type  " " STRINGIZE(BY_X) "x4x" STRINGIZE(MD4_SSE_PARA)
 #  else
-#   define ALGORITHM_NAME_4		"128/128 " MD4_SSE_type  " " STRINGIZE(BY_X) "x4"
+#   define ALGORITHM_NAME_4		SSE_bits MD4_SSE_type  " " STRINGIZE(BY_X) "x4"
 #  endif
 #  define PLAINTEXT_LENGTH	(27*3+1) // for worst-case UTF-8
 #  ifdef MD5_SSE_PARA
@@ -228,7 +236,11 @@ typedef struct private_subformat_data
 #define ALGORITHM_NAME_X86_S	ARCH_BITS_STR"/"ARCH_BITS_STR" "STRINGIZE(X86_BLOCK_LOOPS) "x1"
 #define ALGORITHM_NAME_X86_4	ARCH_BITS_STR"/"ARCH_BITS_STR" "STRINGIZE(X86_BLOCK_LOOPS) "x1"
 
+#ifdef SHA256_ALGORITHM_NAME
+#define ALGORITHM_NAME_S2_256		SHA256_ALGORITHM_NAME
+#else
 #define ALGORITHM_NAME_S2_256		"128/128 "CPU_NAME" 4x"
+#endif
 #define ALGORITHM_NAME_S2_512		"128/128 "CPU_NAME" 2x"
 #if defined (COMMON_DIGEST_FOR_OPENSSL)
 #define ALGORITHM_NAME_X86_S2_256	ARCH_BITS_STR"/"ARCH_BITS_STR" "STRINGIZE(X86_BLOCK_LOOPS) "x1 CommonCrypto"
@@ -12,6 +12,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "misc.h"
 #include "params.h"
@@ -186,6 +187,9 @@ void ext_init(char *mode, struct db_main *db)
 		error();
 	}
 
+	if (cfg_get_bool(SECTION_OPTIONS, NULL, "ExternalNativeCode", 1))
+		c_compile_native();
+
 	ext_word[0] = 0;
 	c_execute(c_lookup("init"));
 
@@ -279,6 +283,157 @@ int ext_filter_body(char *in, char *out)
 	return 1;
 }
 
+/*
+ * Number of times each function is called in ext_self_test(), and the
+ * length limit the modes are initialized with.
+ */
+#define EXT_TEST_CALLS			0x100000
+#define EXT_TEST_LENGTH			16
+
+/*
+ * Makes up a word for testing a filter(), from a few different character
+ * sets including 8-bit characters.
+ */
+static void ext_test_word(unsigned int *seed)
+{
+	static const char *charsets[] = {
+		"abcdefghijklmnopqrstuvwxyz",
+		"abcdefghijklmnopqrstuvwxyz0123456789",
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+		"0123456789 !\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~",
+		NULL
+	};
+	const char *charset;
+	int i, length, size;
+
+	*seed = *seed * 1103515245 + 12345;
+	charset = charsets[(*seed >> 16) & 3];
+	length = (*seed >> 20) % (EXT_TEST_LENGTH + 1);
+	size = charset ? strlen(charset) : 0xff;
+
+	for (i = 0; i < length; i++) {
+		*seed = *seed * 1103515245 + 12345;
+		if (charset)
+			ext_word[i] = (unsigned char)charset[(*seed >> 16) % size];
+		else
+			ext_word[i] = (*seed >> 16) % size + 1;
+	}
+	ext_word[i] = 0;
+}
+
+static void ext_test_hash(unsigned int *hash)
+{
+	c_int *p = ext_word;
+
+	do {
+		*hash = (*hash ^ *p) * 0x01000193;
+	} while (*p++ && p < &ext_word[PLAINTEXT_BUFFER_SIZE]);
+}
+
+/*
+ * Runs the mode in ext_source through EXT_TEST_CALLS calls of generate()
+ * and/or filter(), returning a hash of the words seen.
+ */
+static unsigned int ext_test_run(unsigned int *calls, clock_t *time)
+{
+	void *generate, *filter;
+	unsigned int hash = 0x811c9dc5, seed = 0;
+	clock_t start = clock();
+
+	memset(ext_word, 0, sizeof(ext_word));
+	ext_abort = ext_status = 0;
+	ext_cipher_limit = EXT_TEST_LENGTH;
+	ext_minlen = ext_maxlen = 0;
+	ext_time = 0;
+
+	c_execute(c_lookup("init"));
+	generate = c_lookup("generate");
+	filter = c_lookup("filter");
+
+	for (*calls = 0; *calls < EXT_TEST_CALLS; (*calls)++) {
+		if (generate) {
+			c_execute_fast(generate);
+			if (!ext_word[0])
+				break;
+		} else
+			ext_test_word(&seed);
+		ext_test_hash(&hash);
+		if (filter) {
+			c_execute_fast(filter);
+			ext_test_hash(&hash);
+		}
+	}
+
+	*time = clock() - start;
+	if (*time < 1)
+		*time = 1;
+
+	return hash;
+}
+
+static int ext_test_mode(char *mode)
+{
+	unsigned int hash[2], calls[2];
+	clock_t time[2];
+	int native;
+
+	if (!(ext_source = cfg_get_list(SECTION_EXT, mode))) {
+		fprintf(stderr, "Unknown external mode: %s\n", mode);
+		return 1;
+	}
+
+	for (native = 0; native < 2; native++) {
+		if (c_compile(ext_getchar, ext_rewind, &ext_globals)) {
+			if (!ext_line) ext_line = ext_source->tail;
+			fprintf(stderr, "Compiler error in %s at line %d: %s\n",
+			    cfg_name, ext_line->number, c_errors[c_errno]);
+			return 1;
+		}
+		if (!c_lookup("generate") && !c_lookup("filter"))
+			return 0;
+		if (native && c_compile_native()) {
+			if (!calls[0])
+				printf("%s: 0 calls, n/a, no native code\n",
+				    mode);
+			else
+			printf("%s: %u calls, %.0f/s interpreted, "
+			    "no native code\n", mode, calls[0],
+			    (double)calls[0] * CLOCKS_PER_SEC / time[0]);
+			return 0;
+		}
+		hash[native] = ext_test_run(&calls[native], &time[native]);
+	}
+
+/* Modes whose generate() ends right away have no speed to compare */
+	if (!calls[0] || !calls[1])
+		printf("%s: %u calls, n/a%s\n", mode, calls[0],
+		    (hash[0] != hash[1] || calls[0] != calls[1]) ?
+		    ": MISMATCH" : "");
+	else
+	printf("%s: %u calls, %.0f/s interpreted, %.0f/s native (%.2fx)%s\n",
+	    mode, calls[0], (double)calls[0] * CLOCKS_PER_SEC / time[0],
+	    (double)calls[1] * CLOCKS_PER_SEC / time[1],
+	    (double)time[0] / time[1],
+	    (hash[0] != hash[1] || calls[0] != calls[1]) ? ": MISMATCH" : "");
+
+	return hash[0] != hash[1] || calls[0] != calls[1];
+}
+
+int ext_self_test(char *mode)
+{
+	int failed = 0;
+
+	if (strcasecmp(mode, "all"))
+		failed = ext_test_mode(mode);
+	else
+	for (mode = NULL; (mode = cfg_get_subsection("List.External", mode)); )
+		failed |= ext_test_mode(mode);
+
+	c_cleanup();
+
+	return failed;
+}
+
 static void save_state(FILE *file)
 {
 	unsigned char *ptr;
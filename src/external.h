@@ -63,4 +63,11 @@ extern int ext_filter_body(char *in, char *out);
  */
 extern void do_external_crack(struct db_main *db);
 
+/*
+ * Runs the external mode (or all of them, for "all") both interpreted and as
+ * native code, checking that they produce the same words and reporting the
+ * speed of each.  Returns non-zero if any mode gave different results.
+ */
+extern int ext_self_test(char *mode);
+
 #endif
@@ -90,10 +90,19 @@ void build_fake_salts_for_regen_lost(struct db_salt *salts) {
 		fake_salts[i].count = sp->count;
 		fake_salts[i].hash = sp->hash;
 		fake_salts[i].hash_size = sp->hash_size;
+		fake_salts[i].table_size = sp->table_size;
+		fake_salts[i].table_shift = sp->table_shift;
+		fake_salts[i].table_stride = sp->table_stride;
+		fake_salts[i].table_hash = sp->table_hash;
+		fake_salts[i].table_binary = sp->table_binary;
+		fake_salts[i].table_pw = sp->table_pw;
 		fake_salts[i].index = sp->index;
 		fake_salts[i].keys = sp->keys;
 		fake_salts[i].list = sp->list;
 		fake_salts[i].bitmap = sp->bitmap;	// 'bug' fix when we went to bitmap. Old code was not copying this.
+		fake_salts[i].prefilter_levels = sp->prefilter_levels;
+		memcpy(fake_salts[i].prefilter, sp->prefilter, sizeof(sp->prefilter));
+		memcpy(fake_salts[i].prefilter_index, sp->prefilter_index, sizeof(sp->prefilter_index));
 		ptr=mem_alloc_tiny(sizeof(char*), MEM_ALIGN_WORD);
 		*ptr = (size_t) (buf + (cp-buf));
 		fake_salts[i].salt = ptr;
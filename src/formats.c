@@ -153,6 +153,85 @@ static char *longcand(int index, int ml)
 	return out;
 }
 
+/*
+ * Candidate number index in the set_key_range() self-test: the max. length
+ * test candidate with one of its characters replaced by a lowercase letter.
+ */
+static char *rangecand(int index, int ml)
+{
+	char *out = longcand(0, ml);
+
+	out[(index / 26) % ml] = 'a' + index % 26;
+
+	return out;
+}
+
+/*
+ * Checks that set_key_range() sets the same keys that the corresponding
+ * set_key() calls would, both as seen by get_key() and by crypt_all().
+ */
+static char *fmt_test_key_range(struct fmt_main *format, int max, int ml)
+{
+	static char s_size[100];
+	unsigned char chars[26];
+	int *hashes;
+	int size, index, count, i;
+	char *result = NULL;
+
+	for (i = 0; i < 26; i++)
+		chars[i] = 'a' + i;
+
+	for (size = PASSWORD_HASH_SIZES - 1; size > 0; size--)
+		if (format->methods.get_hash[size] &&
+		    format->methods.get_hash[size] != fmt_default_get_hash)
+			break;
+
+	hashes = mem_alloc(max * sizeof(*hashes));
+
+	format->methods.clear_keys();
+	for (index = 0; index < max; index += count) {
+		count = max - index < 26 ? max - index : 26;
+		format->methods.set_key_range(longcand(0, ml), index,
+		    (index / 26) % ml, chars, count);
+	}
+	count = max;
+	if (format->methods.crypt_all(&count, NULL) != count) {
+		result = "crypt_all";
+		goto out;
+	}
+	for (index = 0; index < max; index++) {
+		if (strncmp(format->methods.get_key(index),
+		    rangecand(index, ml), ml + 1)) {
+			sprintf(s_size, "set_key_range(%d), get_key", index);
+			result = s_size;
+			goto out;
+		}
+		hashes[index] = format->methods.get_hash[size](index);
+	}
+
+	format->methods.clear_keys();
+	for (index = 0; index < max; index++)
+		format->methods.set_key(rangecand(index, ml), index);
+	count = max;
+	if (format->methods.crypt_all(&count, NULL) != count) {
+		result = "crypt_all";
+		goto out;
+	}
+	for (index = 0; index < max; index++)
+	if (format->methods.get_hash[size](index) != hashes[index]) {
+		sprintf(s_size, "set_key_range(%d), get_hash[%d]",
+		        index, size);
+		result = s_size;
+		goto out;
+	}
+
+out:
+	MEM_FREE(hashes);
+	format->methods.clear_keys();
+
+	return result;
+}
+
 static char *fmt_self_test_body(struct fmt_main *format,
     void *binary_copy, void *salt_copy)
 {
@@ -487,6 +566,14 @@ static char *fmt_self_test_body(struct fmt_main *format,
 
 		format->methods.set_salt(salt);
 
+		if (format->methods.set_key_range && !done && index == 0 &&
+		    current == format->params.tests && ml > 0) {
+			char *result = fmt_test_key_range(format, max, ml);
+
+			if (result)
+				return result;
+		}
+
 #ifndef BENCH_BUILD
 		if (extra_tests && maxlength == 0) {
 			int min = format->params.min_keys_per_crypt;
@@ -298,6 +298,17 @@ struct fmt_methods {
 
 /* Compares an ASCII ciphertext against a particular crypt_all() output */
 	int (*cmp_exact)(char *source, int index);
+
+/* Optional, NULL if not supported.  Sets count plaintexts at indices index to
+ * index + count - 1, all equal to key except for the character at position
+ * pos, which takes the values chars[0] to chars[count - 1] in turn.  This is
+ * the same as that many set_key() calls, but lets the format lay the keys out
+ * directly in its (possibly interleaved SIMD) key buffer.  Used by mask mode
+ * for the fastest-changing placeholder.  key is longer than pos characters,
+ * none of chars[] is zero and index + count is at most max_keys_per_crypt.
+ * get_key() must work for these indices just like after set_key(). */
+	void (*set_key_range)(char *key, int index, int pos,
+	    unsigned char *chars, int count);
 };
 
 /*
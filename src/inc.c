@@ -8,6 +8,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "arch.h"
 #include "misc.h"
@@ -70,6 +73,21 @@ static int counts[CHARSET_LENGTH][CHARSET_LENGTH];
 static unsigned int real_count, real_minc, real_min, real_max, real_size;
 static unsigned char real_chars[CHARSET_SIZE];
 
+/*
+ * Block of candidates generated by several threads: each thread's share
+ * starts at its own numbers[], and the one being tried is block_index keys
+ * after block_start.
+ */
+static int block_threads;
+static char *block_keys;
+static unsigned char (*block_starts)[CHARSET_LENGTH];
+static int *block_counts;
+static unsigned char *block_start;
+static unsigned int block_fixed, block_index;
+
+static int inc_advance(unsigned char *numbers, unsigned int length,
+	unsigned int fixed, unsigned int n);
+
 static void save_state(FILE *file)
 {
 	unsigned int pos;
@@ -105,9 +123,14 @@ static int restore_state(FILE *file)
 
 static void fix_state(void)
 {
+	if (block_start) {
+		memcpy(numbers, block_start, length + 1);
+		inc_advance(numbers, length, block_fixed, block_index);
+	}
+
 	rec_entry = entry;
 	rec_length = length;
-	memcpy(rec_numbers, numbers, length);
+	memcpy(rec_numbers, numbers, length + 1);
 }
 
 static void inc_format_error(char *charset)
@@ -405,6 +428,144 @@ update_last:
 	return 0;
 }
 
+/*
+ * Moves numbers[] forward by n candidates, returning non-zero if that's past
+ * the last one for this length and fixed position.
+ */
+static int inc_advance(unsigned char *numbers, unsigned int length,
+	unsigned int fixed, unsigned int n)
+{
+	unsigned long long carry = n;
+	int pos;
+
+	for (pos = length; carry && pos >= 0; pos--) {
+		unsigned int radix = counts[length][pos] + 1;
+
+		if (pos == fixed)
+			continue;
+		carry += numbers[pos];
+		numbers[pos] = carry % radix;
+		carry /= radix;
+	}
+
+	return carry != 0;
+}
+
+/*
+ * Generates up to n candidates starting at numbers[] into keys, spaced
+ * length + 2 apart.  Returns the number generated, which is less than n if
+ * the last one has been reached.
+ */
+static int inc_key_block(char *keys, unsigned char *start, int n,
+	int length, int fixed,
+	char *char1, char2_table char2, chars_table *chars)
+{
+	unsigned char numbers[CHARSET_LENGTH];
+	int *counts_length = counts[length];
+	char *key = keys;
+	int i, pos;
+
+	memcpy(numbers, start, length + 1);
+
+	pos = 0;
+	for (i = 0; i < n; i++, key += length + 2) {
+		if (i)
+			memcpy(key, key - (length + 2), pos);
+		for (; pos <= length; pos++) {
+			if (pos == 0)
+				key[0] = char1[numbers[0]];
+			else if (pos == 1)
+				key[1] = (*char2)[ARCH_INDEX(key[0]) -
+				    CHARSET_MIN][numbers[1]];
+			else
+				key[pos] = (*chars[pos - 2])
+				    [ARCH_INDEX(key[pos - 2]) - CHARSET_MIN]
+				    [ARCH_INDEX(key[pos - 1]) - CHARSET_MIN]
+				    [numbers[pos]];
+		}
+		key[length + 1] = 0;
+
+		for (pos = length; pos >= 0; pos--) {
+			if (pos == fixed)
+				continue;
+			if (++numbers[pos] <= counts_length[pos])
+				break;
+			numbers[pos] = 0;
+		}
+		if (pos < 0)
+			return i + 1;
+	}
+
+	return n;
+}
+
+/*
+ * Same as inc_key_loop(), with the candidates generated by block_threads
+ * threads at a time, each taking a consecutive share of the block.
+ */
+static int inc_key_loop_mt(int length, int fixed, int count,
+	char *char1, char2_table char2, chars_table *chars)
+{
+	char key_e[PLAINTEXT_BUFFER_SIZE];
+	char *key;
+	unsigned char next[CHARSET_LENGTH];
+	int share = INC_BLOCK_SIZE / block_threads;
+	int threads, last, t, i;
+
+	numbers[fixed] = count;
+	block_fixed = fixed;
+	memcpy(next, numbers, length + 1);
+
+	do {
+		memcpy(block_starts[0], next, length + 1);
+		last = 0;
+		for (threads = 1; threads < block_threads; threads++) {
+			memcpy(block_starts[threads], block_starts[threads - 1],
+			    length + 1);
+			if ((last = inc_advance(block_starts[threads], length,
+			    fixed, share)))
+				break;
+		}
+		if (!last) {
+			memcpy(next, block_starts[threads - 1], length + 1);
+			last = inc_advance(next, length, fixed, share);
+		}
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+		for (t = 0; t < threads; t++)
+			block_counts[t] = inc_key_block(
+			    &block_keys[t * share * (length + 2)],
+			    block_starts[t], share,
+			    length, fixed, char1, char2, chars);
+
+		for (t = 0; t < threads; t++) {
+			block_start = block_starts[t];
+			key = &block_keys[t * share * (length + 2)];
+			for (i = 0; i < block_counts[t];
+			    i++, key += length + 2) {
+				block_index = i;
+				if (options.mask) {
+					if (do_mask_crack(key))
+						return 1;
+				} else
+				if (!f_filter || ext_filter_body(key, key_e))
+					if (crk_process_key(f_filter ?
+					    key_e : key))
+						return 1;
+			}
+		}
+	} while (!last);
+
+/* Leave numbers[] at the last candidate, as inc_key_loop() does */
+	memcpy(numbers, block_start, length + 1);
+	inc_advance(numbers, length, fixed, block_index);
+	block_start = NULL;
+
+	return 0;
+}
+
 void do_incremental_crack(struct db_main *db, char *mode)
 {
 	char *charset;
@@ -699,6 +860,22 @@ void do_incremental_crack(struct db_main *db, char *mode)
 
 	memcpy(numbers, rec_numbers, sizeof(numbers));
 
+	block_threads = 1;
+#ifdef _OPENMP
+	block_threads = omp_get_max_threads();
+	if (block_threads > INC_BLOCK_SIZE)
+		block_threads = INC_BLOCK_SIZE;
+#endif
+	if (block_threads > 1) {
+		block_keys = mem_alloc(INC_BLOCK_SIZE * (CHARSET_LENGTH + 2));
+		block_starts = mem_alloc(block_threads *
+		    sizeof(*block_starts));
+		block_counts = mem_alloc(block_threads *
+		    sizeof(*block_counts));
+		log_event("- Generating candidates with %d threads",
+		    block_threads);
+	}
+
 	crk_init(db, fix_state, NULL);
 
 	last_count = last_length = -1;
@@ -778,6 +955,11 @@ void do_incremental_crack(struct db_main *db, char *mode)
 		log_event("- Trying length %d, fixed @%d, character count %d",
 		    length + 1, fixed + 1, counts[length][fixed] + 1);
 
+		if (block_threads > 1) {
+			if (inc_key_loop_mt(length, fixed, count,
+			    char1, char2, chars))
+				break;
+		} else
 		if (inc_key_loop(length, fixed, count, char1, char2, chars))
 			break;
 	}
@@ -798,6 +980,9 @@ void do_incremental_crack(struct db_main *db, char *mode)
 		MEM_FREE(chars[pos]);
 	MEM_FREE(char2);
 	MEM_FREE(header);
+	MEM_FREE(block_counts);
+	MEM_FREE(block_starts);
+	MEM_FREE(block_keys);
 
 	fclose(file);
 }
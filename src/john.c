@@ -86,10 +86,13 @@ static int john_omp_threads_new;
 #include "charset.h"
 #include "single.h"
 #include "wordlist.h"
+#include "rules.h"
 #include "prince.h"
 #include "inc.h"
 #include "mask.h"
 #include "mkv.h"
+#include "workq.h"
+#include "crackq.h"
 #include "external.h"
 #include "batch.h"
 #include "dynamic.h"
@@ -1140,6 +1143,8 @@ static void john_load(void)
 			/*
 			 * flush before forking, to avoid multple log entries
 			 */
+			workq_init();
+			crackq_init(&database);
 			log_flush();
 			john_fork();
 		}
@@ -1246,6 +1251,11 @@ static void john_init(char *name, int argc, char **argv)
 	john_omp_maybe_adjust_or_fallback(argv);
 #endif
 
+	if (options.rules_test)
+		exit(rules_self_test(options.rules_test) ? 1 : 0);
+	if (options.ext_test)
+		exit(ext_self_test(options.ext_test) ? 1 : 0);
+
 	john_register_all(); /* maybe restricted to one format by options */
 	common_init();
 	sig_init();
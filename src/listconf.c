@@ -135,7 +135,8 @@ static void listconf_list_method_names()
 	puts("init, done, reset, prepare, valid, split, binary, salt,");
 #endif
 	puts("source, binary_hash, salt_hash, salt_compare, set_salt, set_key, get_key,");
-	puts("clear_keys, crypt_all, get_hash, cmp_all, cmp_one, cmp_exact");
+	puts("clear_keys, crypt_all, get_hash, cmp_all, cmp_one, cmp_exact,");
+	puts("set_key_range");
 }
 
 static void listconf_list_build_info(void)
@@ -703,7 +704,8 @@ void listconf_parse_late(void)
 				         strcasecmp(&options.listconf[15], "binary_hash[5]") &&
 					 strcasecmp(&options.listconf[15], "binary_hash[6]") &&
 				         strcasecmp(&options.listconf[15], "salt_hash") &&
-				         strcasecmp(&options.listconf[15], "salt_compare"))
+				         strcasecmp(&options.listconf[15], "salt_compare") &&
+				         strcasecmp(&options.listconf[15], "set_key_range"))
 				{
 					fprintf(stderr, "Error, invalid option (invalid method name) %s\n", options.listconf);
 					fprintf(stderr, "Valid method names are:\n");
@@ -765,6 +767,8 @@ void listconf_parse_late(void)
 					ShowIt = 1;
 				if (format->methods.set_salt != fmt_default_set_salt && !strcasecmp(&options.listconf[15], "set_salt"))
 					ShowIt = 1;
+				if (format->methods.set_key_range != NULL && !strcasecmp(&options.listconf[15], "set_key_range"))
+					ShowIt = 1;
 			}
 			if (ShowIt) {
 				int i;
@@ -826,6 +830,9 @@ void listconf_parse_late(void)
 				printf("\tcmp_one()\n");
 // there is no default for cmp_exact() it must be defined.
 				printf("\tcmp_exact()\n");
+/* set_key_range is optional, NULL if not supported */
+				if (format->methods.set_key_range != NULL)
+					printf("\tset_key_range()\n");
 				printf("\n\n");
 			}
 			if (format->params.flags & FMT_DYNAMIC)
@@ -9,6 +9,8 @@
 #endif
 
 #define LDR_WARN_AMBIGUOUS
+#define NEED_OS_FORK
+#define NEED_OS_FLOCK
 
 #include <stdio.h>
 // needs to be above sys/stat.h for mingw, if -std=c99 used.
@@ -21,6 +23,12 @@
 #ifdef _MSC_VER
 #define S_ISDIR(a) ((a) & _S_IFDIR)
 #endif
+#if (!AC_BUILT || HAVE_SYS_FILE_H)
+#include <sys/file.h>
+#endif
+#if (!AC_BUILT || HAVE_FCNTL_H)
+#include <fcntl.h>
+#endif
 #include <errno.h>
 #include <string.h>
 #include <ctype.h>
@@ -44,6 +52,19 @@
 #include "cracker.h"
 #include "config.h"
 #include "logger.h" /* Beware: log_init() happens after most functions here */
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#if OS_FORK && defined(HAVE_MMAP)
+#define LDR_WORKERS			1
+#include <signal.h>
+#include <sys/wait.h>
+#else
+#define LDR_WORKERS			0
+#endif
+
 #include "memdbg.h"
 
 #ifdef HAVE_CRYPT
@@ -69,6 +90,14 @@ int ldr_in_pot = 0;
 
 static char *no_username = "?";
 static int pristine_gecos;
+static int skip_dupe_checking;
+
+/*
+ * Set in loader worker processes, which report other hash types seen in
+ * ldr_worker_alt instead of printing a warning themselves.
+ */
+static int ldr_worker;
+static struct fmt_main *ldr_worker_alt;
 
 /* There should be legislation against adding a BOM to UTF-8 */
 static char *skip_bom(char *string)
@@ -78,6 +107,38 @@ static char *skip_bom(char *string)
 	return string;
 }
 
+/*
+ * Returns non-zero (the kind of warning to print) if the line doesn't look
+ * like it's in the encoding we expect.
+ */
+static int check_encoding(char *line, int bom, int flags)
+{
+	char *u8check;
+
+	if (!(flags & RF_ALLOW_MISSING) ||
+	    !(u8check = strchr(line, options.loader.field_sep_char)))
+		u8check = line;
+
+	if (((flags & RF_ALLOW_MISSING) && pers_opts.store_utf8) ||
+	    ((flags & RF_ALLOW_DIR) && pers_opts.input_enc == UTF_8)) {
+		if (!valid_utf8((UTF8*)u8check))
+			return 1;
+	} else if (pers_opts.input_enc != UTF_8 &&
+	           (bom || valid_utf8((UTF8*)u8check) > 1))
+		return 2;
+
+	return 0;
+}
+
+static void warn_encoding(int kind, char *name)
+{
+	if (kind == 1)
+		fprintf(stderr, "Warning: invalid UTF-8 seen reading %s\n",
+		        name);
+	else
+		fprintf(stderr, "Warning: UTF-8 seen reading %s\n", name);
+}
+
 static void read_file(struct db_main *db, char *name, int flags,
 	void (*process_line)(struct db_main *db, char *line))
 {
@@ -108,28 +169,12 @@ static void read_file(struct db_main *db, char *name, int flags,
 		line = skip_bom(line_buf);
 
 		if (warn) {
-			char *u8check;
-
-			if (!(flags & RF_ALLOW_MISSING) ||
-			    !(u8check =
-			      strchr(line, options.loader.field_sep_char)))
-				u8check = line;
-
-			if (((flags & RF_ALLOW_MISSING) &&
-			     pers_opts.store_utf8) ||
-			    ((flags & RF_ALLOW_DIR) &&
-			     pers_opts.input_enc == UTF_8)) {
-				if (!valid_utf8((UTF8*)u8check)) {
-					warn = 0;
-					fprintf(stderr, "Warning: invalid UTF-8"
-					        " seen reading %s\n", name);
-				}
-			} else if (pers_opts.input_enc != UTF_8 &&
-			           (line != line_buf ||
-			            valid_utf8((UTF8*)u8check) > 1)) {
+			int kind = check_encoding(line, line != line_buf,
+			                          flags);
+
+			if (kind) {
 				warn = 0;
-				fprintf(stderr, "Warning: UTF-8 seen reading "
-				        "%s\n", name);
+				warn_encoding(kind, name);
 			}
 		}
 		process_line(db, line);
@@ -205,11 +250,105 @@ static void ldr_init_password_hash(struct db_main *db)
 	if (size < 0)
 		size = 0;
 	db->password_hash_func = func;
-	size = password_hash_sizes[size] * sizeof(struct db_password *);
+	size = password_hash_sizes[size] * sizeof(struct db_password_link *);
 	db->password_hash = mem_alloc(size);
 	memset(db->password_hash, 0, size);
 }
 
+/*
+ * Entries of the loader's own hash table are allocated in these blocks, so
+ * that they can all be freed along with the table once loading is complete.
+ */
+#define LDR_LINK_BLOCK_SIZE		0x8000
+
+struct ldr_link_block {
+	struct ldr_link_block *next;
+	int used;
+	struct db_password_link links[LDR_LINK_BLOCK_SIZE];
+};
+
+static struct ldr_link_block *ldr_link_blocks;
+
+static struct db_password_link *ldr_alloc_link(void)
+{
+	struct ldr_link_block *block = ldr_link_blocks;
+
+	if (!block || block->used >= LDR_LINK_BLOCK_SIZE) {
+		block = mem_alloc(sizeof(*block));
+		block->next = ldr_link_blocks;
+		block->used = 0;
+		ldr_link_blocks = block;
+	}
+
+	return &block->links[block->used++];
+}
+
+static void ldr_free_password_hash(struct db_main *db)
+{
+	struct ldr_link_block *block;
+
+	while ((block = ldr_link_blocks)) {
+		ldr_link_blocks = block->next;
+		MEM_FREE(block);
+	}
+
+	MEM_FREE(db->password_hash);
+}
+
+/*
+ * Binary ciphertexts are kept in these blocks while loading.  Once the
+ * per-salt hash tables are built, the binaries are moved into those (or into
+ * per-salt arrays for salts without a hash table) and the blocks are freed.
+ */
+#define LDR_BINARY_BLOCK_SIZE		0x100000
+
+struct ldr_binary_block {
+	struct ldr_binary_block *next;
+	size_t used;
+};
+
+static struct ldr_binary_block *ldr_binary_blocks;
+
+static void *ldr_alloc_binary(void *binary, size_t size, size_t align)
+{
+	struct ldr_binary_block *block = ldr_binary_blocks;
+	size_t block_size = LDR_BINARY_BLOCK_SIZE;
+	char *p = NULL;
+
+	if (align < MEM_ALIGN_WORD)
+		align = MEM_ALIGN_WORD;
+
+	if (block) {
+		p = (char *)(((size_t)block + block->used + align - 1) &
+		    ~(align - 1));
+		if (p + size > (char *)block + block_size)
+			p = NULL;
+	}
+
+	if (!p) {
+		if (block_size < sizeof(*block) + align + size)
+			block_size = sizeof(*block) + align + size;
+		block = mem_alloc(block_size);
+		block->next = ldr_binary_blocks;
+		ldr_binary_blocks = block;
+		p = (char *)(((size_t)(block + 1) + align - 1) & ~(align - 1));
+	}
+
+	block->used = p + size - (char *)block;
+
+	return memcpy(p, binary, size);
+}
+
+static void ldr_free_binaries(void)
+{
+	struct ldr_binary_block *block;
+
+	while ((block = ldr_binary_blocks)) {
+		ldr_binary_blocks = block->next;
+		MEM_FREE(block);
+	}
+}
+
 static char *ldr_get_field(char **ptr, char field_sep_char)
 {
 	static char *last;
@@ -324,6 +463,19 @@ static void ldr_set_encoding(struct fmt_main *format)
 	initUnicode(UNICODE_UNICODE);
 }
 
+static void ldr_warn_alt(struct fmt_main *format, struct fmt_main *alt)
+{
+	if (john_main_process)
+	fprintf(stderr,
+	    "Warning: only loading hashes of type "
+	    "\"%s\", but also saw type \"%s\"\n"
+	    "Use the \"--format=%s\" option to force "
+	    "loading hashes of that type instead\n",
+	    format->params.label,
+	    alt->params.label,
+	    alt->params.label);
+}
+
 static int ldr_split_line(char **login, char **ciphertext,
 	char **gecos, char **home,
 	char *source, struct fmt_main **format,
@@ -484,15 +636,10 @@ static int ldr_split_line(char **login, char **ciphertext,
 			prepared = alt->methods.prepare(fields, alt);
 			if (alt->methods.valid(prepared, alt)) {
 				alt->params.flags |= FMT_WARNED;
-				if (john_main_process)
-				fprintf(stderr,
-				    "Warning: only loading hashes of type "
-				    "\"%s\", but also saw type \"%s\"\n"
-				    "Use the \"--format=%s\" option to force "
-				    "loading hashes of that type instead\n",
-				    (*format)->params.label,
-				    alt->params.label,
-				    alt->params.label);
+				if (ldr_worker)
+					ldr_worker_alt = alt;
+				else
+					ldr_warn_alt(*format, alt);
 				break;
 			}
 		} while ((alt = alt->next));
@@ -620,33 +767,25 @@ static struct list_main *ldr_init_words(char *login, char *gecos, char *home)
 	return words;
 }
 
-static void ldr_load_pw_line(struct db_main *db, char *line)
+/*
+ * Adds one piece of a (possibly split) ciphertext to the database, unless it's
+ * a duplicate.  Returns zero if the rest of the pieces should be skipped.
+ */
+static int ldr_load_pw_piece(struct db_main *db, int index, int count,
+	char *piece, void *binary, char **login, char *gecos, char *home,
+	struct list_main **words)
 {
-	static int skip_dupe_checking = 0;
-	struct fmt_main *format;
-	int index, count;
-	char *login, *ciphertext, *gecos, *home;
-	char *piece;
-	void *binary, *salt;
+	struct fmt_main *format = db->format;
+	void *salt;
 	int salt_hash, pw_hash;
 	struct db_salt *current_salt, *last_salt;
 	struct db_password *current_pw, *last_pw;
-	struct list_main *words;
+	struct db_password_link *link;
 	size_t pw_size, salt_size;
 #if FMT_MAIN_VERSION > 11
 	int i;
 #endif
 
-	count = ldr_split_line(&login, &ciphertext, &gecos, &home,
-		NULL, &db->format, db->options, line);
-	if (count <= 0) return;
-	if (count >= 2) db->options->flags |= DB_SPLIT;
-
-	format = db->format;
-	dyna_salt_init(format);
-
-	words = NULL;
-
 	if (db->options->flags & DB_WORDS) {
 		pw_size = sizeof(struct db_password);
 		salt_size = sizeof(struct db_salt);
@@ -661,176 +800,593 @@ static void ldr_load_pw_line(struct db_main *db, char *line)
 			sizeof(struct db_keys *);
 	}
 
-	if (!db->password_hash) {
-		ldr_init_password_hash(db);
-		if (cfg_get_bool(SECTION_OPTIONS, NULL,
-		                 "NoLoaderDupeCheck", 0)) {
-			skip_dupe_checking = 1;
+	pw_hash = db->password_hash_func(binary);
+
+	if (options.flags & FLG_REJECT_PRINTABLE) {
+		int i = 0;
+
+		while (isprint((int)((unsigned char*)binary)[i]) &&
+		       i < format->params.binary_size)
+			i++;
+
+		if (i == format->params.binary_size) {
 			if (john_main_process)
-				fprintf(stderr, "No dupe-checking performed "
-				        "when loading hashes.\n");
+			fprintf(stderr, "rejecting printable binary"
+			        " \"%.*s\" (%s)\n",
+			        format->params.binary_size,
+			        (char*)binary, piece);
+			return 0;
 		}
 	}
 
+	if (!(db->options->flags & DB_WORDS) && !skip_dupe_checking) {
+		int collisions = 0;
+		if ((link = db->password_hash[pw_hash]))
+		do {
+			current_pw = link->pw;
+			if (!memcmp(binary, current_pw->binary,
+			    format->params.binary_size) &&
+			    !strcmp(piece, format->methods.source(
+			    current_pw->source, current_pw->binary))) {
+				db->options->flags |= DB_NODUP;
+				break;
+			}
+			if (++collisions <= LDR_HASH_COLLISIONS_MAX)
+				continue;
+
+			if (john_main_process) {
+				if (format->params.binary_size)
+				fprintf(stderr, "Warning: "
+				    "excessive partial hash "
+				    "collisions detected\n%s",
+				    db->password_hash_func !=
+				    fmt_default_binary_hash ? "" :
+				    "(cause: the \"format\" lacks "
+				    "proper binary_hash() function "
+				    "definitions)\n");
+				else
+				fprintf(stderr, "Warning: "
+				    "check for duplicates partially "
+				    "bypassed to speedup loading\n");
+			}
+			skip_dupe_checking = 1;
+			link = NULL; /* no match */
+			break;
+		} while ((link = link->next));
+
+		if (link) return 1;
+	}
+
+	salt = format->methods.salt(piece);
+	dyna_salt_create(salt);
+	salt_hash = format->methods.salt_hash(salt);
+
+	if ((current_salt = db->salt_hash[salt_hash])) {
+		do {
+			if (!dyna_salt_cmp(current_salt->salt, salt, format->params.salt_size))
+				break;
+		}  while ((current_salt = current_salt->next));
+	}
+
+	if (!current_salt) {
+		last_salt = db->salt_hash[salt_hash];
+		current_salt = db->salt_hash[salt_hash] =
+			mem_alloc_tiny(salt_size, MEM_ALIGN_WORD);
+		current_salt->next = last_salt;
+
+		current_salt->salt = mem_alloc_copy(salt,
+			format->params.salt_size,
+			format->params.salt_align);
+
+#if FMT_MAIN_VERSION > 11
+		for (i = 0; i < FMT_TUNABLE_COSTS && format->methods.tunable_cost_value[i] != NULL; ++i)
+			current_salt->cost[i] = format->methods.tunable_cost_value[i](current_salt->salt);
+#endif
+
+		current_salt->index = fmt_dummy_hash;
+		current_salt->bitmap = NULL;
+		current_salt->prefilter_levels = 0;
+		current_salt->list = NULL;
+		current_salt->hash = &current_salt->list;
+		current_salt->hash_size = -1;
+
+		current_salt->count = 0;
+
+		if (db->options->flags & DB_WORDS)
+			current_salt->keys = NULL;
+
+		db->salt_count++;
+	} else
+		dyna_salt_remove(salt);
+
+	current_salt->count++;
+	db->password_count++;
+
+	last_pw = current_salt->list;
+	current_pw = current_salt->list = mem_alloc_tiny(
+		pw_size, MEM_ALIGN_WORD);
+	current_pw->next = last_pw;
+
+	link = ldr_alloc_link();
+	link->pw = current_pw;
+	link->next = db->password_hash[pw_hash];
+	db->password_hash[pw_hash] = link;
+
+/* If we're not going to use the source field for its usual purpose, see if we
+ * can pack the binary value in it. */
+	if (format->methods.source != fmt_default_source &&
+	    sizeof(current_pw->source) >= format->params.binary_size)
+		current_pw->binary = memcpy(&current_pw->source,
+			binary, format->params.binary_size);
+	else
+		current_pw->binary = ldr_alloc_binary(binary,
+			format->params.binary_size,
+			format->params.binary_align);
+
+	if (format->methods.source == fmt_default_source)
+		current_pw->source = str_alloc_copy(piece);
+
+	if (db->options->flags & DB_WORDS) {
+		if (!*words)
+			*words = ldr_init_words(*login, gecos, home);
+		current_pw->words = *words;
+	}
+
+	if (db->options->flags & DB_LOGIN) {
+		if (*login != no_username && index == 0)
+			*login = ldr_conv(*login);
+
+		if (count >= 2 && count <= 9) {
+			current_pw->login = mem_alloc_tiny(
+				strlen(*login) + 3, MEM_ALIGN_NONE);
+			sprintf(current_pw->login, "%s:%d",
+				*login, index + 1);
+		} else
+		if (*login == no_username)
+			current_pw->login = *login;
+		else
+		if (*words && **login)
+			current_pw->login = (*words)->head->data;
+		else
+			current_pw->login = str_alloc_copy(*login);
+	}
+
+	return 1;
+}
+
+/*
+ * Allocates the loader's own hash table along with the first hash loaded.
+ */
+static void ldr_init_load(struct db_main *db)
+{
+	if (db->password_hash)
+		return;
+
+	ldr_init_password_hash(db);
+	if (cfg_get_bool(SECTION_OPTIONS, NULL, "NoLoaderDupeCheck", 0)) {
+		skip_dupe_checking = 1;
+		if (john_main_process)
+			fprintf(stderr, "No dupe-checking performed "
+			        "when loading hashes.\n");
+	}
+}
+
+static void ldr_load_pw_line(struct db_main *db, char *line)
+{
+	struct fmt_main *format;
+	int index, count;
+	char *login, *ciphertext, *gecos, *home;
+	char *piece;
+	void *binary;
+	struct list_main *words;
+
+	count = ldr_split_line(&login, &ciphertext, &gecos, &home,
+		NULL, &db->format, db->options, line);
+	if (count <= 0) return;
+	if (count >= 2) db->options->flags |= DB_SPLIT;
+
+	format = db->format;
+	dyna_salt_init(format);
+
+	words = NULL;
+
+	ldr_init_load(db);
+
 	for (index = 0; index < count; index++) {
 		piece = format->methods.split(ciphertext, index, format);
-
 		binary = format->methods.binary(piece);
-		pw_hash = db->password_hash_func(binary);
 
-		if (options.flags & FLG_REJECT_PRINTABLE) {
-			int i = 0;
+		if (!ldr_load_pw_piece(db, index, count, piece, binary,
+		    &login, gecos, home, &words))
+			break;
+	}
+}
+
+#if LDR_WORKERS
+/*
+ * Gets the next line from a memory mapped file into a buffer of
+ * LINE_BUFFER_SIZE bytes, splitting lines exactly like fgets() would.
+ */
+static char *ldr_map_line(char **pos, char *end, char *line_buf)
+{
+	char *eol;
+	size_t len;
+
+	if (*pos >= end)
+		return NULL;
 
-			while (isprint((int)((unsigned char*)binary)[i]) &&
-			       i < format->params.binary_size)
-				i++;
+	len = end - *pos;
+	if (len > LINE_BUFFER_SIZE - 1)
+		len = LINE_BUFFER_SIZE - 1;
+	if ((eol = memchr(*pos, '\n', len)))
+		len = eol - *pos + 1;
 
-			if (i == format->params.binary_size) {
-				if (john_main_process)
-				fprintf(stderr, "rejecting printable binary"
-				        " \"%.*s\" (%s)\n",
-				        format->params.binary_size,
-				        (char*)binary, piece);
-				break;
-			}
-		}
+	memcpy(line_buf, *pos, len);
+	line_buf[len] = 0;
+	*pos += len;
 
-		if (!(db->options->flags & DB_WORDS) && !skip_dupe_checking) {
-			int collisions = 0;
-			if ((current_pw = db->password_hash[pw_hash]))
-			do {
-				if (!memcmp(binary, current_pw->binary,
-				    format->params.binary_size) &&
-				    !strcmp(piece, format->methods.source(
-				    current_pw->source, current_pw->binary))) {
-					db->options->flags |= DB_NODUP;
-					break;
+	return line_buf;
+}
+
+static void ldr_worker_put(FILE *file, void *data, size_t size)
+{
+	if (size && fwrite(data, size, 1, file) != 1)
+		_exit(1);
+}
+
+static void ldr_worker_put_int(FILE *file, char type, int value)
+{
+	ldr_worker_put(file, &type, 1);
+	ldr_worker_put(file, &value, sizeof(value));
+}
+
+static void ldr_worker_put_str(FILE *file, char *str)
+{
+	int len = (str == no_username) ? -1 : strlen(str);
+
+	ldr_worker_put(file, &len, sizeof(len));
+	if (len > 0)
+		ldr_worker_put(file, str, len);
+}
+
+static void ldr_worker_failed(void)
+{
+	fprintf(stderr, "Loader worker process failed\n");
+	error();
+}
+
+static void ldr_worker_get(FILE *file, void *data, size_t size)
+{
+	if (size && fread(data, size, 1, file) != 1)
+		ldr_worker_failed();
+}
+
+static char *ldr_worker_get_str(FILE *file, char **buf, size_t *size)
+{
+	int len;
+
+	ldr_worker_get(file, &len, sizeof(len));
+	if (len < 0)
+		return no_username;
+
+	if (len >= *size) {
+		MEM_FREE(*buf);
+		*size = len + LINE_BUFFER_SIZE;
+		*buf = mem_alloc(*size);
+	}
+	ldr_worker_get(file, *buf, len);
+	(*buf)[len] = 0;
+
+	return *buf;
+}
+
+/*
+ * Worker process: runs prepare(), valid(), split() and binary() on its share
+ * of the chunks and writes the results to its temporary file for the main
+ * process, which does all of the rest (dupe checking, salt(), and the actual loading) in file order.
+ * The format methods may return pointers to static buffers, which is why we
+ * use processes rather than threads for this.  On the other hand, anything
+ * that valid() or split() keep in static variables from one line to the next
+ * is only seen by the worker that set it, and lost to the main process.
+ */
+static void ldr_worker_main(struct db_main *db, FILE *file,
+	char **chunks, int chunk_count, int first, int step, int warn)
+{
+	struct fmt_main *format = db->format;
+	char line_buf[LINE_BUFFER_SIZE], *line;
+	int chunk;
+
+	ldr_worker = 1;
+
+	for (chunk = first; chunk < chunk_count; chunk += step) {
+		char *pos = chunks[chunk];
+
+		while (ldr_map_line(&pos, chunks[chunk + 1], line_buf)) {
+			char *login, *ciphertext, *gecos, *home;
+			int index, count;
+
+			line = skip_bom(line_buf);
+
+			if (warn) {
+				int kind = check_encoding(line,
+				    line != line_buf, RF_ALLOW_DIR);
+
+				if (kind) {
+					warn = 0;
+					ldr_worker_put_int(file, 'W', kind);
 				}
-				if (++collisions <= LDR_HASH_COLLISIONS_MAX)
-					continue;
+			}
 
-				if (john_main_process) {
-					if (format->params.binary_size)
-					fprintf(stderr, "Warning: "
-					    "excessive partial hash "
-					    "collisions detected\n%s",
-					    db->password_hash_func !=
-					    fmt_default_binary_hash ? "" :
-					    "(cause: the \"format\" lacks "
-					    "proper binary_hash() function "
-					    "definitions)\n");
-					else
-					fprintf(stderr, "Warning: "
-					    "check for duplicates partially "
-					    "bypassed to speedup loading\n");
+			count = ldr_split_line(&login, &ciphertext,
+			    &gecos, &home, NULL, &db->format, db->options,
+			    line);
+
+			if (ldr_worker_alt) {
+				struct fmt_main *alt = fmt_list;
+
+				index = 0;
+				while (alt != ldr_worker_alt) {
+					alt = alt->next;
+					index++;
 				}
-				skip_dupe_checking = 1;
-				current_pw = NULL; /* no match */
-				break;
-			} while ((current_pw = current_pw->next_hash));
+				ldr_worker_put_int(file, 'F', index);
+				ldr_worker_alt = NULL;
+			}
 
-			if (current_pw) continue;
-		}
+			if (count <= 0)
+				continue;
 
-		salt = format->methods.salt(piece);
-		dyna_salt_create(salt);
-		salt_hash = format->methods.salt_hash(salt);
+			ldr_worker_put_int(file, 'L', count);
+			ldr_worker_put_str(file, login);
+			ldr_worker_put_str(file, gecos);
+			ldr_worker_put_str(file, home);
 
-		if ((current_salt = db->salt_hash[salt_hash])) {
-			do {
-				if (!dyna_salt_cmp(current_salt->salt, salt, format->params.salt_size))
-					break;
-			}  while ((current_salt = current_salt->next));
+			for (index = 0; index < count; index++) {
+				char *piece;
+				void *binary;
+
+				piece = format->methods.split(ciphertext,
+				    index, format);
+				binary = format->methods.binary(piece);
+
+				ldr_worker_put_str(file, piece);
+				ldr_worker_put(file, binary,
+				    format->params.binary_size);
+			}
 		}
 
-		if (!current_salt) {
-			last_salt = db->salt_hash[salt_hash];
-			current_salt = db->salt_hash[salt_hash] =
-				mem_alloc_tiny(salt_size, MEM_ALIGN_WORD);
-			current_salt->next = last_salt;
+		ldr_worker_put(file, "E", 1);
+	}
+
+	if (fclose(file))
+		_exit(1);
+	_exit(0);
+}
 
-			current_salt->salt = mem_alloc_copy(salt,
-				format->params.salt_size,
-				format->params.salt_align);
+/*
+ * Loads the rest of a memory mapped password file using worker processes.
+ */
+static void ldr_load_pw_workers(struct db_main *db, char *name,
+	char *pos, char *end, int workers, int warn)
+{
+	struct fmt_main *format = db->format;
+	char **chunks, *login_buf, *gecos_buf, *home_buf, *piece_buf;
+	size_t login_size, gecos_size, home_size, piece_size;
+	void *binary;
+	FILE **files;
+	int *pids;
+	int chunk_count, chunk, i;
+
+	chunk_count = (end - pos + LDR_WORKERS_CHUNK_SIZE - 1) /
+		LDR_WORKERS_CHUNK_SIZE;
+	chunks = mem_alloc((chunk_count + 1) * sizeof(*chunks));
+
+/* Move the chunk boundaries to line starts */
+	chunks[0] = pos;
+	for (chunk = 1; chunk < chunk_count; chunk++) {
+		char *p = pos + (size_t)chunk * LDR_WORKERS_CHUNK_SIZE;
+
+		if (p < chunks[chunk - 1])
+			p = chunks[chunk - 1];
+		if ((p = memchr(p, '\n', end - p)))
+			chunks[chunk] = p + 1;
+		else
+			chunks[chunk] = end;
+	}
+	chunks[chunk_count] = end;
 
-#if FMT_MAIN_VERSION > 11
-			for (i = 0; i < FMT_TUNABLE_COSTS && format->methods.tunable_cost_value[i] != NULL; ++i)
-				current_salt->cost[i] = format->methods.tunable_cost_value[i](current_salt->salt);
-#endif
+	if (workers > chunk_count)
+		workers = chunk_count;
 
-			current_salt->index = fmt_dummy_hash;
-			current_salt->bitmap = NULL;
-			current_salt->list = NULL;
-			current_salt->hash = &current_salt->list;
-			current_salt->hash_size = -1;
+	files = mem_alloc(workers * sizeof(*files));
+	pids = mem_alloc(workers * sizeof(*pids));
 
-			current_salt->count = 0;
+	fflush(stdout);
+	fflush(stderr);
 
-			if (db->options->flags & DB_WORDS)
-				current_salt->keys = NULL;
+/*
+ * Each worker spools its results to a temporary file of its own rather than
+ * to a pipe, so that it never has to wait for the main process to get to its
+ * chunks.  We only start merging once all of the workers are done.
+ */
+	for (i = 0; i < workers; i++) {
+		if (!(files[i] = tmpfile()))
+			pexit("tmpfile");
+
+		switch ((pids[i] = fork())) {
+		case -1:
+			pexit("fork");
+
+		case 0:
+			signal(SIGINT, SIG_IGN);
+			ldr_worker_main(db, files[i], chunks, chunk_count,
+			    i, workers, warn);
+		}
+	}
 
-			db->salt_count++;
-		} else
-			dyna_salt_remove(salt);
+	for (i = 0; i < workers; i++) {
+		int status;
 
-		current_salt->count++;
-		db->password_count++;
+		if (waitpid(pids[i], &status, 0) != pids[i] ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			ldr_worker_failed();
+		rewind(files[i]);
+	}
 
-		last_pw = current_salt->list;
-		current_pw = current_salt->list = mem_alloc_tiny(
-			pw_size, MEM_ALIGN_WORD);
-		current_pw->next = last_pw;
+	login_buf = gecos_buf = home_buf = piece_buf = NULL;
+	login_size = gecos_size = home_size = piece_size = 0;
+	binary = mem_alloc_tiny(format->params.binary_size, MEM_ALIGN_SIMD);
 
-		last_pw = db->password_hash[pw_hash];
-		db->password_hash[pw_hash] = current_pw;
-		current_pw->next_hash = last_pw;
+	for (chunk = 0; chunk < chunk_count; chunk++) {
+		FILE *file = files[chunk % workers];
+		char type;
 
-/* If we're not going to use the source field for its usual purpose, see if we
- * can pack the binary value in it. */
-		if (format->methods.source != fmt_default_source &&
-		    sizeof(current_pw->source) >= format->params.binary_size)
-			current_pw->binary = memcpy(&current_pw->source,
-				binary, format->params.binary_size);
-		else
-			current_pw->binary = mem_alloc_copy(binary,
-				format->params.binary_size,
-				format->params.binary_align);
+		while (ldr_worker_get(file, &type, 1), type != 'E') {
+			char *login, *gecos, *home, *piece;
+			struct list_main *words;
+			struct fmt_main *alt;
+			int value, index, skip;
+
+			ldr_worker_get(file, &value, sizeof(value));
+
+			switch (type) {
+			case 'W':
+				if (warn) {
+					warn = 0;
+					warn_encoding(value, name);
+				}
+				break;
 
-		if (format->methods.source == fmt_default_source)
-			current_pw->source = str_alloc_copy(piece);
+			case 'F':
+				alt = fmt_list;
+				while (value--)
+					alt = alt->next;
+				if (!(alt->params.flags & FMT_WARNED)) {
+					alt->params.flags |= FMT_WARNED;
+					ldr_warn_alt(format, alt);
+				}
+				break;
 
-		if (db->options->flags & DB_WORDS) {
-			if (!words)
-				words = ldr_init_words(login, gecos, home);
-			current_pw->words = words;
+			case 'L':
+				login = ldr_worker_get_str(file,
+				    &login_buf, &login_size);
+				gecos = ldr_worker_get_str(file,
+				    &gecos_buf, &gecos_size);
+				home = ldr_worker_get_str(file,
+				    &home_buf, &home_size);
+				if (value >= 2)
+					db->options->flags |= DB_SPLIT;
+
+				words = NULL;
+				skip = 0;
+				for (index = 0; index < value; index++) {
+					piece = ldr_worker_get_str(file,
+					    &piece_buf, &piece_size);
+					ldr_worker_get(file, binary,
+					    format->params.binary_size);
+					if (!skip)
+						skip = !ldr_load_pw_piece(db,
+						    index, value, piece, binary,
+						    &login, gecos, home,
+						    &words);
+				}
+				break;
+
+			default:
+				ldr_worker_failed();
+			}
+
+			check_abort(0);
 		}
+	}
 
-		if (db->options->flags & DB_LOGIN) {
-			if (login != no_username && index == 0)
-				login = ldr_conv(login);
+	for (i = 0; i < workers; i++)
+		fclose(files[i]);
 
-			if (count >= 2 && count <= 9) {
-				current_pw->login = mem_alloc_tiny(
-					strlen(login) + 3, MEM_ALIGN_NONE);
-				sprintf(current_pw->login, "%s:%d",
-					login, index + 1);
-			} else
-			if (login == no_username)
-				current_pw->login = login;
-			else
-			if (words && *login)
-				current_pw->login = words->head->data;
-			else
-				current_pw->login = str_alloc_copy(login);
+	MEM_FREE(piece_buf);
+	MEM_FREE(home_buf);
+	MEM_FREE(gecos_buf);
+	MEM_FREE(login_buf);
+	MEM_FREE(pids);
+	MEM_FREE(files);
+	MEM_FREE(chunks);
+}
+
+/*
+ * Loads a large password file with worker processes, if configured to.
+ * Returns zero (having done nothing) if the file should be read normally.
+ */
+static int ldr_load_pw_parallel(struct db_main *db, char *name)
+{
+	struct stat file_stat;
+	char line_buf[LINE_BUFFER_SIZE], *line;
+	char *map, *pos, *end;
+	size_t size;
+	int fd, workers, warn;
+
+/* Off unless configured, see ldr_worker_main() for why */
+	if ((workers = cfg_get_int(SECTION_OPTIONS, NULL,
+	    "LoaderWorkers")) > LDR_WORKERS_MAX)
+		workers = LDR_WORKERS_MAX;
+	if (workers < 2)
+		return 0;
+
+	if (stat(name, &file_stat) || !S_ISREG(file_stat.st_mode) ||
+	    file_stat.st_size < LDR_WORKERS_MIN_SIZE ||
+	    (size = file_stat.st_size) != file_stat.st_size)
+		return 0;
+
+	if ((fd = open(path_expand(name), O_RDONLY)) < 0)
+		return 0;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	warn = cfg_get_bool(SECTION_OPTIONS, NULL, "WarnEncoding", 0);
+	if (!john_main_process)
+		warn = 0;
+
+	pos = map;
+	end = map + size;
+
+/* Load everything up to and including the first hash ourselves, which also
+ * detects and initializes the format */
+	dyna_salt_init(db->format);
+	while (!db->password_hash && ldr_map_line(&pos, end, line_buf)) {
+		line = skip_bom(line_buf);
+
+		if (warn) {
+			int kind = check_encoding(line, line != line_buf,
+			                          RF_ALLOW_DIR);
+
+			if (kind) {
+				warn = 0;
+				warn_encoding(kind, name);
+			}
 		}
+		ldr_load_pw_line(db, line);
+		check_abort(0);
 	}
+
+	if (pos < end)
+		ldr_load_pw_workers(db, name, pos, end, workers, warn);
+
+	munmap(map, size);
+
+	return 1;
 }
+#endif
 
 void ldr_load_pw_file(struct db_main *db, char *name)
 {
 	pristine_gecos = cfg_get_bool(SECTION_OPTIONS, NULL,
 	        "PristineGecos", 0);
 
+#if LDR_WORKERS
+	if (ldr_load_pw_parallel(db, name))
+		return;
+#endif
 	read_file(db, name, RF_ALLOW_DIR, ldr_load_pw_line);
 }
 
@@ -840,6 +1396,7 @@ static void ldr_load_pot_line(struct db_main *db, char *line)
 	char *ciphertext;
 	void *binary;
 	int hash;
+	struct db_password_link *link;
 	struct db_password *current;
 
 	ciphertext = ldr_get_field(&line, db->options->field_sep_char);
@@ -848,8 +1405,9 @@ static void ldr_load_pot_line(struct db_main *db, char *line)
 	binary = format->methods.binary(ciphertext);
 	hash = db->password_hash_func(binary);
 
-	if ((current = db->password_hash[hash]))
+	if ((link = db->password_hash[hash]))
 	do {
+		current = link->pw;
 		if (options.regen_lost_salts)
 			ldr_pot_possible_fixup_salt(current->source,
 			                            ciphertext);
@@ -861,7 +1419,452 @@ static void ldr_load_pot_line(struct db_main *db, char *line)
 		    format->methods.source(current->source, current->binary)))
 			continue;
 		current->binary = NULL; /* mark for removal */
-	} while ((current = current->next_hash));
+	} while ((link = link->next));
+}
+
+/*
+ * Pot file index.  This is an optional append-only companion to the pot file
+ * (its name with ".idx" appended) holding a hash of the ciphertext field and
+ * the offset of every line in the pot file.  It lets us find the few lines
+ * that may be for the hashes we've loaded without parsing the entire pot file
+ * with the format's methods.  The pot file remains authoritative: lines
+ * appended to it are indexed lazily the next time we load it, and the index
+ * is rebuilt from scratch if the pot file shrank or the last bytes indexed
+ * have changed (so edits elsewhere in the file need the index removed).
+ *
+ * The records start with a section sorted by hash, which we binary search
+ * for each hash we've loaded, followed by records for recently appended lines
+ * in file order, which we scan.  Once there are enough of the latter, they're
+ * merged into the sorted section.
+ *
+ * Only pot lines with the ciphertext exactly as we would write it are found
+ * this way, so this is disabled by default (see "PotIndex" in john.conf).
+ */
+#define POT_INDEX_MAGIC			"JtRpix02"
+#define POT_INDEX_TAIL			64
+#define POT_INDEX_BUFFER_SIZE		0x100000
+#define POT_INDEX_RECORDS		0x1000
+/* Merge the unsorted records once there are more than this plus 1/8 sorted */
+#define POT_INDEX_UNSORTED		POT_INDEX_RECORDS
+#define POT_INDEX_UNSORTED_SHR		3
+
+struct pot_index_header {
+/* POT_INDEX_MAGIC */
+	char magic[8];
+
+/* Size of the pot file covered by the index, always at a line boundary */
+	uint64_t pot_pos;
+
+/* Hash of the last POT_INDEX_TAIL bytes covered, to detect pot file edits */
+	uint64_t tail_hash;
+
+/* Number of records following the header */
+	uint64_t count;
+
+/* Number of those at the start that are sorted by hash and offset */
+	uint64_t sorted;
+};
+
+struct pot_index_record {
+	uint64_t hash;
+	uint64_t offset;
+};
+
+/* FNV-1a, never zero (we use zero for empty slots) */
+static uint64_t pot_hash(char *data, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (len--) {
+		hash ^= *(unsigned char *)data++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash ? hash : 1;
+}
+
+/*
+ * Returns the length of the ciphertext field at the start of a line of len
+ * bytes, the same as ldr_get_field() would get from what fgets() returned.
+ */
+static size_t pot_field_len(char *line, size_t len, char field_sep_char)
+{
+	char *end, *pos;
+
+	if ((end = memchr(line, 0, len)))
+		len = end - line;
+	if ((pos = memchr(line, field_sep_char, len)))
+		return pos - line;
+
+	end = line + len;
+	for (pos = line; pos < end; pos++)
+		if (*pos == '\r' || *pos == '\n')
+			break;
+
+	return pos - line;
+}
+
+#ifdef HAVE_MMAP
+static int pot_record_cmp(const void *p1, const void *p2)
+{
+	const struct pot_index_record *r1 = p1, *r2 = p2;
+
+	if (r1->hash != r2->hash)
+		return r1->hash < r2->hash ? -1 : 1;
+	if (r1->offset != r2->offset)
+		return r1->offset < r2->offset ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Sorts the unsorted records and merges them into the sorted section, in
+ * place.  The index is marked invalid on disk while we do this, so that it's
+ * rebuilt if we don't get to write the updated header.
+ */
+static int ldr_pot_index_sort(FILE *idx, struct pot_index_header *header)
+{
+	struct pot_index_header invalid;
+	struct pot_index_record *records, *tail;
+	uint64_t i, j, k;
+	size_t size;
+	void *map;
+
+	invalid = *header;
+	invalid.magic[0] = 0;
+	rewind(idx);
+	if (fwrite(&invalid, sizeof(invalid), 1, idx) != 1 || fflush(idx))
+		return 0;
+
+	size = sizeof(*header) + header->count * sizeof(*records);
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fileno(idx), 0);
+	if (map == MAP_FAILED)
+		return 0;
+	records = (struct pot_index_record *)((char *)map + sizeof(*header));
+
+	j = header->count - header->sorted;
+	qsort(records + header->sorted, j, sizeof(*records), pot_record_cmp);
+
+/* Merge from the end, where the unsorted records were */
+	if (header->sorted) {
+		tail = mem_alloc(j * sizeof(*tail));
+		memcpy(tail, records + header->sorted, j * sizeof(*tail));
+		i = header->sorted;
+		k = header->count;
+		while (j) {
+			if (i && pot_record_cmp(&records[i - 1], &tail[j - 1]) > 0)
+				records[--k] = records[--i];
+			else
+				records[--k] = tail[--j];
+		}
+		MEM_FREE(tail);
+	}
+
+	if (munmap(map, size))
+		return 0;
+
+	header->sorted = header->count;
+	return 1;
+}
+#endif
+
+static uint64_t pot_tail_hash(FILE *pot, int64_t pos)
+{
+	char buf[POT_INDEX_TAIL];
+	size_t len = pos < POT_INDEX_TAIL ? pos : POT_INDEX_TAIL;
+
+	if (jtr_fseek64(pot, pos - len, SEEK_SET) ||
+	    fread(buf, 1, len, pot) != len)
+		return 0;
+
+	return pot_hash(buf, len);
+}
+
+/*
+ * Indexes any lines appended to the pot file since we last did.  Returns the
+ * index file, locked, or NULL if we can't use one.
+ */
+static FILE *ldr_pot_index_update(char *name, FILE *pot,
+	struct pot_index_header *header, char field_sep_char)
+{
+	struct pot_index_record *records;
+	char *idx_name, *buf;
+	FILE *idx;
+	int fd, count;
+	int64_t pot_size, pos, idx_size;
+	size_t buf_len;
+
+	idx_name = mem_alloc(strlen(name) + 5);
+	sprintf(idx_name, "%s.idx", name);
+	fd = open(idx_name, O_RDWR | O_CREAT, 0600);
+	MEM_FREE(idx_name);
+	if (fd == -1)
+		return NULL;
+#if OS_FLOCK
+	if (flock(fd, LOCK_EX)) {
+		close(fd);
+		return NULL;
+	}
+#endif
+	if (!(idx = fdopen(fd, "r+b"))) {
+		close(fd);
+		return NULL;
+	}
+
+	if (jtr_fseek64(pot, 0, SEEK_END) || (pot_size = jtr_ftell64(pot)) < 0 ||
+	    jtr_fseek64(idx, 0, SEEK_END) || (idx_size = jtr_ftell64(idx)) < 0)
+		goto fail;
+
+	rewind(idx);
+	if (fread(header, sizeof(*header), 1, idx) != 1 ||
+	    memcmp(header->magic, POT_INDEX_MAGIC, sizeof(header->magic)) ||
+	    idx_size != sizeof(*header) + header->count * sizeof(*records) ||
+	    header->sorted > header->count ||
+	    header->pot_pos > pot_size ||
+	    pot_tail_hash(pot, header->pot_pos) != header->tail_hash) {
+		memset(header, 0, sizeof(*header));
+		memcpy(header->magic, POT_INDEX_MAGIC, sizeof(header->magic));
+		header->tail_hash = pot_tail_hash(pot, 0);
+		if (ftruncate(fd, 0))
+			goto fail;
+		idx_size = sizeof(*header);
+	}
+
+	if (header->pot_pos == pot_size)
+		return idx;
+
+	if (jtr_fseek64(pot, header->pot_pos, SEEK_SET) ||
+	    jtr_fseek64(idx, idx_size, SEEK_SET))
+		goto fail;
+
+	buf = mem_alloc(POT_INDEX_BUFFER_SIZE + LINE_BUFFER_SIZE);
+	records = mem_alloc(POT_INDEX_RECORDS * sizeof(*records));
+	pos = header->pot_pos;
+	buf_len = count = 0;
+
+/*
+ * Split the lines exactly like fgets() with a buffer of LINE_BUFFER_SIZE
+ * would, leaving an incomplete last line for the next time.
+ */
+	while (1) {
+		char *line = buf, *end, *eol;
+		size_t len;
+
+		buf_len += fread(buf + buf_len, 1,
+		    POT_INDEX_BUFFER_SIZE + LINE_BUFFER_SIZE - buf_len, pot);
+		end = buf + buf_len;
+
+		while (line < end) {
+			len = end - line;
+			if (len > LINE_BUFFER_SIZE - 1)
+				len = LINE_BUFFER_SIZE - 1;
+			if ((eol = memchr(line, '\n', len)))
+				len = eol - line + 1;
+			else if (len < LINE_BUFFER_SIZE - 1)
+				break;
+
+			records[count].offset = pos;
+			if (len >= 3 && !memcmp(line, "\xEF\xBB\xBF", 3))
+				records[count].hash = pot_hash(line + 3,
+				    pot_field_len(line + 3, len - 3,
+				    field_sep_char));
+			else
+				records[count].hash = pot_hash(line,
+				    pot_field_len(line, len, field_sep_char));
+			if (++count == POT_INDEX_RECORDS) {
+				if (fwrite(records, sizeof(*records), count,
+				    idx) != count)
+					break;
+				header->count += count;
+				count = 0;
+			}
+
+			line += len;
+			pos += len;
+		}
+
+		if (line == buf || ferror(idx))
+			break;
+		buf_len = end - line;
+		memmove(buf, line, buf_len);
+	}
+
+	if (count && fwrite(records, sizeof(*records), count, idx) == count)
+		header->count += count;
+	else if (count)
+		pos = -1;
+
+	MEM_FREE(records);
+	MEM_FREE(buf);
+
+	if (pos < 0 || ferror(pot) || ferror(idx))
+		goto fail;
+
+#ifdef HAVE_MMAP
+	if (header->count - header->sorted > POT_INDEX_UNSORTED +
+	    (header->sorted >> POT_INDEX_UNSORTED_SHR) &&
+	    (fflush(idx) || !ldr_pot_index_sort(idx, header)))
+		goto fail;
+#endif
+
+/* Only now that the records are written do we update the header */
+	header->pot_pos = pos;
+	header->tail_hash = pot_tail_hash(pot, pos);
+	rewind(idx);
+	if (fwrite(header, sizeof(*header), 1, idx) != 1 || fflush(idx))
+		goto fail;
+
+	return idx;
+
+fail:
+	fclose(idx);
+	return NULL;
+}
+
+/*
+ * Removes the hashes found in the pot file using its index.  Returns zero if
+ * we should read the entire pot file instead.
+ */
+static int ldr_load_pot_indexed(struct db_main *db, char *name)
+{
+	struct fmt_main *format = db->format;
+	struct pot_index_header header;
+	struct pot_index_record *records;
+	struct db_salt *salt;
+	struct db_password *pw;
+	char line_buf[LINE_BUFFER_SIZE];
+	uint64_t *table, mask, left, slot;
+	FILE *pot, *idx;
+	int hash;
+
+	if (!cfg_get_bool(SECTION_OPTIONS, NULL, "PotIndex", 0) ||
+	    options.regen_lost_salts)
+		return 0;
+
+	if (!(pot = fopen(path_expand(name), "rb")))
+		return errno == ENOENT;
+#if OS_FLOCK
+	if (flock(fileno(pot), LOCK_SH)) {
+		fclose(pot);
+		return 0;
+	}
+#endif
+
+	if (!(idx = ldr_pot_index_update(path_expand(name), pot, &header,
+	    db->options->field_sep_char))) {
+		fclose(pot);
+		return 0;
+	}
+
+/* Hash the ciphertexts of all the hashes we've loaded */
+	for (mask = 0xf; mask < 2ULL * db->password_count; mask = mask * 2 + 1);
+	table = mem_calloc((mask + 1) * sizeof(*table));
+	for (hash = 0; hash < SALT_HASH_SIZE; hash++)
+	for (salt = db->salt_hash[hash]; salt; salt = salt->next)
+	for (pw = salt->list; pw; pw = pw->next) {
+		char *source = format->methods.source(pw->source, pw->binary);
+		uint64_t value = pot_hash(source, strlen(source));
+
+		slot = value & mask;
+		while (table[slot] && table[slot] != value)
+			slot = (slot + 1) & mask;
+		table[slot] = value;
+	}
+
+	left = header.count;
+
+#ifdef HAVE_MMAP
+/* Look up each of those in the sorted section */
+	if (header.sorted) {
+		size_t size = sizeof(header) + header.sorted * sizeof(*records);
+		void *map = mmap(NULL, size, PROT_READ, MAP_SHARED,
+		    fileno(idx), 0);
+
+		if (map != MAP_FAILED) {
+			records = (struct pot_index_record *)
+				((char *)map + sizeof(header));
+			for (slot = 0; slot <= mask; slot++) {
+				uint64_t value = table[slot], lo = 0,
+					hi = header.sorted;
+
+				if (!value)
+					continue;
+				while (lo < hi) {
+					uint64_t mid = lo + (hi - lo) / 2;
+
+					if (records[mid].hash < value)
+						lo = mid + 1;
+					else
+						hi = mid;
+				}
+				for (; lo < header.sorted &&
+				    records[lo].hash == value; lo++) {
+					if (jtr_fseek64(pot, records[lo].offset,
+					    SEEK_SET) ||
+					    !fgets(line_buf, sizeof(line_buf),
+					    pot))
+						pexit("fgets: %s",
+						    path_expand(name));
+					ldr_load_pot_line(db,
+					    skip_bom(line_buf));
+				}
+			}
+			munmap(map, size);
+			left -= header.sorted;
+		}
+		check_abort(0);
+	}
+#endif
+
+/* Process the unsorted pot lines with matching ciphertext hashes */
+	records = mem_alloc(POT_INDEX_RECORDS * sizeof(*records));
+	if (jtr_fseek64(idx, sizeof(header) +
+	    (header.count - left) * sizeof(*records), SEEK_SET))
+		left = 0;
+	while (left) {
+		size_t count = left < POT_INDEX_RECORDS ?
+			left : POT_INDEX_RECORDS;
+		size_t i;
+
+		if (fread(records, sizeof(*records), count, idx) != count)
+			pexit("fread: %s.idx", path_expand(name));
+		left -= count;
+
+		for (i = 0; i < count; i++) {
+			uint64_t value = records[i].hash;
+
+			slot = value & mask;
+			while (table[slot] && table[slot] != value)
+				slot = (slot + 1) & mask;
+			if (!table[slot])
+				continue;
+
+			if (jtr_fseek64(pot, records[i].offset, SEEK_SET) ||
+			    !fgets(line_buf, sizeof(line_buf), pot))
+				pexit("fgets: %s", path_expand(name));
+			ldr_load_pot_line(db, skip_bom(line_buf));
+		}
+		check_abort(0);
+	}
+	MEM_FREE(records);
+	MEM_FREE(table);
+
+	if (fclose(idx))
+		pexit("fclose");
+
+/* An incomplete last line isn't indexed, so process it as usual */
+	if (jtr_fseek64(pot, header.pot_pos, SEEK_SET))
+		pexit("fseek");
+	while (fgets(line_buf, sizeof(line_buf), pot))
+		ldr_load_pot_line(db, skip_bom(line_buf));
+	if (name == pers_opts.activepot)
+		crk_pot_pos = jtr_ftell64(pot);
+
+	if (ferror(pot)) pexit("fgets");
+
+	if (fclose(pot)) pexit("fclose");
+
+	return 1;
 }
 
 void ldr_load_pot_file(struct db_main *db, char *name)
@@ -870,7 +1873,9 @@ void ldr_load_pot_file(struct db_main *db, char *name)
 #ifdef HAVE_CRYPT
 		ldr_in_pot = 1;
 #endif
-		read_file(db, name, RF_ALLOW_MISSING, ldr_load_pot_line);
+		if (!ldr_load_pot_indexed(db, name))
+			read_file(db, name, RF_ALLOW_MISSING,
+			          ldr_load_pot_line);
 #ifdef HAVE_CRYPT
 		ldr_in_pot = 0;
 #endif
@@ -893,15 +1898,16 @@ static void ldr_init_salts(struct db_main *db)
 
 	for (hash = 0, tail = &db->salts; hash < SALT_HASH_SIZE; hash++)
 	if ((current = db->salt_hash[hash])) {
+#ifdef DEBUG_HASH
+		int first = ctr;
+#endif
 		*tail = current;
-		ctr = 0;
 		do {
 			current -> sequential_id = ctr++;
 			tail = &current->next;
 		} while ((current = current->next));
 #ifdef DEBUG_HASH
-		if (ctr)
-			printf("salt hash %08x, %d salts\n", hash, ctr);
+		printf("salt hash %08x, %d salts\n", hash, ctr - first);
 #endif
 	}
 }
@@ -1191,6 +2197,57 @@ static void ldr_filter_costs(struct db_main *db)
 }
 #endif
 
+/*
+ * Set up the smaller bitmaps crk_password_loop() checks before the main one,
+ * if the main bitmap is too large to stay in cache and the salt has few enough
+ * hashes for a cache-friendly bitmap to reject most computed hashes.  Sizes
+ * are tried smallest first, so the first level is the one most likely to stay
+ * in L1 and each further one is more selective.
+ */
+static void ldr_init_prefilter(struct db_main *db, struct db_salt *salt)
+{
+	struct db_password *current;
+	struct fmt_methods *methods = &db->format->methods;
+	int size, bitmap_size, hash;
+
+	salt->prefilter_levels = 0;
+
+	if (password_hash_sizes[salt->hash_size] <= PASSWORD_PREFILTER_MAX_SIZE)
+		return;
+
+	for (size = 0; size < salt->hash_size &&
+	    salt->prefilter_levels < PASSWORD_PREFILTER_LEVELS; size++) {
+		unsigned int *bitmap;
+		size_t bytes;
+
+		bitmap_size = password_hash_sizes[size];
+		if (bitmap_size > PASSWORD_PREFILTER_MAX_SIZE)
+			break;
+		if (salt->count > bitmap_size >> PASSWORD_PREFILTER_SHR ||
+		    !methods->binary_hash[size] ||
+		    methods->binary_hash[size] == fmt_default_binary_hash ||
+		    !methods->get_hash[size] ||
+		    methods->get_hash[size] == fmt_default_get_hash)
+			continue;
+
+		bytes = (bitmap_size + sizeof(*bitmap) * 8 - 1) /
+		    (sizeof(*bitmap) * 8) * sizeof(*bitmap);
+		bitmap = mem_alloc_tiny(bytes, MEM_ALIGN_CACHE);
+		memset(bitmap, 0, bytes);
+
+		current = salt->list;
+		do {
+			hash = methods->binary_hash[size](current->binary);
+			bitmap[hash / (sizeof(*bitmap) * 8)] |=
+			    1U << (hash % (sizeof(*bitmap) * 8));
+		} while ((current = current->next));
+
+		salt->prefilter[salt->prefilter_levels] = bitmap;
+		salt->prefilter_index[salt->prefilter_levels++] =
+		    methods->get_hash[size];
+	}
+}
+
 /*
  * Allocate memory for and initialize the hash table for this salt if needed.
  * Also initialize salt->count (the number of password hashes for this salt).
@@ -1199,17 +2256,37 @@ static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 {
 	struct db_password *current;
 	int (*hash_func)(void *binary);
-	int bitmap_size, hash_size;
+	int bitmap_size, binary_size, align;
+	unsigned int table_size;
+	char *binaries;
 	int hash;
 
+	binary_size = db->format->params.binary_size;
+	align = db->format->params.binary_align;
+	if (align < MEM_ALIGN_WORD)
+		align = MEM_ALIGN_WORD;
+	salt->table_stride = (binary_size + align - 1) & ~(align - 1);
+
 	if (salt->hash_size < 0) {
+		salt->table_hash = NULL;
 		salt->count = 0;
 		if ((current = salt->list))
 		do {
-			current->next_hash = NULL; /* unused */
 			salt->count++;
 		} while ((current = current->next));
 
+/* Move the binaries out of the loader's blocks, which are about to be freed */
+		binaries = mem_alloc_tiny((size_t)salt->count *
+		    salt->table_stride, align);
+		if ((current = salt->list))
+		do {
+			if (current->binary != &current->source) {
+				current->binary = memcpy(binaries,
+				    current->binary, binary_size);
+				binaries += salt->table_stride;
+			}
+		} while ((current = current->next));
+
 		return;
 	}
 
@@ -1222,12 +2299,18 @@ static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 		memset(salt->bitmap, 0, size);
 	}
 
-	hash_size = bitmap_size >> PASSWORD_HASH_SHR;
-	if (hash_size > 1) {
-		size_t size = hash_size * sizeof(struct db_password *);
-		salt->hash = mem_alloc_tiny(size, MEM_ALIGN_WORD);
-		memset(salt->hash, 0, size);
-	}
+	table_size = salt->count + (salt->count >> PASSWORD_TABLE_SHR) + 1;
+	salt->table_size = table_size;
+	for (salt->table_shift = 0; (1U << salt->table_shift) < bitmap_size;
+	    salt->table_shift++);
+
+	salt->table_hash = mem_alloc_tiny(table_size * sizeof(unsigned int),
+	    MEM_ALIGN_CACHE);
+	memset(salt->table_hash, 0xff, table_size * sizeof(unsigned int));
+	salt->table_binary = mem_alloc_tiny(
+	    (size_t)table_size * salt->table_stride, MEM_ALIGN_CACHE);
+	salt->table_pw = mem_alloc_tiny(
+	    table_size * sizeof(struct db_password *), MEM_ALIGN_WORD);
 
 	salt->index = db->format->methods.get_hash[salt->hash_size];
 
@@ -1236,17 +2319,24 @@ static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 	salt->count = 0;
 	if ((current = salt->list))
 	do {
+		unsigned int slot;
+
 		hash = hash_func(current->binary);
 		salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] |=
 		    1U << (hash % (sizeof(*salt->bitmap) * 8));
-		if (hash_size > 1) {
-			hash >>= PASSWORD_HASH_SHR;
-			current->next_hash = salt->hash[hash];
-			salt->hash[hash] = current;
-		} else
-			current->next_hash = current->next;
+
+		slot = PASSWORD_TABLE_SLOT(salt, hash);
+		while (salt->table_hash[slot] != PASSWORD_TABLE_EMPTY)
+			slot = PASSWORD_TABLE_NEXT(salt, slot);
+		salt->table_hash[slot] = hash;
+		salt->table_pw[slot] = current;
+		current->binary = memcpy(
+		    &salt->table_binary[(size_t)slot * salt->table_stride],
+		    current->binary, binary_size);
 		salt->count++;
 	} while ((current = current->next));
+
+	ldr_init_prefilter(db, salt);
 }
 
 /*
@@ -1332,7 +2422,7 @@ void ldr_fix_database(struct db_main *db)
 	int total = db->password_count;
 
 	ldr_init_salts(db);
-	MEM_FREE(db->password_hash);
+	ldr_free_password_hash(db);
 	if (!db->format ||
 	    db->format->methods.salt_hash == fmt_default_salt_hash ||
 	    mem_saving_level >= 2) /* Otherwise kept for faster pot sync */
@@ -1349,6 +2439,7 @@ void ldr_fix_database(struct db_main *db)
 	ldr_sort_salts(db);
 
 	ldr_init_hash(db);
+	ldr_free_binaries();
 
 	db->loaded = 1;
 
@@ -25,11 +25,6 @@ struct db_password {
 /* Pointer to next password hash with the same salt */
 	struct db_password *next;
 
-/* After loading is completed: pointer to next password hash with the same salt
- * and hash-of-hash.
- * While loading: pointer to next password hash with the same hash-of-hash. */
-	struct db_password *next_hash;
-
 /* Hot portion of or full binary ciphertext for fast comparison (aligned) */
 	void *binary;
 
@@ -46,6 +41,17 @@ struct db_password {
 	struct list_main *words;
 };
 
+/*
+ * Entry in the loader's own hash table, only used while loading.
+ */
+struct db_password_link {
+/* Pointer to next entry with the same hash-of-hash */
+	struct db_password_link *next;
+
+/* The password hash */
+	struct db_password *pw;
+};
+
 /*
  * Buffered keys hash table entry.
  */
@@ -96,7 +102,10 @@ struct db_keys {
 /* Number of recursive calls for this salt */
 	int lock;
 
-/* The keys, allocated as (plaintext_length * min_keys_per_crypt) bytes */
+/* Number of keys the buffer has room for */
+	int max_count;
+
+/* The keys, allocated as (plaintext_length * max_count) bytes */
 	char buffer[1];
 };
 
@@ -120,15 +129,35 @@ struct db_salt {
  * zero if there's no bitmap for this salt. */
 	int (*index)(int index);
 
+/* Smaller bitmaps to check before the one above, smallest first, and their
+ * get_hash() functions.  These are only ever set up for salts with a bitmap.
+ * Bits are never cleared from these, so they may let through a few more
+ * computed hashes than necessary after some passwords have been cracked. */
+	int prefilter_levels;
+	unsigned int *prefilter[PASSWORD_PREFILTER_LEVELS];
+	int (*prefilter_index[PASSWORD_PREFILTER_LEVELS])(int index);
+
 /* List of passwords with this salt */
 	struct db_password *list;
 
-/* Password hash table for this salt, or a pointer to the list field */
+/* Pointer to the list field (the hash table is below) */
 	struct db_password **hash;
 
 /* Hash table size code, negative for none */
 	int hash_size;
 
+/* Open addressing table used for salts with a bitmap, with table_size slots.
+ * For each slot, table_hash[] holds the binary_hash() value (or
+ * PASSWORD_TABLE_EMPTY), the binary is stored inline at
+ * &table_binary[slot * table_stride] (where the entry's binary field points),
+ * and table_pw[] points to the rest of the entry.  Probing starts at
+ * PASSWORD_TABLE_SLOT() and goes up.  Removed entries are left in place with
+ * a NULL table_pw[] so that probing past them still works. */
+	unsigned int table_size, table_shift, table_stride;
+	unsigned int *table_hash;
+	char *table_binary;
+	struct db_password **table_pw;
+
 /* Number of passwords with this salt */
 	int count;
 
@@ -146,6 +175,16 @@ struct db_salt {
 	struct db_keys *keys;
 };
 
+/*
+ * Map a binary_hash() value (of table_shift bits) onto the salt's hash table
+ * and get the next slot to probe.
+ */
+#define PASSWORD_TABLE_SLOT(salt, hash) \
+	((unsigned int)(((unsigned long long)(hash) * (salt)->table_size) >> \
+	(salt)->table_shift))
+#define PASSWORD_TABLE_NEXT(salt, slot) \
+	((slot) + 1 < (salt)->table_size ? (slot) + 1 : 0)
+
 /*
  * Structure to hold a cracked password.
  */
@@ -217,7 +256,7 @@ struct db_main {
 
 /* Salt and password hash tables, used while loading */
 	struct db_salt **salt_hash;
-	struct db_password **password_hash;
+	struct db_password_link **password_hash;
 
 /* binary_hash function used by the loader itself */
 	int (*password_hash_func)(void *binary);
@@ -51,6 +51,7 @@
 #include "john-mpi.h"
 #endif
 #include "cracker.h"
+#include "crackq.h"
 #include "signals.h"
 #include "memdbg.h"
 
@@ -149,7 +150,8 @@ static void log_file_flush(struct log_file *f)
 			}
 		} else
 #endif
-		if (options.fork)
+/* With --fork, the other processes may get the cracks from crackq.c */
+		if (options.fork && !crackq_enabled)
 			raise(SIGUSR2);
 	}
 #else
@@ -28,6 +28,7 @@
 #include "cracker.h"
 #include "john.h"
 #include "mask.h"
+#include "workq.h"
 #include "unicode.h"
 #include "encoding_data.h"
 #include "memdbg.h"
@@ -55,6 +56,17 @@ static unsigned long long cand, rec_cand;
 unsigned long long mask_tot_cand;
 unsigned long long mask_parent_keys;
 
+/*
+ * With the shared work queue (see workq.h), each mask length is a stage and
+ * its keyspace is split into units of mask_unit_size() candidates.  mask_unit
+ * is the unit we're generating keys for, and rec_start is the first candidate
+ * of the queue's low-water mark, for the crash recovery file.
+ */
+static int use_workq, mask_max_keys;
+static unsigned long long mask_unit = WORKQ_NONE, rec_start;
+/* First candidate and size of mask_unit, for progress reporting */
+static unsigned long long unit_start, unit_cands;
+
 #define BUILT_IN_CHARSET "ludshaLUDSHA123456789"
 
 #define store_op(k, i) \
@@ -1117,15 +1129,71 @@ static MAYBE_INLINE char* mask_cp_to_utf8(char *in)
 	return in;
 }
 
+/*
+ * Passes the keys for the rest of placeholder ps's range (from its current
+ * iter on) to the cracker in as few crk_process_key_range() calls as the keys
+ * buffer allows.  iter is left at the last key passed on before each call,
+ * as with one key at a time, so that mask_fix_state() saves the right
+ * position, and at count when done.  Returns 1 if aborted, 2 if this node
+ * ran out of candidates, 0 otherwise.
+ */
+static int process_key_range(cpu_mask_context *cpu_mask_ctx, int ps,
+			     unsigned long long *my_candidates)
+{
+	mask_range *range = &cpu_mask_ctx->ranges[ps];
+	int pos = range->pos + range->offset;
+
+	while (range->iter < range->count) {
+		int first = range->iter;
+		int n = range->count - first;
+		int room = crk_key_range_room();
+
+		if (n > room)
+			n = room;
+		if (options.node_count && !(options.flags & FLG_MASK_STACKED)) {
+			if (!*my_candidates)
+				return 2;
+			if (n > *my_candidates)
+				n = *my_candidates;
+			*my_candidates -= n;
+		}
+
+		range->iter += n - 1;
+		template_key[pos] = range->chars[range->iter];
+		if (crk_process_key_range(template_key, pos,
+		                          &range->chars[first], n))
+			return 1;
+		range->iter++;
+	}
+
+	return 0;
+}
+
 static int generate_keys(cpu_mask_context *cpu_mask_ctx,
 			  unsigned long long *my_candidates)
 {
 	int ps1 = MAX_NUM_MASK_PLHDR, ps2 = MAX_NUM_MASK_PLHDR,
 	    ps3 = MAX_NUM_MASK_PLHDR, ps4 = MAX_NUM_MASK_PLHDR, ps ;
 	int start1, start2, start3, start4;
+/*
+ * Let the format lay out the keys for the fastest-changing placeholder by
+ * itself if it can and nothing needs to see or alter each key on the way.
+ */
+	int use_range = cpu_mask_ctx->cpu_count && crk_key_range_room() &&
+		!f_filter &&
+		!(mask_has_8bit && (pers_opts.internal_enc != UTF_8 &&
+		                    pers_opts.target_enc == UTF_8));
 
 #define ranges(i) cpu_mask_ctx->ranges[i]
 
+#define process_range(ps)						\
+	switch (process_key_range(cpu_mask_ctx, ps, my_candidates)) {	\
+	case 1:								\
+		return 1;						\
+	case 2:								\
+		goto done;						\
+	}
+
 #define process_key(key)						\
 	if (ext_filter(template_key))					\
 		if ((crk_process_key(mask_cp_to_utf8(template_key))))   \
@@ -1177,12 +1245,17 @@ static int generate_keys(cpu_mask_context *cpu_mask_ctx,
 		init_key(ps);
 
 		while (1) {
-			if (options.node_count &&
-			    !(options.flags & FLG_MASK_STACKED) &&
-			    !(*my_candidates)--)
-				goto done;
-
-			process_key(template_key);
+			if (use_range) {
+				process_range(ps1);
+				ranges(ps1).iter--;
+			} else {
+				if (options.node_count &&
+				    !(options.flags & FLG_MASK_STACKED) &&
+				    !(*my_candidates)--)
+					goto done;
+
+				process_key(template_key);
+			}
 			ps = ps1;
 			next_state(ps);
 		}
@@ -1206,6 +1279,9 @@ static int generate_keys(cpu_mask_context *cpu_mask_ctx,
 					set_template_key(ps3, start3);
 					for (iterate_over(ps2)) {
 						set_template_key(ps2, start2);
+						if (use_range) {
+							process_range(ps1);
+						} else
 						for (iterate_over(ps1)) {
 							if (options.node_count &&
 							    !(options.flags & FLG_MASK_STACKED) &&
@@ -1228,6 +1304,7 @@ static int generate_keys(cpu_mask_context *cpu_mask_ctx,
 done:
 	return 0;
 #undef ranges
+#undef process_range
 #undef process_key
 #undef next_state
 #undef init_key
@@ -1276,9 +1353,24 @@ static void skip_position(cpu_mask_context *cpu_mask_ctx, int *arr)
 		}
 }
 
+/* Sets the placeholders to the candidate at the given offset */
+static void set_position(cpu_mask_context *cpu_mask_ctx,
+			 unsigned long long offset)
+{
+	unsigned long long ctr = 1;
+	int ps = cpu_mask_ctx->ps1;
+
+	while(ps != MAX_NUM_MASK_PLHDR) {
+		cpu_mask_ctx->ranges[ps].iter = (offset / ctr) %
+			cpu_mask_ctx->ranges[ps].count;
+		ctr *= cpu_mask_ctx->ranges[ps].count;
+		ps = cpu_mask_ctx->ranges[ps].next;
+	}
+}
+
 static unsigned long long divide_work(cpu_mask_context *cpu_mask_ctx)
 {
-	unsigned long long offset, my_candidates, total_candidates, ctr;
+	unsigned long long offset, my_candidates, total_candidates;
 	int ps;
 	double fract;
 
@@ -1308,18 +1400,76 @@ static unsigned long long divide_work(cpu_mask_context *cpu_mask_ctx)
 		error();
 	}
 
-	ctr = 1;
-	ps = cpu_mask_ctx->ps1;
-	while(ps != MAX_NUM_MASK_PLHDR) {
-		cpu_mask_ctx->ranges[ps].iter = (offset / ctr) %
-			cpu_mask_ctx->ranges[ps].count;
-		ctr *= cpu_mask_ctx->ranges[ps].count;
-		ps = cpu_mask_ctx->ranges[ps].next;
-	}
+	set_position(cpu_mask_ctx, offset);
 
 	return my_candidates;
 }
 
+/* Number of candidates for the given length */
+static unsigned long long mask_length_cands(cpu_mask_context *cpu_mask_ctx,
+					    int len)
+{
+	unsigned long long total = 1;
+	int i;
+
+	for (i = 0; i < cpu_mask_ctx->count; i++)
+		if ((int)(cpu_mask_ctx->active_positions[i]) &&
+		    cpu_mask_ctx->ranges[i].pos < len)
+			total *= cpu_mask_ctx->ranges[i].count;
+
+	return total;
+}
+
+/*
+ * Number of candidates per work unit for the given length, large enough for
+ * the unit indices to fit in 32 bits.
+ */
+static unsigned long long mask_unit_size(cpu_mask_context *cpu_mask_ctx,
+					 int len)
+{
+	unsigned long long total = mask_length_cands(cpu_mask_ctx, len);
+	unsigned long long size = (unsigned long long)mask_max_keys *
+		WORKQ_UNIT_BATCHES;
+
+	if (total / size >= 0xffffffffULL)
+		size = total / 0xffffffffULL + 1;
+
+	return size;
+}
+
+/*
+ * Claims units of the current length from the work queue and generates
+ * their keys, until there are no more left for this length.
+ */
+static int generate_units(cpu_mask_context *cpu_mask_ctx)
+{
+	unsigned long long unit, start, size, total;
+
+	total = mask_length_cands(cpu_mask_ctx, max_keylen);
+	size = mask_unit_size(cpu_mask_ctx, max_keylen);
+
+	while ((unit = workq_claim(max_keylen)) != WORKQ_NONE) {
+		start = WORKQ_INDEX(unit) * size;
+		if (start >= total)
+			break;
+
+		mask_unit = unit;
+		set_position(cpu_mask_ctx, start);
+		cand = total - start < size ? total - start : size;
+		unit_start = start;
+		unit_cands = cand;
+		if (generate_keys(cpu_mask_ctx, &cand))
+			return 1;
+	}
+
+	mask_unit = WORKQ_NONE;
+	unit_start = total;
+	unit_cands = cand = 0;
+	workq_finish(max_keylen);
+
+	return 0;
+}
+
 static double get_progress(void)
 {
 	double try;
@@ -1332,6 +1482,11 @@ static double get_progress(void)
 	if (!mask_tot_cand)
 		return -1;
 
+/* Other processes have taken the units we skipped over */
+	if (use_workq)
+		return 100.0 * (unit_start + unit_cands - cand) /
+			(double)mask_tot_cand;
+
 	if (cand_length)
 		try -= cand_length;
 
@@ -1342,7 +1497,11 @@ void mask_save_state(FILE *file)
 {
 	int i;
 
-	fprintf(file, "%llu\n", rec_cand + 1);
+/* Static sessions never save 0 here, see mask_restore_state() */
+	if (use_workq)
+		fprintf(file, "0\n%llu\n", rec_start);
+	else
+		fprintf(file, "%llu\n", rec_cand + 1);
 	fprintf(file, "%d\n", rec_ctx.count);
 	fprintf(file, "%d\n", rec_ctx.offset);
 	if (options.force_minlength >= 0) {
@@ -1359,12 +1518,27 @@ int mask_restore_state(FILE *file)
 	unsigned char uc;
 	unsigned long long ull;
 	int fail = !(options.flags & FLG_MASK_STACKED);
+	int saved_workq = 0;
 
 	if (fscanf(file, "%llu\n", &ull) == 1)
 		cand = ull;
 	else
 		return fail;
 
+/* 0 means the next line is the work queue's low-water mark */
+	if (!cand) {
+		if (fscanf(file, "%llu\n", &ull) == 1)
+			rec_start = ull;
+		else
+			return fail;
+		saved_workq = 1;
+	}
+	if (saved_workq != use_workq) {
+		fprintf(stderr, "Session was saved with a different "
+		    "DynamicFork setting\n");
+		return 1;
+	}
+
 	if (fscanf(file, "%d\n", &d) == 1)
 		cpu_mask_ctx.count = d;
 	else
@@ -1393,6 +1567,15 @@ int mask_restore_state(FILE *file)
 	else
 		return fail;
 	restored = 0;
+
+	if (use_workq) {
+		int len = options.force_minlength >= 0 ?
+			restored_len : max_keylen;
+
+		workq_restore(WORKQ_UNIT(len,
+		    rec_start / mask_unit_size(&cpu_mask_ctx, len)));
+	}
+
 	return 0;
 }
 
@@ -1406,6 +1589,21 @@ void mask_fix_state(void)
 	rec_len = max_keylen;
 	for (i = 0; i < rec_ctx.count; i++)
 		rec_ctx.ranges[i].iter = cpu_mask_ctx.ranges[i].iter;
+
+/*
+ * We're called once the buffered candidates have been tried, so every unit
+ * we claimed is complete except possibly for the one we're generating.
+ */
+	if (use_workq) {
+		unsigned long long low;
+
+		workq_complete(mask_unit);
+		if ((low = workq_low()) != WORKQ_NONE) {
+			rec_len = WORKQ_STAGE(low);
+			rec_start = WORKQ_INDEX(low) *
+				mask_unit_size(&cpu_mask_ctx, rec_len);
+		}
+	}
 }
 
 void remove_slash(char *mask)
@@ -1696,7 +1894,11 @@ void mask_init(struct db_main *db, char *unprocessed_mask)
 	skip_position(&cpu_mask_ctx, NULL);
 
 	/* If running hybrid (stacked), we let the parent mode distribute */
-	if (options.node_count && !(options.flags & FLG_MASK_STACKED))
+	use_workq = workq_enabled && !(options.flags & FLG_MASK_STACKED);
+	mask_max_keys = db->format->params.max_keys_per_crypt;
+
+	if (options.node_count && !use_workq &&
+	    !(options.flags & FLG_MASK_STACKED))
 		cand = divide_work(&cpu_mask_ctx);
 	else {
 		cand = 1;
@@ -1728,7 +1930,10 @@ void mask_done()
 		    options.force_maxlength > 0)
 			MEM_FREE(mask);
 		// For reporting DONE regardless of rounding errors
-		if (!event_abort) {
+		if (!event_abort && use_workq) {
+			unit_start = mask_tot_cand;
+			unit_cands = cand = 0;
+		} else if (!event_abort) {
 			int num_nodes = options.node_count ?
 				options.node_count : 1;
 			mask_tot_cand = num_nodes *
@@ -1737,6 +1942,8 @@ void mask_done()
 			cand_length = 0;
 		}
 		crk_done();
+		if (use_workq && !event_abort)
+			workq_done();
 
 		rec_done(event_abort);
 	}
@@ -1784,7 +1991,7 @@ int do_mask_crack(const char *key)
 			generate_template_key(mask, key, key_len, &parsed_mask,
 		                      &cpu_mask_ctx);
 
-			if (options.node_count &&
+			if (options.node_count && !use_workq &&
 			    !(options.flags & FLG_MASK_STACKED) && restored) {
 				cand = divide_work(&cpu_mask_ctx);
 				restored = 1;
@@ -1801,7 +2008,8 @@ int do_mask_crack(const char *key)
 				       key, cpy_len);
 			}
 
-			if (generate_keys(&cpu_mask_ctx, &cand))
+			if (use_workq ? generate_units(&cpu_mask_ctx) :
+			    generate_keys(&cpu_mask_ctx, &cand))
 				return 1;
 		}
 	} else {
@@ -1822,7 +2030,8 @@ int do_mask_crack(const char *key)
 			       cpy_len);
 		}
 
-		if (generate_keys(&cpu_mask_ctx, &cand))
+		if (use_workq ? generate_units(&cpu_mask_ctx) :
+		    generate_keys(&cpu_mask_ctx, &cand))
 			return 1;
 	}
 	if (!event_abort && (options.flags & FLG_MASK_STACKED))
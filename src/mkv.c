@@ -7,6 +7,9 @@
 
 #include <stdio.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "arch.h"
 #include "misc.h"
@@ -53,182 +56,91 @@ static void fix_state(void)
 	tidx = gidx;
 }
 
-static int show_pwd_rnbs(struct s_pwd * pwd)
-{
-	unsigned long long i;
-	unsigned int k;
-	unsigned long lvl;
-	char pass_filtered[PLAINTEXT_BUFFER_SIZE];
-	char * pass;
-
-	k=0;
-	i = nbparts[pwd->password[pwd->len-1] + pwd->len*256 + pwd->level*256*gmax_len];
-	pwd->len++;
-	lvl = pwd->level;
-	pwd->password[pwd->len] = 0;
-	while(i>1)
-	{
-		pwd->password[pwd->len-1] = charsorted[ pwd->password[pwd->len-2]*256 + k ];
-		pwd->level = lvl + proba2[ pwd->password[pwd->len-2]*256 + pwd->password[pwd->len-1] ];
-		i -= nbparts[ pwd->password[pwd->len-1] + pwd->len*256 + pwd->level*256*gmax_len ];
-		if(pwd->len<=gmax_len)
-		{
-			if(show_pwd_rnbs(pwd))
-				return 1;
-		}
-		if( (pwd->len >= gmin_len) && (pwd->level >= gmin_level) )
-		{
-			pass = (char*) pwd->password;
-			if (options.mask) {
-				if (do_mask_crack(pass))
-					return 1;
-			} else
-			if (!f_filter || ext_filter_body((char*) pwd->password, pass = pass_filtered))
-				if(crk_process_key(pass))
-					return 1;
-		}
-		gidx++;
-		k++;
-		if(gidx>gend)
-			return 1;
-	}
-	pwd->len--;
-	pwd->password[pwd->len] = 0;
-	pwd->level = lvl;
-	return 0;
-}
+/*
+ * Candidates generated at once, and the rank of each for fix_state().  With
+ * several threads, each generates a consecutive share of the block from its
+ * own iterator.
+ */
+static int block_threads;
+static char *block_keys;
+static unsigned long long *block_ranks;
+static struct mkv_iter *block_iters;
+static int *block_counts;
 
-static int show_pwd_r(struct s_pwd * pwd, unsigned int bs)
+#define MKV_KEY_SIZE			(MAX_MKV_LEN + 1)
+
+/*
+ * Generates the candidates for up to n ranks from the iterator, up to and
+ * including rank end, leaving out those not within the length and level
+ * limits.  Returns the number of candidates.
+ */
+static int mkv_key_block(struct mkv_iter *it, unsigned long long end, int n,
+	char *keys, unsigned long long *ranks)
 {
-	unsigned long long i;
-	unsigned int k;
-	unsigned long lvl;
-	unsigned char curchar;
-	char pass_filtered[PLAINTEXT_BUFFER_SIZE];
-	char * pass;
+	int count = 0;
 
-	k=0;
-	i = nbparts[pwd->password[pwd->len-1] + pwd->len*256 + pwd->level*256*gmax_len];
-	pwd->len++;
-	lvl = pwd->level;
-	if(bs)
-	{
-		while( (curchar=charsorted[ pwd->password[pwd->len-2]*256 + k ]) != pwd->password[pwd->len-1] )
-		{
-			i -= nbparts[ curchar + pwd->len*256 + (pwd->level + proba2[ pwd->password[pwd->len-2]*256 + curchar ])*256*gmax_len  ];
-			k++;
+	while (n-- && it->rank <= end) {
+		if (it->len >= gmin_len && it->level[it->len] >= gmin_level) {
+			memcpy(&keys[count * MKV_KEY_SIZE], it->password,
+			    it->len + 1);
+			ranks[count++] = it->rank;
 		}
-		pwd->level += proba2[ pwd->password[pwd->len-2]*256 + pwd->password[pwd->len-1] ];
-		if(pwd->password[pwd->len]!=0)
-			if(show_pwd_r(pwd, 1))
-				return 1;
-		i -= nbparts[ pwd->password[pwd->len-1] + pwd->len*256 + pwd->level*256*gmax_len ];
-		if( (pwd->len >= gmin_len) && (pwd->level >= gmin_level) )
-		{
-			pass = (char*) pwd->password;
-			if (options.mask) {
-				if (do_mask_crack(pass))
-					return 1;
-			} else
-			if (!f_filter || ext_filter_body((char*)pwd->password, pass = pass_filtered))
-				if(crk_process_key(pass))
-					return 1;
+		if (!mkv_next(it)) {
+			it->rank = end + 1;
+			break;
 		}
-		gidx++;
-		k++;
 	}
-	pwd->password[pwd->len] = 0;
-	while(i>1)
-	{
-		pwd->password[pwd->len-1] = charsorted[ pwd->password[pwd->len-2]*256 + k ];
-		pwd->level = lvl + proba2[ pwd->password[pwd->len-2]*256 + pwd->password[pwd->len-1] ];
-		i -= nbparts[ pwd->password[pwd->len-1] + pwd->len*256 + pwd->level*256*gmax_len ];
-		if(pwd->len<=gmax_len)
-		{
-			if(show_pwd_r(pwd, 0))
-				return 1;
-		}
-		if( (pwd->len >= gmin_len) && (pwd->level >= gmin_level) )
-		{
-			pass = (char*) pwd->password;
-			if (options.mask) {
-				if (do_mask_crack(pass))
-					return 1;
-			} else
-			if (!f_filter || ext_filter_body((char*)pwd->password, pass = pass_filtered))
-				if(crk_process_key(pass))
-					return 1;
-		}
-		gidx++;
-		k++;
-		if(gidx>gend)
-			return 1;
-	}
-	pwd->len--;
-	pwd->password[pwd->len] = 0;
-	pwd->level = lvl;
-	return 0;
+
+	return count;
 }
 
-static int show_pwd(unsigned long long start)
+static int show_pwd(unsigned long long start, unsigned long long end)
 {
-	struct s_pwd pwd;
-	unsigned int i;
 	char pass_filtered[PLAINTEXT_BUFFER_SIZE];
-	char * pass;
+	char *pass;
+	int share = MKV_BLOCK_SIZE / block_threads;
+	int threads, t, i;
 
-	if(gidx==0)
-		gidx = start;
-	i=0;
+	if (!mkv_seek(&block_iters[0], start))
+		return 0;
 
-	if(gidx>0)
-	{
-		print_pwd(gidx, &pwd, gmax_level, gmax_len);
-		while(charsorted[i] != pwd.password[0])
-			i++;
-		pwd.len = 1;
-		pwd.level = proba1[pwd.password[0]];
-		if(show_pwd_r(&pwd, 1))
-			return 1;
-
-		if( (pwd.len >= gmin_len) && (pwd.level >= gmin_level) )
-		{
-			pass = (char*) pwd.password;
-			if (options.mask) {
-				if (do_mask_crack(pass))
-					return 1;
-			} else
-			if (!f_filter || ext_filter_body((char*)pwd.password, pass = pass_filtered))
-				if(crk_process_key(pass))
-					return 1;
+	while (block_iters[0].rank <= end) {
+		for (threads = 1; threads < block_threads; threads++) {
+			unsigned long long rank =
+			    block_iters[0].rank + (unsigned long long)threads * share;
+			if (rank > end)
+				break;
+			mkv_seek(&block_iters[threads], rank);
 		}
-		gidx++;
-		i++;
-	}
-	while(proba1[charsorted[i]]<=gmax_level)
-	{
-		if(gidx>gend)
-			return 1;
-		pwd.len = 1;
-		pwd.password[0] = charsorted[i];
-		pwd.level = proba1[pwd.password[0]];
-		pwd.password[1] = 0;
-		if(show_pwd_rnbs(&pwd))
-			return 1;
-		if( (pwd.len >= gmin_len) && (pwd.level >= gmin_level) )
-		{
-			pass = (char*) pwd.password;
+
+#ifdef _OPENMP
+#pragma omp parallel for if (threads > 1)
+#endif
+		for (t = 0; t < threads; t++) {
+			unsigned long long last = block_iters[t].rank + share - 1;
+			block_counts[t] = mkv_key_block(&block_iters[t],
+			    last < end ? last : end, share,
+			    &block_keys[t * share * MKV_KEY_SIZE],
+			    &block_ranks[t * share]);
+		}
+
+		for (t = 0; t < threads; t++)
+		for (i = 0; i < block_counts[t]; i++) {
+			gidx = block_ranks[t * share + i];
+			pass = &block_keys[(t * share + i) * MKV_KEY_SIZE];
 			if (options.mask) {
 				if (do_mask_crack(pass))
 					return 1;
 			} else
-			if (!f_filter || ext_filter_body((char*)pwd.password, pass = pass_filtered))
-				if(crk_process_key(pass))
+			if (!f_filter || ext_filter_body(pass, pass_filtered))
+				if (crk_process_key(f_filter ?
+				    pass_filtered : pass))
 					return 1;
 		}
-		gidx++;
-		i++;
+
+		block_iters[0] = block_iters[threads - 1];
 	}
+
 	return 0;
 }
 
@@ -244,7 +156,7 @@ static double get_progress(void)
 
 	try = ((unsigned long long)status.cands.hi << 32) + status.cands.lo;
 
-	return 100.0 * try / ((gend - gstart) * mask_mult);
+	return 100.0 * try / ((gend - gstart + 1) * mask_mult);
 }
 
 void get_markov_options(struct db_main *db,
@@ -638,17 +550,26 @@ void do_markov_crack(struct db_main *db, char *mkv_param)
 		        options.node_count > 1 ? " split over nodes" : "");
 	}
 
+/* Ranks are 1-based, and there's no candidate for the root */
+	if (mkv_start < 1)
+		mkv_start = 1;
+	if (mkv_end > nbparts[0] - 1)
+		mkv_end = nbparts[0] - 1;
+
 	if (options.node_count > 1) {
-		unsigned long long mkv_size;
+		unsigned long long mkv_size, per_node, extra;
 
 		mkv_size = mkv_end - mkv_start + 1;
-		if (options.node_max != options.node_count)
-			mkv_end = mkv_start + mkv_size / options.node_count * options.node_max - 1;
-		mkv_start += mkv_size / options.node_count * (options.node_min - 1);
+		per_node = mkv_size / options.node_count;
+		extra = mkv_size % options.node_count;
+		mkv_end = mkv_start + per_node * options.node_max - 1 +
+			(options.node_max < extra ? options.node_max : extra);
+		mkv_start += per_node * (options.node_min - 1) +
+			(options.node_min - 1 < extra ? options.node_min - 1 : extra);
 	}
 
 	gstart = mkv_start;
-	gend = mkv_end + 10; /* omg !! */
+	gend = mkv_end;
 
 	if(param)
 		log_event("Proceeding with Markov mode %s", param);
@@ -660,7 +581,23 @@ void do_markov_crack(struct db_main *db, char *mkv_param)
 	log_event("- Length: %d - %d", mkv_minlen, mkv_maxlen);
 	log_event("- Start-End: "LLd" - "LLd, mkv_start, mkv_end);
 
-	show_pwd(mkv_start);
+	block_threads = 1;
+#ifdef _OPENMP
+	block_threads = omp_get_max_threads();
+	if (block_threads > MKV_BLOCK_SIZE)
+		block_threads = MKV_BLOCK_SIZE;
+#endif
+	block_keys = mem_alloc(MKV_BLOCK_SIZE * MKV_KEY_SIZE);
+	block_ranks = mem_alloc(MKV_BLOCK_SIZE * sizeof(*block_ranks));
+	block_iters = mem_alloc(block_threads * sizeof(*block_iters));
+	block_counts = mem_alloc(block_threads * sizeof(*block_counts));
+
+	show_pwd(gidx ? gidx : mkv_start, mkv_end);
+
+	MEM_FREE(block_counts);
+	MEM_FREE(block_iters);
+	MEM_FREE(block_ranks);
+	MEM_FREE(block_keys);
 
 	if (!event_abort)
 		gidx = gend; // For reporting DONE properly
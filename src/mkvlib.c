@@ -109,6 +109,112 @@ void print_pwd(unsigned long long index, struct s_pwd * pwd, unsigned int max_lv
 }
 
 
+#define MKV_SIZE(c, len, level) \
+	nbparts[(c) + (len)*256 + (level)*256*gmax_len]
+
+/*
+ * Makes the first node at or after index k in the children of the node at
+ * depth d - 1 the iterator's node at depth d, returning the size of its
+ * subtree, or 0 if there's none.
+ */
+static unsigned long long mkv_child(struct mkv_iter * it, unsigned int d, unsigned int k)
+{
+	unsigned char prev = (d > 1) ? it->password[d-2] : 0;
+	unsigned long long size;
+	unsigned int level;
+	unsigned char c;
+
+	for(; k<256; k++)
+	{
+		c = charsorted[prev*256 + k];
+		if(d > 1)
+			level = it->level[d-1] + proba2[prev*256 + c];
+		else
+			level = proba1[c];
+		if(level > gmax_level)
+			return 0;
+		/* Not counted in nbparts[], such as character 0 */
+		if(!(size = MKV_SIZE(c, d, level)))
+			continue;
+		it->k[d] = k;
+		it->level[d] = level;
+		it->password[d-1] = c;
+		return size;
+	}
+
+	return 0;
+}
+
+int mkv_seek(struct mkv_iter * it, unsigned long long rank)
+{
+	unsigned long long size, rem;
+	unsigned int d, k;
+
+	it->rank = rank;
+	rem = nbparts[0] - 1;
+	if(!rank || rank > rem)
+		return 0;
+
+	for(d=1;d<=gmax_len;d++)
+	{
+		k = 0;
+		while(1)
+		{
+			if(!(size = mkv_child(it, d, k)) || size > rem)
+				return 0;
+			rem -= size;
+			if(rank <= size)
+				break;
+			rank -= size;
+			k = it->k[d] + 1;
+		}
+		it->rem[d] = rem;
+		if(rank == size)
+		{
+			it->len = d;
+			it->password[d] = 0;
+			return 1;
+		}
+		rem = size - 1;
+	}
+
+	return 0;
+}
+
+int mkv_next(struct mkv_iter * it)
+{
+	unsigned int d = it->len;
+	unsigned long long size, child;
+
+	it->rank++;
+
+	if(!it->rem[d])
+	{
+		if(d == 1)
+			return 0;
+		it->len = --d;
+		it->password[d] = 0;
+		return 1;
+	}
+
+	if(!(size = mkv_child(it, d, it->k[d] + 1)) || size > it->rem[d])
+		return 0;
+	it->rem[d] -= size;
+
+	/* Go down to the first node of the sibling's subtree */
+	while(size > 1)
+	{
+		if(!(child = mkv_child(it, ++d, 0)) || child > size - 1)
+			return 0;
+		it->rem[d] = size - 1 - child;
+		size = child;
+	}
+	it->len = d;
+	it->password[d] = 0;
+
+	return 1;
+}
+
 static void stupidsort(unsigned char * result, unsigned char * source, unsigned int size)
 {
 	unsigned char pivot;
@@ -30,7 +30,32 @@ extern unsigned long long gidx;
 extern unsigned long long gstart;
 extern unsigned long long gend;
 
+/*
+ * Position in the walk of the Markov tree that candidates are generated in,
+ * where each node comes after its subtree.  rank is 1-based, and for each
+ * depth d from 1 to len, k[d] is the node's index in its row of charsorted[]
+ * and rem[d] the number of ranks left in its later siblings' subtrees.
+ */
+struct mkv_iter
+{
+	unsigned long long rank;
+	unsigned int len;
+	unsigned int k[MAX_MKV_LEN+1];
+	unsigned int level[MAX_MKV_LEN+1];
+	unsigned long long rem[MAX_MKV_LEN+1];
+	unsigned char password[MAX_MKV_LEN+1];
+};
+
 void print_pwd(unsigned long long index, struct s_pwd * pwd, unsigned int max_lvl, unsigned int max_len);
+/*
+ * Moves the iterator to the given rank, in O(length) steps.  Returns 0 if
+ * there's no such rank.
+ */
+int mkv_seek(struct mkv_iter * it, unsigned long long rank);
+/*
+ * Moves the iterator to the next rank.  Returns 0 past the last one.
+ */
+int mkv_next(struct mkv_iter * it);
 unsigned long long nb_parts(unsigned char lettre, unsigned int len, unsigned int level, unsigned int max_lvl, unsigned int max_len);
 void init_probatables(char * filename);
 #endif
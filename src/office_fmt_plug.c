@@ -15,7 +15,6 @@ john_register_one(&fmt_office);
 #include <openssl/aes.h>
 #ifdef _OPENMP
 #include <omp.h>
-#define OMP_SCALE               4
 #endif
 
 #include "arch.h"
@@ -28,12 +27,34 @@ john_register_one(&fmt_office);
 #include "sha.h"
 #include "sha2.h"
 #include "johnswap.h"
+#include "sse-intrinsics.h"
 #include "office_common.h"
 #include "memdbg.h"
 
+#ifdef SHA1_SSE_PARA
+#define SHA1_LANES		(MMX_COEF * SHA1_SSE_PARA)
+#else
+#define SHA1_LANES		1
+#endif
+#ifdef MMX_COEF_SHA512
+#define SHA512_LANES		(MMX_COEF_SHA512 * SHA512_SSE_PARA)
+#define SHA512_ALGO		SHA512_ALGORITHM_NAME
+#else
+#define SHA512_LANES		1
+#define SHA512_ALGO		"32/" ARCH_BITS_STR
+#endif
+
+#ifdef _OPENMP
+#if SHA1_LANES > 1
+#define OMP_SCALE               1
+#else
+#define OMP_SCALE               4
+#endif
+#endif
+
 #define FORMAT_LABEL		"Office"
 #define FORMAT_NAME		"2007/2010 (SHA-1) / 2013 (SHA-512), with AES"
-#define ALGORITHM_NAME		"32/" ARCH_BITS_STR " " SHA2_LIB
+#define ALGORITHM_NAME		"SHA1 " SHA1_ALGORITHM_NAME " / SHA512 " SHA512_ALGO " AES"
 #define BENCHMARK_COMMENT	""
 #define BENCHMARK_LENGTH	-1
 #define PLAINTEXT_LENGTH	32
@@ -41,8 +62,13 @@ john_register_one(&fmt_office);
 #define SALT_SIZE		sizeof(*cur_salt)
 #define BINARY_ALIGN	1
 #define SALT_ALIGN	sizeof(int)
-#define MIN_KEYS_PER_CRYPT	1
-#define MAX_KEYS_PER_CRYPT	1
+/* Whole bundles for either hash */
+#if SHA1_LANES > SHA512_LANES
+#define MIN_KEYS_PER_CRYPT	SHA1_LANES
+#else
+#define MIN_KEYS_PER_CRYPT	SHA512_LANES
+#endif
+#define MAX_KEYS_PER_CRYPT	MIN_KEYS_PER_CRYPT
 
 #undef MIN
 #define MIN(a, b)		(((a) > (b)) ? (b) : (a))
@@ -129,30 +155,75 @@ static unsigned char *DeriveKey(unsigned char *hashValue, unsigned char *X1)
 	return NULL;
 }
 
-static unsigned char* GeneratePasswordHashUsingSHA1(UTF16 *passwordBuf, int passwordBufSize, unsigned char *final)
+/* H(0) = H(salt, password) */
+static void HashPasswordSHA1(UTF16 *passwordBuf, int passwordBufSize, unsigned char *hashBuf)
 {
-	unsigned char hashBuf[20], *key;
-	/* H(0) = H(salt, password)
-	 * hashBuf = SHA1Hash(salt, password);
-	 * create input buffer for SHA1 from salt and unicode version of password */
-	unsigned int inputBuf[(0x14 + 0x04 + 4) / sizeof(int)];
-	unsigned char X1[20];
-	int i;
 	SHA_CTX ctx;
 
 	SHA1_Init(&ctx);
 	SHA1_Update(&ctx, cur_salt->osalt, cur_salt->saltSize);
 	SHA1_Update(&ctx, passwordBuf, passwordBufSize);
 	SHA1_Final(hashBuf, &ctx);
+}
 
-	/* Generate each hash in turn
-	 * H(n) = H(i, H(n-1))
-	 * hashBuf = SHA1Hash(i, hashBuf); */
+static void HashPasswordSHA512(UTF16 *passwordBuf, int passwordBufSize, unsigned char *hashBuf)
+{
+	SHA512_CTX ctx;
+
+	SHA512_Init(&ctx);
+	SHA512_Update(&ctx, cur_salt->osalt, cur_salt->saltSize);
+	SHA512_Update(&ctx, passwordBuf, passwordBufSize);
+	SHA512_Final(hashBuf, &ctx);
+}
+
+/* Generate each hash in turn
+ * H(n) = H(i, H(n-1))
+ * hashBuf = SHA1Hash(i, hashBuf); */
+#ifdef SHA1_SSE_PARA
+/*
+ * The input is always the 4 byte counter and the previous hash, so we keep
+ * it as a single pre-padded block per lane and have SSESHA1body() write each
+ * hash straight back into it, right after the counter.
+ */
+#define SHA1_POS(w, lane)	(((lane) / MMX_COEF) * 16 * MMX_COEF + \
+	(w) * MMX_COEF + ((lane) & (MMX_COEF - 1)))
+
+static void SpinSHA1(unsigned char (*hashBuf)[64], int spinCount)
+{
+	JTR_ALIGN(16) ARCH_WORD_32 buf[16 * SHA1_LANES];
+	int i, j, k;
+
+	memset(buf, 0, sizeof(buf));
+	for (k = 0; k < SHA1_LANES; k++) {
+		for (j = 0; j < 5; j++)
+			buf[SHA1_POS(j + 1, k)] = JOHNSWAP(((ARCH_WORD_32*)hashBuf[k])[j]);
+		buf[SHA1_POS(6, k)] = 0x80000000;
+		buf[SHA1_POS(15, k)] = (0x14 + 0x04) << 3;
+	}
+	for (i = 0; i < spinCount; i++) {
+		// 1.3.6 says that little-endian byte ordering is expected
+		ARCH_WORD_32 counter = JOHNSWAP(i);
+
+		for (k = 0; k < SHA1_LANES; k++)
+			buf[SHA1_POS(0, k)] = counter;
+		SSESHA1body((__m128i*)buf, &buf[MMX_COEF], NULL,
+		            SSEi_MIXED_IN|SSEi_OUTPUT_AS_INP_FMT);
+	}
+	for (k = 0; k < SHA1_LANES; k++)
+		for (j = 0; j < 5; j++)
+			((ARCH_WORD_32*)hashBuf[k])[j] = JOHNSWAP(buf[SHA1_POS(j + 1, k)]);
+}
+#else
+static void SpinSHA1(unsigned char (*hashBuf)[64], int spinCount)
+{
+	unsigned int inputBuf[(0x14 + 0x04 + 4) / sizeof(int)];
+	int i;
+	SHA_CTX ctx;
 
 	// Create a byte array of the integer and put at the front of the input buffer
 	// 1.3.6 says that little-endian byte ordering is expected
-	memcpy(&inputBuf[1], hashBuf, 20);
-	for (i = 0; i < MS_OFFICE_2007_ITERATIONS; i++) {
+	memcpy(&inputBuf[1], hashBuf[0], 20);
+	for (i = 0; i < spinCount; i++) {
 #if ARCH_LITTLE_ENDIAN
 		*inputBuf = i;
 #else
@@ -163,8 +234,86 @@ static unsigned char* GeneratePasswordHashUsingSHA1(UTF16 *passwordBuf, int pass
 		SHA1_Update(&ctx, inputBuf, 0x14 + 0x04);
 		SHA1_Final((unsigned char*)&inputBuf[1], &ctx);
 	}
+	memcpy(hashBuf[0], &inputBuf[1], 20);
+}
+#endif
+
+#ifdef MMX_COEF_SHA512
+/*
+ * Same for SHA-512, except that the 4 byte counter puts the hash off the
+ * 64-bit word boundaries, so we shift it into place from the output.
+ */
+#define SHA512_POS(n, w, lane)	(((lane) / MMX_COEF_SHA512) * (n) * MMX_COEF_SHA512 + \
+	(w) * MMX_COEF_SHA512 + ((lane) & (MMX_COEF_SHA512 - 1)))
+#define SHA512_IN(w, lane)	SHA512_POS(16, w, lane)
+#define SHA512_OUT(w, lane)	SHA512_POS(8, w, lane)
+
+static void SpinSHA512(unsigned char (*hashBuf)[64], int spinCount)
+{
+	JTR_ALIGN(16) ARCH_WORD_64 buf[16 * SHA512_LANES];
+	JTR_ALIGN(16) ARCH_WORD_64 out[8 * SHA512_LANES];
+	int i, j, k;
+
+	memset(buf, 0, sizeof(buf));
+	for (k = 0; k < SHA512_LANES; k++) {
+		for (j = 0; j < 8; j++)
+			out[SHA512_OUT(j, k)] = JOHNSWAP64(((ARCH_WORD_64*)hashBuf[k])[j]);
+		buf[SHA512_IN(15, k)] = (64 + 0x04) << 3;
+	}
+	for (i = 0; i < spinCount; i++) {
+		// 1.3.6 says that little-endian byte ordering is expected
+		ARCH_WORD_64 counter = (ARCH_WORD_64)JOHNSWAP(i) << 32;
+
+		for (k = 0; k < SHA512_LANES; k++) {
+			buf[SHA512_IN(0, k)] = counter | out[SHA512_OUT(0, k)] >> 32;
+			for (j = 1; j < 8; j++)
+				buf[SHA512_IN(j, k)] =
+					out[SHA512_OUT(j - 1, k)] << 32 |
+					out[SHA512_OUT(j, k)] >> 32;
+			buf[SHA512_IN(8, k)] =
+				out[SHA512_OUT(7, k)] << 32 | 0x80000000;
+		}
+		SSESHA512body((__m128i*)buf, out, NULL, SSEi_MIXED_IN);
+	}
+	for (k = 0; k < SHA512_LANES; k++)
+		for (j = 0; j < 8; j++)
+			((ARCH_WORD_64*)hashBuf[k])[j] = JOHNSWAP64(out[SHA512_OUT(j, k)]);
+}
+#else
+static void SpinSHA512(unsigned char (*hashBuf)[64], int spinCount)
+{
+	unsigned int inputBuf[128 / sizeof(int)];
+	int i;
+	SHA512_CTX ctx;
+
+	// Create a byte array of the integer and put at the front of the input buffer
+	// 1.3.6 says that little-endian byte ordering is expected
+	memcpy(&inputBuf[1], hashBuf[0], 64);
+	for (i = 0; i < spinCount; i++) {
+#if ARCH_LITTLE_ENDIAN
+		*inputBuf = i;
+#else
+		*inputBuf = JOHNSWAP(i);
+#endif
+		// 'append' the previously generated hash to the input buffer
+		SHA512_Init(&ctx);
+		SHA512_Update(&ctx, inputBuf, 64 + 0x04);
+		SHA512_Final((unsigned char*)&inputBuf[1], &ctx);
+	}
+	memcpy(hashBuf[0], &inputBuf[1], 64);
+}
+#endif
+
+/* The rest of the key derivation, from H(n) */
+static unsigned char* GeneratePasswordHashUsingSHA1(unsigned char *hashBuf, unsigned char *final)
+{
+	unsigned int inputBuf[(0x14 + 0x04 + 4) / sizeof(int)];
+	unsigned char X1[20], *key;
+	SHA_CTX ctx;
+
 	// Finally, append "block" (0) to H(n)
 	// hashBuf = SHA1Hash(hashBuf, 0);
+	memcpy(&inputBuf[1], hashBuf, 20);
 	memset(&inputBuf[6], 0, 4);
 	SHA1_Init(&ctx);
 	SHA1_Update(&ctx, &inputBuf[1], 0x14 + 0x04);
@@ -179,39 +328,14 @@ static unsigned char* GeneratePasswordHashUsingSHA1(UTF16 *passwordBuf, int pass
 	return final;
 }
 
-static void GenerateAgileEncryptionKey(UTF16 *passwordBuf, int passwordBufSize, int hashSize, unsigned char *hashBuf)
+static void GenerateAgileEncryptionKey(unsigned char *hashBuf, int hashSize)
 {
-	/* H(0) = H(salt, password)
-	 * hashBuf = SHA1Hash(salt, password);
-	 * create input buffer for SHA1 from salt and unicode version of password */
 	unsigned int inputBuf[(28 + 4) / sizeof(int)];
 	int i;
 	SHA_CTX ctx;
 
-	SHA1_Init(&ctx);
-	SHA1_Update(&ctx, cur_salt->osalt, cur_salt->saltSize);
-	SHA1_Update(&ctx, passwordBuf, passwordBufSize);
-	SHA1_Final(hashBuf, &ctx);
-
-	/* Generate each hash in turn
-	 * H(n) = H(i, H(n-1))
-	 * hashBuf = SHA1Hash(i, hashBuf); */
-
-	// Create a byte array of the integer and put at the front of the input buffer
-	// 1.3.6 says that little-endian byte ordering is expected
-	memcpy(&inputBuf[1], hashBuf, 20);
-	for (i = 0; i < cur_salt->spinCount; i++) {
-#if ARCH_LITTLE_ENDIAN
-		*inputBuf = i;
-#else
-		*inputBuf = JOHNSWAP(i);
-#endif
-		// 'append' the previously generated hash to the input buffer
-		SHA1_Init(&ctx);
-		SHA1_Update(&ctx, inputBuf, 0x14 + 0x04);
-		SHA1_Final((unsigned char*)&inputBuf[1], &ctx);
-	}
 	// Finally, append "block" (0) to H(n)
+	memcpy(&inputBuf[1], hashBuf, 20);
 	memcpy(&inputBuf[6], encryptedVerifierHashInputBlockKey, 8);
 	SHA1_Init(&ctx);
 	SHA1_Update(&ctx, &inputBuf[1], 28);
@@ -232,32 +356,13 @@ static void GenerateAgileEncryptionKey(UTF16 *passwordBuf, int passwordBufSize,
 	}
 }
 
-static void GenerateAgileEncryptionKey512(UTF16 *passwordBuf, int passwordBufSize, unsigned char *hashBuf)
+static void GenerateAgileEncryptionKey512(unsigned char *hashBuf)
 {
 	unsigned int inputBuf[128 / sizeof(int)];
-	int i;
 	SHA512_CTX ctx;
 
-	SHA512_Init(&ctx);
-	SHA512_Update(&ctx, cur_salt->osalt, cur_salt->saltSize);
-	SHA512_Update(&ctx, passwordBuf, passwordBufSize);
-	SHA512_Final(hashBuf, &ctx);
-
-	// Create a byte array of the integer and put at the front of the input buffer
-	// 1.3.6 says that little-endian byte ordering is expected
-	memcpy(&inputBuf[1], hashBuf, 64);
-	for (i = 0; i < cur_salt->spinCount; i++) {
-#if ARCH_LITTLE_ENDIAN
-		*inputBuf = i;
-#else
-		*inputBuf = JOHNSWAP(i);
-#endif
-		// 'append' the previously generated hash to the input buffer
-		SHA512_Init(&ctx);
-		SHA512_Update(&ctx, inputBuf, 64 + 0x04);
-		SHA512_Final((unsigned char*)&inputBuf[1], &ctx);
-	}
 	// Finally, append "block" (0) to H(n)
+	memcpy(&inputBuf[1], hashBuf, 64);
 	memcpy(&inputBuf[68/4], encryptedVerifierHashInputBlockKey, 8);
 	SHA512_Init(&ctx);
 	SHA512_Update(&ctx, &inputBuf[1], 64 + 8);
@@ -294,45 +399,78 @@ static void set_salt(void *salt)
 	cur_salt = (ms_office_custom_salt *)salt;
 }
 
+/* Check the verifier of the salt, with H(n) of a candidate */
+static int PasswordVerifier(unsigned char *hashBuf)
+{
+	if(cur_salt->version == 2007) {
+		unsigned char encryptionKey[256];
+		GeneratePasswordHashUsingSHA1(hashBuf, encryptionKey);
+		return ms_office_common_PasswordVerifier(cur_salt, encryptionKey);
+	}
+	else if (cur_salt->version == 2010) {
+		unsigned char verifierKeys[64], decryptedVerifierHashInputBytes[16], decryptedVerifierHashBytes[32];
+		unsigned char hash[20];
+		SHA_CTX ctx;
+		memcpy(verifierKeys, hashBuf, 20);
+		GenerateAgileEncryptionKey(verifierKeys, cur_salt->keySize >> 3);
+		ms_office_common_DecryptUsingSymmetricKeyAlgorithm(cur_salt, verifierKeys, cur_salt->encryptedVerifier, decryptedVerifierHashInputBytes, 16);
+		ms_office_common_DecryptUsingSymmetricKeyAlgorithm(cur_salt, &verifierKeys[32], cur_salt->encryptedVerifierHash, decryptedVerifierHashBytes, 32);
+		SHA1_Init(&ctx);
+		SHA1_Update(&ctx, decryptedVerifierHashInputBytes, 16);
+		SHA1_Final(hash, &ctx);
+		return !memcmp(hash, decryptedVerifierHashBytes, 20);
+	}
+	else if (cur_salt->version == 2013) {
+		unsigned char verifierKeys[128], decryptedVerifierHashInputBytes[16], decryptedVerifierHashBytes[32];
+		unsigned char hash[64];
+		SHA512_CTX ctx;
+		memcpy(verifierKeys, hashBuf, 64);
+		GenerateAgileEncryptionKey512(verifierKeys);
+		ms_office_common_DecryptUsingSymmetricKeyAlgorithm(cur_salt, verifierKeys, cur_salt->encryptedVerifier, decryptedVerifierHashInputBytes, 16);
+		ms_office_common_DecryptUsingSymmetricKeyAlgorithm(cur_salt, &verifierKeys[64], cur_salt->encryptedVerifierHash, decryptedVerifierHashBytes, 32);
+		SHA512_Init(&ctx);
+		SHA512_Update(&ctx, decryptedVerifierHashInputBytes, 16);
+		SHA512_Final(hash, &ctx);
+		return !memcmp(hash, decryptedVerifierHashBytes, 20);
+	}
+	return 0;
+}
+
 static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	int count = *pcount;
 	int index = 0;
+	int lanes, spinCount;
+
+	if (cur_salt->version == 2013) {
+		lanes = SHA512_LANES;
+		spinCount = cur_salt->spinCount;
+	} else {
+		lanes = SHA1_LANES;
+		spinCount = (cur_salt->version == 2007) ?
+			MS_OFFICE_2007_ITERATIONS : cur_salt->spinCount;
+	}
 
+	/* The spin loops run lanes candidates in lockstep, then each
+	   candidate's verifier is checked */
 #ifdef _OPENMP
 #pragma omp parallel for
-	for (index = 0; index < count; index++)
 #endif
-	{
-		if(cur_salt->version == 2007) {
-			unsigned char encryptionKey[256];
-			GeneratePasswordHashUsingSHA1(saved_key[index], saved_len[index], encryptionKey);
-			cracked[index] = ms_office_common_PasswordVerifier(cur_salt, encryptionKey);
-		}
-		else if (cur_salt->version == 2010) {
-			unsigned char verifierKeys[64], decryptedVerifierHashInputBytes[16], decryptedVerifierHashBytes[32];
-			unsigned char hash[20];
-			SHA_CTX ctx;
-			GenerateAgileEncryptionKey(saved_key[index], saved_len[index], cur_salt->keySize >> 3, verifierKeys);
-			ms_office_common_DecryptUsingSymmetricKeyAlgorithm(cur_salt, verifierKeys, cur_salt->encryptedVerifier, decryptedVerifierHashInputBytes, 16);
-			ms_office_common_DecryptUsingSymmetricKeyAlgorithm(cur_salt, &verifierKeys[32], cur_salt->encryptedVerifierHash, decryptedVerifierHashBytes, 32);
-			SHA1_Init(&ctx);
-			SHA1_Update(&ctx, decryptedVerifierHashInputBytes, 16);
-			SHA1_Final(hash, &ctx);
-			cracked[index] = !memcmp(hash, decryptedVerifierHashBytes, 20);
-		}
-		else if (cur_salt->version == 2013) {
-			unsigned char verifierKeys[128], decryptedVerifierHashInputBytes[16], decryptedVerifierHashBytes[32];
-			unsigned char hash[64];
-			SHA512_CTX ctx;
-			GenerateAgileEncryptionKey512(saved_key[index], saved_len[index], verifierKeys);
-			ms_office_common_DecryptUsingSymmetricKeyAlgorithm(cur_salt, verifierKeys, cur_salt->encryptedVerifier, decryptedVerifierHashInputBytes, 16);
-			ms_office_common_DecryptUsingSymmetricKeyAlgorithm(cur_salt, &verifierKeys[64], cur_salt->encryptedVerifierHash, decryptedVerifierHashBytes, 32);
-			SHA512_Init(&ctx);
-			SHA512_Update(&ctx, decryptedVerifierHashInputBytes, 16);
-			SHA512_Final(hash, &ctx);
-			cracked[index] = !memcmp(hash, decryptedVerifierHashBytes, 20);
+	for (index = 0; index < count; index += lanes) {
+		JTR_ALIGN(16) unsigned char hashBuf[MAX_KEYS_PER_CRYPT][64];
+		int i;
+
+		if (cur_salt->version == 2013) {
+			for (i = 0; i < lanes; i++)
+				HashPasswordSHA512(saved_key[index + i], saved_len[index + i], hashBuf[i]);
+			SpinSHA512(hashBuf, spinCount);
+		} else {
+			for (i = 0; i < lanes; i++)
+				HashPasswordSHA1(saved_key[index + i], saved_len[index + i], hashBuf[i]);
+			SpinSHA1(hashBuf, spinCount);
 		}
+		for (i = 0; i < lanes && index + i < count; i++)
+			cracked[index + i] = PasswordVerifier(hashBuf[i]);
 	}
 	return count;
 }
@@ -183,6 +183,8 @@ static struct opt_entry opt_list[] = {
 	{"fork", FLG_FORK, FLG_FORK,
 		FLG_CRACKING_CHK, FLG_STDIN_CHK | FLG_STDOUT | FLG_PIPE_CHK | OPT_REQ_PARAM,
 		"%u", &options.fork},
+	{"salt-workers", FLG_ZERO, 0, FLG_CRACKING_CHK, OPT_REQ_PARAM,
+		"%u", &options.salt_workers},
 #endif
 	{"pot", FLG_ZERO, 0, 0, OPT_REQ_PARAM,
 		OPT_FMT_STR_ALLOC, &pers_opts.activepot},
@@ -251,6 +253,18 @@ static struct opt_entry opt_list[] = {
 	{"stress-test", FLG_LOOPTEST | FLG_TEST_SET, FLG_TEST_CHK,
 		0, ~FLG_TEST_SET & ~FLG_FORMAT & ~FLG_SAVEMEM & ~FLG_DYNFMT &
 		~OPT_REQ_PARAM & ~FLG_NOLOG, "%u", &benchmark_time},
+	{"bench-format", FLG_ZERO, 0, FLG_TEST_CHK, OPT_REQ_PARAM,
+		OPT_FMT_STR_ALLOC, &options.bench_format},
+	{"bench-output", FLG_ZERO, 0, FLG_TEST_CHK, OPT_REQ_PARAM,
+		OPT_FMT_STR_ALLOC, &options.bench_output},
+	{"bench-baseline", FLG_ZERO, 0, FLG_TEST_CHK, OPT_REQ_PARAM,
+		OPT_FMT_STR_ALLOC, &options.bench_baseline},
+	{"bench-regress", FLG_ZERO, 0, FLG_TEST_CHK, OPT_REQ_PARAM,
+		"%u", &options.bench_regress},
+	{"test-rules", FLG_ZERO, 0, 0, OPT_REQ_PARAM,
+		OPT_FMT_STR_ALLOC, &options.rules_test},
+	{"test-external", FLG_ZERO, 0, 0, OPT_REQ_PARAM,
+		OPT_FMT_STR_ALLOC, &options.ext_test},
 	{NULL}
 };
 
@@ -447,7 +461,16 @@ void opt_print_hidden_usage(void)
 	puts("--reject-printable        reject printable binaries");
 	puts("--verbosity=N             change verbosity (1-5, default 3)");
 	puts("--skip-self-tests         skip self tests");
+#if OS_FORK
+	puts("--salt-workers=N          split salts with N more processes (see doc/OPTIONS)");
+#endif
 	puts("--stress-test[=TIME]      loop self tests forever");
+	puts("--bench-format=NAME       --test results as csv or json (see doc/OPTIONS)");
+	puts("--bench-output=FILE       write --test results to FILE (csv unless json)");
+	puts("--bench-baseline=FILE     compare --test results to FILE from --bench-output");
+	puts("--bench-regress=N         slowdown in % to report as a regression (5)");
+	puts("--test-rules=SECTION      check compiled rules against the interpreter");
+	puts("--test-external=MODE      benchmark native external mode code (or \"all\")");
 	puts("--input-encoding=NAME     input encoding (alias for --encoding)");
 	puts("--internal-encoding=NAME  encoding used in rules/masks (see doc/ENCODING)");
 	puts("--target-encoding=NAME    output encoding (used by format, see doc/ENCODING)");
@@ -489,6 +512,8 @@ void opt_init(char *name, int argc, char **argv, int show_usage)
 	options.max_run_time = options.status_interval = 0;
 	options.reload_at_save = options.dynamic_bare_hashes_always_valid = 0;
 	options.verbosity = 3;
+	options.bench_regress = BENCHMARK_REGRESS;
+	options.salt_workers = -1;
 
 	list_init(&options.passwd);
 
@@ -780,6 +805,11 @@ void opt_init(char *name, int argc, char **argv, int show_usage)
 		fprintf(stderr, "--fork number must be between 2 and 1024\n");
 		error();
 	}
+	if (options.salt_workers > CRK_WORKERS_MAX) {
+		fprintf(stderr, "--salt-workers number must be at most %d\n",
+		    CRK_WORKERS_MAX);
+		error();
+	}
 #endif
 
 	if (options.node_str) {
@@ -903,7 +933,8 @@ void opt_init(char *name, int argc, char **argv, int show_usage)
 	 * It's from commit 90a8caee.
 	 */
 	if (!(options.subformat && !strcasecmp(options.subformat, "list")) &&
-	    (!options.listconf))
+	    (!options.listconf) && (!options.rules_test) &&
+	    (!options.ext_test))
 	if ((options.flags & (FLG_PASSWD | FLG_PWD_REQ)) == FLG_PWD_REQ) {
 		if (john_main_process)
 			fprintf(stderr, "Password files required, "
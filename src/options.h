@@ -214,6 +214,9 @@ struct options_main {
 	char *node_str;
 	unsigned int node_min, node_max, node_count, fork;
 
+/* Extra processes to split the salts with, -1 for the config file default */
+	int salt_workers;
+
 /* Configuration file name */
 	char *config;
 
@@ -299,6 +302,15 @@ struct options_main {
 	char *regex;
 /* Custom masks */
 	char *custom_mask[MAX_NUM_CUST_PLHDR];
+/* Machine-readable --test results: csv or json, and the file to write to */
+	char *bench_format, *bench_output;
+/* Earlier results to compare against, and slowdown in percent to report */
+	char *bench_baseline;
+	int bench_regress;
+/* Rules section to check compiled rules against the interpreter for */
+	char *rules_test;
+/* External mode to compare native code against the interpreter for */
+	char *ext_test;
 };
 
 extern struct options_main options;
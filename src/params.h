@@ -139,6 +139,12 @@
  */
 #define BENCHMARK_MANY			0x100
 
+/*
+ * Default slowdown (in percent) against a --bench-baseline result that is
+ * reported as a regression.
+ */
+#define BENCHMARK_REGRESS		5
+
 /*
  * File names.
  */
@@ -205,8 +211,8 @@
 
 /*
  * Password hash table thresholds.  These are the counts of entries required
- * to enable the corresponding bitmap size.  The corresponding hash table size
- * may be smaller as determined by PASSWORD_HASH_SHR.
+ * to enable the corresponding bitmap size.  The hash table that goes with
+ * the bitmap is sized according to the count instead, see below.
  */
 #define PASSWORD_HASH_THRESHOLD_0	3
 #define PASSWORD_HASH_THRESHOLD_1	3
@@ -223,13 +229,30 @@ extern int password_hash_sizes[PASSWORD_HASH_SIZES];
 extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
 
 /*
- * How much smaller should the hash tables be than bitmaps in terms of entry
- * count.  Setting this to 0 will result in them having the same number of
- * entries, 1 will make the hash tables twice smaller than bitmaps, etc.
- * 5 or 6 will make them the same size in bytes on systems with 32-bit or
- * 64-bit pointers, respectively.
+ * The per-salt open addressing hash tables have (1 + 1 / 2^PASSWORD_TABLE_SHR)
+ * times as many slots as there are entries, plus one.  Each slot holds a
+ * 32-bit hash, the binary ciphertext and a pointer, so this is a trade-off
+ * between memory usage and the length of probe sequences.
+ */
+#define PASSWORD_TABLE_SHR		2
+
+/*
+ * Hash value marking unused slots in those tables.
  */
-#define PASSWORD_HASH_SHR		2
+#define PASSWORD_TABLE_EMPTY		0xffffffffU
+
+/*
+ * Up to this many smaller bitmaps may be checked (smallest first) before a
+ * salt's main bitmap, so that most computed hashes are rejected without
+ * touching the main bitmap when that one is larger than the CPU caches.
+ * A bitmap size is only used this way if it has at most
+ * PASSWORD_PREFILTER_MAX_SIZE bits (the main bitmap being larger than that)
+ * and at least (1 << PASSWORD_PREFILTER_SHR) times as many bits as the salt
+ * has hashes, so that it rejects most of what it is given.
+ */
+#define PASSWORD_PREFILTER_LEVELS	2
+#define PASSWORD_PREFILTER_MAX_SIZE	PASSWORD_HASH_SIZE_4
+#define PASSWORD_PREFILTER_SHR		2
 
 /*
  * Cracked password hash size, used while loading.
@@ -265,6 +288,12 @@ extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
 #define UNIQUE_HASH_SIZE		(1 << UNIQUE_HASH_LOG)
 #define UNIQUE_BUFFER_SIZE		0x8000000
 
+/*
+ * Maximum number of temporary files for unique -parts=N, all of which are
+ * open at once.
+ */
+#define UNIQUE_MAX_PARTS		256
+
 /*
  * Maximum number of GECOS words per password to load.
  */
@@ -277,6 +306,49 @@ extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
  */
 #define LDR_HASH_COLLISIONS_MAX		1000
 
+/*
+ * Password files at least this large are parsed by several worker processes
+ * (see the "LoaderWorkers" option), each handling chunks of roughly this many
+ * bytes at a time.  The results are still merged into the database in file
+ * order by the main process.
+ */
+#define LDR_WORKERS_MIN_SIZE		0x1000000
+#define LDR_WORKERS_CHUNK_SIZE		0x100000
+
+/*
+ * Maximum number of loader worker processes.
+ */
+#define LDR_WORKERS_MAX			32
+
+/*
+ * Salt worker processes (see the "SaltWorkers" option) are only started if
+ * there are at least this many salts per process, and at most this many.
+ */
+#define CRK_WORKERS_MIN_SALTS		8
+#define CRK_WORKERS_MAX			32
+
+/*
+ * Number of wordlist lines per work unit when --fork'ed processes share their
+ * work dynamically (see the "DynamicFork" option).  Smaller units balance the
+ * load better, but cost a little more time claiming them.
+ */
+#define WORKQ_UNIT_LINES		0x400
+
+/*
+ * Number of crypt_all() calls' worth of candidates (at max_keys_per_crypt)
+ * per work unit in mask mode.
+ */
+#define WORKQ_UNIT_BATCHES		0x10
+
+/*
+ * Number of entries in the ring buffer of hashes cracked by --fork'ed
+ * processes (see the "ShareCracked" option), and the largest binary_size
+ * for which it's used.  A process that falls this many cracks behind the
+ * others gets the rest from the pot file instead.
+ */
+#define CRACKQ_SIZE			0x1000
+#define CRACKQ_BINARY_MAX		0x100
+
 /*
  * Maximum number of GECOS words to try in pairs.
  */
@@ -292,6 +364,12 @@ extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
 #define CHARSET_MAX			0xff
 #define CHARSET_LENGTH			24
 
+/*
+ * Number of candidates incremental mode generates at once, split between
+ * OpenMP threads.
+ */
+#define INC_BLOCK_SIZE			0x1000
+
 /*
  * Compiler parameters.
  */
@@ -307,6 +385,34 @@ extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
  */
 #define RULE_BUFFER_SIZE		0x400
 
+/*
+ * Maximum number of character translation tables in a compiled rule.  Runs
+ * of commands that translate each character (such as case conversions and
+ * substitutions) are merged into one table each.
+ */
+#define RULE_MAPS_MAX			0x20
+
+/*
+ * Number of words rules_apply_block() processes at once.
+ */
+#define RULE_BLOCK_SIZE			0x100
+
+/*
+ * Filter of duplicate candidates produced by wordlist rules (see the
+ * "RulesDupeFilterSize" option, off by default).  Each key sets DEDUPE_HASHES
+ * bits within a block of DEDUPE_BLOCK_SIZE bytes (512 bits, the hashes being
+ * 9 bits each), and a generation holds one key per "RulesDupeFilterBits"
+ * bits.  The false positive rate is in the order of 1 in 20000 at 32 bits
+ * per key, and 1 in a few million at 64.  Sizes are in megabytes.
+ */
+#define DEDUPE_BLOCK_SIZE		64
+#define DEDUPE_HASHES			7
+#define DEDUPE_DEFAULT_BITS		32
+#define DEDUPE_MIN_BITS			8
+#define DEDUPE_MAX_BITS			1024
+#define DEDUPE_DEFAULT_SIZE		0
+#define DEDUPE_MAX_SIZE			0x4000
+
 /*
  * Maximum number of character ranges for rules.
  */
@@ -356,10 +462,24 @@ extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
 /* Markov mode stuff */
 #define MAX_MKV_LVL 400
 #define MAX_MKV_LEN 30
+/* Number of ranks Markov mode generates candidates for at once */
+#define MKV_BLOCK_SIZE 0x1000
+
+/* Number of candidates PRINCE mode generates at once */
+#define PRINCE_BLOCK_SIZE 0x1000
 
 /* Default maximum size of wordlist memory buffer. */
 #define WORDLIST_BUFFER_DEFAULT		5000000
 
+/*
+ * Compressed wordlists are decompressed in chunks of ZFILE_CHUNK_SIZE bytes,
+ * cut at line boundaries.  A checkpoint of the decompressor's state is taken
+ * about every ZFILE_CHECKPOINT_SPAN bytes for crash recovery to resume from,
+ * where the compression format allows for it (only gzip for now).
+ */
+#define ZFILE_CHUNK_SIZE		0x100000
+#define ZFILE_CHECKPOINT_SPAN		0x1000000
+
 /* Number of custom Mask placeholders */
 #define MAX_NUM_CUST_PLHDR 9
 
@@ -200,7 +200,7 @@ static void _pbkdf2_sha256_sse_load_hmac(const unsigned char *K[SSE_GROUP_SZ_SHA
 	}
 }
 
-static void pbkdf2_sha256_sse(const unsigned char *K[MMX_COEF_SHA256], int KL[MMX_COEF_SHA256], unsigned char *S, int SL, int R, unsigned char *out[MMX_COEF_SHA256], int outlen, int skip_bytes)
+static void pbkdf2_sha256_sse(const unsigned char *K[SSE_GROUP_SZ_SHA256], int KL[SSE_GROUP_SZ_SHA256], unsigned char *S, int SL, int R, unsigned char *out[SSE_GROUP_SZ_SHA256], int outlen, int skip_bytes)
 {
 	unsigned char tmp_hash[SHA256_DIGEST_LENGTH];
 	ARCH_WORD_32 *i1, *i2, *o1, *ptmp;
@@ -94,6 +94,9 @@
 #if (!AC_BUILT || HAVE_UNISTD_H) && !_MSC_VER
 #include <unistd.h>
 #endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "arch.h"
 #include "jumbo.h"
@@ -156,12 +159,6 @@ typedef struct
 
 } pw_order_t;
 
-typedef struct
-{
-  u8   *buf;
-
-} elem_t;
-
 typedef struct
 {
   u8   *buf;
@@ -170,11 +167,13 @@ typedef struct
   mpz_t ks_cnt;
   mpz_t ks_pos;
 
+  u64   ks_cnt_u64; // 0 if the keyspace doesn't fit in 64 bits
+
 } chain_t;
 
 typedef struct
 {
-  elem_t  *elems_buf;
+  u8      *elems_buf; // elems_cnt elements of the entry's length, back to back
   u64      elems_cnt;
   u64      elems_alloc;
 
@@ -375,7 +374,7 @@ static void usage_big_print (const char *progname)
 #define malloc_tiny(size)	mem_alloc_tiny(size, MEM_ALIGN_NONE)
 #endif
 
-static void check_realloc_elems (db_entry_t *db_entry)
+static void check_realloc_elems (db_entry_t *db_entry, const int elem_len)
 {
   if (db_entry->elems_cnt == db_entry->elems_alloc)
   {
@@ -383,11 +382,11 @@ static void check_realloc_elems (db_entry_t *db_entry)
 
     const u64 elems_alloc_new = elems_alloc + ALLOC_NEW_ELEMS;
 
-    db_entry->elems_buf = (elem_t *) realloc (db_entry->elems_buf, elems_alloc_new * sizeof (elem_t));
+    db_entry->elems_buf = (u8 *) realloc (db_entry->elems_buf, elems_alloc_new * elem_len);
 
     if (db_entry->elems_buf == NULL)
     {
-      fprintf (stderr, "Out of memory trying to allocate %zu bytes\n", (size_t) elems_alloc_new * sizeof (elem_t));
+      fprintf (stderr, "Out of memory trying to allocate %zu bytes\n", (size_t) elems_alloc_new * elem_len);
 
 #ifndef JTR_MODE
       exit (-1);
@@ -396,8 +395,6 @@ static void check_realloc_elems (db_entry_t *db_entry)
 #endif
     }
 
-    memset (&db_entry->elems_buf[elems_alloc], 0, ALLOC_NEW_ELEMS * sizeof (elem_t));
-
     db_entry->elems_alloc = elems_alloc_new;
   }
 }
@@ -552,12 +549,57 @@ static void chain_ks (const chain_t *chain_buf, const db_entry_t *db_entries, mp
   }
 }
 
+static u64 chain_ks_u64 (const chain_t *chain_buf, const db_entry_t *db_entries)
+{
+  const u8 *buf = chain_buf->buf;
+  const int cnt = chain_buf->cnt;
+
+  u64 ks_cnt = 1;
+
+  for (int idx = 0; idx < cnt; idx++)
+  {
+    const u8 db_key = buf[idx];
+
+    const db_entry_t *db_entry = &db_entries[db_key];
+
+    const u64 elems_cnt = db_entry->elems_cnt;
+
+    if (ks_cnt > UINT64_MAX / elems_cnt) return 0;
+
+    ks_cnt *= elems_cnt;
+  }
+
+  return ks_cnt;
+}
+
 static void set_chain_ks_poses (const chain_t *chain_buf, const db_entry_t *db_entries, mpz_t *tmp, u64 cur_chain_ks_poses[OUT_LEN_MAX])
 {
   const u8 *buf = chain_buf->buf;
 
   const int cnt = chain_buf->cnt;
 
+  if (chain_buf->ks_cnt_u64)
+  {
+    // positions within the chain fit, no need for mpz arithmetic
+
+    u64 ks_pos = mpz_get_ui (*tmp);
+
+    for (int idx = 0; idx < cnt; idx++)
+    {
+      const u8 db_key = buf[idx];
+
+      const db_entry_t *db_entry = &db_entries[db_key];
+
+      const u64 elems_cnt = db_entry->elems_cnt;
+
+      cur_chain_ks_poses[idx] = ks_pos % elems_cnt;
+
+      ks_pos /= elems_cnt;
+    }
+
+    return;
+  }
+
   for (int idx = 0; idx < cnt; idx++)
   {
     const u8 db_key = buf[idx];
@@ -572,6 +614,37 @@ static void set_chain_ks_poses (const chain_t *chain_buf, const db_entry_t *db_e
   }
 }
 
+static void chain_ks_poses_add (const chain_t *chain_buf, const db_entry_t *db_entries, u64 cur_chain_ks_poses[OUT_LEN_MAX], u64 ks_add)
+{
+  const u8 *buf = chain_buf->buf;
+
+  const int cnt = chain_buf->cnt;
+
+  for (int idx = 0; idx < cnt && ks_add; idx++)
+  {
+    const u8 db_key = buf[idx];
+
+    const db_entry_t *db_entry = &db_entries[db_key];
+
+    const u64 elems_cnt = db_entry->elems_cnt;
+
+    const u64 elems_idx = cur_chain_ks_poses[idx] + ks_add % elems_cnt;
+
+    ks_add /= elems_cnt;
+
+    if (elems_idx < elems_cnt)
+    {
+      cur_chain_ks_poses[idx] = elems_idx;
+    }
+    else
+    {
+      cur_chain_ks_poses[idx] = elems_idx - elems_cnt;
+
+      ks_add++;
+    }
+  }
+}
+
 static void chain_set_pwbuf_init (const chain_t *chain_buf, const db_entry_t *db_entries, const u64 cur_chain_ks_poses[OUT_LEN_MAX], char *pw_buf)
 {
   const u8 *buf = chain_buf->buf;
@@ -586,7 +659,7 @@ static void chain_set_pwbuf_init (const chain_t *chain_buf, const db_entry_t *db
 
     const u64 elems_idx = cur_chain_ks_poses[idx];
 
-    memcpy (pw_buf, db_entry->elems_buf[elems_idx].buf, db_key);
+    memcpy (pw_buf, &db_entry->elems_buf[elems_idx * db_key], db_key);
 
     pw_buf += db_key;
   }
@@ -612,14 +685,14 @@ static void chain_set_pwbuf_increment (const chain_t *chain_buf, const db_entry_
 
     if (elems_idx < elems_cnt)
     {
-      memcpy (pw_buf, db_entry->elems_buf[elems_idx].buf, db_key);
+      memcpy (pw_buf, &db_entry->elems_buf[elems_idx * db_key], db_key);
 
       break;
     }
 
     cur_chain_ks_poses[idx] = 0;
 
-    memcpy (pw_buf, db_entry->elems_buf[0].buf, db_key);
+    memcpy (pw_buf, db_entry->elems_buf, db_key);
 
     pw_buf += db_key;
   }
@@ -661,16 +734,35 @@ static mpz_t pos, rec_pos;
 static uint64_t node_dist, rec_dist;
 static int rec_pos_destroyed;
 
+/*
+ * While going through a chain, pos is where the run of candidates started and
+ * pos_iter is the offset of the next candidate, out of pos_iter_max.
+ */
+static u64 pos_iter, pos_iter_max, rec_pos_iter;
+
+/*
+ * Candidates generated at once.  With several threads, each generates a
+ * consecutive share of the block from its own copy of the chain positions.
+ */
+static int block_threads;
+static char *block_keys;
+static u64 (*block_poses)[OUT_LEN_MAX];
+
 static void save_state(FILE *file)
 {
   mpz_t half; mpz_init(half);
+  mpz_t full; mpz_init(full);
 
-  mpz_fdiv_r_2exp(half, rec_pos, 64); // lower 64 bits
+  mpz_add_ui(full, rec_pos, rec_pos_iter);
+
+  mpz_fdiv_r_2exp(half, full, 64); // lower 64 bits
   fprintf(file, "%llu\n", (unsigned long long)mpz_get_ui(half));
 
-  mpz_fdiv_q_2exp(half, rec_pos, 64); // upper 64 bits
+  mpz_fdiv_q_2exp(half, full, 64); // upper 64 bits
   fprintf(file, "%llu\n", (unsigned long long)mpz_get_ui(half));
 
+  mpz_clear(full);
+
   fprintf(file, "%llu\n", (unsigned long long)rec_dist);
 }
 
@@ -679,18 +771,18 @@ static int restore_state(FILE *file)
   unsigned long long temp;
   mpz_t hi;
 
-  if (fscanf(file, "%llu\n", &temp))
+  if (fscanf(file, "%llu\n", &temp) != 1)
     return 1;
   mpz_set_ui(rec_pos, temp);
 
-  if (fscanf(file, "%llu\n", &temp))
+  if (fscanf(file, "%llu\n", &temp) != 1)
     return 1;
   mpz_init_set_ui(hi, temp);
   mpz_mul_2exp(hi, hi, 64); // hi = temp << 64
   mpz_add(rec_pos, rec_pos, hi);
   mpz_clear(hi);
 
-  if (fscanf(file, "%llu\n", &temp))
+  if (fscanf(file, "%llu\n", &temp) != 1)
     return 1;
   rec_dist = temp;
 
@@ -700,7 +792,28 @@ static int restore_state(FILE *file)
 static void fix_state(void)
 {
   mpz_set(rec_pos, pos);
+  rec_pos_iter = pos_iter;
+
+  // A run restored from the middle gets its node_dist increment again
   rec_dist = node_dist;
+  if (options.node_count && pos_iter && pos_iter < pos_iter_max)
+    rec_dist--;
+}
+
+static void chain_key_block (const chain_t *chain_buf, const db_entry_t *db_entries, u64 cur_chain_ks_poses[OUT_LEN_MAX], const int pw_len, const int keys_cnt, char *keys_buf)
+{
+  char pw_buf[OUT_LEN_MAX + 1];
+
+  chain_set_pwbuf_init (chain_buf, db_entries, cur_chain_ks_poses, pw_buf);
+
+  pw_buf[pw_len] = 0;
+
+  for (int keys_idx = 0; keys_idx < keys_cnt; keys_idx++)
+  {
+    memcpy (&keys_buf[keys_idx * (pw_len + 1)], pw_buf, pw_len + 1);
+
+    chain_set_pwbuf_increment (chain_buf, db_entries, cur_chain_ks_poses, pw_buf);
+  }
 }
 
 static double get_progress(void)
@@ -1054,21 +1167,19 @@ void do_prince_crack(struct db_main *db, char *filename)
 
     db_entry_t *db_entry = &db_entries[input_len];
 
-    check_realloc_elems (db_entry);
+    check_realloc_elems (db_entry, input_len);
 
-    elem_t *elem_buf = &db_entry->elems_buf[db_entry->elems_cnt];
+    u8 *elem_buf = &db_entry->elems_buf[db_entry->elems_cnt * input_len];
 
-    elem_buf->buf = malloc_tiny (input_len);
-
-    memcpy (elem_buf->buf, input_buf, input_len);
+    memcpy (elem_buf, input_buf, input_len);
 
     db_entry->elems_cnt++;
 
     if (case_permute)
     {
-      check_realloc_elems (db_entry);
+      check_realloc_elems (db_entry, input_len);
 
-      elem_t *elem_buf = &db_entry->elems_buf[db_entry->elems_cnt];
+      u8 *elem_buf = &db_entry->elems_buf[db_entry->elems_cnt * input_len];
 
       const char old_c = input_buf[0];
 
@@ -1079,9 +1190,7 @@ void do_prince_crack(struct db_main *db, char *filename)
       {
         input_buf[0] = new_cu;
 
-        elem_buf->buf = malloc_tiny (input_len);
-
-        memcpy (elem_buf->buf, input_buf, input_len);
+        memcpy (elem_buf, input_buf, input_len);
 
         db_entry->elems_cnt++;
       }
@@ -1090,9 +1199,7 @@ void do_prince_crack(struct db_main *db, char *filename)
       {
         input_buf[0] = new_cl;
 
-        elem_buf->buf = malloc_tiny (input_len);
-
-        memcpy (elem_buf->buf, input_buf, input_len);
+        memcpy (elem_buf, input_buf, input_len);
 
         db_entry->elems_cnt++;
       }
@@ -1251,6 +1358,8 @@ void do_prince_crack(struct db_main *db, char *filename)
 
       chain_ks (chain_buf, db_entries, &chain_buf->ks_cnt);
 
+      chain_buf->ks_cnt_u64 = chain_ks_u64 (chain_buf, db_entries);
+
       mpz_add (tmp, tmp, chain_buf->ks_cnt);
     }
 
@@ -1299,6 +1408,15 @@ void do_prince_crack(struct db_main *db, char *filename)
   mpf_set_z(count, total_ks_cnt);
 
   crk_init(db, fix_state, NULL);
+
+  block_threads = 1;
+#ifdef _OPENMP
+  block_threads = omp_get_max_threads();
+  if (block_threads > PRINCE_BLOCK_SIZE)
+    block_threads = PRINCE_BLOCK_SIZE;
+#endif
+  block_keys = mem_alloc(PRINCE_BLOCK_SIZE * (OUT_LEN_MAX + 1));
+  block_poses = mem_alloc(block_threads * sizeof(*block_poses));
 #endif
 
   /**
@@ -1517,6 +1635,8 @@ void do_prince_crack(struct db_main *db, char *filename)
       pw_buf[pw_len] = '\n';
 #else
       pw_buf[pw_len] = '\0';
+
+      char pw_filtered[PLAINTEXT_BUFFER_SIZE];
 #endif
 
       db_entry_t *db_entry = &db_entries[pw_len];
@@ -1560,7 +1680,7 @@ void do_prince_crack(struct db_main *db, char *filename)
 
 #ifdef JTR_MODE
         u32 for_node, node_skip = 0;
-        if (options.node_count)
+        if (options.node_count && mpz_cmp (tmp, skip) > 0)
         {
           for_node = ++node_dist % options.node_count + 1;
           node_skip = for_node < options.node_min ||
@@ -1584,22 +1704,85 @@ void do_prince_crack(struct db_main *db, char *filename)
             set_chain_ks_poses (chain_buf, db_entries, &tmp, db_entry->cur_chain_ks_poses);
           }
 
+#ifndef JTR_MODE
           chain_set_pwbuf_init (chain_buf, db_entries, db_entry->cur_chain_ks_poses, pw_buf);
 
           while (iter_pos_u64 < iter_max_u64)
           {
-#ifndef JTR_MODE
             out_push (out, pw_buf, pw_len + 1);
-#else
-            if (ext_filter(pw_buf))
-            if ((jtr_done = crk_process_key(pw_buf)))
-              break;
-#endif
 
             chain_set_pwbuf_increment (chain_buf, db_entries, db_entry->cur_chain_ks_poses, pw_buf);
 
             iter_pos_u64++;
           }
+#else
+          const int share = PRINCE_BLOCK_SIZE / block_threads;
+
+          mpz_set (pos, total_ks_pos);
+
+          pos_iter_max = iter_max_u64;
+
+          if (block_threads == 1)
+          {
+            chain_set_pwbuf_init (chain_buf, db_entries, db_entry->cur_chain_ks_poses, pw_buf);
+
+            while (iter_pos_u64 < iter_max_u64)
+            {
+              pos_iter = ++iter_pos_u64;
+
+              if (!f_filter || ext_filter_body(pw_buf, pw_filtered))
+              if ((jtr_done = crk_process_key(f_filter ? pw_filtered : pw_buf)))
+                break;
+
+              chain_set_pwbuf_increment (chain_buf, db_entries, db_entry->cur_chain_ks_poses, pw_buf);
+            }
+          }
+          else
+          while (iter_pos_u64 < iter_max_u64)
+          {
+            const u64 keys_left = iter_max_u64 - iter_pos_u64;
+
+            int threads;
+
+            memcpy (block_poses[0], db_entry->cur_chain_ks_poses, sizeof (block_poses[0]));
+
+            for (threads = 1; threads < block_threads && (u64) threads * share < keys_left; threads++)
+            {
+              memcpy (block_poses[threads], block_poses[threads - 1], sizeof (block_poses[0]));
+
+              chain_ks_poses_add (chain_buf, db_entries, block_poses[threads], share);
+            }
+
+            const int keys_cnt = MIN (keys_left, (u64) threads * share);
+
+#ifdef _OPENMP
+#pragma omp parallel for if (threads > 1)
+#endif
+            for (int t = 0; t < threads; t++)
+            {
+              const int keys_off = t * share;
+
+              chain_key_block (chain_buf, db_entries, block_poses[t], pw_len, MIN (share, keys_cnt - keys_off), &block_keys[keys_off * (pw_len + 1)]);
+            }
+
+            memcpy (db_entry->cur_chain_ks_poses, block_poses[threads - 1], sizeof (block_poses[0]));
+
+            for (int keys_idx = 0; keys_idx < keys_cnt; keys_idx++)
+            {
+              char *key = &block_keys[keys_idx * (pw_len + 1)];
+
+              pos_iter = iter_pos_u64 + keys_idx + 1;
+
+              if (!f_filter || ext_filter_body(key, pw_filtered))
+              if ((jtr_done = crk_process_key(f_filter ? pw_filtered : key)))
+                break;
+            }
+
+            if (jtr_done) break;
+
+            iter_pos_u64 += keys_cnt;
+          }
+#endif
         }
         else
         {
@@ -1608,15 +1791,17 @@ void do_prince_crack(struct db_main *db, char *filename)
           set_chain_ks_poses (chain_buf, db_entries, &tmp, db_entry->cur_chain_ks_poses);
         }
 
+#ifdef JTR_MODE
+        if (jtr_done || event_abort)
+          break;
+#endif
         outs_pos += iter_max_u64;
 
         mpz_add (total_ks_pos, total_ks_pos, iter_max);
 
 #ifdef JTR_MODE
         mpz_set(pos, total_ks_pos);
-
-        if (jtr_done || event_abort)
-          break;
+        pos_iter = 0;
 #endif
         mpz_add (chain_buf->ks_pos, chain_buf->ks_pos, iter_max);
 
@@ -1654,7 +1839,10 @@ void do_prince_crack(struct db_main *db, char *filename)
   log_event("PRINCE done. Cleaning up.");
 
   if (!event_abort)
-      mpz_set(rec_pos, total_ks_cnt);
+  {
+    mpz_set(rec_pos, total_ks_cnt);
+    rec_pos_iter = 0;
+  }
 #endif
   mpz_clear (iter_max);
   mpz_clear (total_ks_cnt);
@@ -1700,6 +1888,9 @@ void do_prince_crack(struct db_main *db, char *filename)
   crk_done();
   rec_done(event_abort || (status.pass && db->salts));
 
+  MEM_FREE(block_poses);
+  MEM_FREE(block_keys);
+
   mpf_clear(count);
   mpz_clear(pos);
   rec_pos_destroyed = 1;
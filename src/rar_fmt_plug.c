@@ -81,13 +81,19 @@ john_register_one(&fmt_rar);
 #include "options.h"
 #include "unicode.h"
 #include "johnswap.h"
+#include "sse-intrinsics.h"
 #include "unrar.h"
 #include "config.h"
 #include "jumbo.h"
 
 #define FORMAT_LABEL		"rar"
 #define FORMAT_NAME		"RAR3"
+#ifdef MMX_COEF
+#define NBKEYS			(MMX_COEF * SHA1_SSE_PARA)
+#define ALGORITHM_NAME		"SHA1 " SHA1_ALGORITHM_NAME " AES"
+#else
 #define ALGORITHM_NAME		"SHA1 AES 32/" ARCH_BITS_STR
+#endif
 
 #ifdef DEBUG
 #define BENCHMARK_COMMENT	" (1-16 characters)"
@@ -102,17 +108,28 @@ john_register_one(&fmt_rar);
 #define BINARY_ALIGN		MEM_ALIGN_NONE
 #define SALT_SIZE		sizeof(rarfile*)
 #define SALT_ALIGN		sizeof(rarfile*)
+#ifdef MMX_COEF
+#define MIN_KEYS_PER_CRYPT	NBKEYS
+/* Room for grouping the keys by length */
+#define MAX_KEYS_PER_CRYPT	(4 * NBKEYS)
+#else
 #define MIN_KEYS_PER_CRYPT	1
 #define MAX_KEYS_PER_CRYPT	1
+#endif
 
 #define ROUNDS			0x40000
+#ifdef MMX_COEF
+/* 64 copies of password, salt and counter, per SIMD lane */
+#define SHA1_BUF_SIZE		(64 * (UNICODE_LENGTH + 8 + 3) * NBKEYS)
+#endif
 
 #define MIN(a, b)		(((a) > (b)) ? (b) : (a))
 #define MAX(a, b)		(((a) > (b)) ? (a) : (b))
 
 /* The reason we want to bump OMP_SCALE in this case is to even out the
    difference in processing time for different length keys. It doesn't
-   boost performance in other ways */
+   boost performance in other ways. The SIMD code groups the keys by
+   length instead. */
 #ifdef _MSC_VER
 #undef _OPENMP
 #endif
@@ -120,7 +137,11 @@ john_register_one(&fmt_rar);
 #ifdef _OPENMP
 #include <omp.h>
 #include <pthread.h>
+#ifdef MMX_COEF
+#define OMP_SCALE		1
+#else
 #define OMP_SCALE		4
+#endif
 static pthread_mutex_t *lockarray;
 #endif
 
@@ -135,6 +156,11 @@ static unpack_data_t (*unpack_data);
 static unsigned int *saved_len;
 static unsigned char *aes_key;
 static unsigned char *aes_iv;
+#ifdef MMX_COEF
+static ARCH_WORD_32 *sha1_buf;
+/* Key indices grouped by length, each group padded to a multiple of NBKEYS */
+static int *MixOrder;
+#endif
 
 typedef struct {
 	dyna_salt dsalt; /* must be first. allows dyna_salt to work */
@@ -425,6 +451,13 @@ static void init(struct fmt_main *self)
 		self->params.plaintext_length = MIN(125, 3 * PLAINTEXT_LENGTH);
 
 	unpack_data = mem_calloc_tiny(sizeof(unpack_data_t) * omp_t, MEM_ALIGN_WORD);
+#ifdef MMX_COEF
+	sha1_buf = mem_calloc_tiny(SHA1_BUF_SIZE * omp_t, MEM_ALIGN_SIMD);
+	MixOrder = mem_calloc_tiny(sizeof(*MixOrder) *
+	                           (self->params.max_keys_per_crypt +
+	                            NBKEYS * (UNICODE_LENGTH / 2 + 1)),
+	                           MEM_ALIGN_WORD);
+#endif
 	cracked = mem_calloc_tiny(sizeof(*cracked) * self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
 	saved_key = mem_calloc_tiny(UNICODE_LENGTH * self->params.max_keys_per_crypt, MEM_ALIGN_NONE);
 	saved_len = mem_calloc_tiny(sizeof(*saved_len) * self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
@@ -657,11 +690,174 @@ static MAYBE_INLINE int check_huffman(unsigned char *next) {
 	return 1; /* Passed this check! */
 }
 
+#ifdef MMX_COEF
+/*
+ * The SHA-1 input is ROUNDS copies of the password, salt and a 3 byte round
+ * counter, so any run of 64 copies is exactly RawLength blocks.  For NBKEYS
+ * keys of the same length, we build those blocks once, in SIMD order and
+ * endianity, and then only patch the counters for each run.
+ */
+#define WORDPOS(blk, w, lane)	((blk) * 16 * NBKEYS + \
+	((lane) / MMX_COEF) * 16 * MMX_COEF + (w) * MMX_COEF + \
+	((lane) & (MMX_COEF - 1)))
+#define HASHPOS(w, lane)	(((lane) / MMX_COEF) * 5 * MMX_COEF + \
+	(w) * MMX_COEF + ((lane) & (MMX_COEF - 1)))
+
+static const ARCH_WORD_32 sha1_iv[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+/* Set a byte of the input to the same value in all lanes */
+static void patch_byte(ARCH_WORD_32 *buf, int pos, unsigned char c)
+{
+	ARCH_WORD_32 *w = &buf[WORDPOS(pos >> 6, (pos >> 2) & 15, 0)];
+	int shift = (3 - (pos & 3)) << 3;
+	ARCH_WORD_32 mask = ~(0xffU << shift), val = (ARCH_WORD_32)c << shift;
+	int p, l;
+
+	for (p = 0; p < SHA1_SSE_PARA; p++, w += 16 * MMX_COEF)
+		for (l = 0; l < MMX_COEF; l++)
+			w[l] = (w[l] & mask) | val;
+}
+
+/* Padded last block(s) of a message of total bytes, ending with RawPsw[start..end) */
+static int final_blocks(ARCH_WORD_32 *fin,
+                        unsigned char RawPsw[NBKEYS][UNICODE_LENGTH + 8 + 3],
+                        int start, int end, ARCH_WORD_32 total)
+{
+	int blocks = (end - start + 9 + 63) >> 6;
+	int k, i;
+
+	for (k = 0; k < NBKEYS; k++) {
+		unsigned char block[128];
+
+		memset(block, 0, sizeof(block));
+		memcpy(block, &RawPsw[k][start], end - start);
+		block[end - start] = 0x80;
+		for (i = 0; i < 4; i++)
+			block[(blocks << 6) - 1 - i] = (total << 3) >> (i << 3);
+		for (i = 0; i < blocks << 4; i++)
+			fin[WORDPOS(i >> 4, i & 15, k)] =
+				(ARCH_WORD_32)block[4 * i] << 24 |
+				(ARCH_WORD_32)block[4 * i + 1] << 16 |
+				(ARCH_WORD_32)block[4 * i + 2] << 8 |
+				block[4 * i + 3];
+	}
+	return blocks;
+}
+
+static void rar_key_simd(int *order, ARCH_WORD_32 *buf)
+{
+	unsigned char RawPsw[NBKEYS][UNICODE_LENGTH + 8 + 3];
+	JTR_ALIGN(16) ARCH_WORD_32 state[5 * NBKEYS];
+	JTR_ALIGN(16) ARCH_WORD_32 tmp_state[5 * NBKEYS];
+	JTR_ALIGN(16) ARCH_WORD_32 fin[2 * 16 * NBKEYS];
+	int plen = saved_len[order[0]];
+	int RawLength = plen + 8 + 3;
+	int first = RawLength >> 6; /* full blocks in the first copy */
+	int i, j, k, b;
+
+	for (k = 0; k < NBKEYS; k++) {
+		unsigned char *c = RawPsw[k];
+
+		memcpy(c, &saved_key[UNICODE_LENGTH * order[k]], plen);
+		memcpy(c + plen, saved_salt, 8);
+		memset(c + plen + 8, 0, 3);
+		for (i = 0; i < RawLength << 4; i++) {
+			int pos = i << 2;
+
+			buf[WORDPOS(i >> 4, i & 15, k)] =
+				(ARCH_WORD_32)c[pos % RawLength] << 24 |
+				(ARCH_WORD_32)c[(pos + 1) % RawLength] << 16 |
+				(ARCH_WORD_32)c[(pos + 2) % RawLength] << 8 |
+				c[(pos + 3) % RawLength];
+		}
+		for (j = 0; j < 5; j++)
+			state[HASHPOS(j, k)] = sha1_iv[j];
+	}
+
+	for (i = 0; i < ROUNDS; i += 64) {
+		for (j = 0; j < 64; j++) {
+			int pos = (j + 1) * RawLength - 3;
+
+			patch_byte(buf, pos, (unsigned char)(i + j));
+			if ((i & 0xff) == 0) {
+				patch_byte(buf, pos + 1, (unsigned char)(i >> 8));
+				patch_byte(buf, pos + 2, (unsigned char)(i >> 16));
+			}
+		}
+		for (b = 0; b < RawLength; b++) {
+			/* IV byte, from the digest up to the first copy of this run */
+			if (b == first && i % (ROUNDS / 16) == 0) {
+				int blocks;
+
+				for (k = 0; k < NBKEYS; k++) {
+					RawPsw[k][plen + 8] = (unsigned char)i;
+					RawPsw[k][plen + 9] = (unsigned char)(i >> 8);
+					RawPsw[k][plen + 10] = (unsigned char)(i >> 16);
+				}
+				blocks = final_blocks(fin, RawPsw, first << 6,
+				                      RawLength, (i + 1) * RawLength);
+				SSESHA1body((__m128i*)fin, tmp_state, state,
+				            SSEi_RELOAD|SSEi_MIXED_IN);
+				if (blocks == 2)
+					SSESHA1body((__m128i*)&fin[16 * NBKEYS],
+					            tmp_state, tmp_state,
+					            SSEi_RELOAD|SSEi_MIXED_IN);
+				for (k = 0; k < NBKEYS; k++)
+					aes_iv[order[k] * 16 + i / (ROUNDS / 16)] =
+						tmp_state[HASHPOS(4, k)];
+			}
+			SSESHA1body((__m128i*)&buf[b * 16 * NBKEYS], state, state,
+			            SSEi_RELOAD|SSEi_MIXED_IN);
+		}
+	}
+
+	/* The data ends on a block boundary, so this is only padding */
+	final_blocks(fin, RawPsw, 0, 0, ROUNDS * RawLength);
+	SSESHA1body((__m128i*)fin, state, state, SSEi_RELOAD|SSEi_MIXED_IN);
+	for (k = 0; k < NBKEYS; k++)
+		for (j = 0; j < 4; j++)
+			for (i = 0; i < 4; i++)
+				aes_key[order[k] * 16 + j * 4 + i] =
+					state[HASHPOS(j, k)] >> (i << 3);
+}
+#endif
+
 static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	int count = *pcount;
 	int index = 0;
 
+#ifdef MMX_COEF
+	int tot_todo = 0;
+	int len;
+
+	/* Group the keys by length, filling up the tail of each group with
+	   copies of its last key */
+	for (len = 0; len <= UNICODE_LENGTH; len += 2) {
+		for (index = 0; index < count; index++)
+			if (saved_len[index] == len)
+				MixOrder[tot_todo++] = index;
+		while (tot_todo % NBKEYS) {
+			MixOrder[tot_todo] = MixOrder[tot_todo - 1];
+			tot_todo++;
+		}
+	}
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for (index = 0; index < tot_todo; index += NBKEYS) {
+#ifdef _OPENMP
+		ARCH_WORD_32 *buf =
+			&sha1_buf[omp_get_thread_num() * SHA1_BUF_SIZE / 4];
+#else
+		ARCH_WORD_32 *buf = sha1_buf;
+#endif
+		rar_key_simd(&MixOrder[index], buf);
+	}
+#else
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
@@ -701,6 +897,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 			digest[i] = JOHNSWAP(digest[i]);
 		memcpy(&aes_key[i16], (unsigned char*)digest, 16);
 	}
+#endif
 
 #ifdef _OPENMP
 #pragma omp parallel for
@@ -234,6 +234,32 @@ key_cleaning:
 	}
 	keybuffer[14*MMX_COEF] = len << 3;
 }
+
+/* Lay out the first key as usual, then copy its lane for the others */
+static void set_key_range(char *key, int index, int pos, unsigned char *chars,
+                          int count)
+{
+	ARCH_WORD_32 *base = &((ARCH_WORD_32*)saved_key)[(index&(MMX_COEF-1)) + (index>>(MMX_COEF>>1))*MD5_BUF_SIZ*MMX_COEF];
+	unsigned int i, words;
+	int j;
+
+	set_key(key, index);
+	((unsigned char*)saved_key)[GETPOS(pos, index)] = chars[0];
+	/* key words including the one with the 0x80 terminator */
+	words = (base[14*MMX_COEF] >> 5) + 1;
+
+	for (j = 1; j < count; j++) {
+		int idx = index + j;
+		ARCH_WORD_32 *keybuffer = &((ARCH_WORD_32*)saved_key)[(idx&(MMX_COEF-1)) + (idx>>(MMX_COEF>>1))*MD5_BUF_SIZ*MMX_COEF];
+
+		for (i = 0; i < words; i++)
+			keybuffer[i*MMX_COEF] = base[i*MMX_COEF];
+		while (keybuffer[i*MMX_COEF])
+			keybuffer[i++*MMX_COEF] = 0;
+		keybuffer[14*MMX_COEF] = base[14*MMX_COEF];
+		((unsigned char*)saved_key)[GETPOS(pos, idx)] = chars[j];
+	}
+}
 #else
 static void set_key(char *key, int index)
 {
@@ -401,7 +427,12 @@ struct fmt_main fmt_rawMD5 = {
 		},
 		cmp_all,
 		cmp_one,
-		cmp_exact
+		cmp_exact,
+#ifdef MMX_COEF
+		set_key_range
+#else
+		NULL
+#endif
 	}
 };
 
@@ -97,6 +97,8 @@ static struct fmt_tests tests[] = {
 #ifdef MMX_COEF
 JTR_ALIGN(16) ARCH_WORD_32 saved_key[SHA_BUF_SIZ*NBKEYS];
 JTR_ALIGN(16) ARCH_WORD_32 crypt_key[BINARY_SIZE/4*NBKEYS];
+/* Index last passed to cmp_exact(), the only one source() may fix up from */
+static int source_index = -1;
 static unsigned char out[PLAINTEXT_LENGTH + 1];
 #else
 static char saved_key[PLAINTEXT_LENGTH + 1];
@@ -222,6 +224,9 @@ static int cmp_all(void *binary, int count) {
 
 static int cmp_exact(char *source, int count)
 {
+#ifdef MMX_COEF
+	source_index = count;
+#endif
 	return (1);
 }
 
@@ -328,14 +333,20 @@ static char *source(char *source, void *binary)
 	int i;
 
 #ifdef MMX_COEF
-	for (i = 0; i < NBKEYS; ++i) {
+	/*
+	 * Only look at the key that was just confirmed as cracked.  Any other
+	 * crypt_key[] entry may be stale (as in the self-test, where source()
+	 * is called before the crypt and must return the ciphertext as is).
+	 */
+	i = source_index;
+	source_index = -1;
+	if (i >= 0 && i < NBKEYS) {
 		if (crypt_key[(i/MMX_COEF)*20+MMX_COEF+(i%MMX_COEF)] == ((ARCH_WORD_32*)binary)[1]) {
 			// Ok, we may have found it.  Check the next 3 DWORDS
 			if (crypt_key[(i/MMX_COEF)*20+MMX_COEF*2+(i%MMX_COEF)] == ((ARCH_WORD_32*)binary)[2] &&
 			    crypt_key[(i/MMX_COEF)*20+MMX_COEF*3+(i%MMX_COEF)] == ((ARCH_WORD_32*)binary)[3] &&
 			    crypt_key[(i/MMX_COEF)*20+MMX_COEF*4+(i%MMX_COEF)] == ((ARCH_WORD_32*)binary)[4]) {
 				((ARCH_WORD_32*)binary)[0] = crypt_key[(i/MMX_COEF)*20+(i%MMX_COEF)];
-				break;
 			}
 		}
 	}
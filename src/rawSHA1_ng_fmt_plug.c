@@ -422,6 +422,29 @@ static void sha1_fmt_set_key(char *key, int index)
     return;
 }
 
+// Every key has its own 16 byte slot in M, so for a range of keys differing
+// only in one character we can simply copy the first one and patch that
+// character, remembering that the words in M are already byte swapped.
+static void sha1_fmt_set_key_range(char *key, int index, int pos,
+                                   unsigned char *chars, int count)
+{
+    __m128i  X;
+    uint32_t byte = (pos & ~3) + 3 - (pos & 3);
+    int32_t  i;
+
+    sha1_fmt_set_key(key, index);
+    ((uint8_t *)(M[index]))[byte] = chars[0];
+    X = _mm_load_si128(&M[index]);
+
+    for (i = 1; i < count; i++) {
+        _mm_store_si128(&M[index + i], X);
+        ((uint8_t *)(M[index + i]))[byte] = chars[i];
+        N[index + i] = N[index];
+    }
+
+    return;
+}
+
 static char * sha1_fmt_get_key(int index)
 {
     static uint32_t key[5];
@@ -731,6 +754,9 @@ struct fmt_main fmt_sha1_ng = {
     .params                 = {
         .label              = "Raw-SHA1-ng",
         .format_name        = "(pwlen <= 15)",
+        // Each key is held in one __m128i (hence pwlen <= 15), so this
+        // format stays at 4 lanes of 128 bits even on AVX2 and AVX-512;
+        // Raw-SHA1 uses the wider vectors.
         .algorithm_name     = "SHA1 128/128 "
 #if defined(__XOP__)
     "XOP"
@@ -800,7 +826,8 @@ struct fmt_main fmt_sha1_ng = {
         },
         .cmp_all            = sha1_fmt_cmp_all,
         .cmp_one            = sha1_fmt_cmp_one,
-        .cmp_exact          = sha1_fmt_cmp_exact
+        .cmp_exact          = sha1_fmt_cmp_exact,
+        .set_key_range      = sha1_fmt_set_key_range
     },
 };
 
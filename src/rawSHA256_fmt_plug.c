@@ -65,7 +65,7 @@ john_register_one(&fmt_rawSHA256);
 
 #define MIN_KEYS_PER_CRYPT      1
 #ifdef MMX_COEF_SHA256
-#define MAX_KEYS_PER_CRYPT      MMX_COEF_SHA256
+#define MAX_KEYS_PER_CRYPT      (MMX_COEF_SHA256*SHA256_SSE_PARA)
 #else
 #define MAX_KEYS_PER_CRYPT      1
 #endif
@@ -259,7 +259,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 
 #ifdef _OPENMP
 #ifdef MMX_COEF_SHA256
-	int inc = MMX_COEF_SHA256;
+	int inc = MMX_COEF_SHA256*SHA256_SSE_PARA;
 #else
 	int inc = 1;
 #endif
@@ -59,6 +59,8 @@ john_register_one(&fmt_rawSHA256_ng);
 #define SIMD_TYPE                 "SSE2"
 #endif
 
+/* This format has its own 128-bit code (4 lanes), also on AVX2 and AVX-512;
+ * Raw-SHA256 uses the wider vectors */
 #define FORMAT_LABEL              "Raw-SHA256-ng"
 #define FORMAT_NAME               ""
 #define ALGORITHM_NAME            "SHA256 128/128 " SIMD_TYPE " 4x"
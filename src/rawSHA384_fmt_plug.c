@@ -68,7 +68,7 @@ john_register_one(&fmt_rawSHA384);
 
 #define MIN_KEYS_PER_CRYPT		1
 #ifdef MMX_COEF_SHA512
-#define MAX_KEYS_PER_CRYPT      MMX_COEF_SHA512
+#define MAX_KEYS_PER_CRYPT      (MMX_COEF_SHA512*SHA512_SSE_PARA)
 #else
 #define MAX_KEYS_PER_CRYPT		1
 #endif
@@ -279,7 +279,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 
 #ifdef _OPENMP
 #ifdef MMX_COEF_SHA512
-	int inc = MMX_COEF_SHA512;
+	int inc = MMX_COEF_SHA512*SHA512_SSE_PARA;
 #else
 	int inc = 1;
 #endif
@@ -52,6 +52,8 @@ john_register_one(&fmt_rawSHA512_ng);
 #define SIMD_TYPE                 "SSE2"
 #endif
 
+/* This format has its own 128-bit code (2 lanes), also on AVX2 and AVX-512;
+ * Raw-SHA512 uses the wider vectors */
 #define FORMAT_LABEL              "Raw-SHA512-ng"
 #define FORMAT_NAME               ""
 #define ALGORITHM_NAME            "SHA512 128/128 " SIMD_TYPE " 2x"
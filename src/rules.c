@@ -16,6 +16,7 @@
 #include "formats.h"
 #include "loader.h"
 #include "logger.h"
+#include "config.h"
 #include "rpp.h"
 #include "rules.h"
 #include "options.h"
@@ -151,6 +152,51 @@ static struct {
 #define CHARS_CONTROL_ASCII_EXTENDED \
 	"\x84\x85\x88\x8D\x8E\x8F\x90\x96\x97\x98\x9A\x9B\x9C\x9D\x9E\x9F"
 
+/*
+ * A rule command as compiled by rules_compile().  Positions that are
+ * constants are resolved at compile time into length[], and pos[] points
+ * either there or to the variable (which may change as the rule is applied).
+ * Character class arguments point to the class table, or are a single
+ * character in value if class is NULL.
+ */
+struct rules_op {
+	char cmd, value, arg;
+	unsigned char length[3];
+	const unsigned char *pos[3];
+	const char *class, *str;
+	int str_length;
+};
+
+/*
+ * The rule last accepted by rules_reject(), compiled.  rules_apply() runs
+ * this instead of parsing the rule when given the same rule buffer.
+ */
+static struct rules_op rules_prog[RULE_BUFFER_SIZE];
+static char *rules_prog_rule;
+static char rules_prog_maps[RULE_MAPS_MAX][0x100];
+
+/*
+ * Compiled commands that translate each character with the table in str,
+ * replacing runs of the commands below.
+ */
+#define OP_MAP				1
+#define OP_MAP_COMMANDS			"lutSVRLs"
+
+/*
+ * If the compiled rule consists of nothing but translations, appends,
+ * prepends and length checks, it's also reduced to a prefix and a suffix to
+ * add to the word translated with map (unless NULL), with the translations
+ * that come after the appends and prepends already applied to them.  This
+ * lets rules_apply_block() build mangled words in one pass.
+ */
+static struct {
+	int valid;
+	const char *map;
+	int prefix_length, suffix_length;
+	char prefix[RULE_WORD_SIZE], suffix[RULE_WORD_SIZE];
+	char map_buffer[0x100];
+} rules_affix;
+
 static char *conv_source = CONV_SOURCE;
 static char *conv_shift, *conv_invert, *conv_vowels, *conv_right, *conv_left;
 static char *conv_tolower, *conv_toupper;
@@ -218,6 +264,39 @@ static char *conv_tolower, *conv_toupper;
 	alt = in; \
 }
 
+/*
+ * Same as the above, but for rules compiled with rules_compile().
+ */
+#define OP_POSITION(value, n) { \
+	if (((value) = *op->pos[n]) == INVALID_LENGTH) \
+		goto out_OP_ERROR_POSITION; \
+}
+
+#define OP_CLASS_export_pos(start, true, false) { \
+	const char *class = op->class; \
+	if (class) { \
+		for (pos = (start); ARCH_INDEX(in[pos]); pos++) \
+		if (class[ARCH_INDEX(in[pos])]) { \
+			true; \
+		} else { \
+			false; \
+		} \
+	} else { \
+		char value = op->value; \
+		for (pos = (start); ARCH_INDEX(in[pos]); pos++) \
+		if (in[pos] == value) { \
+			true; \
+		} else { \
+			false; \
+		} \
+	} \
+}
+
+#define OP_CLASS(start, true, false) { \
+	int pos; \
+	OP_CLASS_export_pos(start, true, false); \
+}
+
 static void rules_init_class(char name, char *valid)
 {
 	char *pos, inv;
@@ -983,6 +1062,272 @@ void rules_init(int max_length)
 	rules_init_length(max_length);
 }
 
+#define COMPILE_VALUE(value) { \
+	if (!((value) = RULE)) return 0; \
+}
+
+#define COMPILE_POSITION(n) { \
+	unsigned char var = ARCH_INDEX(RULE); \
+	if ((var >= '0' && var <= '9') || (var >= 'A' && var <= 'Z') || \
+	    var == 'z') { \
+		op->length[n] = rules_vars[var]; \
+		op->pos[n] = &op->length[n]; \
+	} else if (var) \
+		op->pos[n] = &rules_vars[var]; \
+	else \
+		return 0; \
+}
+
+#define COMPILE_CLASS { \
+	if ((op->value = RULE) == '?') { \
+		if (!(op->class = rules_classes[ARCH_INDEX(RULE)])) \
+			return 0; \
+	} else if (!op->value) \
+		return 0; \
+}
+
+/*
+ * Applies the per-character command in op on top of the translation in map.
+ */
+static void rules_compile_map(char *map, struct rules_op *op)
+{
+	int c;
+
+	for (c = 1; c < 0x100; c++) {
+		char value = map[c];
+
+		if (op->cmd != 's')
+			map[c] = op->str[ARCH_INDEX(value)];
+		else if (op->class ? op->class[ARCH_INDEX(value)] :
+		    value == op->value)
+			map[c] = op->arg;
+	}
+}
+
+static void rules_compile_affix(void)
+{
+	struct rules_op *op;
+	int pos;
+
+	rules_affix.valid = 0;
+	rules_affix.map = NULL;
+	rules_affix.prefix_length = rules_affix.suffix_length = 0;
+
+	for (op = rules_prog; op->cmd; op++)
+	switch (op->cmd) {
+	case OP_MAP:
+		for (pos = 0; pos < rules_affix.prefix_length; pos++)
+			rules_affix.prefix[pos] =
+			    op->str[ARCH_INDEX(rules_affix.prefix[pos])];
+		for (pos = 0; pos < rules_affix.suffix_length; pos++)
+			rules_affix.suffix[pos] =
+			    op->str[ARCH_INDEX(rules_affix.suffix[pos])];
+		if (rules_affix.map) {
+			for (pos = 0; pos < 0x100; pos++)
+				rules_affix.map_buffer[pos] =
+				    op->str[ARCH_INDEX(rules_affix.map[pos])];
+			rules_affix.map = rules_affix.map_buffer;
+		} else
+			rules_affix.map = op->str;
+		break;
+
+	case '$':
+	case '^':
+		if (rules_affix.prefix_length + rules_affix.suffix_length >=
+		    RULE_WORD_SIZE - 1)
+			return;
+		if (op->cmd == '$') {
+			rules_affix.suffix[rules_affix.suffix_length++] =
+			    op->value;
+			break;
+		}
+		memmove(&rules_affix.prefix[1], rules_affix.prefix,
+		    rules_affix.prefix_length++);
+		rules_affix.prefix[0] = op->value;
+		break;
+
+/* The word's initial length changes from word to word */
+	case '<':
+	case '>':
+	case '_':
+		if (op->pos[0] == &rules_vars['l'] ||
+		    op->pos[0] == &rules_vars['m'])
+			return;
+		break;
+
+	default:
+		return;
+	}
+
+	rules_affix.valid = 1;
+}
+
+/*
+ * Compiles a rule that rules_reject() has already optimized into
+ * rules_prog[].  Returns zero if the rule has errors, which we leave for the
+ * interpreter to report when (and if) it gets to them.
+ */
+static int rules_compile(char *rule)
+{
+	struct rules_op *op = rules_prog;
+	int maps = 0;
+
+	while (RULE) {
+		memset(op, 0, sizeof(*op));
+
+		switch (op->cmd = LAST) {
+		case ':':
+		case ' ':
+		case '\t':
+			continue;
+
+		case '_':
+		case '<':
+		case '>':
+		case '\'':
+		case 'T':
+		case 'D':
+			COMPILE_POSITION(0)
+			break;
+
+		case 'l':
+			op->str = conv_tolower;
+			break;
+
+		case 'u':
+			op->str = conv_toupper;
+			break;
+
+		case 't':
+			op->str = conv_invert;
+			break;
+
+		case 'S':
+			op->str = conv_shift;
+			break;
+
+		case 'V':
+			op->str = conv_vowels;
+			break;
+
+		case 'R':
+			op->str = conv_right;
+			break;
+
+		case 'L':
+			op->str = conv_left;
+			break;
+
+		case 'c':
+		case 'C':
+		case 'r':
+		case 'd':
+		case 'f':
+		case 'p':
+		case 'P':
+		case 'I':
+		case '[':
+		case ']':
+		case '{':
+		case '}':
+		case 'M':
+		case 'Q':
+		case 'U':
+		case '1':
+		case '2':
+		case '+':
+			break;
+
+		case '$':
+		case '^':
+			COMPILE_VALUE(op->value)
+			break;
+
+		case 'x':
+			COMPILE_POSITION(0)
+			COMPILE_POSITION(1)
+			break;
+
+		case 'i':
+		case 'o':
+			COMPILE_POSITION(0)
+			COMPILE_VALUE(op->arg)
+			break;
+
+		case 's':
+			COMPILE_CLASS
+			COMPILE_VALUE(op->arg)
+			break;
+
+		case '@':
+		case '!':
+		case '/':
+		case '(':
+		case ')':
+			COMPILE_CLASS
+			break;
+
+		case '=':
+		case '%':
+			COMPILE_POSITION(0)
+			COMPILE_CLASS
+			break;
+
+		case 'A':
+			COMPILE_POSITION(0)
+			COMPILE_VALUE(op->arg)
+			op->str = rule;
+			while (RULE != op->arg)
+				if (!LAST)
+					return 0;
+			op->str_length = rule - 1 - op->str;
+			break;
+
+		case 'X':
+			COMPILE_POSITION(0)
+			COMPILE_POSITION(1)
+			COMPILE_POSITION(2)
+			break;
+
+		case 'v':
+			COMPILE_VALUE(op->value)
+			if (op->value < 'a' || op->value > 'k')
+				return 0;
+			COMPILE_POSITION(0)
+			COMPILE_POSITION(1)
+			break;
+
+		default:
+			return 0;
+		}
+
+		if (strchr(OP_MAP_COMMANDS, op->cmd)) {
+			if (op > rules_prog && op[-1].cmd == OP_MAP) {
+				rules_compile_map((char *)op[-1].str, op);
+				continue;
+			}
+			if (maps < RULE_MAPS_MAX) {
+				char *map = rules_prog_maps[maps++];
+				int c;
+
+				for (c = 0; c < 0x100; c++)
+					map[c] = c;
+				rules_compile_map(map, op);
+				op->cmd = OP_MAP;
+				op->str = map;
+			}
+		}
+
+		op++;
+	}
+
+	op->cmd = 0;
+
+	rules_compile_affix();
+
+	return 1;
+}
+
 char *rules_reject(char *rule, int split, char *last, struct db_main *db)
 {
 	static char out_rule[RULE_BUFFER_SIZE];
@@ -1137,10 +1482,14 @@ char *rules_reject(char *rule, int split, char *last, struct db_main *db)
 
 accept:
 	rules_pass--;
+	rules_prog_rule = NULL;
 	strnzcpy(out_rule, rule - 1, sizeof(out_rule));
 	rules_apply("", out_rule, split, last);
 	rules_pass++;
 
+	if (!rules_pass && rules_compile(out_rule))
+		rules_prog_rule = out_rule;
+
 	return out_rule;
 }
 
@@ -1199,17 +1548,61 @@ static MAYBE_INLINE int rules_valid_utf8(UTF8 *source)
 	return 1;
 }
 
+/*
+ * Non-zero if words are mangled in the internal encoding and converted back
+ * to UTF-8 on output.  The dupe check against the previous word then sees the
+ * new word before conversion and the previous one after it, so only repeated
+ * words that are plain ASCII get dropped.  rules_apply_block() relies on this
+ * to treat such words exactly as rules_apply() does.
+ */
+static MAYBE_INLINE int rules_utf8_convert(void)
+{
+	return pers_opts.internal_enc != UTF_8 && pers_opts.target_enc == UTF_8;
+}
+
 static char* rules_cp_to_utf8(char *in)
 {
 	static char out[PLAINTEXT_BUFFER_SIZE + 1];
 
-	if (!(options.flags & FLG_MASK_STACKED) &&
-	    pers_opts.internal_enc != UTF_8 && pers_opts.target_enc == UTF_8)
+	if (!(options.flags & FLG_MASK_STACKED) && rules_utf8_convert())
 		return cp_to_utf8_r(in, out, rules_max_length);
 
 	return in;
 }
 
+/*
+ * Truncates a mangled word, applies --min-length and --max-length, and
+ * compares it against the previous one.  Returns zero if it's rejected.
+ */
+static MAYBE_INLINE int rules_finish(char *in, int length, char *last)
+{
+	in[rules_max_length] = 0;
+	if (minlength)
+		if (length < minlength)
+			return 0;
+	/* --maxlength will skip, not truncate */
+	if (maxlength)
+		if (length > maxlength)
+			return 0;
+	if (last) {
+		if (length > rules_max_length)
+			length = rules_max_length;
+		if (length >= ARCH_SIZE - 1) {
+			if (*(ARCH_WORD *)in != *(ARCH_WORD *)last)
+				return 1;
+			if (strcmp(&in[ARCH_SIZE - 1], &last[ARCH_SIZE - 1]))
+				return 1;
+			return 0;
+		}
+		if (last[length])
+			return 1;
+		if (memcmp(in, last, length))
+			return 1;
+		return 0;
+	}
+	return 1;
+}
+
 char *rules_apply(char *word_in, char *rule, int split, char *last)
 {
 	char cpword[PLAINTEXT_BUFFER_SIZE + 1];
@@ -1218,7 +1611,7 @@ char *rules_apply(char *word_in, char *rule, int split, char *last)
 	int length;
 	int which;
 
-	if (pers_opts.internal_enc != UTF_8 && pers_opts.target_enc == UTF_8)
+	if (rules_utf8_convert())
 		memory = word = utf8_to_cp_r(word_in, cpword,
 		                             PLAINTEXT_BUFFER_SIZE);
 	else
@@ -1257,6 +1650,510 @@ char *rules_apply(char *word_in, char *rule, int split, char *last)
 
 	which = 0;
 
+/*
+ * Run the compiled rule if we have it.  This duplicates the interpreter
+ * below command for command and must be kept in sync with it, which the
+ * --test-rules option helps verify.
+ */
+	if (rule == rules_prog_rule && !rules_pass) {
+		struct rules_op *op;
+
+		for (op = rules_prog; op->cmd; op++) {
+			in[RULE_WORD_SIZE - 1] = 0;
+
+			switch (op->cmd) {
+			case '_':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					if (length != pos) REJECT
+				}
+				break;
+
+			case '<':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					if (length >= pos) REJECT
+				}
+				break;
+
+			case '>':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					if (length <= pos) REJECT
+				}
+				break;
+
+			case OP_MAP:
+			case 'l':
+			case 'u':
+			case 't':
+			case 'S':
+			case 'V':
+			case 'R':
+			case 'L':
+				CONV(op->str)
+				break;
+
+			case 'c':
+				{
+					int pos = 0;
+					if ((in[0] = conv_toupper[ARCH_INDEX(in[0])]))
+					while (in[++pos])
+						in[pos] = conv_tolower[
+						    ARCH_INDEX(in[pos])];
+					in[pos] = 0;
+				}
+				if (in[0] != 'M' || in[1] != 'c')
+					break;
+				in[2] = conv_toupper[ARCH_INDEX(in[2])];
+				break;
+
+			case 'r':
+				{
+					char *out;
+					GET_OUT
+					*(out += length) = 0;
+					while (*in)
+						*--out = *in++;
+					in = out;
+				}
+				break;
+
+			case 'd':
+				memcpy(in + length, in, length);
+				in[length <<= 1] = 0;
+				break;
+
+			case 'f':
+				{
+					int pos;
+					char *p = in;
+					in[pos = (length <<= 1)] = 0;
+					while (*p)
+						in[--pos] = *p++;
+				}
+				break;
+
+			case 'p':
+				if (length < 2) break;
+				{
+					int pos = length - 1;
+					if (strchr("sxz", in[pos]) ||
+					    (pos > 1 && in[pos] == 'h' &&
+					    (in[pos - 1] == 'c' ||
+					    in[pos - 1] == 's')))
+						strcat(in, "es");
+					else
+					if (in[pos] == 'f' && in[pos - 1] != 'f')
+						strcpy(&in[pos], "ves");
+					else
+					if (pos > 1 &&
+					    in[pos] == 'e' && in[pos - 1] == 'f')
+						strcpy(&in[pos - 1], "ves");
+					else
+					if (pos > 1 && in[pos] == 'y') {
+						if (strchr("aeiou", in[pos - 1]))
+							strcat(in, "s");
+						else
+							strcpy(&in[pos], "ies");
+					} else
+						strcat(in, "s");
+				}
+				length = strlen(in);
+				break;
+
+			case '$':
+				in[length++] = op->value;
+				in[length] = 0;
+				break;
+
+			case '^':
+				{
+					char *out;
+					GET_OUT
+					out[0] = op->value;
+					strcpy(&out[1], in);
+					in = out;
+				}
+				length++;
+				break;
+
+			case 'x':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					if (pos < length) {
+						char *out;
+						GET_OUT
+						in += pos;
+						OP_POSITION(pos, 1)
+						strnzcpy(out, in, pos + 1);
+						length = strlen(in = out);
+						break;
+					}
+					OP_POSITION(pos, 1)
+					in[length = 0] = 0;
+				}
+				break;
+
+			case 'i':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					if (pos < length) {
+						char *p = in + pos;
+						memmove(p + 1, p, length++ - pos);
+						*p = op->arg;
+						in[length] = 0;
+						break;
+					}
+				}
+				in[length++] = op->arg;
+				in[length] = 0;
+				break;
+
+			case 'o':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					if (pos < length)
+						in[pos] = op->arg;
+				}
+				break;
+
+			case 's':
+				OP_CLASS(0, in[pos] = op->arg, {})
+				break;
+
+			case '@':
+				length = 0;
+				OP_CLASS(0, {}, in[length++] = in[pos])
+				in[length] = 0;
+				break;
+
+			case '!':
+				OP_CLASS(0, REJECT, {})
+				break;
+
+			case '/':
+				{
+					int pos;
+					OP_CLASS_export_pos(0, break, {})
+					rules_vars['p'] = pos;
+					if (in[pos]) break;
+				}
+				REJECT
+				break;
+
+			case '=':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					if (pos >= length)
+						REJECT
+					OP_CLASS_export_pos(pos, break, REJECT)
+				}
+				break;
+
+			case '[':
+				if (length) {
+					char *out;
+					GET_OUT
+					strcpy(out, &in[1]);
+					length--;
+					in = out;
+					break;
+				}
+				in[0] = 0;
+				break;
+
+			case ']':
+				if (length)
+					in[--length] = 0;
+				break;
+
+			case 'C':
+				{
+					int pos = 0;
+					if ((in[0] = conv_tolower[ARCH_INDEX(in[0])]))
+					while (in[++pos])
+						in[pos] = conv_toupper[
+						    ARCH_INDEX(in[pos])];
+					in[pos] = 0;
+				}
+				if (in[0] == 'm' && in[1] == 'C')
+					in[2] = conv_tolower[ARCH_INDEX(in[2])];
+				break;
+
+			case '(':
+				OP_CLASS(0, break, REJECT)
+				break;
+
+			case ')':
+				if (!length)
+					REJECT
+				OP_CLASS(length - 1, break, REJECT)
+				break;
+
+			case '\'':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					if (pos < length)
+						in[length = pos] = 0;
+				}
+				break;
+
+			case '%':
+				{
+					int count = 0, required, pos;
+					OP_POSITION(required, 0)
+					OP_CLASS_export_pos(0,
+					    if (++count >= required) break, {})
+					if (count < required) REJECT
+					rules_vars['p'] = pos;
+				}
+				break;
+
+			case 'A':
+				{
+					int pos, count;
+					OP_POSITION(pos, 0)
+					if (pos >= length)
+						pos = length;
+					count = RULE_WORD_SIZE - 1 - pos;
+					if (count > op->str_length)
+						count = op->str_length;
+					if (count < 0)
+						count = 0;
+					if (pos == length) {
+						memcpy(&in[pos], op->str, count);
+						in[length += count] = 0;
+						break;
+					}
+					{
+						char *out;
+						GET_OUT
+						memcpy(out, in, pos);
+						memcpy(&out[pos], op->str, count);
+						strcpy(&out[pos + count], &in[pos]);
+						length += count;
+						in = out;
+					}
+				}
+				break;
+
+			case 'T':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					in[pos] = conv_invert[ARCH_INDEX(in[pos])];
+				}
+				break;
+
+			case 'D':
+				{
+					int pos;
+					OP_POSITION(pos, 0)
+					if (pos < length) {
+						char *out;
+						GET_OUT
+						memcpy(out, in, pos);
+						strcpy(&out[pos], &in[pos + 1]);
+						length--;
+						in = out;
+					}
+				}
+				break;
+
+			case '{':
+				if (length) {
+					char *out;
+					GET_OUT
+					strcpy(out, &in[1]);
+					in[1] = 0;
+					strcat(out, in);
+					in = out;
+					break;
+				}
+				in[0] = 0;
+				break;
+
+			case '}':
+				if (length) {
+					char *out;
+					int pos;
+					GET_OUT
+					out[0] = in[pos = length - 1];
+					in[pos] = 0;
+					strcpy(&out[1], in);
+					in = out;
+					break;
+				}
+				in[0] = 0;
+				break;
+
+			case 'P':
+				{
+					int pos;
+					if ((pos = length - 1) < 2) break;
+					if (in[pos] == 'd' && in[pos - 1] == 'e')
+						break;
+					if (in[pos] == 'y') in[pos] = 'i'; else
+					if (strchr("bgp", in[pos]) &&
+					    !strchr("bgp", in[pos - 1])) {
+						in[pos + 1] = in[pos];
+						in[pos + 2] = 0;
+					}
+					if (in[pos] == 'e')
+						strcat(in, "d");
+					else
+						strcat(in, "ed");
+				}
+				length = strlen(in);
+				break;
+
+			case 'I':
+				{
+					int pos;
+					if ((pos = length - 1) < 2) break;
+					if (in[pos] == 'g' && in[pos - 1] == 'n' &&
+					    in[pos - 2] == 'i') break;
+					if (strchr("aeiou", in[pos]))
+						strcpy(&in[pos], "ing");
+					else {
+						if (strchr("bgp", in[pos]) &&
+						    !strchr("bgp", in[pos - 1])) {
+							in[pos + 1] = in[pos];
+							in[pos + 2] = 0;
+						}
+						strcat(in, "ing");
+					}
+				}
+				length = strlen(in);
+				break;
+
+			case 'M':
+				memory = memory_buffer;
+				strnfcpy(memory_buffer, in, rules_max_length);
+				rules_vars['m'] = (unsigned char)length - 1;
+				break;
+
+			case 'U':
+				if (!rules_valid_utf8((UTF8*)in))
+					REJECT
+				break;
+
+			case 'Q':
+				if (!strncmp(memory, in, rules_max_length))
+					REJECT
+				break;
+
+			case 'X':
+				{
+					int mpos, count, ipos, mleft;
+					char *inp;
+					const char *mp;
+					OP_POSITION(mpos, 0)
+					OP_POSITION(count, 1)
+					OP_POSITION(ipos, 2)
+					mleft = (int)(rules_vars['m'] + 1) - mpos;
+					if (count > mleft)
+						count = mleft;
+					if (count <= 0)
+						break;
+					mp = memory + mpos;
+					if (ipos >= length) {
+						memcpy(&in[length], mp, count);
+						in[length += count] = 0;
+						break;
+					}
+					inp = in + ipos;
+					memmove(inp + count, inp, length - ipos);
+					in[length += count] = 0;
+					memcpy(inp, mp, count);
+				}
+				break;
+
+			case 'v':
+				{
+					unsigned char a, s;
+					rules_vars['l'] = length;
+					OP_POSITION(a, 0)
+					OP_POSITION(s, 1)
+					rules_vars[ARCH_INDEX(op->value)] = a - s;
+				}
+				break;
+
+			case '1':
+				if (split < 0)
+					goto out_ERROR_UNALLOWED;
+				if (!split) REJECT
+				if (which)
+					memcpy(buffer[2], in, length + 1);
+				else
+					strnzcpy(buffer[2], &word[split],
+					    RULE_WORD_SIZE);
+				length = split;
+				if (length > RULE_WORD_SIZE - 1)
+					length = RULE_WORD_SIZE - 1;
+				memcpy(in, word, length);
+				in[length] = 0;
+				which = 1;
+				break;
+
+			case '2':
+				if (split < 0)
+					goto out_ERROR_UNALLOWED;
+				if (!split) REJECT
+				if (which) {
+					memcpy(buffer[2], in, length + 1);
+				} else {
+					length = split;
+					if (length > RULE_WORD_SIZE - 1)
+						length = RULE_WORD_SIZE - 1;
+					strnzcpy(buffer[2], word, length + 1);
+				}
+				strnzcpy(in, &word[split], RULE_WORD_SIZE);
+				length = strlen(in);
+				which = 2;
+				break;
+
+			case '+':
+				switch (which) {
+				case 1:
+					strcat(in, buffer[2]);
+					break;
+
+				case 2:
+					{
+						char *out;
+						GET_OUT
+						strcpy(out, buffer[2]);
+						strcat(out, in);
+						in = out;
+					}
+					break;
+
+				default:
+					goto out_ERROR_UNALLOWED;
+				}
+				length = strlen(in);
+				which = 0;
+				break;
+			}
+
+			if (!length) REJECT
+		}
+
+		if (which)
+			goto out_which;
+		goto out_OK;
+	}
+
 	while (RULE) {
 		in[RULE_WORD_SIZE - 1] = 0;
 
@@ -1821,30 +2718,8 @@ char *rules_apply(char *word_in, char *rule, int split, char *last)
 		goto out_which;
 
 out_OK:
-	in[rules_max_length] = 0;
-	if (minlength)
-		if (length < minlength)
-			return NULL;
-	/* --maxlength will skip, not truncate */
-	if (maxlength)
-		if (length > maxlength)
-			return NULL;
-	if (last) {
-		if (length > rules_max_length)
-			length = rules_max_length;
-		if (length >= ARCH_SIZE - 1) {
-			if (*(ARCH_WORD *)in != *(ARCH_WORD *)last)
-				return rules_cp_to_utf8(in);
-			if (strcmp(&in[ARCH_SIZE - 1], &last[ARCH_SIZE - 1]))
-				return rules_cp_to_utf8(in);
-			return NULL;
-		}
-		if (last[length])
-			return rules_cp_to_utf8(in);
-		if (memcmp(in, last, length))
-			return rules_cp_to_utf8(in);
+	if (!rules_finish(in, length, last))
 		return NULL;
-	}
 	return rules_cp_to_utf8(in);
 
 out_which:
@@ -1879,6 +2754,145 @@ out_ERROR_UNKNOWN:
 out_ERROR_UNALLOWED:
 	rules_errno = RULES_ERROR_UNALLOWED;
 	goto out_NULL;
+
+out_OP_ERROR_POSITION:
+	rules_errno = RULES_ERROR_POSITION;
+	goto out_NULL;
+}
+
+char **rules_apply_block(char **words, int count, char *rule, char *last)
+{
+	static union {
+		struct {
+			char keys[RULE_BLOCK_SIZE][RULE_WORD_SIZE * 2];
+			char last[RULE_WORD_SIZE * 2];
+		} buffers;
+		ARCH_WORD dummy;
+	} CC_CACHE_ALIGN block;
+	static char *keys[RULE_BLOCK_SIZE];
+	int fast, fit = 0, min = 0, max = 0, index;
+	char *prev;
+
+	if (count > RULE_BLOCK_SIZE)
+		count = RULE_BLOCK_SIZE;
+
+/* The previous word may be in the buffers we're about to overwrite */
+	strnzcpy(block.buffers.last, last, sizeof(block.buffers.last));
+	prev = block.buffers.last;
+
+/*
+ * Words that need converting always go through rules_apply(), which also
+ * keeps its dupe check as described above rules_utf8_convert().
+ */
+	fast = rule == rules_prog_rule && !rules_pass && rules_affix.valid &&
+	    !rules_utf8_convert();
+
+/*
+ * Turn the length checks into limits on the word's initial length.  Words
+ * too long to take the prefix and suffix without truncation go the slow way.
+ */
+	if (fast) {
+		struct rules_op *op;
+		int added = 0;
+
+		fit = RULE_WORD_SIZE - 1 -
+		    rules_affix.prefix_length - rules_affix.suffix_length;
+		min = rules_prog[0].cmd ? 1 : 0;
+		max = fit;
+
+		for (op = rules_prog; op->cmd; op++) {
+			int pos;
+
+			switch (op->cmd) {
+			case '$':
+			case '^':
+				added++;
+				continue;
+
+			case '<':
+			case '>':
+			case '_':
+				pos = *op->pos[0];
+				break;
+
+			default:
+				continue;
+			}
+
+/* Leave it to rules_apply() to report the error */
+			if (pos == INVALID_LENGTH) {
+				fast = 0;
+				break;
+			}
+
+			switch (op->cmd) {
+			case '<':
+				if (max > pos - added - 1)
+					max = pos - added - 1;
+				break;
+
+			case '>':
+				if (min < pos - added + 1)
+					min = pos - added + 1;
+				break;
+
+			case '_':
+				if (min < pos - added)
+					min = pos - added;
+				if (max > pos - added)
+					max = pos - added;
+			}
+		}
+	}
+
+	for (index = 0; index < count; index++) {
+		char *word = words[index], *out = block.buffers.keys[index];
+		int length;
+
+		keys[index] = NULL;
+
+		if (fast) {
+			const char *map = rules_affix.map;
+			char *p = out + rules_affix.prefix_length;
+
+			if (map) {
+				for (length = 0; length <= fit && word[length];
+				    length++)
+					p[length] = map[ARCH_INDEX(word[length])];
+			} else {
+				for (length = 0; length <= fit && word[length];
+				    length++)
+					p[length] = word[length];
+			}
+
+			if (length <= fit) {
+				int pos;
+
+				if (length < min || length > max)
+					continue;
+
+				for (pos = 0; pos < rules_affix.prefix_length;
+				    pos++)
+					out[pos] = rules_affix.prefix[pos];
+				p += length;
+				for (pos = 0; pos < rules_affix.suffix_length;
+				    pos++)
+					p[pos] = rules_affix.suffix[pos];
+				p[pos] = 0;
+
+				if (rules_finish(out, p + pos - out, prev))
+					keys[index] = prev = out;
+				continue;
+			}
+		}
+
+		if ((word = rules_apply(word, rule, -1, prev))) {
+			strnzcpy(out, word, sizeof(block.buffers.keys[0]));
+			keys[index] = prev = out;
+		}
+	}
+
+	return keys;
 }
 
 /*
@@ -2102,3 +3116,132 @@ int rules_count(struct rpp_context *start, int split)
 
 	return count1;
 }
+
+/*
+ * Words and split positions for rules_self_test(), chosen to get most rule
+ * commands down both their common and their edge case code paths.
+ */
+static struct {
+	char *word;
+	int split;
+} rules_test_words[] = {
+	{"", 0},
+	{"a", 0},
+	{"ab", 1},
+	{"password", 4},
+	{"Password1", 8},
+	{"PASSWORD", 0},
+	{"johnsmith", 4},
+	{"JohnSmith", 4},
+	{"mcdonald", 2},
+	{"McDonald", 2},
+	{"church", 0},
+	{"knife", 0},
+	{"staff", 0},
+	{"play", 0},
+	{"city", 0},
+	{"shop", 0},
+	{"bed", 0},
+	{"going", 0},
+	{"love", 0},
+	{"12345", 2},
+	{"1a2b3c", 3},
+	{"p@ss w0rd!", 5},
+	{"aaaaaaaaaa", 5},
+	{"\xe9t\xe9\xe0\xdf\xfc", 3},
+	{"abcdefghijklmnopqrstuvwxyz0123456789"
+	 "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+	 "abcdefghijklmnopqrstuvwxyz0123456789", 36},
+	{NULL}
+};
+
+int rules_self_test(char *subsection)
+{
+	static const int max_lengths[] = {8, RULE_WORD_SIZE - 1};
+	struct rpp_context ctx;
+	char *prerule, *rule;
+	char copy[RULE_BUFFER_SIZE], expected[RULE_WORD_SIZE * 2];
+	unsigned char vars[sizeof(rules_vars)], vars_after[sizeof(rules_vars)];
+	int length, reject, test, splits[2], count, index;
+	unsigned long long applied = 0;
+	int rules = 0, errors = 0;
+
+	if (rpp_init(&ctx, subsection)) {
+		fprintf(stderr, "No \"%s\" mode rules found in %s\n",
+		    subsection, cfg_name);
+		return 1;
+	}
+
+/*
+ * Each rule is applied to each word with the interpreter (by passing it a
+ * copy of the rule) and then compiled, and we expect the same results,
+ * including any changes to the rule variables.
+ */
+	for (length = 0; length < sizeof(max_lengths) / sizeof(int); length++)
+	for (reject = -1; reject <= 0; reject++) {
+		rules_init(max_lengths[length]);
+		rpp_init(&ctx, subsection);
+
+		while ((prerule = rpp_next(&ctx))) {
+			if (!(rule = rules_reject(prerule, reject, NULL, NULL)) ||
+			    rule != rules_prog_rule)
+				continue;
+			rules++;
+
+			for (test = 0; rules_test_words[test].word; test++) {
+				char *word = rules_test_words[test].word;
+
+				splits[0] = reject;
+				count = 1;
+				if (!reject && rules_test_words[test].split)
+					splits[count++] =
+					    rules_test_words[test].split;
+
+				for (index = 0; index < count; index++) {
+					int split = splits[index];
+					char *interpreted, *compiled;
+					int interpreted_errno;
+
+					memcpy(vars, rules_vars, sizeof(vars));
+					strnzcpy(copy, rule, sizeof(copy));
+					rules_errno = RULES_ERROR_NONE;
+					if ((interpreted = rules_apply(word, copy,
+					    split, NULL)))
+						strnzcpy(expected, interpreted,
+						    sizeof(expected));
+					interpreted_errno = rules_errno;
+					memcpy(vars_after, rules_vars,
+					    sizeof(vars_after));
+
+					memcpy(rules_vars, vars, sizeof(vars));
+					rules_errno = RULES_ERROR_NONE;
+					compiled = rules_apply(word, rule, split,
+					    NULL);
+					applied++;
+
+					if (!interpreted == !compiled &&
+					    (!compiled ||
+					    !strcmp(expected, compiled)) &&
+					    interpreted_errno == rules_errno &&
+					    !memcmp(vars_after, rules_vars,
+					    sizeof(vars_after)))
+						continue;
+
+					fprintf(stderr, "Rule '%.100s' on '%.100s' "
+					    "(split %d, length %d): "
+					    "expected '%.100s', got '%.100s'\n",
+					    rule, word, split,
+					    max_lengths[length],
+					    interpreted ? expected : "(rejected)",
+					    compiled ? compiled : "(rejected)");
+					errors++;
+				}
+			}
+		}
+	}
+
+	printf("Compiled %d rules, applied %llu times: %d mismatch%s\n",
+	    rules, applied, errors, errors == 1 ? "" : "es");
+
+	return errors != 0;
+}
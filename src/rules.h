@@ -29,6 +29,9 @@ extern void rules_init(int max_length);
  * split < 0	"single crack" mode rules are invalid
  *
  * last may specify which internal buffer must not be touched.
+ *
+ * The accepted rule is also compiled, so that rules_apply() doesn't have to
+ * parse it again for every word.  This only holds until the next call.
  */
 extern char *rules_reject(char *rule, int split, char *last,
 	struct db_main *db);
@@ -45,9 +48,24 @@ extern char *rules_reject(char *rule, int split, char *last,
  * assumed to be properly aligned for ARCH_WORD accesses (pointers returned by
  * rules_apply() are properly aligned).  If the new mangled word matches the
  * previous one, it will be rejected (rules_apply() will return NULL).
+ *
+ * If rule is the pointer last returned by rules_reject(), the compiled rule
+ * is used.  Copies of the rule are interpreted instead, with the same results.
  */
 extern char *rules_apply(char *word, char *rule, int split, char *last);
 
+/*
+ * Applies rule to count words (at most RULE_BLOCK_SIZE) in wordlist mode,
+ * with the same results as calling rules_apply() for each word in turn and
+ * passing it the last word it returned.  Returns an array of count mangled
+ * words, with NULL for the ones rejected, valid until the next call.
+ *
+ * Compiled rules that only translate characters, append, prepend, and check
+ * the length are applied without going through rules_apply() at all.
+ */
+extern char **rules_apply_block(char **words, int count, char *rule,
+	char *last);
+
 /*
  * Similar to rules_check(), but displays a message and does not return on
  * error.  Also performs 'dupe' rule removal, and lists if any rules were removed.
@@ -65,4 +83,11 @@ extern int rules_count(struct rpp_context *start, int split);
  */
 extern int rules_remove_dups(struct cfg_line *pLines, int log);
 
+/*
+ * Applies each rule in the subsection to a set of test words, both compiled
+ * and interpreted, and reports any differences in the results.  Returns
+ * non-zero if there were any.
+ */
+extern int rules_self_test(char *subsection);
+
 #endif
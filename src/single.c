@@ -33,7 +33,7 @@ static int rec_rule;
 
 static struct db_main *single_db;
 static int rule_number, rule_count;
-static int length, key_count;
+static int length, key_count, key_count_min;
 static struct db_keys *guessed_keys;
 static struct rpp_context *rule_ctx;
 
@@ -68,18 +68,19 @@ static double get_progress(void)
 		(double)rule_number / (rule_count + 1) * 100.0;
 }
 
-static void single_alloc_keys(struct db_keys **keys)
+static void single_alloc_keys(struct db_keys **keys, int count)
 {
 	int hash_size = sizeof(struct db_keys_hash) +
-		sizeof(struct db_keys_hash_entry) * (key_count - 1);
+		sizeof(struct db_keys_hash_entry) * (count - 1);
 
 	if (!*keys) {
 		*keys = mem_alloc_tiny(
-			sizeof(struct db_keys) - 1 + length * key_count,
+			sizeof(struct db_keys) - 1 + length * count,
 			MEM_ALIGN_WORD);
 		(*keys)->hash = mem_alloc_tiny(hash_size, MEM_ALIGN_WORD);
 	}
 
+	(*keys)->max_count = count;
 	(*keys)->count = (*keys)->count_from_guesses = 0;
 	(*keys)->ptr = (*keys)->buffer;
 	(*keys)->have_words = 1; /* assume yes; we'll see for real later */
@@ -88,9 +89,42 @@ static void single_alloc_keys(struct db_keys **keys)
 	memset((*keys)->hash, -1, hash_size);
 }
 
+/*
+ * Estimates how many candidate passwords one rule makes out of the salt's
+ * login/GECOS words, and sizes its keys buffer to about that, rounded up to a
+ * multiple of key_count_min and at most key_count.  Salts with few words thus
+ * don't take more memory than they need, while those with many fill up the
+ * larger crypt_all() batches of formats with a high max_keys_per_crypt.
+ */
+static int single_key_count(struct db_salt *salt)
+{
+	struct db_password *pw;
+	int count = 0;
+
+	if ((pw = salt->list))
+	do {
+		int words = pw->words->count;
+		int firsts = words < words_pair_max ? words : words_pair_max;
+		int seconds = words - 1 < words_pair_max ?
+			words - 1 : words_pair_max;
+
+		count += words + 2 * firsts * seconds;
+	} while (count < key_count && (pw = pw->next));
+
+	count = (count + key_count_min - 1) / key_count_min * key_count_min;
+	if (count < key_count_min)
+		count = key_count_min;
+	if (count > key_count)
+		count = key_count;
+
+	return count;
+}
+
 static void single_init(void)
 {
 	struct db_salt *salt;
+	unsigned long long total = 0;
+	int min = 0x7fffffff, max = 0;
 
 	log_event("Proceeding with \"single crack\" mode");
 
@@ -103,7 +137,8 @@ static void single_init(void)
 	length = single_db->format->params.plaintext_length;
 	if (options.force_maxlength && options.force_maxlength < length)
 		length = options.force_maxlength;
-	key_count = single_db->format->params.min_keys_per_crypt;
+	key_count = single_db->format->params.max_keys_per_crypt;
+	key_count_min = single_db->format->params.min_keys_per_crypt;
 	if (key_count < SINGLE_HASH_MIN)
 		key_count = SINGLE_HASH_MIN;
 /*
@@ -114,6 +149,10 @@ static void single_init(void)
 		key_count = 0x8000;
 	while (key_count > 0xffff / length + 1)
 		key_count >>= 1;
+	if (key_count_min < SINGLE_HASH_MIN)
+		key_count_min = SINGLE_HASH_MIN;
+	if (key_count_min > key_count)
+		key_count_min = key_count;
 
 	if (rpp_init(rule_ctx, pers_opts.activesinglerules)) {
 		log_event("! No \"%s\" mode rules found",
@@ -137,18 +176,31 @@ static void single_init(void)
 
 	salt = single_db->salts;
 	do {
-		single_alloc_keys(&salt->keys);
+		int count = single_key_count(salt);
+
+		single_alloc_keys(&salt->keys, count);
+		total += count;
+		if (count < min)
+			min = count;
+		if (count > max)
+			max = count;
 	} while ((salt = salt->next));
 
-	if (key_count > 1)
-	log_event("- Allocated %d buffer%s of %d candidate passwords%s",
-		single_db->salt_count,
-		single_db->salt_count != 1 ? "s" : "",
-		key_count,
-		single_db->salt_count != 1 ? " each" : "");
+	if (key_count > 1) {
+		if (min == max)
+		log_event("- Allocated %d buffer%s of %d candidate passwords%s",
+			single_db->salt_count,
+			single_db->salt_count != 1 ? "s" : "",
+			max,
+			single_db->salt_count != 1 ? " each" : "");
+		else
+		log_event("- Allocated %d buffers of %d to %d candidate "
+			"passwords, %llu in total",
+			single_db->salt_count, min, max, total);
+	}
 
 	guessed_keys = NULL;
-	single_alloc_keys(&guessed_keys);
+	single_alloc_keys(&guessed_keys, key_count);
 
 	crk_init(single_db, NULL, guessed_keys);
 }
@@ -238,18 +290,51 @@ static int single_add_key(struct db_salt *salt, char *key, int is_from_guesses)
 
 	keys->count_from_guesses += is_from_guesses;
 
-	if (++(keys->count) >= key_count)
+	if (++(keys->count) >= keys->max_count)
 		return single_process_buffer(salt);
 
 	return 0;
 }
 
-static int single_process_buffer(struct db_salt *salt)
+/*
+ * Has the keys that have just cracked something tried against the other salts
+ * too (all of them if salt is NULL).
+ */
+static int single_process_guesses(struct db_salt *salt)
 {
 	struct db_salt *current;
 	struct db_keys *keys;
 	size_t size;
 
+	if (!guessed_keys->count)
+		return 0;
+
+	keys = mem_alloc(size = sizeof(struct db_keys) - 1 +
+		length * guessed_keys->count);
+	memcpy(keys, guessed_keys, size);
+
+	keys->ptr = keys->buffer;
+	do {
+		current = single_db->salts;
+		do {
+			if (current == salt || !current->list)
+				continue;
+
+			if (single_add_key(current, keys->ptr, 1))
+				return 1;
+		} while ((current = current->next));
+		keys->ptr += length;
+	} while (--keys->count);
+
+	MEM_FREE(keys);
+
+	return 0;
+}
+
+static int single_process_buffer(struct db_salt *salt)
+{
+	struct db_keys *keys;
+
 	if (crk_process_salt(salt))
 		return 1;
 
@@ -270,26 +355,8 @@ static int single_process_buffer(struct db_salt *salt)
 	keys->ptr = keys->buffer;
 	keys->lock++;
 
-	if (guessed_keys->count) {
-		keys = mem_alloc(size = sizeof(struct db_keys) - 1 +
-			length * guessed_keys->count);
-		memcpy(keys, guessed_keys, size);
-
-		keys->ptr = keys->buffer;
-		do {
-			current = single_db->salts;
-			do {
-				if (current == salt || !current->list)
-					continue;
-
-				if (single_add_key(current, keys->ptr, 1))
-					return 1;
-			} while ((current = current->next));
-			keys->ptr += length;
-		} while (--keys->count);
-
-		MEM_FREE(keys);
-	}
+	if (single_process_guesses(salt))
+		return 1;
 
 	keys = salt->keys;
 	keys->lock--;
@@ -403,7 +470,7 @@ next:
 		last = &pw->next;
 	} while ((pw = pw->next));
 
-	if (keys->count && rule_number - keys->rule > (key_count << 1))
+	if (keys->count && rule_number - keys->rule > (keys->max_count << 1))
 		if (single_process_buffer(salt))
 			return 1;
 
@@ -496,27 +563,54 @@ static void single_run(void)
 	}
 }
 
-static void single_done(void)
+/*
+ * Processes the remaining buffered keys, including those that other salts'
+ * guesses add meanwhile, and waits for the salt workers to be done with them.
+ */
+static int single_flush(void)
 {
 	struct db_salt *salt;
+	int again, done;
+
+	do {
+		again = 0;
 
+		if ((salt = single_db->salts))
+		do {
+			if (!salt->list || !salt->keys->count)
+				continue;
+			if (single_process_buffer(salt))
+				return 1;
+			again = 1;
+		} while ((salt = salt->next));
+
+		while (!(done = crk_wait_salt())) {
+			if (single_process_guesses(NULL))
+				return 1;
+			again = 1;
+		}
+		if (done > 0)
+			return 1;
+	} while (again);
+
+	return 0;
+}
+
+static void single_done(void)
+{
 	if (!event_abort) {
-		if ((salt = single_db->salts)) {
+		if (single_db->salts) {
 			log_event("- Processing the remaining buffered "
 				"candidate passwords, if any");
 
-			do {
-				if (!salt->list)
-					continue;
-				if (salt->keys->count)
-					if (single_process_buffer(salt))
-						break;
-			} while ((salt = salt->next));
+			single_flush();
 		}
 
 		progress = 100;
 	}
 
+	crk_done();
+
 	rec_done(event_abort || (status.pass && single_db->salts));
 }
 
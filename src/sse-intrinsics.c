@@ -38,6 +38,10 @@
  *    raw-SHA512_ng_fmt.c) added all setup and tear down logic, to do multi-block,
  *    sha384, flat or interleaved, OMP safe optional un-BE, optional final add of
  *    original vector (the +=).
+ *
+ * AVX2 and AVX-512 support for the MD4, MD5, SHA-1, SHA-256 and SHA-512
+ *    rounds: these process 2 or 4 of the 128-bit wide blocks per vector.
+ *    Buffers keep their layout.
  */
 
 #include "arch.h"
@@ -50,6 +54,9 @@
 #elif defined __SSSE3__
 #include <tmmintrin.h>
 #endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "memory.h"
 #include "md5.h"
@@ -185,54 +192,170 @@ _inline __m128i _mm_set1_epi64x(long long a)
 #define MMX_COEF 4
 #endif
 
+/*
+ * Vector type used for the MD4, MD5, SHA-1 and SHA-2 rounds, holding VBLOCKS
+ * of the __m128i wide blocks.  The input and output buffers (and their
+ * SSEi_flags handling) stay __m128i based, so that all formats see the same
+ * MMX_COEF (MMX_COEF_SHA256, MMX_COEF_SHA512) layout.  VLOAD() combines
+ * VBLOCKS __m128i values that are stride apart and VSTORE() splits them back.
+ */
+#if defined(__AVX512F__)
+#define VBLOCKS				4
+typedef __m512i vtype;
+
+#define vadd_epi32			_mm512_add_epi32
+#define vand				_mm512_and_si512
+#define vandnot				_mm512_andnot_si512
+#define vor				_mm512_or_si512
+#define vxor				_mm512_xor_si512
+#define vset1_epi32			_mm512_set1_epi32
+#define vcmov(y, z, x)			_mm512_ternarylogic_epi32(x, y, z, 0xCA)
+#define vroti_epi32(a, s)		_mm512_rol_epi32(a, ((s) + 32) & 31)
+#define vroti16_epi32(a, s)		_mm512_rol_epi32(a, 16)
+#define vsrli_epi32			_mm512_srli_epi32
+#define vadd_epi64			_mm512_add_epi64
+#define vset1_epi64x			_mm512_set1_epi64
+#define vroti_epi64(a, s)		_mm512_rol_epi64(a, ((s) + 64) & 63)
+#define vsrli_epi64			_mm512_srli_epi64
+
+#define VLOAD(p, stride)					\
+	_mm512_inserti64x4(_mm512_castsi256_si512(			\
+		_mm256_inserti128_si256(_mm256_castsi128_si256(	\
+		(p)[0]), (p)[(stride)], 1)),				\
+		_mm256_inserti128_si256(_mm256_castsi128_si256(	\
+		(p)[2 * (stride)]), (p)[3 * (stride)], 1), 1)
+#define VSTORE(p, stride, v)					\
+{								\
+	(p)[0] = _mm512_extracti32x4_epi32((v), 0);		\
+	(p)[(stride)] = _mm512_extracti32x4_epi32((v), 1);	\
+	(p)[2 * (stride)] = _mm512_extracti32x4_epi32((v), 2);	\
+	(p)[3 * (stride)] = _mm512_extracti32x4_epi32((v), 3);	\
+}
+
+#elif defined(__AVX2__)
+#define VBLOCKS				2
+typedef __m256i vtype;
+
+#define vadd_epi32			_mm256_add_epi32
+#define vand				_mm256_and_si256
+#define vandnot				_mm256_andnot_si256
+#define vor				_mm256_or_si256
+#define vxor				_mm256_xor_si256
+#define vset1_epi32			_mm256_set1_epi32
+#define vcmov(y, z, x)			vxor(z, vand(x, vxor(y, z)))
+#define vroti_epi32(a, s)					\
+	((s) < 0 ?						\
+		vor(_mm256_srli_epi32((a), -(s)),		\
+		    _mm256_slli_epi32((a), 32 + (s)))		\
+	:							\
+		vor(_mm256_slli_epi32((a), (s)),		\
+		    _mm256_srli_epi32((a), 32 - (s))))
+#define vroti16_epi32(a, s)					\
+	_mm256_shuffle_epi8((a), _mm256_set_epi32(		\
+		0x0d0c0f0e, 0x09080b0a, 0x05040706, 0x01000302,	\
+		0x0d0c0f0e, 0x09080b0a, 0x05040706, 0x01000302))
+#define vsrli_epi32			_mm256_srli_epi32
+#define vadd_epi64			_mm256_add_epi64
+#define vset1_epi64x			_mm256_set1_epi64x
+#define vroti_epi64(a, s)					\
+	((s) < 0 ?						\
+		vor(_mm256_srli_epi64((a), -(s)),		\
+		    _mm256_slli_epi64((a), 64 + (s)))		\
+	:							\
+		vor(_mm256_slli_epi64((a), (s)),		\
+		    _mm256_srli_epi64((a), 64 - (s))))
+#define vsrli_epi64			_mm256_srli_epi64
+
+#define VLOAD(p, stride)					\
+	_mm256_inserti128_si256(_mm256_castsi128_si256((p)[0]),	\
+		(p)[(stride)], 1)
+#define VSTORE(p, stride, v)					\
+{								\
+	(p)[0] = _mm256_castsi256_si128(v);			\
+	(p)[(stride)] = _mm256_extracti128_si256((v), 1);	\
+}
+
+#else
+#define VBLOCKS				1
+typedef __m128i vtype;
+
+#define vadd_epi32			_mm_add_epi32
+#define vand				_mm_and_si128
+#define vandnot				_mm_andnot_si128
+#define vor				_mm_or_si128
+#define vxor				_mm_xor_si128
+#define vset1_epi32			_mm_set1_epi32
+#define vcmov				_mm_cmov_si128
+#define vroti_epi32			_mm_roti_epi32
+#define vroti16_epi32			_mm_roti16_epi32
+#define vsrli_epi32			_mm_srli_epi32
+#define vadd_epi64			_mm_add_epi64
+#define vset1_epi64x			_mm_set1_epi64x
+#define vroti_epi64			_mm_roti_epi64
+#define vsrli_epi64			_mm_srli_epi64
+
+#define VLOAD(p, stride)		((p)[0])
+#define VSTORE(p, stride, v)		{ (p)[0] = (v); }
+#endif
+
 #ifdef MD5_SSE_PARA
 #define MD5_SSE_NUM_KEYS	(MMX_COEF*MD5_SSE_PARA)
 #define MD5_PARA_DO(x)	for((x)=0;(x)<MD5_SSE_PARA;(x)++)
+#define MD5_VPARA		(MD5_SSE_PARA / VBLOCKS)
+#define MD5_VPARA_DO(x)	for((x)=0;(x)<MD5_VPARA;(x)++)
+#if MD5_SSE_PARA % VBLOCKS
+#error MD5_SSE_PARA must be a multiple of VBLOCKS
+#endif
 
 #define MD5_F(x,y,z) \
-	MD5_PARA_DO(i) tmp[i] = _mm_cmov_si128((y[i]),(z[i]),(x[i]));
+	MD5_VPARA_DO(i) tmp[i] = vcmov((y[i]),(z[i]),(x[i]));
 
 #define MD5_G(x,y,z) \
-	MD5_PARA_DO(i) tmp[i] = _mm_cmov_si128((x[i]),(y[i]),(z[i]));
+	MD5_VPARA_DO(i) tmp[i] = vcmov((x[i]),(y[i]),(z[i]));
 
 #define MD5_H(x,y,z) \
-	MD5_PARA_DO(i) tmp[i] = _mm_xor_si128((y[i]),(z[i])); \
-	MD5_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(x[i]));
+	MD5_VPARA_DO(i) tmp[i] = vxor((y[i]),(z[i])); \
+	MD5_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(x[i]));
 
 #define MD5_I(x,y,z) \
-	MD5_PARA_DO(i) tmp[i] = _mm_andnot_si128((z[i]), mask); \
-	MD5_PARA_DO(i) tmp[i] = _mm_or_si128((tmp[i]),(x[i])); \
-	MD5_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(y[i]));
+	MD5_VPARA_DO(i) tmp[i] = vandnot((z[i]), mask); \
+	MD5_VPARA_DO(i) tmp[i] = vor((tmp[i]),(x[i])); \
+	MD5_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(y[i]));
 
 #define MD5_STEP(f, a, b, c, d, x, t, s) \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], _mm_set_epi32(t,t,t,t) ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], vset1_epi32(t) ); \
 	f((b),(c),(d)) \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], tmp[i] ); \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], data[i*16+x] ); \
-	MD5_PARA_DO(i) a[i] = _mm_roti_epi32( a[i], (s) ); \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], b[i] );
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], tmp[i] ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], vdata[i*16+x] ); \
+	MD5_VPARA_DO(i) a[i] = vroti_epi32( a[i], (s) ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], b[i] );
 
 #define MD5_STEP_r16(f, a, b, c, d, x, t, s) \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], _mm_set_epi32(t,t,t,t) ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], vset1_epi32(t) ); \
 	f((b),(c),(d)) \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], tmp[i] ); \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], data[i*16+x] ); \
-	MD5_PARA_DO(i) a[i] = _mm_roti16_epi32( a[i], (s) ); \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], b[i] );
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], tmp[i] ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], vdata[i*16+x] ); \
+	MD5_VPARA_DO(i) a[i] = vroti16_epi32( a[i], (s) ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], b[i] );
 
 void SSEmd5body(__m128i* _data, unsigned int * out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags)
 {
 	__m128i w[16*MD5_SSE_PARA];
-	__m128i a[MD5_SSE_PARA];
-	__m128i b[MD5_SSE_PARA];
-	__m128i c[MD5_SSE_PARA];
-	__m128i d[MD5_SSE_PARA];
-	__m128i tmp[MD5_SSE_PARA];
-	__m128i mask;
+	vtype a[MD5_VPARA];
+	vtype b[MD5_VPARA];
+	vtype c[MD5_VPARA];
+	vtype d[MD5_VPARA];
+	vtype tmp[MD5_VPARA];
+	vtype mask;
 	unsigned int i;
 	__m128i *data;
+#if VBLOCKS > 1
+	vtype vdata[16*MD5_VPARA];
+#else
+	vtype *vdata;
+#endif
 
-	mask = _mm_set1_epi32(0Xffffffff);
+	mask = vset1_epi32(0Xffffffff);
 
 	if(SSEi_flags & SSEi_FLAT_IN) {
 		// Move _data to __data, mixing it MMX_COEF wise.
@@ -285,36 +408,43 @@ void SSEmd5body(__m128i* _data, unsigned int * out, ARCH_WORD_32 *reload_state,
 	} else
 		data = _data;
 
+#if VBLOCKS > 1
+	for (i = 0; i < 16*MD5_VPARA; i++)
+		vdata[i] = VLOAD(&data[(i & ~15) * VBLOCKS + (i & 15)], 16);
+#else
+	vdata = data;
+#endif
+
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		MD5_PARA_DO(i)
+		MD5_VPARA_DO(i)
 		{
-			a[i] = _mm_set1_epi32(0x67452301);
-			b[i] = _mm_set1_epi32(0xefcdab89);
-			c[i] = _mm_set1_epi32(0x98badcfe);
-			d[i] = _mm_set1_epi32(0x10325476);
+			a[i] = vset1_epi32(0x67452301);
+			b[i] = vset1_epi32(0xefcdab89);
+			c[i] = vset1_epi32(0x98badcfe);
+			d[i] = vset1_epi32(0x10325476);
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			MD5_PARA_DO(i)
+			MD5_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+12]);
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+0], 16);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+4], 16);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+8], 16);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+12], 16);
 			}
 		}
 		else
 		{
-			MD5_PARA_DO(i)
+			MD5_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16+12]);
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+0], 4);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+4], 4);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+8], 4);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+12], 4);
 			}
 		}
 	}
@@ -393,55 +523,55 @@ void SSEmd5body(__m128i* _data, unsigned int * out, ARCH_WORD_32 *reload_state,
 
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		MD5_PARA_DO(i)
+		MD5_VPARA_DO(i)
 		{
-			a[i] = _mm_add_epi32(a[i], _mm_set1_epi32(0x67452301));
-			b[i] = _mm_add_epi32(b[i], _mm_set1_epi32(0xefcdab89));
-			c[i] = _mm_add_epi32(c[i], _mm_set1_epi32(0x98badcfe));
-			d[i] = _mm_add_epi32(d[i], _mm_set1_epi32(0x10325476));
+			a[i] = vadd_epi32(a[i], vset1_epi32(0x67452301));
+			b[i] = vadd_epi32(b[i], vset1_epi32(0xefcdab89));
+			c[i] = vadd_epi32(c[i], vset1_epi32(0x98badcfe));
+			d[i] = vadd_epi32(d[i], vset1_epi32(0x10325476));
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			MD5_PARA_DO(i)
+			MD5_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+12]));
+				a[i] = vadd_epi32(a[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+0], 16));
+				b[i] = vadd_epi32(b[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+4], 16));
+				c[i] = vadd_epi32(c[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+8], 16));
+				d[i] = vadd_epi32(d[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+12], 16));
 			}
 		}
 		else
 		{
-			MD5_PARA_DO(i)
+			MD5_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16+12]));
+				a[i] = vadd_epi32(a[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+0], 4));
+				b[i] = vadd_epi32(b[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+4], 4));
+				c[i] = vadd_epi32(c[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+8], 4));
+				d[i] = vadd_epi32(d[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+12], 4));
 			}
 		}
 	}
 	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
 	{
-		MD5_PARA_DO(i)
+		MD5_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16*4+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+12], d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+0], 16, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+4], 16, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+8], 16, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+12], 16, d[i]);
 		}
 	}
 	else
 	{
-		MD5_PARA_DO(i)
+		MD5_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16+12], d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16+0], 4, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16+4], 4, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16+8], 4, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16+12], 4, d[i]);
 		}
 	}
 }
@@ -681,39 +811,49 @@ void md5cryptsse(unsigned char pwd[MD5_SSE_NUM_KEYS][16], unsigned char * salt,
 #ifdef MD4_SSE_PARA
 #define MD4_SSE_NUM_KEYS	(MMX_COEF*MD4_SSE_PARA)
 #define MD4_PARA_DO(x)	for((x)=0;(x)<MD4_SSE_PARA;(x)++)
+#define MD4_VPARA		(MD4_SSE_PARA / VBLOCKS)
+#define MD4_VPARA_DO(x)	for((x)=0;(x)<MD4_VPARA;(x)++)
+#if MD4_SSE_PARA % VBLOCKS
+#error MD4_SSE_PARA must be a multiple of VBLOCKS
+#endif
 
 #define MD4_F(x,y,z) \
-	MD4_PARA_DO(i) tmp[i] = _mm_cmov_si128((y[i]),(z[i]),(x[i]));
+	MD4_VPARA_DO(i) tmp[i] = vcmov((y[i]),(z[i]),(x[i]));
 
 #define MD4_G(x,y,z) \
-	MD4_PARA_DO(i) tmp[i] = _mm_or_si128((y[i]),(z[i])); \
-	MD4_PARA_DO(i) tmp2[i] = _mm_and_si128((y[i]),(z[i])); \
-	MD4_PARA_DO(i) tmp[i] = _mm_and_si128((tmp[i]),(x[i])); \
-	MD4_PARA_DO(i) tmp[i] = _mm_or_si128((tmp[i]), (tmp2[i]) );
+	MD4_VPARA_DO(i) tmp[i] = vor((y[i]),(z[i])); \
+	MD4_VPARA_DO(i) tmp2[i] = vand((y[i]),(z[i])); \
+	MD4_VPARA_DO(i) tmp[i] = vand((tmp[i]),(x[i])); \
+	MD4_VPARA_DO(i) tmp[i] = vor((tmp[i]), (tmp2[i]) );
 
 #define MD4_H(x,y,z) \
-	MD4_PARA_DO(i) tmp[i] = _mm_xor_si128((y[i]),(z[i])); \
-	MD4_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(x[i]));
+	MD4_VPARA_DO(i) tmp[i] = vxor((y[i]),(z[i])); \
+	MD4_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(x[i]));
 
 #define MD4_STEP(f, a, b, c, d, x, t, s) \
-	MD4_PARA_DO(i) a[i] = _mm_add_epi32( a[i], t ); \
+	MD4_VPARA_DO(i) a[i] = vadd_epi32( a[i], t ); \
 	f((b),(c),(d)) \
-	MD4_PARA_DO(i) a[i] = _mm_add_epi32( a[i], tmp[i] ); \
-	MD4_PARA_DO(i) a[i] = _mm_add_epi32( a[i], data[i*16+x] ); \
-	MD4_PARA_DO(i) a[i] = _mm_roti_epi32( a[i], (s) );
+	MD4_VPARA_DO(i) a[i] = vadd_epi32( a[i], tmp[i] ); \
+	MD4_VPARA_DO(i) a[i] = vadd_epi32( a[i], vdata[i*16+x] ); \
+	MD4_VPARA_DO(i) a[i] = vroti_epi32( a[i], (s) );
 
 void SSEmd4body(__m128i* _data, unsigned int * out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags)
 {
 	__m128i w[16*MD4_SSE_PARA];
-	__m128i a[MD4_SSE_PARA];
-	__m128i b[MD4_SSE_PARA];
-	__m128i c[MD4_SSE_PARA];
-	__m128i d[MD4_SSE_PARA];
-	__m128i tmp[MD4_SSE_PARA];
-	__m128i tmp2[MD4_SSE_PARA];
-	__m128i	cst;
+	vtype a[MD4_VPARA];
+	vtype b[MD4_VPARA];
+	vtype c[MD4_VPARA];
+	vtype d[MD4_VPARA];
+	vtype tmp[MD4_VPARA];
+	vtype tmp2[MD4_VPARA];
+	vtype	cst;
 	unsigned int i;
 	__m128i *data;
+#if VBLOCKS > 1
+	vtype vdata[16*MD4_VPARA];
+#else
+	vtype *vdata;
+#endif
 
 if(SSEi_flags & SSEi_FLAT_IN) {
 		// Move _data to __data, mixing it MMX_COEF wise.
@@ -766,43 +906,50 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 	} else
 		data = _data;
 
+#if VBLOCKS > 1
+	for (i = 0; i < 16*MD4_VPARA; i++)
+		vdata[i] = VLOAD(&data[(i & ~15) * VBLOCKS + (i & 15)], 16);
+#else
+	vdata = data;
+#endif
+
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		MD4_PARA_DO(i)
+		MD4_VPARA_DO(i)
 		{
-			a[i] = _mm_set1_epi32(0x67452301);
-			b[i] = _mm_set1_epi32(0xefcdab89);
-			c[i] = _mm_set1_epi32(0x98badcfe);
-			d[i] = _mm_set1_epi32(0x10325476);
+			a[i] = vset1_epi32(0x67452301);
+			b[i] = vset1_epi32(0xefcdab89);
+			c[i] = vset1_epi32(0x98badcfe);
+			d[i] = vset1_epi32(0x10325476);
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			MD4_PARA_DO(i)
+			MD4_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+12]);
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+0], 16);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+4], 16);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+8], 16);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+12], 16);
 			}
 		}
 		else
 		{
-			MD4_PARA_DO(i)
+			MD4_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16+12]);
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+0], 4);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+4], 4);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+8], 4);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+12], 4);
 			}
 		}
 	}
 
 
 /* Round 1 */
-		cst = _mm_set_epi32(0,0,0,0);
+		cst = vset1_epi32(0);
 		MD4_STEP(MD4_F, a, b, c, d, 0, cst, 3)
 		MD4_STEP(MD4_F, d, a, b, c, 1, cst, 7)
 		MD4_STEP(MD4_F, c, d, a, b, 2, cst, 11)
@@ -821,7 +968,7 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 		MD4_STEP(MD4_F, b, c, d, a, 15, cst, 19)
 
 /* Round 2 */
-		cst = _mm_set_epi32(0x5A827999L,0x5A827999L,0x5A827999L,0x5A827999L);
+		cst = vset1_epi32(0x5A827999L);
 		MD4_STEP(MD4_G, a, b, c, d, 0, cst, 3)
 		MD4_STEP(MD4_G, d, a, b, c, 4, cst, 5)
 		MD4_STEP(MD4_G, c, d, a, b, 8, cst, 9)
@@ -840,7 +987,7 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 		MD4_STEP(MD4_G, b, c, d, a, 15, cst, 13)
 
 /* Round 3 */
-		cst = _mm_set_epi32(0x6ED9EBA1L,0x6ED9EBA1L,0x6ED9EBA1L,0x6ED9EBA1L);
+		cst = vset1_epi32(0x6ED9EBA1L);
 		MD4_STEP(MD4_H, a, b, c, d, 0, cst, 3)
 		MD4_STEP(MD4_H, d, a, b, c, 8, cst, 9)
 		MD4_STEP(MD4_H, c, d, a, b, 4, cst, 11)
@@ -861,55 +1008,55 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		MD4_PARA_DO(i)
+		MD4_VPARA_DO(i)
 		{
-			a[i] = _mm_add_epi32(a[i], _mm_set1_epi32(0x67452301));
-			b[i] = _mm_add_epi32(b[i], _mm_set1_epi32(0xefcdab89));
-			c[i] = _mm_add_epi32(c[i], _mm_set1_epi32(0x98badcfe));
-			d[i] = _mm_add_epi32(d[i], _mm_set1_epi32(0x10325476));
+			a[i] = vadd_epi32(a[i], vset1_epi32(0x67452301));
+			b[i] = vadd_epi32(b[i], vset1_epi32(0xefcdab89));
+			c[i] = vadd_epi32(c[i], vset1_epi32(0x98badcfe));
+			d[i] = vadd_epi32(d[i], vset1_epi32(0x10325476));
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			MD4_PARA_DO(i)
+			MD4_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+12]));
+				a[i] = vadd_epi32(a[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+0], 16));
+				b[i] = vadd_epi32(b[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+4], 16));
+				c[i] = vadd_epi32(c[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+8], 16));
+				d[i] = vadd_epi32(d[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+12], 16));
 			}
 		}
 		else
 		{
-			MD4_PARA_DO(i)
+			MD4_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16+12]));
+				a[i] = vadd_epi32(a[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+0], 4));
+				b[i] = vadd_epi32(b[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+4], 4));
+				c[i] = vadd_epi32(c[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+8], 4));
+				d[i] = vadd_epi32(d[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16+12], 4));
 			}
 		}
 	}
 	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
 	{
-		MD4_PARA_DO(i)
+		MD4_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16*4+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+12], d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+0], 16, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+4], 16, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+8], 16, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+12], 16, d[i]);
 		}
 	}
 	else
 	{
-		MD4_PARA_DO(i)
+		MD4_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16+12], d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16+0], 4, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16+4], 4, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16+8], 4, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16+12], 4, d[i]);
 		}
 	}
 }
@@ -919,25 +1066,30 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 #ifdef SHA1_SSE_PARA
 #define SHA1_SSE_NUM_KEYS	(MMX_COEF*SHA1_SSE_PARA)
 #define SHA1_PARA_DO(x)		for((x)=0;(x)<SHA1_SSE_PARA;(x)++)
+#define SHA1_VPARA		(SHA1_SSE_PARA / VBLOCKS)
+#define SHA1_VPARA_DO(x)		for((x)=0;(x)<SHA1_VPARA;(x)++)
+#if SHA1_SSE_PARA % VBLOCKS
+#error SHA1_SSE_PARA must be a multiple of VBLOCKS
+#endif
 
 #define SHA1_F(x,y,z) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_cmov_si128((y[i]),(z[i]),(x[i]));
+	SHA1_VPARA_DO(i) tmp[i] = vcmov((y[i]),(z[i]),(x[i]));
 
 #define SHA1_G(x,y,z) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128((y[i]),(z[i])); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(x[i]));
+	SHA1_VPARA_DO(i) tmp[i] = vxor((y[i]),(z[i])); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(x[i]));
 
 #ifdef __XOP__
 #define SHA1_H(x,y,z) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_cmov_si128((x[i]),(y[i]),(z[i])); \
-	SHA1_PARA_DO(i) tmp2[i] = _mm_andnot_si128((x[i]),(y[i])); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(tmp2[i]));
+	SHA1_VPARA_DO(i) tmp[i] = vcmov((x[i]),(y[i]),(z[i])); \
+	SHA1_VPARA_DO(i) tmp2[i] = vandnot((x[i]),(y[i])); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(tmp2[i]));
 #else
 #define SHA1_H(x,y,z) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_and_si128((x[i]),(y[i])); \
-	SHA1_PARA_DO(i) tmp2[i] = _mm_or_si128((x[i]),(y[i])); \
-	SHA1_PARA_DO(i) tmp2[i] = _mm_and_si128((tmp2[i]),(z[i])); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_or_si128((tmp[i]),(tmp2[i]));
+	SHA1_VPARA_DO(i) tmp[i] = vand((x[i]),(y[i])); \
+	SHA1_VPARA_DO(i) tmp2[i] = vor((x[i]),(y[i])); \
+	SHA1_VPARA_DO(i) tmp2[i] = vand((tmp2[i]),(z[i])); \
+	SHA1_VPARA_DO(i) tmp[i] = vor((tmp[i]),(tmp2[i]));
 #endif
 
 #define SHA1_I(x,y,z) SHA1_G(x,y,z)
@@ -946,6 +1098,10 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 
 // Bartavelle's original code, using 80x4 words of buffer
 
+#if VBLOCKS > 1
+#error The 80x4 SHA-1 buffer code only supports 128-bit vectors
+#endif
+
 #define SHA1_EXPAND(t) \
 	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( data[i*80+t-3], data[i*80+t-8] ); \
 	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*80+t-14] ); \
@@ -1167,101 +1323,106 @@ void SSESHA1body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, u
 // JimF's code, using 16x4 words of buffer just like MD4/5
 
 #define SHA1_EXPAND2a(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( data[i*16+t-3], data[i*16+t-8] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-14] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-16] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( vdata[i*16+t-3], vdata[i*16+t-8] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], vdata[i*16+t-14] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], vdata[i*16+t-16] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 #define SHA1_EXPAND2b(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmpR[i*16+((t-3)&0xF)], data[i*16+t-8] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-14] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-16] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmpR[i*16+((t-3)&0xF)], vdata[i*16+t-8] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], vdata[i*16+t-14] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], vdata[i*16+t-16] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 #define SHA1_EXPAND2c(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-14] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-16] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], vdata[i*16+t-14] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], vdata[i*16+t-16] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 #define SHA1_EXPAND2d(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], tmpR[i*16+((t-14)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-16] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], tmpR[i*16+((t-14)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], vdata[i*16+t-16] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 #define SHA1_EXPAND2(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], tmpR[i*16+((t-14)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], tmpR[i*16+((t-16)&0xF)] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], tmpR[i*16+((t-14)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], tmpR[i*16+((t-16)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 
 #define SHA1_ROUND2a(a,b,c,d,e,F,t) \
 	SHA1_EXPAND2a(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], data[i*16+t] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], vdata[i*16+t] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2b(a,b,c,d,e,F,t) \
 	SHA1_EXPAND2b(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], data[i*16+t] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], vdata[i*16+t] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2c(a,b,c,d,e,F,t) \
 	SHA1_EXPAND2c(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], data[i*16+t] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], vdata[i*16+t] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2d(a,b,c,d,e,F,t) \
 	SHA1_EXPAND2d(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], data[i*16+t] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], vdata[i*16+t] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2(a,b,c,d,e,F,t) \
-	SHA1_PARA_DO(i) tmp3[i] = tmpR[i*16+(t&0xF)]; \
+	SHA1_VPARA_DO(i) tmp3[i] = tmpR[i*16+(t&0xF)]; \
 	SHA1_EXPAND2(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp3[i] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp3[i] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2x(a,b,c,d,e,F,t) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmpR[i*16+(t&0xF)] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmpR[i*16+(t&0xF)] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 
 void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags)
 {
 	__m128i w[16*SHA1_SSE_PARA];
-	__m128i a[SHA1_SSE_PARA];
-	__m128i b[SHA1_SSE_PARA];
-	__m128i c[SHA1_SSE_PARA];
-	__m128i d[SHA1_SSE_PARA];
-	__m128i e[SHA1_SSE_PARA];
-	__m128i tmp[SHA1_SSE_PARA];
-	__m128i tmp2[SHA1_SSE_PARA];
-	__m128i tmp3[SHA1_SSE_PARA];
-	__m128i tmpR[SHA1_SSE_PARA*16];
-	__m128i	cst;
+	vtype a[SHA1_VPARA];
+	vtype b[SHA1_VPARA];
+	vtype c[SHA1_VPARA];
+	vtype d[SHA1_VPARA];
+	vtype e[SHA1_VPARA];
+	vtype tmp[SHA1_VPARA];
+	vtype tmp2[SHA1_VPARA];
+	vtype tmp3[SHA1_VPARA];
+	vtype tmpR[SHA1_VPARA*16];
+	vtype	cst;
 	unsigned int i;
 	__m128i *data;
+#if VBLOCKS > 1
+	vtype vdata[16*SHA1_VPARA];
+#else
+	vtype *vdata;
+#endif
 
 	if(SSEi_flags & SSEi_FLAT_IN) {
 		// Move _data to __data, mixing it MMX_COEF wise.
@@ -1333,44 +1494,51 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	} else
 		data = _data;
 
+#if VBLOCKS > 1
+	for (i = 0; i < 16*SHA1_VPARA; i++)
+		vdata[i] = VLOAD(&data[(i & ~15) * VBLOCKS + (i & 15)], 16);
+#else
+	vdata = data;
+#endif
+
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		SHA1_PARA_DO(i)
+		SHA1_VPARA_DO(i)
 		{
-			a[i] = _mm_set1_epi32(0x67452301);
-			b[i] = _mm_set1_epi32(0xefcdab89);
-			c[i] = _mm_set1_epi32(0x98badcfe);
-			d[i] = _mm_set1_epi32(0x10325476);
-			e[i] = _mm_set1_epi32(0xC3D2E1F0);
+			a[i] = vset1_epi32(0x67452301);
+			b[i] = vset1_epi32(0xefcdab89);
+			c[i] = vset1_epi32(0x98badcfe);
+			d[i] = vset1_epi32(0x10325476);
+			e[i] = vset1_epi32(0xC3D2E1F0);
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			SHA1_PARA_DO(i)
+			SHA1_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+12]);
-				e[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+16]);
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+0], 16);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+4], 16);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+8], 16);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+12], 16);
+				e[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+16], 16);
 			}
 		}
 		else
 		{
-			SHA1_PARA_DO(i)
+			SHA1_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*20+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*20+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*20+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*20+12]);
-				e[i] = _mm_load_si128((__m128i *)&reload_state[i*20+16]);
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+0], 5);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+4], 5);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+8], 5);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+12], 5);
+				e[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+16], 5);
 			}
 		}
 	}
 
-	cst = _mm_set1_epi32(0x5A827999);
+	cst = vset1_epi32(0x5A827999);
 	SHA1_ROUND2a( a, b, c, d, e, SHA1_F,  0 );
 	SHA1_ROUND2a( e, a, b, c, d, SHA1_F,  1 );
 	SHA1_ROUND2a( d, e, a, b, c, SHA1_F,  2 );
@@ -1392,7 +1560,7 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	SHA1_ROUND2( c, d, e, a, b, SHA1_F, 18 );
 	SHA1_ROUND2( b, c, d, e, a, SHA1_F, 19 );
 
-	cst = _mm_set1_epi32(0x6ED9EBA1);
+	cst = vset1_epi32(0x6ED9EBA1);
 	SHA1_ROUND2( a, b, c, d, e, SHA1_G, 20 );
 	SHA1_ROUND2( e, a, b, c, d, SHA1_G, 21 );
 	SHA1_ROUND2( d, e, a, b, c, SHA1_G, 22 );
@@ -1414,7 +1582,7 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	SHA1_ROUND2( c, d, e, a, b, SHA1_G, 38 );
 	SHA1_ROUND2( b, c, d, e, a, SHA1_G, 39 );
 
-	cst = _mm_set1_epi32(0x8F1BBCDC);
+	cst = vset1_epi32(0x8F1BBCDC);
 	SHA1_ROUND2( a, b, c, d, e, SHA1_H, 40 );
 	SHA1_ROUND2( e, a, b, c, d, SHA1_H, 41 );
 	SHA1_ROUND2( d, e, a, b, c, SHA1_H, 42 );
@@ -1436,7 +1604,7 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	SHA1_ROUND2( c, d, e, a, b, SHA1_H, 58 );
 	SHA1_ROUND2( b, c, d, e, a, SHA1_H, 59 );
 
-	cst = _mm_set1_epi32(0xCA62C1D6);
+	cst = vset1_epi32(0xCA62C1D6);
 	SHA1_ROUND2( a, b, c, d, e, SHA1_I, 60 );
 	SHA1_ROUND2( e, a, b, c, d, SHA1_I, 61 );
 	SHA1_ROUND2( d, e, a, b, c, SHA1_I, 62 );
@@ -1460,60 +1628,60 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		SHA1_PARA_DO(i)
+		SHA1_VPARA_DO(i)
 		{
-			a[i] = _mm_add_epi32(a[i], _mm_set1_epi32(0x67452301));
-			b[i] = _mm_add_epi32(b[i], _mm_set1_epi32(0xefcdab89));
-			c[i] = _mm_add_epi32(c[i], _mm_set1_epi32(0x98badcfe));
-			d[i] = _mm_add_epi32(d[i], _mm_set1_epi32(0x10325476));
-			e[i] = _mm_add_epi32(e[i], _mm_set1_epi32(0xC3D2E1F0));
+			a[i] = vadd_epi32(a[i], vset1_epi32(0x67452301));
+			b[i] = vadd_epi32(b[i], vset1_epi32(0xefcdab89));
+			c[i] = vadd_epi32(c[i], vset1_epi32(0x98badcfe));
+			d[i] = vadd_epi32(d[i], vset1_epi32(0x10325476));
+			e[i] = vadd_epi32(e[i], vset1_epi32(0xC3D2E1F0));
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			SHA1_PARA_DO(i)
+			SHA1_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+12]));
-				e[i] = _mm_add_epi32(e[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+16]));
+				a[i] = vadd_epi32(a[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+0], 16));
+				b[i] = vadd_epi32(b[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+4], 16));
+				c[i] = vadd_epi32(c[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+8], 16));
+				d[i] = vadd_epi32(d[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+12], 16));
+				e[i] = vadd_epi32(e[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+16], 16));
 			}
 		}
 		else
 		{
-			SHA1_PARA_DO(i)
+			SHA1_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*20+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*20+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*20+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*20+12]));
-				e[i] = _mm_add_epi32(e[i], _mm_load_si128((__m128i *)&reload_state[i*20+16]));
+				a[i] = vadd_epi32(a[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+0], 5));
+				b[i] = vadd_epi32(b[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+4], 5));
+				c[i] = vadd_epi32(c[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+8], 5));
+				d[i] = vadd_epi32(d[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+12], 5));
+				e[i] = vadd_epi32(e[i], VLOAD((__m128i *)&reload_state[i*VBLOCKS*20+16], 5));
 			}
 		}
 	}
 	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
 	{
-		SHA1_PARA_DO(i)
+		SHA1_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16*4+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+12], d[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+16], e[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+0], 16, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+4], 16, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+8], 16, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+12], 16, d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+16], 16, e[i]);
 		}
 	}
 	else
 	{
-		SHA1_PARA_DO(i)
+		SHA1_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*20+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*20+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*20+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*20+12], d[i]);
-			_mm_store_si128((__m128i *)&out[i*20+16], e[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*20+0], 5, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*20+4], 5, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*20+8], 5, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*20+12], 5, d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*20+16], 5, e[i]);
 		}
 	}
 }
@@ -1523,80 +1691,86 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 
 #define S0(x)                           \
 (                                       \
-    _mm_xor_si128 (                     \
-        _mm_roti_epi32 (x, -22),        \
-        _mm_xor_si128 (                 \
-            _mm_roti_epi32 (x,  -2),    \
-            _mm_roti_epi32 (x, -13)     \
+    vxor (                              \
+        vroti_epi32 (x, -22),           \
+        vxor (                          \
+            vroti_epi32 (x,  -2),       \
+            vroti_epi32 (x, -13)        \
         )                               \
     )                                   \
 )
 
 #define S1(x)                           \
 (                                       \
-    _mm_xor_si128 (                     \
-        _mm_roti_epi32 (x, -25),        \
-        _mm_xor_si128 (                 \
-            _mm_roti_epi32 (x,  -6),    \
-            _mm_roti_epi32 (x, -11)     \
+    vxor (                              \
+        vroti_epi32 (x, -25),           \
+        vxor (                          \
+            vroti_epi32 (x,  -6),       \
+            vroti_epi32 (x, -11)        \
         )                               \
     )                                   \
 )
 
 #define s0(x)                           \
 (                                       \
-    _mm_xor_si128 (                     \
-        _mm_srli_epi32 (x, 3),          \
-        _mm_xor_si128 (                 \
-            _mm_roti_epi32 (x,  -7),    \
-            _mm_roti_epi32 (x, -18)     \
+    vxor (                              \
+        vsrli_epi32 (x, 3),             \
+        vxor (                          \
+            vroti_epi32 (x,  -7),       \
+            vroti_epi32 (x, -18)        \
         )                               \
     )                                   \
 )
 
 #define s1(x)                           \
 (                                       \
-    _mm_xor_si128 (                     \
-        _mm_srli_epi32 (x, 10),         \
-        _mm_xor_si128 (                 \
-            _mm_roti_epi32 (x, -17),    \
-            _mm_roti_epi32 (x, -19)     \
+    vxor (                              \
+        vsrli_epi32 (x, 10),            \
+        vxor (                          \
+            vroti_epi32 (x, -17),       \
+            vroti_epi32 (x, -19)        \
         )                               \
     )                                   \
 )
 
-#define Maj(x,y,z) _mm_cmov_si128 (x, y, _mm_xor_si128 (z, y))
+#define Maj(x,y,z) vcmov (x, y, vxor (z, y))
 
-#define Ch(x,y,z) _mm_cmov_si128 (y, z, x)
+#define Ch(x,y,z) vcmov (y, z, x)
 
 #undef R
-#define R(x,x1,x2,x3)                         \
-{                                             \
-    tmp1 = _mm_add_epi32 (s1(w[x1]), w[x2]);  \
-    tmp1 = _mm_add_epi32 (w[x],  tmp1);       \
-    w[x] = _mm_add_epi32 (s0(w[x3]), tmp1);   \
+#define R(x,x1,x2,x3)                                           \
+{                                                               \
+    tmp1[i] = vadd_epi32 (s1(w[i*16+(x1)]), w[i*16+(x2)]);      \
+    tmp1[i] = vadd_epi32 (w[i*16+(x)],  tmp1[i]);               \
+    w[i*16+(x)] = vadd_epi32 (s0(w[i*16+(x3)]), tmp1[i]);       \
 }
 
-#define SHA256_STEP0(a,b,c,d,e,f,g,h,x,K)            \
-{                                                    \
-    tmp1 = _mm_add_epi32 (h,    S1(e));              \
-    tmp1 = _mm_add_epi32 (tmp1, Ch(e,f,g));          \
-    tmp1 = _mm_add_epi32 (tmp1, _mm_set1_epi32(K));  \
-    tmp1 = _mm_add_epi32 (tmp1, w[x]);               \
-    tmp2 = _mm_add_epi32 (S0(a),Maj(a,b,c));         \
-    d    = _mm_add_epi32 (tmp1, d);                  \
-    h    = _mm_add_epi32 (tmp1, tmp2);               \
+#define SHA256_STEP0(a,b,c,d,e,f,g,h,x,K)                       \
+{                                                               \
+  SHA256_VPARA_DO(i)                                            \
+  {                                                             \
+    tmp1[i] = vadd_epi32 (h[i],    S1(e[i]));                   \
+    tmp1[i] = vadd_epi32 (tmp1[i], Ch(e[i],f[i],g[i]));         \
+    tmp1[i] = vadd_epi32 (tmp1[i], vset1_epi32(K));             \
+    tmp1[i] = vadd_epi32 (tmp1[i], w[i*16+(x)]);                \
+    tmp2[i] = vadd_epi32 (S0(a[i]),Maj(a[i],b[i],c[i]));        \
+    d[i]    = vadd_epi32 (tmp1[i], d[i]);                       \
+    h[i]    = vadd_epi32 (tmp1[i], tmp2[i]);                    \
+  }                                                             \
 }
-#define SHA256_STEP_R(a,b,c,d,e,f,g,h, x,x1,x2,x3, K)\
-{                                                    \
-	R(x,x1,x2,x3);								     \
-    tmp1 = _mm_add_epi32 (h,    S1(e));              \
-    tmp1 = _mm_add_epi32 (tmp1, Ch(e,f,g));          \
-    tmp1 = _mm_add_epi32 (tmp1, _mm_set1_epi32(K));  \
-    tmp1 = _mm_add_epi32 (tmp1, w[x]);				 \
-    tmp2 = _mm_add_epi32 (S0(a),Maj(a,b,c));         \
-    d    = _mm_add_epi32 (tmp1, d);                  \
-    h    = _mm_add_epi32 (tmp1, tmp2);               \
+#define SHA256_STEP_R(a,b,c,d,e,f,g,h, x,x1,x2,x3, K)           \
+{                                                               \
+  SHA256_VPARA_DO(i)                                            \
+  {                                                             \
+    R(x,x1,x2,x3);                                              \
+    tmp1[i] = vadd_epi32 (h[i],    S1(e[i]));                   \
+    tmp1[i] = vadd_epi32 (tmp1[i], Ch(e[i],f[i],g[i]));         \
+    tmp1[i] = vadd_epi32 (tmp1[i], vset1_epi32(K));             \
+    tmp1[i] = vadd_epi32 (tmp1[i], w[i*16+(x)]);                \
+    tmp2[i] = vadd_epi32 (S0(a[i]),Maj(a[i],b[i],c[i]));        \
+    d[i]    = vadd_epi32 (tmp1[i], d[i]);                       \
+    h[i]    = vadd_epi32 (tmp1[i], tmp2[i]);                    \
+  }                                                             \
 }
 
 // this macro was used to create the new macros for the smaller w[16] array.
@@ -1616,70 +1790,88 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
  *  5. (DONE) Redid the out, into a MMX mixed blob, and not 8 arrays
  *  6. (DONE) Separated the reload array from the out array.  Required for work like PBKDF2, where we capture first block value, then replay it over and over.
  *  6. Optimizations.  Look at intel, AMD, newest intel, newest AMD, etc performances.
- *  7. See if we can do anything better using 'DO_PARA' type methods, like we do in SHA1/MD4/5
+ *  7. (DONE) Use 'DO_PARA' type methods, like we do in SHA1/MD4/5.  Each call
+ *            now does SHA256_SSE_PARA blocks of MMX_COEF_SHA256 keys, laid out
+ *            one after the other in all of the buffers.
  */
 #if defined (MMX_COEF_SHA256)
+#ifndef SHA256_SSE_PARA
+#define SHA256_SSE_PARA		1
+#endif
+#define SHA256_PARA_DO(x)	for((x)=0;(x)<SHA256_SSE_PARA;(x)++)
+#define SHA256_VPARA		(SHA256_SSE_PARA / VBLOCKS)
+#define SHA256_VPARA_DO(x)	for((x)=0;(x)<SHA256_VPARA;(x)++)
+#if SHA256_SSE_PARA % VBLOCKS
+#error SHA256_SSE_PARA must be a multiple of VBLOCKS
+#endif
+
 void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags)
 {
-	__m128i a, b, c, d, e, f, g, h;
-	union {
-		__m128i w[16];
-		ARCH_WORD_32 p[16*sizeof(__m128i)/sizeof(ARCH_WORD_32)];
-
-	}_w;
-	__m128i tmp1, tmp2, *w=_w.w;
-	ARCH_WORD_32 *saved_key=0;
+	vtype a[SHA256_VPARA], b[SHA256_VPARA], c[SHA256_VPARA], d[SHA256_VPARA];
+	vtype e[SHA256_VPARA], f[SHA256_VPARA], g[SHA256_VPARA], h[SHA256_VPARA];
+	vtype w[16*SHA256_VPARA], tmp1[SHA256_VPARA], tmp2[SHA256_VPARA];
+	__m128i _w[16*SHA256_SSE_PARA];
+	unsigned int i, k;
 
-	int i;
 	if (SSEi_flags & SSEi_FLAT_IN) {
+		ARCH_WORD_32 *saved_key = (ARCH_WORD_32 *)data;
+		__m128i *W = _w;
 
+		SHA256_PARA_DO(k)
+		{
 #ifdef __SSE4_1__
-		saved_key = (ARCH_WORD_32 *)data;
-		if (SSEi_flags & SSEi_4BUF_INPUT) {
-			for (i=0; i < 14; ++i) { GATHER_4x (w[i], saved_key, i); SWAP_ENDIAN (w[i]); }
-			GATHER_4x (w[14], saved_key, 14);
-			GATHER_4x (w[15], saved_key, 15);
-		} else if (SSEi_flags & SSEi_2BUF_INPUT) {
-			for (i=0; i < 14; ++i) { GATHER_2x (w[i], saved_key, i); SWAP_ENDIAN (w[i]); }
-			GATHER_2x (w[14], saved_key, 14);
-			GATHER_2x (w[15], saved_key, 15);
-		} else {
-			for (i=0; i < 14; ++i) { GATHER (w[i], saved_key, i); SWAP_ENDIAN (w[i]); }
-			GATHER (w[14], saved_key, 14);
-			GATHER (w[15], saved_key, 15);
-		}
-		if ( ((SSEi_flags & SSEi_2BUF_INPUT_FIRST_BLK) == SSEi_2BUF_INPUT_FIRST_BLK) ||
-			 ((SSEi_flags & SSEi_4BUF_INPUT_FIRST_BLK) == SSEi_4BUF_INPUT_FIRST_BLK)) {
-			SWAP_ENDIAN (w[14]);
-			SWAP_ENDIAN (w[15]);
-		}
+			if (SSEi_flags & SSEi_4BUF_INPUT) {
+				for (i=0; i < 14; ++i) { GATHER_4x (W[i], saved_key, i); SWAP_ENDIAN (W[i]); }
+				GATHER_4x (W[14], saved_key, 14);
+				GATHER_4x (W[15], saved_key, 15);
+				saved_key += (MMX_COEF_SHA256<<6);
+			} else if (SSEi_flags & SSEi_2BUF_INPUT) {
+				for (i=0; i < 14; ++i) { GATHER_2x (W[i], saved_key, i); SWAP_ENDIAN (W[i]); }
+				GATHER_2x (W[14], saved_key, 14);
+				GATHER_2x (W[15], saved_key, 15);
+				saved_key += (MMX_COEF_SHA256<<5);
+			} else {
+				for (i=0; i < 14; ++i) { GATHER (W[i], saved_key, i); SWAP_ENDIAN (W[i]); }
+				GATHER (W[14], saved_key, 14);
+				GATHER (W[15], saved_key, 15);
+				saved_key += (MMX_COEF_SHA256<<4);
+			}
 #else
-		int j;
-		ARCH_WORD_32 *p = _w.p;
-		saved_key = (ARCH_WORD_32 *)data;
-		if (SSEi_flags & SSEi_4BUF_INPUT) {
-			for (j=0; j < 16; j++)
-				for (i=0; i < MMX_COEF_SHA256; i++)
-					*p++ = saved_key[(i<<6)+j];
-		} else if (SSEi_flags & SSEi_2BUF_INPUT) {
-			for (j=0; j < 16; j++)
-				for (i=0; i < MMX_COEF_SHA256; i++)
-					*p++ = saved_key[(i<<5)+j];
-		} else {
-			for (j=0; j < 16; j++)
-				for (i=0; i < MMX_COEF_SHA256; i++)
-					*p++ = saved_key[(i<<4)+j];
-		}
-		for (i=0; i < 14; i++)
-			SWAP_ENDIAN (w[i]);
-		if ( ((SSEi_flags & SSEi_2BUF_INPUT_FIRST_BLK) == SSEi_2BUF_INPUT_FIRST_BLK) ||
-			 ((SSEi_flags & SSEi_4BUF_INPUT_FIRST_BLK) == SSEi_4BUF_INPUT_FIRST_BLK)) {
-			SWAP_ENDIAN (w[14]);
-			SWAP_ENDIAN (w[15]);
-		}
+			ARCH_WORD_32 *p = (ARCH_WORD_32 *)W;
+			int j;
+
+			if (SSEi_flags & SSEi_4BUF_INPUT) {
+				for (j=0; j < 16; j++)
+					for (i=0; i < MMX_COEF_SHA256; i++)
+						*p++ = saved_key[(i<<6)+j];
+				saved_key += (MMX_COEF_SHA256<<6);
+			} else if (SSEi_flags & SSEi_2BUF_INPUT) {
+				for (j=0; j < 16; j++)
+					for (i=0; i < MMX_COEF_SHA256; i++)
+						*p++ = saved_key[(i<<5)+j];
+				saved_key += (MMX_COEF_SHA256<<5);
+			} else {
+				for (j=0; j < 16; j++)
+					for (i=0; i < MMX_COEF_SHA256; i++)
+						*p++ = saved_key[(i<<4)+j];
+				saved_key += (MMX_COEF_SHA256<<4);
+			}
+			for (i=0; i < 14; i++)
+				SWAP_ENDIAN (W[i]);
 #endif
-	} else
-		memcpy(w, data, 16*sizeof(__m128i));
+			if ( ((SSEi_flags & SSEi_2BUF_INPUT_FIRST_BLK) == SSEi_2BUF_INPUT_FIRST_BLK) ||
+				 ((SSEi_flags & SSEi_4BUF_INPUT_FIRST_BLK) == SSEi_4BUF_INPUT_FIRST_BLK)) {
+				SWAP_ENDIAN (W[14]);
+				SWAP_ENDIAN (W[15]);
+			}
+			W += 16;
+		}
+		data = _w;
+	}
+
+	SHA256_VPARA_DO(k)
+		for (i = 0; i < 16; i++)
+			w[k*16+i] = VLOAD(&data[k*VBLOCKS*16+i], 16);
 
 //	dump_stuff_shammx(w, 64, 0);
 
@@ -1687,51 +1879,62 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	if (SSEi_flags & SSEi_RELOAD) {
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			i=0; // later if we do PARA, i will be used in the PARA_FOR loop
-			a = _mm_load_si128((__m128i *)&reload_state[i*16*4+0]);
-			b = _mm_load_si128((__m128i *)&reload_state[i*16*4+4]);
-			c = _mm_load_si128((__m128i *)&reload_state[i*16*4+8]);
-			d = _mm_load_si128((__m128i *)&reload_state[i*16*4+12]);
-			e = _mm_load_si128((__m128i *)&reload_state[i*16*4+16]);
-			f = _mm_load_si128((__m128i *)&reload_state[i*16*4+20]);
-			g = _mm_load_si128((__m128i *)&reload_state[i*16*4+24]);
-			h = _mm_load_si128((__m128i *)&reload_state[i*16*4+28]);
+			SHA256_VPARA_DO(i)
+			{
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+0], 16);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+4], 16);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+8], 16);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+12], 16);
+				e[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+16], 16);
+				f[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+20], 16);
+				g[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+24], 16);
+				h[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+28], 16);
+			}
 		}
 		else
 		{
-			i=0;
-			a = _mm_load_si128((__m128i *)&reload_state[i*32+0]);
-			b = _mm_load_si128((__m128i *)&reload_state[i*32+4]);
-			c = _mm_load_si128((__m128i *)&reload_state[i*32+8]);
-			d = _mm_load_si128((__m128i *)&reload_state[i*32+12]);
-			e = _mm_load_si128((__m128i *)&reload_state[i*32+16]);
-			f = _mm_load_si128((__m128i *)&reload_state[i*32+20]);
-			g = _mm_load_si128((__m128i *)&reload_state[i*32+24]);
-			h = _mm_load_si128((__m128i *)&reload_state[i*32+28]);
+			SHA256_VPARA_DO(i)
+			{
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+0], 8);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+4], 8);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+8], 8);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+12], 8);
+				e[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+16], 8);
+				f[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+20], 8);
+				g[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+24], 8);
+				h[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+28], 8);
+			}
 		}
 	} else {
 		if (SSEi_flags & SSEi_CRYPT_SHA224) {
-			/* SHA-224 IV */
-			a = _mm_set1_epi32 (0xc1059ed8);
-			b = _mm_set1_epi32 (0x367cd507);
-			c = _mm_set1_epi32 (0x3070dd17);
-			d = _mm_set1_epi32 (0xf70e5939);
-			e = _mm_set1_epi32 (0xffc00b31);
-			f = _mm_set1_epi32 (0x68581511);
-			g = _mm_set1_epi32 (0x64f98fa7);
-			h = _mm_set1_epi32 (0xbefa4fa4);
+			SHA256_VPARA_DO(i)
+			{
+				/* SHA-224 IV */
+				a[i] = vset1_epi32 (0xc1059ed8);
+				b[i] = vset1_epi32 (0x367cd507);
+				c[i] = vset1_epi32 (0x3070dd17);
+				d[i] = vset1_epi32 (0xf70e5939);
+				e[i] = vset1_epi32 (0xffc00b31);
+				f[i] = vset1_epi32 (0x68581511);
+				g[i] = vset1_epi32 (0x64f98fa7);
+				h[i] = vset1_epi32 (0xbefa4fa4);
+			}
 		} else {
-			// SHA-256 IV */
-			a = _mm_set1_epi32 (0x6a09e667);
-			b = _mm_set1_epi32 (0xbb67ae85);
-			c = _mm_set1_epi32 (0x3c6ef372);
-			d = _mm_set1_epi32 (0xa54ff53a);
-			e = _mm_set1_epi32 (0x510e527f);
-			f = _mm_set1_epi32 (0x9b05688c);
-			g = _mm_set1_epi32 (0x1f83d9ab);
-			h = _mm_set1_epi32 (0x5be0cd19);
+			SHA256_VPARA_DO(i)
+			{
+				// SHA-256 IV */
+				a[i] = vset1_epi32 (0x6a09e667);
+				b[i] = vset1_epi32 (0xbb67ae85);
+				c[i] = vset1_epi32 (0x3c6ef372);
+				d[i] = vset1_epi32 (0xa54ff53a);
+				e[i] = vset1_epi32 (0x510e527f);
+				f[i] = vset1_epi32 (0x9b05688c);
+				g[i] = vset1_epi32 (0x1f83d9ab);
+				h[i] = vset1_epi32 (0x5be0cd19);
+			}
 		}
 	}
+
 	SHA256_STEP0(a, b, c, d, e, f, g, h,  0, 0x428a2f98);
 	SHA256_STEP0(h, a, b, c, d, e, f, g,  1, 0x71374491);
 	SHA256_STEP0(g, h, a, b, c, d, e, f,  2, 0xb5c0fbcf);
@@ -1803,99 +2006,104 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	if (SSEi_flags & SSEi_RELOAD) {
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			i=0; // later if we do PARA, i will be used in the PARA_FOR loop
-			a = _mm_add_epi32(a,_mm_load_si128((__m128i *)&reload_state[i*16*2+0]));
-			b = _mm_add_epi32(b,_mm_load_si128((__m128i *)&reload_state[i*16*2+4]));
-			c = _mm_add_epi32(c,_mm_load_si128((__m128i *)&reload_state[i*16*2+8]));
-			d = _mm_add_epi32(d,_mm_load_si128((__m128i *)&reload_state[i*16*2+12]));
-			e = _mm_add_epi32(e,_mm_load_si128((__m128i *)&reload_state[i*16*2+16]));
-			f = _mm_add_epi32(f,_mm_load_si128((__m128i *)&reload_state[i*16*2+20]));
-			g = _mm_add_epi32(g,_mm_load_si128((__m128i *)&reload_state[i*16*2+24]));
-			h = _mm_add_epi32(h,_mm_load_si128((__m128i *)&reload_state[i*16*2+28]));
+			SHA256_VPARA_DO(i)
+			{
+				a[i] = vadd_epi32(a[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+0], 16));
+				b[i] = vadd_epi32(b[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+4], 16));
+				c[i] = vadd_epi32(c[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+8], 16));
+				d[i] = vadd_epi32(d[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+12], 16));
+				e[i] = vadd_epi32(e[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+16], 16));
+				f[i] = vadd_epi32(f[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+20], 16));
+				g[i] = vadd_epi32(g[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+24], 16));
+				h[i] = vadd_epi32(h[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*4+28], 16));
+			}
 		}
 		else
 		{
-			i=0;
-			a = _mm_add_epi32(a,_mm_load_si128((__m128i *)&reload_state[i*32+0]));
-			b = _mm_add_epi32(b,_mm_load_si128((__m128i *)&reload_state[i*32+4]));
-			c = _mm_add_epi32(c,_mm_load_si128((__m128i *)&reload_state[i*32+8]));
-			d = _mm_add_epi32(d,_mm_load_si128((__m128i *)&reload_state[i*32+12]));
-			e = _mm_add_epi32(e,_mm_load_si128((__m128i *)&reload_state[i*32+16]));
-			f = _mm_add_epi32(f,_mm_load_si128((__m128i *)&reload_state[i*32+20]));
-			g = _mm_add_epi32(g,_mm_load_si128((__m128i *)&reload_state[i*32+24]));
-			h = _mm_add_epi32(h,_mm_load_si128((__m128i *)&reload_state[i*32+28]));
+			SHA256_VPARA_DO(i)
+			{
+				a[i] = vadd_epi32(a[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+0], 8));
+				b[i] = vadd_epi32(b[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+4], 8));
+				c[i] = vadd_epi32(c[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+8], 8));
+				d[i] = vadd_epi32(d[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+12], 8));
+				e[i] = vadd_epi32(e[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+16], 8));
+				f[i] = vadd_epi32(f[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+20], 8));
+				g[i] = vadd_epi32(g[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+24], 8));
+				h[i] = vadd_epi32(h[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*32+28], 8));
+			}
 		}
 	} else if ((SSEi_flags & SSEi_SKIP_FINAL_ADD) == 0) {
 		if (SSEi_flags & SSEi_CRYPT_SHA224) {
-			/* SHA-224 IV */
-			a = _mm_add_epi32 (a, _mm_set1_epi32 (0xc1059ed8));
-			b = _mm_add_epi32 (b, _mm_set1_epi32 (0x367cd507));
-			c = _mm_add_epi32 (c, _mm_set1_epi32 (0x3070dd17));
-			d = _mm_add_epi32 (d, _mm_set1_epi32 (0xf70e5939));
-			e = _mm_add_epi32 (e, _mm_set1_epi32 (0xffc00b31));
-			f = _mm_add_epi32 (f, _mm_set1_epi32 (0x68581511));
-			g = _mm_add_epi32 (g, _mm_set1_epi32 (0x64f98fa7));
-			h = _mm_add_epi32 (h, _mm_set1_epi32 (0xbefa4fa4));
+			SHA256_VPARA_DO(i)
+			{
+				/* SHA-224 IV */
+				a[i] = vadd_epi32 (a[i], vset1_epi32 (0xc1059ed8));
+				b[i] = vadd_epi32 (b[i], vset1_epi32 (0x367cd507));
+				c[i] = vadd_epi32 (c[i], vset1_epi32 (0x3070dd17));
+				d[i] = vadd_epi32 (d[i], vset1_epi32 (0xf70e5939));
+				e[i] = vadd_epi32 (e[i], vset1_epi32 (0xffc00b31));
+				f[i] = vadd_epi32 (f[i], vset1_epi32 (0x68581511));
+				g[i] = vadd_epi32 (g[i], vset1_epi32 (0x64f98fa7));
+				h[i] = vadd_epi32 (h[i], vset1_epi32 (0xbefa4fa4));
+			}
 		} else {
-			/* SHA-256 IV */
-			a = _mm_add_epi32 (a, _mm_set1_epi32 (0x6a09e667));
-			b = _mm_add_epi32 (b, _mm_set1_epi32 (0xbb67ae85));
-			c = _mm_add_epi32 (c, _mm_set1_epi32 (0x3c6ef372));
-			d = _mm_add_epi32 (d, _mm_set1_epi32 (0xa54ff53a));
-			e = _mm_add_epi32 (e, _mm_set1_epi32 (0x510e527f));
-			f = _mm_add_epi32 (f, _mm_set1_epi32 (0x9b05688c));
-			g = _mm_add_epi32 (g, _mm_set1_epi32 (0x1f83d9ab));
-			h = _mm_add_epi32 (h, _mm_set1_epi32 (0x5be0cd19));
+			SHA256_VPARA_DO(i)
+			{
+				/* SHA-256 IV */
+				a[i] = vadd_epi32 (a[i], vset1_epi32 (0x6a09e667));
+				b[i] = vadd_epi32 (b[i], vset1_epi32 (0xbb67ae85));
+				c[i] = vadd_epi32 (c[i], vset1_epi32 (0x3c6ef372));
+				d[i] = vadd_epi32 (d[i], vset1_epi32 (0xa54ff53a));
+				e[i] = vadd_epi32 (e[i], vset1_epi32 (0x510e527f));
+				f[i] = vadd_epi32 (f[i], vset1_epi32 (0x9b05688c));
+				g[i] = vadd_epi32 (g[i], vset1_epi32 (0x1f83d9ab));
+				h[i] = vadd_epi32 (h[i], vset1_epi32 (0x5be0cd19));
+			}
 		}
 	}
-	if (SSEi_flags & SSEi_SWAP_FINAL) {
-		/* NOTE, if we swap OUT of BE into proper LE, then this can not be
-		 * used in a sha256_flags&SHA256_RELOAD manner, without swapping back into BE format.
-		 * NORMALLY, a format will switch binary values into BE format at start, and then
-		 * just take the 'normal' non swapped output of this function (i.e. keep it in BE) */
-		SWAP_ENDIAN (a);
-		SWAP_ENDIAN (b);
-		SWAP_ENDIAN (c);
-		SWAP_ENDIAN (d);
-		SWAP_ENDIAN (e);
-		SWAP_ENDIAN (f);
-		SWAP_ENDIAN (g);
-		SWAP_ENDIAN (h);
-	}
 	/* We store the MMX_mixed values.  This will be in proper 'mixed' format, in BE
-	 * format (i.e. correct to reload on a subsquent call), UNLESS, swapped in the prior
-	 * if statement (the SHA256_SWAP_FINAL) */
+	 * format (i.e. correct to reload on a subsquent call), UNLESS, swapped in the
+	 * following if statement (the SHA256_SWAP_FINAL) */
 	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
 	{
-		i=0;
-		//SHA512_PARA_DO(i)
+		SHA256_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16*4+0], a);
-			_mm_store_si128((__m128i *)&out[i*16*4+4], b);
-			_mm_store_si128((__m128i *)&out[i*16*4+8], c);
-			_mm_store_si128((__m128i *)&out[i*16*4+12], d);
-			_mm_store_si128((__m128i *)&out[i*16*4+16], e);
-			_mm_store_si128((__m128i *)&out[i*16*4+20], f);
-			_mm_store_si128((__m128i *)&out[i*16*4+24], g);
-			_mm_store_si128((__m128i *)&out[i*16*4+28], h);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+0], 16, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+4], 16, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+8], 16, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+12], 16, d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+16], 16, e[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+20], 16, f[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+24], 16, g[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*4+28], 16, h[i]);
 		}
 	}
 	else
 	{
-		i=0;
-		//SHA512_PARA_DO(i)
+		SHA256_VPARA_DO(i)
 		{
-			_mm_store_si128 ((__m128i *)&(out[i*32+0]), a);
-			_mm_store_si128 ((__m128i *)&(out[i*32+4]), b);
-			_mm_store_si128 ((__m128i *)&(out[i*32+8]), c);
-			_mm_store_si128 ((__m128i *)&(out[i*32+12]), d);
-			_mm_store_si128 ((__m128i *)&(out[i*32+16]), e);
-			_mm_store_si128 ((__m128i *)&(out[i*32+20]), f);
-			_mm_store_si128 ((__m128i *)&(out[i*32+24]), g);
-			_mm_store_si128 ((__m128i *)&(out[i*32+28]), h);
+			VSTORE((__m128i *)&out[i*VBLOCKS*32+0], 8, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*32+4], 8, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*32+8], 8, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*32+12], 8, d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*32+16], 8, e[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*32+20], 8, f[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*32+24], 8, g[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*32+28], 8, h[i]);
 		}
 	}
+	if (SSEi_flags & SSEi_SWAP_FINAL) {
+		/* NOTE, if we swap OUT of BE into proper LE, then this can not be
+		 * used in a sha256_flags&SHA256_RELOAD manner, without swapping back into BE format.
+		 * NORMALLY, a format will switch binary values into BE format at start, and then
+		 * just take the 'normal' non swapped output of this function (i.e. keep it in BE) */
+		__m128i *o = (__m128i *)out;
+		unsigned int stride = (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT) ? 16 : 8;
 
+		SHA256_PARA_DO(k)
+			for (i = 0; i < 8; i++)
+				SWAP_ENDIAN (o[k*stride+i]);
+	}
 }
 #endif
 
@@ -1904,11 +2112,11 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 #undef S0
 #define S0(x)                          \
 (                                      \
-    _mm_xor_si128 (                    \
-        _mm_roti_epi64 (x, -39),       \
-        _mm_xor_si128 (                \
-            _mm_roti_epi64 (x, -28),   \
-            _mm_roti_epi64 (x, -34)    \
+    vxor (                             \
+        vroti_epi64 (x, -39),          \
+        vxor (                         \
+            vroti_epi64 (x, -28),      \
+            vroti_epi64 (x, -34)       \
         )                              \
     )                                  \
 )
@@ -1916,11 +2124,11 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 #undef S1
 #define S1(x)                          \
 (                                      \
-    _mm_xor_si128 (                    \
-        _mm_roti_epi64 (x, -41),       \
-        _mm_xor_si128 (                \
-            _mm_roti_epi64 (x, -14),   \
-            _mm_roti_epi64 (x, -18)    \
+    vxor (                             \
+        vroti_epi64 (x, -41),          \
+        vxor (                         \
+            vroti_epi64 (x, -14),      \
+            vroti_epi64 (x, -18)       \
         )                              \
     )                                  \
 )
@@ -1928,11 +2136,11 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 #undef s0
 #define s0(x)                          \
 (                                      \
-    _mm_xor_si128 (                    \
-        _mm_srli_epi64 (x, 7),         \
-        _mm_xor_si128 (                \
-            _mm_roti_epi64 (x, -1),    \
-            _mm_roti_epi64 (x, -8)     \
+    vxor (                             \
+        vsrli_epi64 (x, 7),            \
+        vxor (                         \
+            vroti_epi64 (x, -1),       \
+            vroti_epi64 (x, -8)        \
         )                              \
     )                                  \
 )
@@ -1940,134 +2148,170 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 #undef s1
 #define s1(x)                          \
 (                                      \
-    _mm_xor_si128 (                    \
-        _mm_srli_epi64 (x, 6),         \
-        _mm_xor_si128 (                \
-            _mm_roti_epi64 (x, -19),   \
-            _mm_roti_epi64 (x, -61)    \
+    vxor (                             \
+        vsrli_epi64 (x, 6),            \
+        vxor (                         \
+            vroti_epi64 (x, -19),      \
+            vroti_epi64 (x, -61)       \
         )                              \
     )                                  \
 )
 
-#define Maj(x,y,z) _mm_cmov_si128 (x, y, _mm_xor_si128 (z, y))
+#define Maj(x,y,z) vcmov (x, y, vxor (z, y))
 
-#define Ch(x,y,z)  _mm_cmov_si128 (y, z, x)
+#define Ch(x,y,z) vcmov (y, z, x)
 
 #undef R
-#define R(t)                                         \
-{                                                    \
-    tmp1 = _mm_add_epi64 (s1(w[t -  2]), w[t - 7]);  \
-    tmp2 = _mm_add_epi64 (s0(w[t - 15]), w[t - 16]); \
-    w[t] = _mm_add_epi64 (tmp1, tmp2);               \
+#define R(t)                                                         \
+{                                                                    \
+  SHA512_VPARA_DO(i)                                                 \
+  {                                                                  \
+    tmp1[i] = vadd_epi64 (s1(w[i*80+(t)-2]), w[i*80+(t)-7]);         \
+    tmp2[i] = vadd_epi64 (s0(w[i*80+(t)-15]), w[i*80+(t)-16]);       \
+    w[i*80+(t)] = vadd_epi64 (tmp1[i], tmp2[i]);                     \
+  }                                                                  \
 }
 
-#define SHA512_STEP(a,b,c,d,e,f,g,h,x,K)             \
-{                                                    \
-    tmp1 = _mm_add_epi64 (h,    w[x]);               \
-    tmp2 = _mm_add_epi64 (S1(e),_mm_set1_epi64x(K)); \
-    tmp1 = _mm_add_epi64 (tmp1, Ch(e,f,g));          \
-    tmp1 = _mm_add_epi64 (tmp1, tmp2);               \
-    tmp2 = _mm_add_epi64 (S0(a),Maj(a,b,c));         \
-    d    = _mm_add_epi64 (tmp1, d);                  \
-    h    = _mm_add_epi64 (tmp1, tmp2);               \
+#define SHA512_STEP(a,b,c,d,e,f,g,h,x,K)                             \
+{                                                                    \
+  SHA512_VPARA_DO(i)                                                 \
+  {                                                                  \
+    tmp1[i] = vadd_epi64 (h[i],    w[i*80+(x)]);                     \
+    tmp2[i] = vadd_epi64 (S1(e[i]),vset1_epi64x(K));                 \
+    tmp1[i] = vadd_epi64 (tmp1[i], Ch(e[i],f[i],g[i]));              \
+    tmp1[i] = vadd_epi64 (tmp1[i], tmp2[i]);                         \
+    tmp2[i] = vadd_epi64 (S0(a[i]),Maj(a[i],b[i],c[i]));             \
+    d[i]    = vadd_epi64 (tmp1[i], d[i]);                            \
+    h[i]    = vadd_epi64 (tmp1[i], tmp2[i]);                         \
+  }                                                                  \
 }
 
 #if defined (MMX_COEF_SHA512)
+#ifndef SHA512_SSE_PARA
+#define SHA512_SSE_PARA		1
+#endif
+#define SHA512_PARA_DO(x)	for((x)=0;(x)<SHA512_SSE_PARA;(x)++)
+#define SHA512_VPARA		(SHA512_SSE_PARA / VBLOCKS)
+#define SHA512_VPARA_DO(x)	for((x)=0;(x)<SHA512_VPARA;(x)++)
+#if SHA512_SSE_PARA % VBLOCKS
+#error SHA512_SSE_PARA must be a multiple of VBLOCKS
+#endif
+
 void SSESHA512body(__m128i* data, ARCH_WORD_64 *out, ARCH_WORD_64 *reload_state, unsigned SSEi_flags)
 {
-	int i;
+	unsigned int i, k;
 
-	__m128i a, b, c, d, e, f, g, h;
-	__m128i w[80], tmp1, tmp2;
+	vtype a[SHA512_VPARA], b[SHA512_VPARA], c[SHA512_VPARA], d[SHA512_VPARA];
+	vtype e[SHA512_VPARA], f[SHA512_VPARA], g[SHA512_VPARA], h[SHA512_VPARA];
+	vtype w[80*SHA512_VPARA], tmp1[SHA512_VPARA], tmp2[SHA512_VPARA];
+	__m128i _w[16*SHA512_SSE_PARA];
 
 	if (SSEi_flags & SSEi_FLAT_IN) {
+		__m128i t1, t2, *W = _w;
 
-		if (SSEi_flags & SSEi_2BUF_INPUT) {
-			ARCH_WORD_64 (*saved_key)[32] = (ARCH_WORD_64(*)[32])data;
-			for (i = 0; i < 14; i += 2) {
-				GATHER64 (tmp1, saved_key, i);
-				GATHER64 (tmp2, saved_key, i + 1);
-				SWAP_ENDIAN64 (tmp1);
-				SWAP_ENDIAN64 (tmp2);
-				w[i] = tmp1;
-				w[i + 1] = tmp2;
+		SHA512_PARA_DO(k)
+		{
+			if (SSEi_flags & SSEi_2BUF_INPUT) {
+				ARCH_WORD_64 (*saved_key)[32] = &((ARCH_WORD_64(*)[32])data)[k*MMX_COEF_SHA512];
+				for (i = 0; i < 14; i += 2) {
+					GATHER64 (t1, saved_key, i);
+					GATHER64 (t2, saved_key, i + 1);
+					SWAP_ENDIAN64 (t1);
+					SWAP_ENDIAN64 (t2);
+					W[i] = t1;
+					W[i + 1] = t2;
+				}
+				GATHER64 (t1, saved_key, 14);
+				GATHER64 (t2, saved_key, 15);
+			} else {
+				ARCH_WORD_64 (*saved_key)[16] = &((ARCH_WORD_64(*)[16])data)[k*MMX_COEF_SHA512];
+				for (i = 0; i < 14; i += 2) {
+					GATHER64 (t1, saved_key, i);
+					GATHER64 (t2, saved_key, i + 1);
+					SWAP_ENDIAN64 (t1);
+					SWAP_ENDIAN64 (t2);
+					W[i] = t1;
+					W[i + 1] = t2;
+				}
+				GATHER64 (t1, saved_key, 14);
+				GATHER64 (t2, saved_key, 15);
 			}
-			GATHER64 (tmp1, saved_key, 14);
-			GATHER64 (tmp2, saved_key, 15);
-		} else {
-			ARCH_WORD_64 (*saved_key)[16] = (ARCH_WORD_64(*)[16])data;
-			for (i = 0; i < 14; i += 2) {
-				GATHER64 (tmp1, saved_key, i);
-				GATHER64 (tmp2, saved_key, i + 1);
-				SWAP_ENDIAN64 (tmp1);
-				SWAP_ENDIAN64 (tmp2);
-				w[i] = tmp1;
-				w[i + 1] = tmp2;
+			if ( ((SSEi_flags & SSEi_2BUF_INPUT_FIRST_BLK) == SSEi_2BUF_INPUT_FIRST_BLK)) {
+				SWAP_ENDIAN64 (t1);
+				SWAP_ENDIAN64 (t2);
 			}
-			GATHER64 (tmp1, saved_key, 14);
-			GATHER64 (tmp2, saved_key, 15);
-		}
-		if ( ((SSEi_flags & SSEi_2BUF_INPUT_FIRST_BLK) == SSEi_2BUF_INPUT_FIRST_BLK)) {
-			SWAP_ENDIAN64 (tmp1);
-			SWAP_ENDIAN64 (tmp2);
+			W[14] = t1;
+			W[15] = t2;
+			W += 16;
 		}
-		w[14] = tmp1;
-		w[15] = tmp2;
-	} else
-		memcpy(w, data, 16*sizeof(__m128i));
+		data = _w;
+	}
 
-	for (i = 16; i < 80; i++)
-		R(i);
+	SHA512_VPARA_DO(k)
+		for (i = 0; i < 16; i++)
+			w[k*80+i] = VLOAD(&data[k*VBLOCKS*16+i], 16);
+
+	for (k = 16; k < 80; k++)
+		R(k);
 
 	if (SSEi_flags & SSEi_RELOAD) {
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			i=0; // later if we do PARA, i will be used in the PARA_FOR loop
-			a = _mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+( 0/2)]);
-			b = _mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+( 4/2)]);
-			c = _mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+( 8/2)]);
-			d = _mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(12/2)]);
-			e = _mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(16/2)]);
-			f = _mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(20/2)]);
-			g = _mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(24/2)]);
-			h = _mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(28/2)]);
+			SHA512_VPARA_DO(i)
+			{
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+( 0/2)], 16);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+( 4/2)], 16);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+( 8/2)], 16);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(12/2)], 16);
+				e[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(16/2)], 16);
+				f[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(20/2)], 16);
+				g[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(24/2)], 16);
+				h[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(28/2)], 16);
+			}
 		}
 		else
 		{
-			i=0;
-			a = _mm_load_si128((__m128i *)&reload_state[i*(32/2)+( 0/2)]);
-			b = _mm_load_si128((__m128i *)&reload_state[i*(32/2)+( 4/2)]);
-			c = _mm_load_si128((__m128i *)&reload_state[i*(32/2)+( 8/2)]);
-			d = _mm_load_si128((__m128i *)&reload_state[i*(32/2)+(12/2)]);
-			e = _mm_load_si128((__m128i *)&reload_state[i*(32/2)+(16/2)]);
-			f = _mm_load_si128((__m128i *)&reload_state[i*(32/2)+(20/2)]);
-			g = _mm_load_si128((__m128i *)&reload_state[i*(32/2)+(24/2)]);
-			h = _mm_load_si128((__m128i *)&reload_state[i*(32/2)+(28/2)]);
+			SHA512_VPARA_DO(i)
+			{
+				a[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+( 0/2)], 8);
+				b[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+( 4/2)], 8);
+				c[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+( 8/2)], 8);
+				d[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(12/2)], 8);
+				e[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(16/2)], 8);
+				f[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(20/2)], 8);
+				g[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(24/2)], 8);
+				h[i] = VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(28/2)], 8);
+			}
 		}
 	} else {
 		if (SSEi_flags & SSEi_CRYPT_SHA384) {
-			/* SHA-384 IV */
-			a = _mm_set1_epi64x (0xcbbb9d5dc1059ed8ULL);
-			b = _mm_set1_epi64x (0x629a292a367cd507ULL);
-			c = _mm_set1_epi64x (0x9159015a3070dd17ULL);
-			d = _mm_set1_epi64x (0x152fecd8f70e5939ULL);
-			e = _mm_set1_epi64x (0x67332667ffc00b31ULL);
-			f = _mm_set1_epi64x (0x8eb44a8768581511ULL);
-			g = _mm_set1_epi64x (0xdb0c2e0d64f98fa7ULL);
-			h = _mm_set1_epi64x (0x47b5481dbefa4fa4ULL);
+			SHA512_VPARA_DO(i)
+			{
+				/* SHA-384 IV */
+				a[i] = vset1_epi64x (0xcbbb9d5dc1059ed8ULL);
+				b[i] = vset1_epi64x (0x629a292a367cd507ULL);
+				c[i] = vset1_epi64x (0x9159015a3070dd17ULL);
+				d[i] = vset1_epi64x (0x152fecd8f70e5939ULL);
+				e[i] = vset1_epi64x (0x67332667ffc00b31ULL);
+				f[i] = vset1_epi64x (0x8eb44a8768581511ULL);
+				g[i] = vset1_epi64x (0xdb0c2e0d64f98fa7ULL);
+				h[i] = vset1_epi64x (0x47b5481dbefa4fa4ULL);
+			}
 		} else {
-			// SHA-512 IV */
-			a = _mm_set1_epi64x (0x6a09e667f3bcc908ULL);
-			b = _mm_set1_epi64x (0xbb67ae8584caa73bULL);
-			c = _mm_set1_epi64x (0x3c6ef372fe94f82bULL);
-			d = _mm_set1_epi64x (0xa54ff53a5f1d36f1ULL);
-			e = _mm_set1_epi64x (0x510e527fade682d1ULL);
-			f = _mm_set1_epi64x (0x9b05688c2b3e6c1fULL);
-			g = _mm_set1_epi64x (0x1f83d9abfb41bd6bULL);
-			h = _mm_set1_epi64x (0x5be0cd19137e2179ULL);
+			SHA512_VPARA_DO(i)
+			{
+				// SHA-512 IV */
+				a[i] = vset1_epi64x (0x6a09e667f3bcc908ULL);
+				b[i] = vset1_epi64x (0xbb67ae8584caa73bULL);
+				c[i] = vset1_epi64x (0x3c6ef372fe94f82bULL);
+				d[i] = vset1_epi64x (0xa54ff53a5f1d36f1ULL);
+				e[i] = vset1_epi64x (0x510e527fade682d1ULL);
+				f[i] = vset1_epi64x (0x9b05688c2b3e6c1fULL);
+				g[i] = vset1_epi64x (0x1f83d9abfb41bd6bULL);
+				h[i] = vset1_epi64x (0x5be0cd19137e2179ULL);
+			}
 		}
 	}
-
 	SHA512_STEP(a, b, c, d, e, f, g, h,  0, 0x428a2f98d728ae22ULL);
 	SHA512_STEP(h, a, b, c, d, e, f, g,  1, 0x7137449123ef65cdULL);
 	SHA512_STEP(g, h, a, b, c, d, e, f,  2, 0xb5c0fbcfec4d3b2fULL);
@@ -2156,107 +2400,106 @@ void SSESHA512body(__m128i* data, ARCH_WORD_64 *out, ARCH_WORD_64 *reload_state,
 	if (SSEi_flags & SSEi_RELOAD) {
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			i=0; // later if we do PARA, i will be used in the PARA_FOR loop
-			//SHA512_PARA_DO(i)
+			SHA512_VPARA_DO(i)
 			{
-				a = _mm_add_epi64(a,_mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+( 0/2)]));
-				b = _mm_add_epi64(b,_mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+( 4/2)]));
-				c = _mm_add_epi64(c,_mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+( 8/2)]));
-				d = _mm_add_epi64(d,_mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(12/2)]));
-				e = _mm_add_epi64(e,_mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(16/2)]));
-				f = _mm_add_epi64(f,_mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(20/2)]));
-				g = _mm_add_epi64(g,_mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(24/2)]));
-				h = _mm_add_epi64(h,_mm_load_si128((__m128i *)&reload_state[i*(16/2)*8+(28/2)]));
+				a[i] = vadd_epi64(a[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+( 0/2)], 16));
+				b[i] = vadd_epi64(b[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+( 4/2)], 16));
+				c[i] = vadd_epi64(c[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+( 8/2)], 16));
+				d[i] = vadd_epi64(d[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(12/2)], 16));
+				e[i] = vadd_epi64(e[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(16/2)], 16));
+				f[i] = vadd_epi64(f[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(20/2)], 16));
+				g[i] = vadd_epi64(g[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(24/2)], 16));
+				h[i] = vadd_epi64(h[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*16*2+(28/2)], 16));
 			}
 		}
 		else
 		{
-			i=0;
-			//SHA512_PARA_DO(i)
+			SHA512_VPARA_DO(i)
 			{
-				a = _mm_add_epi64(a,_mm_load_si128((__m128i *)&reload_state[i*(32/2)+( 0/2)]));
-				b = _mm_add_epi64(b,_mm_load_si128((__m128i *)&reload_state[i*(32/2)+( 4/2)]));
-				c = _mm_add_epi64(c,_mm_load_si128((__m128i *)&reload_state[i*(32/2)+( 8/2)]));
-				d = _mm_add_epi64(d,_mm_load_si128((__m128i *)&reload_state[i*(32/2)+(12/2)]));
-				e = _mm_add_epi64(e,_mm_load_si128((__m128i *)&reload_state[i*(32/2)+(16/2)]));
-				f = _mm_add_epi64(f,_mm_load_si128((__m128i *)&reload_state[i*(32/2)+(20/2)]));
-				g = _mm_add_epi64(g,_mm_load_si128((__m128i *)&reload_state[i*(32/2)+(24/2)]));
-				h = _mm_add_epi64(h,_mm_load_si128((__m128i *)&reload_state[i*(32/2)+(28/2)]));
-				}
+				a[i] = vadd_epi64(a[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+( 0/2)], 8));
+				b[i] = vadd_epi64(b[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+( 4/2)], 8));
+				c[i] = vadd_epi64(c[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+( 8/2)], 8));
+				d[i] = vadd_epi64(d[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(12/2)], 8));
+				e[i] = vadd_epi64(e[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(16/2)], 8));
+				f[i] = vadd_epi64(f[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(20/2)], 8));
+				g[i] = vadd_epi64(g[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(24/2)], 8));
+				h[i] = vadd_epi64(h[i],VLOAD((__m128i *)&reload_state[i*VBLOCKS*(32/2)+(28/2)], 8));
+			}
 		}
 	} else if ((SSEi_flags & SSEi_SKIP_FINAL_ADD) == 0) {
 		if (SSEi_flags & SSEi_CRYPT_SHA384) {
-			/* SHA-384 IV */
-			a = _mm_add_epi64 (a, _mm_set1_epi64x (0xcbbb9d5dc1059ed8ULL));
-			b = _mm_add_epi64 (b, _mm_set1_epi64x (0x629a292a367cd507ULL));
-			c = _mm_add_epi64 (c, _mm_set1_epi64x (0x9159015a3070dd17ULL));
-			d = _mm_add_epi64 (d, _mm_set1_epi64x (0x152fecd8f70e5939ULL));
-			e = _mm_add_epi64 (e, _mm_set1_epi64x (0x67332667ffc00b31ULL));
-			f = _mm_add_epi64 (f, _mm_set1_epi64x (0x8eb44a8768581511ULL));
-			g = _mm_add_epi64 (g, _mm_set1_epi64x (0xdb0c2e0d64f98fa7ULL));
-			h = _mm_add_epi64 (h, _mm_set1_epi64x (0x47b5481dbefa4fa4ULL));
+			SHA512_VPARA_DO(i)
+			{
+				/* SHA-384 IV */
+				a[i] = vadd_epi64 (a[i], vset1_epi64x (0xcbbb9d5dc1059ed8ULL));
+				b[i] = vadd_epi64 (b[i], vset1_epi64x (0x629a292a367cd507ULL));
+				c[i] = vadd_epi64 (c[i], vset1_epi64x (0x9159015a3070dd17ULL));
+				d[i] = vadd_epi64 (d[i], vset1_epi64x (0x152fecd8f70e5939ULL));
+				e[i] = vadd_epi64 (e[i], vset1_epi64x (0x67332667ffc00b31ULL));
+				f[i] = vadd_epi64 (f[i], vset1_epi64x (0x8eb44a8768581511ULL));
+				g[i] = vadd_epi64 (g[i], vset1_epi64x (0xdb0c2e0d64f98fa7ULL));
+				h[i] = vadd_epi64 (h[i], vset1_epi64x (0x47b5481dbefa4fa4ULL));
+			}
 		} else {
-			/* SHA-512 IV */
-			a = _mm_add_epi64 (a, _mm_set1_epi64x (0x6a09e667f3bcc908ULL));
-			b = _mm_add_epi64 (b, _mm_set1_epi64x (0xbb67ae8584caa73bULL));
-			c = _mm_add_epi64 (c, _mm_set1_epi64x (0x3c6ef372fe94f82bULL));
-			d = _mm_add_epi64 (d, _mm_set1_epi64x (0xa54ff53a5f1d36f1ULL));
-			e = _mm_add_epi64 (e, _mm_set1_epi64x (0x510e527fade682d1ULL));
-			f = _mm_add_epi64 (f, _mm_set1_epi64x (0x9b05688c2b3e6c1fULL));
-			g = _mm_add_epi64 (g, _mm_set1_epi64x (0x1f83d9abfb41bd6bULL));
-			h = _mm_add_epi64 (h, _mm_set1_epi64x (0x5be0cd19137e2179ULL));
+			SHA512_VPARA_DO(i)
+			{
+				/* SHA-512 IV */
+				a[i] = vadd_epi64 (a[i], vset1_epi64x (0x6a09e667f3bcc908ULL));
+				b[i] = vadd_epi64 (b[i], vset1_epi64x (0xbb67ae8584caa73bULL));
+				c[i] = vadd_epi64 (c[i], vset1_epi64x (0x3c6ef372fe94f82bULL));
+				d[i] = vadd_epi64 (d[i], vset1_epi64x (0xa54ff53a5f1d36f1ULL));
+				e[i] = vadd_epi64 (e[i], vset1_epi64x (0x510e527fade682d1ULL));
+				f[i] = vadd_epi64 (f[i], vset1_epi64x (0x9b05688c2b3e6c1fULL));
+				g[i] = vadd_epi64 (g[i], vset1_epi64x (0x1f83d9abfb41bd6bULL));
+				h[i] = vadd_epi64 (h[i], vset1_epi64x (0x5be0cd19137e2179ULL));
+			}
 		}
 	}
 
-	if (SSEi_flags & SSEi_SWAP_FINAL) {
-		/* NOTE, if we swap OUT of BE into proper LE, then this can not be
-		 * used in a sha512_flags&SHA512_RELOAD manner, without swapping back into BE format.
-		 * NORMALLY, a format will switch binary values into BE format at start, and then
-		 * just take the 'normal' non swapped output of this function (i.e. keep it in BE) */
-		SWAP_ENDIAN64(a);
-		SWAP_ENDIAN64(b);
-		SWAP_ENDIAN64(c);
-		SWAP_ENDIAN64(d);
-		SWAP_ENDIAN64(e);
-		SWAP_ENDIAN64(f);
-		SWAP_ENDIAN64(g);
-		SWAP_ENDIAN64(h);
-	}
-
 	/* We store the MMX_mixed values.  This will be in proper 'mixed' format, in BE
-	 * format (i.e. correct to reload on a subsquent call), UNLESS, swapped in the prior
-	 * if statement (the SHA512_SWAP_FINAL) */
+	 * format (i.e. correct to reload on a subsquent call), UNLESS, swapped in the
+	 * following if statement (the SHA512_SWAP_FINAL) */
 	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
 	{
-		i=0;
-		//SHA512_PARA_DO(i)
+		SHA512_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*(16/2)*8+( 0/2)], a);
-			_mm_store_si128((__m128i *)&out[i*(16/2)*8+( 4/2)], b);
-			_mm_store_si128((__m128i *)&out[i*(16/2)*8+( 8/2)], c);
-			_mm_store_si128((__m128i *)&out[i*(16/2)*8+(12/2)], d);
-			_mm_store_si128((__m128i *)&out[i*(16/2)*8+(16/2)], e);
-			_mm_store_si128((__m128i *)&out[i*(16/2)*8+(20/2)], f);
-			_mm_store_si128((__m128i *)&out[i*(16/2)*8+(24/2)], g);
-			_mm_store_si128((__m128i *)&out[i*(16/2)*8+(28/2)], h);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*2+( 0/2)], 16, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*2+( 4/2)], 16, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*2+( 8/2)], 16, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*2+(12/2)], 16, d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*2+(16/2)], 16, e[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*2+(20/2)], 16, f[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*2+(24/2)], 16, g[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*16*2+(28/2)], 16, h[i]);
 		}
 	}
 	else
 	{
-		i=0;
-		//SHA512_PARA_DO(i)
+		SHA512_VPARA_DO(i)
 		{
-			_mm_store_si128 ((__m128i *)&(out[i*(32/2)+( 0/2)]), a);
-			_mm_store_si128 ((__m128i *)&(out[i*(32/2)+( 4/2)]), b);
-			_mm_store_si128 ((__m128i *)&(out[i*(32/2)+( 8/2)]), c);
-			_mm_store_si128 ((__m128i *)&(out[i*(32/2)+(12/2)]), d);
-			_mm_store_si128 ((__m128i *)&(out[i*(32/2)+(16/2)]), e);
-			_mm_store_si128 ((__m128i *)&(out[i*(32/2)+(20/2)]), f);
-			_mm_store_si128 ((__m128i *)&(out[i*(32/2)+(24/2)]), g);
-			_mm_store_si128 ((__m128i *)&(out[i*(32/2)+(28/2)]), h);
+			VSTORE((__m128i *)&out[i*VBLOCKS*(32/2)+( 0/2)], 8, a[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*(32/2)+( 4/2)], 8, b[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*(32/2)+( 8/2)], 8, c[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*(32/2)+(12/2)], 8, d[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*(32/2)+(16/2)], 8, e[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*(32/2)+(20/2)], 8, f[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*(32/2)+(24/2)], 8, g[i]);
+			VSTORE((__m128i *)&out[i*VBLOCKS*(32/2)+(28/2)], 8, h[i]);
 		}
 	}
 
+	if (SSEi_flags & SSEi_SWAP_FINAL) {
+		/* NOTE, if we swap OUT of BE into proper LE, then this can not be
+		 * used in a sha512_flags&SHA512_RELOAD manner, without swapping back into BE format.
+		 * NORMALLY, a format will switch binary values into BE format at start, and then
+		 * just take the 'normal' non swapped output of this function (i.e. keep it in BE) */
+		__m128i *o = (__m128i *)out;
+		unsigned int stride = (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT) ? 16 : 8;
 
+		SHA512_PARA_DO(k)
+			for (i = 0; i < 8; i++) {
+				SWAP_ENDIAN64 (o[k*stride+i]);
+			}
+	}
 }
 #endif
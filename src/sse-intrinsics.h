@@ -25,7 +25,13 @@
 #define STRINGIZE2(s) #s
 #define STRINGIZE(s) STRINGIZE2(s)
 
-#if defined(__XOP__)
+#if defined(__AVX512F__)
+#undef SSE_type
+#define SSE_type			"AVX512F"
+#elif defined(__AVX2__)
+#undef SSE_type
+#define SSE_type			"AVX2"
+#elif defined(__XOP__)
 #undef SSE_type
 #define SSE_type			"XOP"
 #elif defined(__AVX__)
@@ -42,11 +48,20 @@
 #define SSE_type			"SSE2"
 #endif
 
+/* Vector width of the MD4, MD5, SHA-1 and SHA-2 code (see VBLOCKS in the .c file) */
+#if defined(__AVX512F__)
+#define SSE_bits			"512/512 "
+#elif defined(__AVX2__)
+#define SSE_bits			"256/256 "
+#else
+#define SSE_bits			"128/128 "
+#endif
+
 #ifdef MD5_SSE_PARA
 void md5cryptsse(unsigned char * buf, unsigned char * salt, char * out, int md5_type);
 void SSEmd5body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags);
 #define MD5_SSE_type			SSE_type
-#define MD5_ALGORITHM_NAME		"128/128 " MD5_SSE_type " " MD5_N_STR
+#define MD5_ALGORITHM_NAME		SSE_bits MD5_SSE_type " " MD5_N_STR
 #else
 #define MD5_SSE_type			"1x"
 #define MD5_ALGORITHM_NAME		"32/" ARCH_BITS_STR
@@ -56,7 +71,7 @@ void SSEmd5body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, un
 //void SSEmd4body(__m128i* data, unsigned int * out, int init);
 void SSEmd4body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags);
 #define MD4_SSE_type			SSE_type
-#define MD4_ALGORITHM_NAME		"128/128 " MD4_SSE_type " " MD4_N_STR
+#define MD4_ALGORITHM_NAME		SSE_bits MD4_SSE_type " " MD4_N_STR
 #else
 #define MD4_SSE_type			"1x"
 #define MD4_ALGORITHM_NAME		"32/" ARCH_BITS_STR
@@ -65,7 +80,7 @@ void SSEmd4body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, un
 #ifdef SHA1_SSE_PARA
 void SSESHA1body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags);
 #define SHA1_SSE_type			SSE_type
-#define SHA1_ALGORITHM_NAME		"128/128 " SHA1_SSE_type " " SHA1_N_STR
+#define SHA1_ALGORITHM_NAME		SSE_bits SHA1_SSE_type " " SHA1_N_STR
 #else
 #define SHA1_SSE_type			"1x"
 #define SHA1_ALGORITHM_NAME		"32/" ARCH_BITS_STR
@@ -87,18 +102,28 @@ void SSESHA1body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, u
 #if MMX_COEF==4
 
 #ifdef MMX_COEF_SHA256
-#define SHA256_ALGORITHM_NAME	"128/128 " SIMD_TYPE " " STRINGIZE(MMX_COEF_SHA256)"x"
+#ifndef SHA256_SSE_PARA
+#define SHA256_SSE_PARA 1
+#endif
+#ifndef SHA256_N_STR
+#define SHA256_N_STR	STRINGIZE(MMX_COEF_SHA256)"x"
+#endif
+#define SHA256_ALGORITHM_NAME	SSE_bits SSE_type " " SHA256_N_STR
 void SSESHA256body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags);
 #define SHA256_BUF_SIZ 16
-#define SHA256_SSE_PARA 1
 #endif
 
 #ifdef MMX_COEF_SHA512
-#define SHA512_ALGORITHM_NAME	"128/128 " SIMD_TYPE " " STRINGIZE(MMX_COEF_SHA512)"x"
+#ifndef SHA512_SSE_PARA
+#define SHA512_SSE_PARA 1
+#endif
+#ifndef SHA512_N_STR
+#define SHA512_N_STR	STRINGIZE(MMX_COEF_SHA512)"x"
+#endif
+#define SHA512_ALGORITHM_NAME	SSE_bits SSE_type " " SHA512_N_STR
 void SSESHA512body(__m128i* data, ARCH_WORD_64 *out, ARCH_WORD_64 *reload_state, unsigned SSEi_flags);
 // ????  (16 long longs).
 #define SHA512_BUF_SIZ 16
-#define SHA512_SSE_PARA 1
 #endif
 
 #endif
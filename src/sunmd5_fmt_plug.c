@@ -97,6 +97,8 @@ john_register_one(&fmt_sunmd5);
 #define MAX_KEYS_PER_CRYPT 96
 #elif MD5_SSE_PARA==5
 #define MAX_KEYS_PER_CRYPT 100
+#elif MD5_SSE_PARA==6 || MD5_SSE_PARA==8 || MD5_SSE_PARA==12
+#define MAX_KEYS_PER_CRYPT 96
 #endif
 #else
 #define MAX_KEYS_PER_CRYPT		1
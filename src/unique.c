@@ -23,6 +23,11 @@
  *           params.h.  The default is 21.  valid range from 13 to 25.  25
  *           will use a 2GB memory buffer, and 33 entry million hash table
  *           Each number doubles size.
+ * -parts=num  Splits the input into num temporary files next to the output
+ *           file, makes each of them unique in parallel and merges them back
+ *           in the original order.  Each file is read in memory in whole, so
+ *           use enough of them for input much larger than RAM.  Only as many
+ *           files are processed at once as fit in the -mem= size.
  */
 
 #if AC_BUILT
@@ -37,6 +42,9 @@
 #include <fcntl.h>
 #endif
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #ifdef _MSC_VER
 #include <io.h>
 #pragma warning ( disable : 4996 )
@@ -63,9 +71,11 @@ static FILE *fpInput;
 static FILE *output;
 static FILE *use_to_unique_but_not_add;
 static int do_not_unique_against_self=0;
+static char *part_base;
 
 long long totLines=0,written_lines=0;
 int verbose=0, cut_len=0, LM=0;
+unsigned int parts=0;
 unsigned int vUNIQUE_HASH_LOG=UNIQUE_HASH_LOG, vUNIQUE_HASH_SIZE=UNIQUE_HASH_SIZE, vUNIQUE_BUFFER_SIZE=UNIQUE_BUFFER_SIZE;
 unsigned int vUNIQUE_HASH_MASK = UNIQUE_HASH_SIZE - 1;
 unsigned int vUNIQUE_HASH_LOG_HALF = UNIQUE_HASH_LOG / 2;
@@ -329,8 +339,12 @@ static void unique_init(char *name)
 {
 	int fd;
 
-	buffer.hash = mem_alloc(vUNIQUE_HASH_SIZE * sizeof(unsigned int));
-	buffer.data = mem_alloc(vUNIQUE_BUFFER_SIZE);
+	if (parts)
+		part_base = name;
+	else {
+		buffer.hash = mem_alloc(vUNIQUE_HASH_SIZE * sizeof(unsigned int));
+		buffer.data = mem_alloc(vUNIQUE_BUFFER_SIZE);
+	}
 
 #if defined (_MSC_VER) || defined(__MINGW32__)
 	fd = open(name, O_RDWR | O_CREAT | O_EXCL | O_BINARY, 0600);
@@ -363,6 +377,335 @@ static void unique_run(void)
 	}
 }
 
+/*
+ * Partitioned mode.  Each temporary file holds records made of the line's
+ * (64-bit) number in the input followed by the line and a newline.  Lines
+ * from an -ex_file go first, numbered PART_EX.
+ */
+#define PART_EX				(~0ULL)
+
+static struct part {
+	FILE *file;
+	unsigned long long lines, size;
+	unsigned long long kept, seq;
+	unsigned int table_log;
+} *part;
+
+static struct part_work {
+	char *data;
+	unsigned int *table;
+} *part_work;
+
+/* Number of temporary files created so far and not yet removed */
+static unsigned int part_files;
+
+static unsigned int part_hash(char *line)
+{
+	unsigned char *p = (unsigned char *)line;
+	unsigned int hash = 0x811c9dc5;
+
+	while (*p) {
+		hash ^= *p++;
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+static void part_name(char *name, unsigned int index)
+{
+	snprintf(name, PATH_BUFFER_SIZE, "%s.part%u", part_base, index);
+}
+
+/*
+ * Removes the temporary files when we exit on an error.
+ */
+static void part_cleanup(void)
+{
+	char name[PATH_BUFFER_SIZE];
+
+	while (part_files) {
+		part_files--;
+		if (part[part_files].file)
+			fclose(part[part_files].file);
+		part_name(name, part_files);
+		remove(name);
+	}
+}
+
+static void part_put(unsigned long long seq, char *line)
+{
+	struct part *p;
+	size_t length = strlen(line);
+
+	p = &part[((unsigned long long)part_hash(line) * parts) >> 32];
+	if (fwrite(&seq, sizeof(seq), 1, p->file) != 1 ||
+	    fwrite(line, 1, length, p->file) != length ||
+	    putc('\n', p->file) == EOF)
+		pexit("fwrite");
+	p->lines++;
+	p->size += sizeof(seq) + length + 1;
+}
+
+static void part_split(void)
+{
+	char line[LINE_BUFFER_SIZE], name[PATH_BUFFER_SIZE];
+	unsigned long long seq = 0;
+	unsigned int i;
+
+	part = mem_calloc(parts * sizeof(*part));
+	atexit(part_cleanup);
+	for (i = 0; i < parts; i++) {
+		part_name(name, i);
+		if (!(part[i].file = fopen(name, "wb+")))
+			pexit("fopen: %s", name);
+		part_files++;
+	}
+
+	if (use_to_unique_but_not_add)
+	while (fgetl(line, sizeof(line), use_to_unique_but_not_add)) {
+		if (cut_len) line[cut_len] = 0;
+		part_put(PART_EX, line);
+	}
+
+	while (fgetl(line, sizeof(line), fpInput)) {
+		char LM_Buf[8];
+		if (LM) {
+			if (strlen(line) > 7) {
+				strncpy(LM_Buf, &line[7], 7);
+				LM_Buf[7] = 0;
+				upcase(LM_Buf);
+				++totLines;
+			}
+			else
+				*LM_Buf = 0;
+			line[7] = 0;
+			upcase(line);
+		} else if (cut_len) line[cut_len] = 0;
+		++totLines;
+		part_put(seq++, line);
+		if (LM && *LM_Buf)
+			part_put(seq++, LM_Buf);
+
+		if (verbose && !(seq & 0xfffff))
+			printf("\rSplitting, lines read %llu", totLines);
+	}
+
+	if (ferror(fpInput)) pexit("fgets");
+
+	if (verbose)
+		printf("\rSplit %llu lines into %u files\n", totLines, parts);
+}
+
+/*
+ * Reads one part in memory in whole and rewrites it with only the first
+ * occurrence of each line, in the same order.
+ */
+static void part_unique(struct part *p, struct part_work *w)
+{
+	unsigned int mask = (1U << p->table_log) - 1;
+	size_t ptr, next;
+	unsigned long long seq;
+	char *line, *end;
+
+	if (!p->lines)
+		return;
+
+	if (fflush(p->file) || fseek(p->file, 0, SEEK_SET) < 0)
+		pexit("fseek");
+	if (fread(w->data, p->size, 1, p->file) != 1)
+		pexit("fread");
+	memset(w->table, 0xff, (mask + 1) * sizeof(unsigned int));
+
+	for (ptr = 0; ptr < p->size; ptr = next) {
+		unsigned int index, current;
+
+		line = &w->data[ptr + sizeof(seq)];
+		end = memchr(line, '\n', p->size - ptr - sizeof(seq));
+		*end = 0;
+		next = end + 1 - w->data;
+
+		index = (part_hash(line) * 0x9e3779b1U) >> (32 - p->table_log);
+		while ((current = w->table[index]) != ENTRY_END_HASH) {
+			if (!strcmp(line, &w->data[current + sizeof(seq)]))
+				break;
+			index = (index + 1) & mask;
+		}
+
+		memcpy(&seq, &w->data[ptr], sizeof(seq));
+		if (current != ENTRY_END_HASH) {
+			if (seq != PART_EX) {
+				seq = PART_EX;
+				memcpy(&w->data[ptr], &seq, sizeof(seq));
+			}
+			continue;
+		}
+
+		w->table[index] = ptr;
+	}
+
+	if (fseek(p->file, 0, SEEK_SET) < 0)
+		pexit("fseek");
+	p->kept = 0;
+	for (ptr = 0; ptr < p->size; ptr = next) {
+		line = &w->data[ptr + sizeof(seq)];
+		next = ptr + sizeof(seq) + strlen(line) + 1;
+		memcpy(&seq, &w->data[ptr], sizeof(seq));
+		if (seq == PART_EX)
+			continue;
+		w->data[next - 1] = '\n';
+		if (fwrite(&w->data[ptr], next - ptr, 1, p->file) != 1)
+			pexit("fwrite");
+		p->kept++;
+	}
+	if (fflush(p->file)) pexit("fflush");
+}
+
+/*
+ * Each thread needs a buffer for the largest part and its hash table.  We
+ * run no more threads than fit in what -mem= would use in the normal mode,
+ * but always at least one.
+ */
+static void part_unique_all(void)
+{
+	unsigned long long max_size = 0, need, budget;
+	unsigned int max_log = 0;
+	int i, threads = 1;
+
+	for (i = 0; i < parts; i++) {
+		struct part *p = &part[i];
+
+		if (p->size > 0xffffffffULL - 1)
+			exit(fprintf(stderr, "Error, temporary file %u is over "
+			    "4 GB, use more -parts\n", i));
+		if (p->size > max_size)
+			max_size = p->size;
+		p->table_log = 4;
+		while ((1ULL << p->table_log) < 2 * p->lines)
+			p->table_log++;
+		if (p->table_log > max_log)
+			max_log = p->table_log;
+	}
+
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+	need = max_size + 1 + (sizeof(unsigned int) << max_log);
+	budget = vUNIQUE_BUFFER_SIZE +
+	    (unsigned long long)vUNIQUE_HASH_SIZE * sizeof(unsigned int);
+	if (threads > budget / need)
+		threads = budget / need ? budget / need : 1;
+	if (need > budget)
+		fprintf(stderr, "Warning, the largest temporary file needs %llu MB, "
+		    "over the -mem= size, use more -parts\n", need >> 20);
+	part_work = mem_alloc(threads * sizeof(*part_work));
+	for (i = 0; i < threads; i++) {
+		part_work[i].data = mem_alloc(max_size + 1);
+		part_work[i].table = mem_alloc(sizeof(unsigned int) << max_log);
+	}
+
+	if (verbose)
+		printf("Making files unique with %d thread%s, up to %llu MB "
+		    "each\n", threads, threads > 1 ? "s" : "",
+		    (max_size + (sizeof(unsigned int) << max_log)) >> 20);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threads)
+#endif
+	for (i = 0; i < parts; i++) {
+		int t = 0;
+#ifdef _OPENMP
+		t = omp_get_thread_num();
+#endif
+		part_unique(&part[i], &part_work[t]);
+	}
+
+	for (i = 0; i < threads; i++) {
+		MEM_FREE(part_work[i].data);
+		MEM_FREE(part_work[i].table);
+	}
+	MEM_FREE(part_work);
+}
+
+static int part_read_seq(struct part *p)
+{
+	if (!p->kept)
+		return 0;
+	p->kept--;
+	if (fread(&p->seq, sizeof(p->seq), 1, p->file) != 1)
+		pexit("fread");
+	return 1;
+}
+
+/*
+ * Merges the parts back by line number, using a heap of the parts that have
+ * lines left.
+ */
+static void part_merge(void)
+{
+	char line[LINE_BUFFER_SIZE + 1];
+	unsigned int *heap, count = 0, i, j, k;
+
+	heap = mem_alloc(parts * sizeof(*heap));
+	for (i = 0; i < parts; i++) {
+		if (fseek(part[i].file, 0, SEEK_SET) < 0) pexit("fseek");
+		if (!part_read_seq(&part[i]))
+			continue;
+		for (j = count++; j && part[heap[(j - 1) / 2]].seq > part[i].seq;
+		    j = (j - 1) / 2)
+			heap[j] = heap[(j - 1) / 2];
+		heap[j] = i;
+	}
+
+	while (count) {
+		struct part *p = &part[i = heap[0]];
+
+		if (!fgets(line, sizeof(line), p->file)) pexit("fgets");
+		if (fputs(line, output) < 0) pexit("fputs");
+		++written_lines;
+
+		if (!part_read_seq(p))
+			i = heap[--count];
+		for (j = 0; (k = 2 * j + 1) < count; j = k) {
+			if (k + 1 < count && part[heap[k + 1]].seq < part[heap[k]].seq)
+				k++;
+			if (part[heap[k]].seq > part[i].seq)
+				break;
+			heap[j] = heap[k];
+		}
+		if (count)
+			heap[j] = i;
+	}
+
+	MEM_FREE(heap);
+}
+
+static void part_done(void)
+{
+	char name[PATH_BUFFER_SIZE];
+	unsigned int i;
+
+	for (i = 0; i < parts; i++) {
+		FILE *file = part[i].file;
+
+		part[i].file = NULL;
+		if (fclose(file)) pexit("fclose");
+	}
+	while (part_files) {
+		part_name(name, --part_files);
+		if (remove(name)) pexit("remove: %s", name);
+	}
+	MEM_FREE(part);
+}
+
+static void unique_run_parts(void)
+{
+	part_split();
+	part_unique_all();
+	part_merge();
+	part_done();
+}
+
 static void unique_done(void)
 {
 	if (fclose(output)) pexit("fclose");
@@ -370,7 +713,7 @@ static void unique_done(void)
 
 int unique(int argc, char **argv)
 {
-	while (argc > 2 && (!strcmp(argv[1], "-v") || !strncmp(argv[1], "-inp=", 5) || !strncmp(argv[1], "-cut=", 5) || !strncmp(argv[1], "-mem=", 5))) {
+	while (argc > 2 && (!strcmp(argv[1], "-v") || !strncmp(argv[1], "-inp=", 5) || !strncmp(argv[1], "-cut=", 5) || !strncmp(argv[1], "-mem=", 5) || !strncmp(argv[1], "-parts=", 7))) {
 		int i;
 		if (!strcmp(argv[1], "-v"))
 		{
@@ -429,6 +772,15 @@ int unique(int argc, char **argv)
 			vUNIQUE_HASH_MASK = vUNIQUE_HASH_SIZE - 1;
 			vUNIQUE_HASH_LOG_HALF = vUNIQUE_HASH_LOG / 2;
 		}
+		else if (!strncmp(argv[1], "-parts=", 7))
+		{
+			sscanf(argv[1], "-parts=%u", &parts);
+			if (parts < 2 || parts > UNIQUE_MAX_PARTS)
+				exit(fprintf(stderr, "Error, -parts= must be from 2 to %d\n", UNIQUE_MAX_PARTS));
+			--argc;
+			for (i = 1; i < argc; ++i)
+				argv[i] = argv[i+1];
+		}
 	}
 	if (argc == 3 && !strncmp(argv[2], "-ex_file=", 9)) {
 		use_to_unique_but_not_add = fopen(&argv[2][9], "rb");
@@ -449,7 +801,7 @@ int unique(int argc, char **argv)
 #if defined (__MINGW32__)
 	    puts("");
 #endif
-		puts("Usage: unique [-v] [-inp=fname] [-cut=len] [-mem=num] OUTPUT-FILE [-ex_file=FNAME2] [-ex_file_only=FNAME2]\n\n"
+		puts("Usage: unique [-v] [-inp=fname] [-cut=len] [-mem=num] [-parts=num] OUTPUT-FILE [-ex_file=FNAME2] [-ex_file_only=FNAME2]\n\n"
 			 "       reads from stdin 'normally', but can be overridden by optional -inp=\n"
 			 "       If -ex_file=XX is used, then data from file XX is also used to\n"
 			 "       unique the data, but nothing is ever written to XX. Thus, any data in\n"
@@ -461,6 +813,11 @@ int unique(int argc, char **argv)
 			 "       params.h.  The default is 21.  This can be raised, up to 25 (memory usage\n"
 			 "       doubles each number).  If you go TOO large, unique will swap and thrash and\n"
 			 "       work VERY slow\n"
+			 "       -parts=num  For input much larger than memory: splits it into num\n"
+			 "       temporary files next to OUTPUT-FILE, makes them unique in parallel and\n"
+			 "       merges them back in order.  Each file is read in memory in whole, and\n"
+			 "       only as many are processed at once as fit in the -mem= size (at least\n"
+			 "       one, so use enough -parts for each file to fit in it)\n"
 			 "\n"
 			 "       -v is for 'verbose' mode, outputs line counts during the run");
 
@@ -473,7 +830,10 @@ int unique(int argc, char **argv)
 	if (!fpInput)
 		fpInput = stdin;
 	unique_init(argv[1]);
-	unique_run();
+	if (parts)
+		unique_run_parts();
+	else
+		unique_run();
 	unique_done();
 #ifdef __MINGW32__
     printf ("Total lines read %I64u Unique lines written %I64u\n", totLines, written_lines);
@@ -82,6 +82,9 @@
 #include "unicode.h"
 #include "regex.h"
 #include "mask.h"
+#include "workq.h"
+#include "dedupe.h"
+#include "zfile.h"
 #include "memdbg.h"
 
 #define _STR_VALUE(arg)			#arg
@@ -90,6 +93,7 @@
 static int dist_rules;
 
 static FILE *word_file = NULL;
+static struct zfile *word_zf;
 static double progress = 0;
 
 static int rec_rule;
@@ -98,6 +102,9 @@ static int64_t rec_line;
 
 static int rule_number, rule_count;
 static int64_t line_number, loop_line_no;
+/* Lines are claimed from the work queue up to unit_end (exclusive) */
+static int use_workq;
+static int64_t unit_end;
 static int length;
 static struct rpp_context *rule_ctx;
 
@@ -112,6 +119,8 @@ static void save_state(FILE *file)
 {
 	fprintf(file, "%d\n" LLd "\n" LLd "\n",
 	        rec_rule, (long long)rec_pos, (long long)rec_line);
+	if (word_zf && !nWordFileLines)
+		zf_save(word_zf, file, rec_pos);
 }
 
 static int restore_rule_number(void)
@@ -242,6 +251,16 @@ static MAYBE_INLINE char *mgetl(char *res)
 	return res;
 }
 
+/* Next line from whichever way the file is read. */
+static MAYBE_INLINE char *wgetl(char *line)
+{
+	if (mem_map)
+		return mgetl(line);
+	if (word_zf)
+		return zf_getl(line, LINE_BUFFER_SIZE, word_zf);
+	return fgetl(line, LINE_BUFFER_SIZE, word_file);
+}
+
 static MAYBE_INLINE int skip_lines(unsigned long n, char *line)
 {
 	if (n) {
@@ -249,8 +268,7 @@ static MAYBE_INLINE int skip_lines(unsigned long n, char *line)
 
 		if (!nWordFileLines)
 		do {
-			if (mem_map ? !mgetl(line) :
-			    !fgetl(line, LINE_BUFFER_SIZE, word_file))
+			if (!wgetl(line))
 				return 1;
 		} while (--n);
 	}
@@ -258,6 +276,26 @@ static MAYBE_INLINE int skip_lines(unsigned long n, char *line)
 	return 0;
 }
 
+/*
+ * Claim the next unit of lines for this rule from the work queue and skip to
+ * its first line.  Returns non-zero if this rule has no more lines for us.
+ */
+static int next_unit(char *line)
+{
+	unsigned long long unit;
+	int64_t start;
+
+	if ((unit = workq_claim(rule_number)) == WORKQ_NONE)
+		return 1;
+
+	start = (int64_t)WORKQ_INDEX(unit) * WORKQ_UNIT_LINES;
+	unit_end = start + WORKQ_UNIT_LINES;
+	if (skip_lines(start - line_number, line))
+		return 1;
+
+	return nWordFileLines && line_number >= nWordFileLines;
+}
+
 static void restore_line_number(void)
 {
 	char line[LINE_BUFFER_SIZE];
@@ -283,12 +321,25 @@ static int restore_state(FILE *file)
 			return 1;
 		rec_line = line;
 	}
-	if (rec_rule < 0 || rec_pos < 0)
+	if (word_zf && !nWordFileLines && zf_restore(word_zf, file))
 		return 1;
+/* A position of -1 means the line number is the work queue's low-water mark */
+	if (rec_rule < 0 || rec_pos < -1 || (rec_pos == -1) != use_workq) {
+		if (rec_pos == -1 || use_workq)
+			fprintf(stderr, "Session was saved with a different "
+			    "DynamicFork setting\n");
+		return 1;
+	}
 
 	if (restore_rule_number())
 		return 1;
 
+	if (use_workq) {
+		workq_restore(WORKQ_UNIT(rec_rule,
+		    rec_line / WORKQ_UNIT_LINES));
+		return 0;
+	}
+
 	if (word_file == stdin) {
 		restore_line_number();
 	} else
@@ -297,6 +348,9 @@ static int restore_state(FILE *file)
 			char line[LINE_BUFFER_SIZE];
 			skip_lines(rec_line, line);
 		} else
+		if (word_zf)
+			zf_seek(word_zf, rec_pos);
+		else
 		if (jtr_fseek64(word_file, rec_pos, SEEK_SET))
 			pexit(STR_MACRO(jtr_fseek64));
 		line_number = rec_line;
@@ -309,16 +363,39 @@ static int fix_state_delay;
 
 static void fix_state(void)
 {
+/*
+ * We're called once the buffered candidates have been tried, so every unit
+ * we claimed is complete except possibly for the one we're in the middle of.
+ */
+	if (use_workq)
+		workq_complete(line_number < unit_end ?
+		    WORKQ_UNIT(rule_number, line_number / WORKQ_UNIT_LINES) :
+		    WORKQ_NONE);
+
 	if (++fix_state_delay < options.max_fix_state_delay)
 		return;
 	fix_state_delay=0;
 
+	if (use_workq) {
+		unsigned long long low = workq_low();
+
+		if (low != WORKQ_NONE) {
+			rec_rule = WORKQ_STAGE(low);
+			rec_line = (int64_t)WORKQ_INDEX(low) * WORKQ_UNIT_LINES;
+			rec_pos = -1;
+		}
+		return;
+	}
+
 	rec_rule = rule_number;
 	rec_line = line_number;
 
 	if (word_file == stdin)
 		rec_pos = line_number;
 	else
+	if (word_zf)
+		rec_pos = zf_tell(word_zf);
+	else
 	if ((rec_pos = jtr_ftell64(word_file)) < 0) {
 #ifdef __DJGPP__
 		if (rec_pos != -1)
@@ -348,6 +425,9 @@ static double get_progress(void)
 	} else if (mem_map) {
 		pos = map_pos - mem_map;
 		size = map_end - mem_map;
+	} else if (word_zf) {
+		pos = zf_in_tell(word_zf);
+		size = zf_in_size(word_zf);
 	} else {
 		pos = jtr_ftell64(word_file);
 		jtr_fseek64(word_file, 0, SEEK_END);
@@ -509,7 +589,7 @@ void do_wordlist_crack(struct db_main *db, char *name, int rules)
 	int dist_switch=0;
 	unsigned long my_words=0, their_words=0, my_words_left=0;
 	int64_t file_len = 0;
-	int i, pipe_input = 0, max_pipe_words = 0, rules_keep = 0;
+	int i, pipe_input = 0, max_pipe_words = 0, rules_keep = 0, block;
 	int init_once = 1;
 #if HAVE_WINDOWS_H
 	IPC_Item *pIPC=NULL;
@@ -565,9 +645,17 @@ void do_wordlist_crack(struct db_main *db, char *name, int rules)
 	if (!(name = cfg_get_param(SECTION_OPTIONS, NULL, "Wordfile")))
 		name = options.wordlist = WORDLIST_NAME;
 
+/*
+ * Forked processes may claim lines from a shared queue instead.  Not with a
+ * stacked mask, which calls our fix_state() for every word rather than once
+ * its candidates have been tried.
+ */
+	use_workq = workq_enabled && name && !do_lmloop && !options.mask;
+
 	if (name) {
-		char *cp, csearch;
+		char *cp, csearch, *zf_str = NULL;
 		int64_t ourshare = 0;
+		int zf_format;
 
 		if (!(word_file = jtr_fopen(path_expand(name), "rb")))
 			pexit(STR_MACRO(jtr_fopen)": %s", path_expand(name));
@@ -586,38 +674,63 @@ void do_wordlist_crack(struct db_main *db, char *name, int rules)
 			error();
 		}
 
+		if ((zf_format = zf_type(word_file))) {
+			word_zf = zf_open(word_file, zf_format);
+			log_event("- decompressing %s wordlist on the fly",
+			          zf_name(zf_format));
+		}
 #ifdef HAVE_MMAP
-		log_event("- memory mapping wordlist ("LLd" bytes)",
-		          (long long)file_len);
+		else {
+			log_event("- memory mapping wordlist ("LLd" bytes)",
+			          (long long)file_len);
 #if (SIZEOF_SIZE_T < 8)
-		/* Now even though we are 64 bit file size, we must still
-		 * deal with some 32 bit functions ;) */
-		mem_map = MAP_FAILED;
-		if (file_len < ((1LL)<<32))
+			/* Now even though we are 64 bit file size, we must
+			 * still deal with some 32 bit functions ;) */
+			mem_map = MAP_FAILED;
+			if (file_len < ((1LL)<<32))
 #endif
-		mem_map = mmap(NULL, file_len,
-		               PROT_READ, MAP_SHARED,
-		               fileno(word_file), 0);
-		if (mem_map == MAP_FAILED) {
-			mem_map = NULL;
+			mem_map = mmap(NULL, file_len,
+			               PROT_READ, MAP_SHARED,
+			               fileno(word_file), 0);
+			if (mem_map == MAP_FAILED) {
+				mem_map = NULL;
 #ifdef DEBUG
-			fprintf(stderr, "wordlist: memory mapping failed (%s) (non-fatal)\n",
-			        strerror(errno));
+				fprintf(stderr, "wordlist: memory mapping "
+				        "failed (%s) (non-fatal)\n",
+				        strerror(errno));
 #endif
-			log_event("- memory mapping failed (%s) - but we'll do "
-			          "fine without it.", strerror(errno));
-		} else {
-			map_pos = mem_map;
-			map_end = mem_map + file_len;
-			map_scan_end = map_end - 16;
+				log_event("- memory mapping failed (%s) - "
+				          "but we'll do fine without it.",
+				          strerror(errno));
+			} else {
+				map_pos = mem_map;
+				map_end = mem_map + file_len;
+				map_scan_end = map_end - 16;
+			}
 		}
 #endif
 
-		ourshare = options.node_count ?
+		ourshare = options.node_count && !use_workq ?
 			(file_len / options.node_count) *
 			(options.node_max - options.node_min + 1)
 			: file_len;
 
+		if (word_zf) {
+/* We can't tell how large a compressed wordlist is without decompressing it */
+			if (!(options.flags & FLG_EXTERNAL_CHK) &&
+			    !mem_saving_level &&
+			    (dupeCheck || options.flags & FLG_RULES))
+				zf_str = zf_load(word_zf, forceLoad ? 0 :
+				                 options.max_wordfile_memory,
+				                 &file_len);
+			forceLoad = zf_str != NULL;
+			if (forceLoad && !file_len) {
+				if (john_main_process)
+					fprintf(stderr, "Error, dictionary file "
+					        "is empty\n");
+				error();
+			}
+		} else
 		if (ourshare < options.max_wordfile_memory)
 			forceLoad = 1;
 
@@ -626,13 +739,14 @@ void do_wordlist_crack(struct db_main *db, char *name, int rules)
 		   Disabled for external filter - it would trash the buffer. */
 		if (!(options.flags & FLG_EXTERNAL_CHK) && !mem_saving_level)
 		if (dupeCheck || options.flags & FLG_RULES)
-		if (forceLoad || (options.node_count > 1 &&
+		if (forceLoad || (!word_zf && options.node_count > 1 &&
+		     !use_workq &&
 		     file_len > options.node_count * (length * 100) &&
 		     ourshare < options.max_wordfile_memory)) {
 			char *aep;
 
 			// Load only this node's share of words to memory
-			if (mem_map && options.node_count > 1 &&
+			if (mem_map && options.node_count > 1 && !use_workq &&
 			    (file_len > options.node_count * (length * 100))) {
 				/* Check net size for our share. */
 				for (nWordFileLines = 0;; ++nWordFileLines) {
@@ -716,17 +830,22 @@ void do_wordlist_crack(struct db_main *db, char *name, int rules)
 				if (options.node_count > 1 && john_main_process)
 				fprintf(stderr,"Each node loaded the whole "
 				        "wordfile to memory\n");
-				word_file_str =
-					mem_alloc_tiny((size_t)file_len +
-					               LINE_BUFFER_SIZE + 1,
-					               MEM_ALIGN_NONE);
-				if (fread(word_file_str, 1, (size_t)file_len,
-				          word_file) != file_len) {
-					if (ferror(word_file))
-						pexit("fread");
-					fprintf(stderr,
-					        "fread: Unexpected EOF\n");
-					error();
+				if (zf_str)
+					word_file_str = zf_str;
+				else {
+					word_file_str = mem_alloc_tiny(
+						(size_t)file_len +
+						LINE_BUFFER_SIZE + 1,
+						MEM_ALIGN_NONE);
+					if (fread(word_file_str, 1,
+					          (size_t)file_len,
+					          word_file) != file_len) {
+						if (ferror(word_file))
+							pexit("fread");
+						fprintf(stderr, "fread: "
+						        "Unexpected EOF\n");
+						error();
+					}
 				}
 				if (memchr(word_file_str, 0, (size_t)file_len)) {
 					fprintf(stderr,
@@ -991,7 +1110,7 @@ REDO_AFTER_LMLOOP:
 	}
 
 	rule_number = 0;
-	line_number = 0;
+	line_number = unit_end = 0;
 	loop_line_no = 0;
 
 	if (init_once) {
@@ -1006,6 +1125,9 @@ REDO_AFTER_LMLOOP:
 		rec_init(db, save_state);
 
 		crk_init(db, fix_state, NULL);
+
+		if (rules)
+			dedupe_init();
 	}
 
 	prerule = rule = "";
@@ -1022,6 +1144,10 @@ REDO_AFTER_LMLOOP:
 	their_words = 0;
 	/* myWordFileLines indicates we already have OUR share of words in
 	   memory buffer, so no further skipping. */
+	if (use_workq) {
+		log_event("- Will distribute words across processes "
+		          "dynamically");
+	} else
 	if (options.node_count && !myWordFileLines) {
 		int rule_rem = rule_count % options.node_count;
 		const char *now, *later = "";
@@ -1096,6 +1222,17 @@ REDO_AFTER_LMLOOP:
 			}
 		}
 
+/*
+ * Words can be mangled in blocks unless they're distributed across nodes one
+ * by one here, or need per-word processing other than rules.
+ */
+		block = rules && !options.mask && !f_filter &&
+#if HAVE_REXGEN
+		    !regex &&
+#endif
+		    (use_workq || !options.node_count || myWordFileLines ||
+		    dist_rules);
+
 		/* Process loopback LM passwords that were put together
 		   at start of session */
 		if (rule && do_lmloop && (joined = db->plaintexts->head))
@@ -1114,6 +1251,9 @@ REDO_AFTER_LMLOOP:
 			if ((word = apply(joined->data, rule, -1, last))) {
 				last = word;
 
+				if (dedupe_skip(word))
+					continue;
+
 				if (options.mask) {
 					if (do_mask_crack(word)) {
 						rule = NULL;
@@ -1139,6 +1279,10 @@ REDO_AFTER_LMLOOP:
 
 		else if (rule && nWordFileLines)
 		while (line_number < nWordFileLines) {
+			if (use_workq) {
+				if (line_number >= unit_end && next_unit(line))
+					break;
+			} else
 			if (options.node_count && !myWordFileLines)
 			if (!dist_rules) {
 				int for_node = line_number %
@@ -1150,6 +1294,39 @@ REDO_AFTER_LMLOOP:
 					continue;
 				}
 			}
+
+/*
+ * Mangle a block of words at once.  line_number is advanced as the words
+ * are used, so that the crash recovery file doesn't skip any not yet tried.
+ */
+			if (block) {
+				int count = nWordFileLines - line_number;
+				char **keys;
+
+				if (count > RULE_BLOCK_SIZE)
+					count = RULE_BLOCK_SIZE;
+				if (use_workq && count > unit_end - line_number)
+					count = unit_end - line_number;
+
+				keys = rules_apply_block(&words[line_number],
+				    count, rule, last);
+				for (i = 0; i < count; i++) {
+					line_number++;
+					if (!(word = keys[i]))
+						continue;
+					last = word;
+					if (dedupe_skip(word))
+						continue;
+					if (crk_process_key(word))
+						break;
+				}
+				if (i < count) {
+					rules = 0;
+					pipe_input = 0;
+					break;
+				}
+				continue;
+			}
 #if ARCH_ALLOWS_UNALIGNED
 			line = words[line_number];
 #else
@@ -1160,6 +1337,9 @@ REDO_AFTER_LMLOOP:
 			if ((word = apply(line, rule, -1, last))) {
 				last = word;
 
+				if (dedupe_skip(word))
+					continue;
+
 				if (options.mask) {
 					if (do_mask_crack(word)) {
 						rule = NULL;
@@ -1183,8 +1363,9 @@ REDO_AFTER_LMLOOP:
 		}
 
 		else if (rule)
-		while (mem_map ? mgetl(line) :
-		       fgetl(line, LINE_BUFFER_SIZE, word_file)) {
+		while ((!use_workq || line_number < unit_end ||
+		        !next_unit(line)) &&
+		       wgetl(line)) {
 			line_number++;
 
 			if (line[0] != '#') {
@@ -1216,6 +1397,9 @@ process_word:
 					else
 						strcpy(last, word);
 
+					if (dedupe_skip(word))
+						goto next_word;
+
 					if (options.mask) {
 						if (do_mask_crack(word)) {
 							rule = NULL;
@@ -1258,6 +1442,8 @@ EndOfFile:
 #endif
 		if (rules) {
 next_rule:
+			if (use_workq)
+				workq_finish(rule_number);
 			if (!(rule = rpp_next(&ctx))) break;
 			rule_number++;
 
@@ -1270,11 +1456,14 @@ next_rule:
 				their_words = options.node_count - my_words;
 			}
 
-			line_number = 0;
+			line_number = unit_end = 0;
 			if (!nWordFileLines && word_file != stdin) {
 				if (mem_map)
 					map_pos = mem_map;
 				else
+				if (word_zf)
+					zf_seek(word_zf, 0);
+				else
 				if (jtr_fseek64(word_file, 0, SEEK_SET))
 					pexit(STR_MACRO(jtr_fseek64));
 			}
@@ -1295,7 +1484,12 @@ next_rule:
 	if (pipe_input)
 		goto GRAB_NEXT_PIPE_LOAD;
 
+	dedupe_done();
 	crk_done();
+
+	if (use_workq && !event_abort)
+		workq_done();
+
 	rec_done(event_abort || (status.pass && db->salts));
 
 	if (ferror(word_file)) pexit("fgets");
@@ -1313,6 +1507,10 @@ next_rule:
 			munmap(mem_map, file_len);
 		map_pos = map_end = NULL;
 #endif
+		if (word_zf) {
+			zf_close(word_zf);
+			word_zf = NULL;
+		}
 		if (fclose(word_file))
 			pexit("fclose");
 		word_file = NULL;
@@ -0,0 +1,201 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+#if AC_BUILT
+#include "autoconfig.h"
+#endif
+
+#define NEED_OS_FORK
+#include "os.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#if OS_FORK && defined(HAVE_MMAP) && defined(__GNUC__)
+#define WORKQ_SHARED			1
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS			MAP_ANON
+#endif
+#else
+#define WORKQ_SHARED			0
+#endif
+
+#include "arch.h"
+#include "misc.h"
+#include "params.h"
+#include "options.h"
+#include "config.h"
+#include "logger.h"
+#include "workq.h"
+#include "memdbg.h"
+
+int workq_enabled = 0;
+
+#if WORKQ_SHARED
+/*
+ * The shared memory holds the next unit to claim, followed by the first unit
+ * each process has claimed but not completed yet (indexed by node number
+ * within the fork).  A process that has nothing pending publishes WORKQ_IDLE,
+ * and one that is done publishes WORKQ_NONE.  Every unit before the smallest
+ * of these and the next unit to claim has been completed.
+ */
+#define WORKQ_IDLE			(WORKQ_NONE - 1)
+
+static volatile unsigned long long *workq_next, *workq_pending;
+static int workq_count;
+
+static int workq_self(void)
+{
+	return options.node_min - 1;
+}
+
+void workq_init(void)
+{
+	size_t size;
+	void *shared;
+	int i;
+
+	if (options.fork < 2 || options.node_count != options.fork ||
+	    !cfg_get_bool(SECTION_OPTIONS, NULL, "DynamicFork", 0))
+		return;
+
+	workq_count = options.fork;
+	size = (workq_count + 1) * sizeof(*workq_next);
+	shared = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		log_event("! Can't share work dynamically: mmap: %s",
+		    strerror(errno));
+		return;
+	}
+
+	workq_next = shared;
+	workq_pending = workq_next + 1;
+	*workq_next = 0;
+	for (i = 0; i < workq_count; i++)
+		workq_pending[i] = WORKQ_IDLE;
+	workq_enabled = 1;
+
+	log_event("- Will share work between processes dynamically");
+}
+
+unsigned long long workq_claim(unsigned int stage)
+{
+	unsigned long long old, unit;
+
+	volatile unsigned long long *pending = &workq_pending[workq_self()];
+	int idle = *pending == WORKQ_IDLE;
+
+/*
+ * Announce the unit before claiming it, so that workq_low() never sees it
+ * claimed but not pending.  The unit we end up with can only be later.
+ */
+	do {
+		old = *workq_next;
+		if (WORKQ_STAGE(old) > stage) {
+			if (idle)
+				*pending = WORKQ_IDLE;
+			return WORKQ_NONE;
+		}
+		if (idle)
+			*pending = old;
+		unit = WORKQ_STAGE(old) < stage ? WORKQ_UNIT(stage, 0) : old;
+	} while (!__sync_bool_compare_and_swap(workq_next, old, unit + 1));
+
+	if (idle)
+		*pending = unit;
+
+	return unit;
+}
+
+void workq_finish(unsigned int stage)
+{
+	unsigned long long old, unit = WORKQ_UNIT(stage + 1, 0);
+
+	do {
+		old = *workq_next;
+		if (old >= unit)
+			break;
+	} while (!__sync_bool_compare_and_swap(workq_next, old, unit));
+}
+
+void workq_complete(unsigned long long unit)
+{
+	workq_pending[workq_self()] = unit == WORKQ_NONE ? WORKQ_IDLE : unit;
+}
+
+void workq_done(void)
+{
+	workq_pending[workq_self()] = WORKQ_NONE;
+}
+
+unsigned long long workq_low(void)
+{
+	unsigned long long next, low = WORKQ_NONE;
+	int i;
+
+	next = *workq_next;
+	__sync_synchronize();
+
+	for (i = 0; i < workq_count; i++)
+		if (workq_pending[i] < low)
+			low = workq_pending[i];
+
+	if (low != WORKQ_NONE && next < low)
+		low = next;
+
+	return low;
+}
+
+void workq_restore(unsigned long long unit)
+{
+	unsigned long long old;
+
+	do {
+		old = *workq_next;
+		if (old >= unit)
+			break;
+	} while (!__sync_bool_compare_and_swap(workq_next, old, unit));
+}
+
+#else
+
+void workq_init(void)
+{
+}
+
+unsigned long long workq_claim(unsigned int stage)
+{
+	return WORKQ_NONE;
+}
+
+void workq_finish(unsigned int stage)
+{
+}
+
+void workq_complete(unsigned long long unit)
+{
+}
+
+void workq_done(void)
+{
+}
+
+unsigned long long workq_low(void)
+{
+	return WORKQ_NONE;
+}
+
+void workq_restore(unsigned long long unit)
+{
+}
+
+#endif
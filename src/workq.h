@@ -0,0 +1,89 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+/*
+ * Dynamic distribution of work between --fork'ed processes.
+ *
+ * The work is split into stages (such as wordlist rules), each consisting of
+ * a number of units (such as blocks of wordlist lines) that can be processed
+ * in any order.  The processes share a counter of the next unit to process
+ * and claim units from it as they go, so that no process sits idle while
+ * others still have work queued up for them.
+ */
+
+#ifndef _JOHN_WORKQ_H
+#define _JOHN_WORKQ_H
+
+/*
+ * Units are numbered by stage in the high 32 bits and by index within the
+ * stage in the low 32 bits, so that later units compare as greater.
+ */
+#define WORKQ_UNIT(stage, index) \
+	(((unsigned long long)(stage) << 32) | (unsigned int)(index))
+#define WORKQ_STAGE(unit)		((unsigned int)((unit) >> 32))
+#define WORKQ_INDEX(unit)		((unsigned int)(unit))
+
+/*
+ * Returned by workq_claim() when the stage has no more units and by
+ * workq_low() when all processes are done.
+ */
+#define WORKQ_NONE			(~0ULL)
+
+/*
+ * Set if the work queue is in use for this session.
+ */
+extern int workq_enabled;
+
+/*
+ * Sets up the shared work queue if the "DynamicFork" option is enabled.
+ * Must be called before forking.
+ */
+extern void workq_init(void);
+
+/*
+ * Claims the next unit of the given stage.  If the queue is at an earlier
+ * stage, it is moved forward to this one first.  Returns WORKQ_NONE if the
+ * queue has already moved on to a later stage.
+ */
+extern unsigned long long workq_claim(unsigned int stage);
+
+/*
+ * Moves the queue past the given stage, once this process has seen that the
+ * stage has no more units.  Units of this stage claimed by other processes
+ * may still be in progress.
+ */
+extern void workq_finish(unsigned int stage);
+
+/*
+ * Reports that all units this process has claimed before the given one have
+ * been completed, that is, all candidates generated from them have actually
+ * been tried rather than merely buffered.  WORKQ_NONE means all units claimed
+ * so far.  Should be called after each batch of candidates is processed.
+ */
+extern void workq_complete(unsigned long long unit);
+
+/*
+ * Marks this process as having no more work to do.
+ */
+extern void workq_done(void);
+
+/*
+ * Returns the first unit that may not have been completed yet, for saving in
+ * the crash recovery file.  All units before it have been reported completed
+ * by the processes that claimed them.
+ */
+extern unsigned long long workq_low(void);
+
+/*
+ * Continues from a restored workq_low() value.  The queue is moved forward
+ * to this unit unless it is already past it.
+ */
+extern void workq_restore(unsigned long long unit);
+
+#endif
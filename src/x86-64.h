@@ -213,7 +213,13 @@
 #ifdef __SSE2__
 
 #ifndef MD5_SSE_PARA
-#if defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
+#if defined(__AVX512F__)
+#define MD5_SSE_PARA			12
+#define MD5_N_STR			"48x"
+#elif defined(__AVX2__)
+#define MD5_SSE_PARA			6
+#define MD5_N_STR			"24x"
+#elif defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
 #define MD5_SSE_PARA			3
 #define MD5_N_STR			"12x"
 #elif defined(__clang__)
@@ -241,7 +247,13 @@
 #endif
 
 #ifndef MD4_SSE_PARA
-#if defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
+#if defined(__AVX512F__)
+#define MD4_SSE_PARA			12
+#define MD4_N_STR			"48x"
+#elif defined(__AVX2__)
+#define MD4_SSE_PARA			6
+#define MD4_N_STR			"24x"
+#elif defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
 #define MD4_SSE_PARA			3
 #define MD4_N_STR			"12x"
 #elif defined(__clang__)
@@ -266,7 +278,13 @@
 #endif
 
 #ifndef SHA1_SSE_PARA
-#if defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
+#if defined(__AVX512F__)
+#define SHA1_SSE_PARA			8
+#define SHA1_N_STR			"32x"
+#elif defined(__AVX2__)
+#define SHA1_SSE_PARA			4
+#define SHA1_N_STR			"16x"
+#elif defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
 #define SHA1_SSE_PARA			1
 #define SHA1_N_STR			"4x"
 #elif defined(__clang__)
@@ -311,7 +329,21 @@
 #endif
 #endif
 
+#if defined(__AVX512F__)
+#define MMX_TYPE			" AVX512F"
+#elif defined(__AVX2__)
+#define MMX_TYPE			" AVX2"
+#elif defined(__XOP__)
+#define MMX_TYPE			" XOP"
+#elif defined(__AVX__)
+#define MMX_TYPE			" AVX"
+#elif defined(__SSE4_1__)
+#define MMX_TYPE			" SSE4.1"
+#elif defined(__SSSE3__)
+#define MMX_TYPE			" SSSE3"
+#else
 #define MMX_TYPE			" SSE2"
+#endif
 #define MMX_COEF			4
 
 #define NT_X86_64
@@ -319,6 +351,32 @@
 #define MMX_COEF_SHA256 4
 #define MMX_COEF_SHA512 2
 
+#ifndef SHA256_SSE_PARA
+#if defined(__AVX512F__)
+#define SHA256_SSE_PARA			4
+#define SHA256_N_STR			"16x"
+#elif defined(__AVX2__)
+#define SHA256_SSE_PARA			2
+#define SHA256_N_STR			"8x"
+#else
+#define SHA256_SSE_PARA			1
+#define SHA256_N_STR			"4x"
+#endif
+#endif
+
+#ifndef SHA512_SSE_PARA
+#if defined(__AVX512F__)
+#define SHA512_SSE_PARA			4
+#define SHA512_N_STR			"8x"
+#elif defined(__AVX2__)
+#define SHA512_SSE_PARA			2
+#define SHA512_N_STR			"4x"
+#else
+#define SHA512_SSE_PARA			1
+#define SHA512_N_STR			"2x"
+#endif
+#endif
+
 #endif /* __SSE2__ */
 
 #define BF_ASM				0
@@ -0,0 +1,880 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ *
+ * Checkpoints within gzip files work the same way as in zlib's zran.c
+ * example by Mark Adler.
+ */
+
+#if AC_BUILT
+#include "autoconfig.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include <zlib.h>
+#if HAVE_LIBBZ2
+#include <bzlib.h>
+#endif
+#if HAVE_LIBLZMA
+#include <lzma.h>
+#endif
+
+#include "arch.h"
+#include "jumbo.h"
+#include "misc.h"
+#include "params.h"
+#include "memory.h"
+#include "zfile.h"
+#include "memdbg.h"
+
+#define ZF_IN_SIZE			0x10000
+#define ZF_WINDOW			0x8000
+#define ZF_POINTS			4
+
+/* Error code for data we can't decompress, errno values are positive */
+#define ZF_CORRUPT			(-1)
+
+struct zf_point {
+	int64_t pos, in_pos;
+	int bits;
+	unsigned int have;
+	unsigned char window[ZF_WINDOW];
+};
+
+struct zf_chunk {
+	char *data;
+	size_t len;
+	int64_t pos, end_pos, in_pos;
+	int eof, err;
+};
+
+struct zfile {
+	FILE *file;
+	int type;
+	int64_t size;
+
+/* Decompressor state, only used by whichever thread is filling chunks */
+	union {
+		z_stream gz;
+#if HAVE_LIBBZ2
+		bz_stream bz;
+#endif
+#if HAVE_LIBLZMA
+		lzma_stream xz;
+#endif
+	} s;
+	int ready, eof, err, in_end, member_end, raw, skip;
+	int64_t in_pos, out_pos, next_point;
+	unsigned char in[ZF_IN_SIZE];
+	unsigned char hist[ZF_WINDOW];
+
+/* The last bytes of a chunk that are not a whole line yet */
+	char *carry;
+	size_t carry_len;
+
+/* Checkpoints, shared with the main thread for zf_save() */
+	struct zf_point *point;
+	int point_next;
+
+	struct zf_chunk chunk[2];
+	int cur, next;
+	char *ptr;
+	int64_t seek_pos, seek_in_pos;
+	char *loaded;
+
+#if HAVE_PTHREAD
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int running, sync, stop, fill, full[2];
+#endif
+};
+
+static const char *zf_names[] = {
+	"uncompressed", "gzip", "bzip2", "xz", "zstd"
+};
+
+int zf_type(FILE *file)
+{
+	unsigned char m[10];
+	size_t n = fread(m, 1, sizeof(m), file);
+
+	rewind(file);
+
+	if (n >= 3 && m[0] == 0x1f && m[1] == 0x8b && m[2] == 8)
+		return ZF_GZIP;
+	if (n == 10 && !memcmp(m, "BZh", 3) && m[3] >= '1' && m[3] <= '9' &&
+	    (!memcmp(&m[4], "1AY&SY", 6) ||
+	    !memcmp(&m[4], "\x17\x72\x45\x38\x50\x90", 6)))
+		return ZF_BZIP2;
+	if (n >= 6 && !memcmp(m, "\xfd" "7zXZ", 6))
+		return ZF_XZ;
+	if (n >= 4 && !memcmp(m, "\x28\xb5\x2f\xfd", 4))
+		return ZF_ZSTD;
+
+	return ZF_NONE;
+}
+
+const char *zf_name(int type)
+{
+	return zf_names[type];
+}
+
+static void zf_fail(int err)
+{
+	if (err > 0) {
+		errno = err;
+		pexit("fread");
+	}
+
+	fprintf(stderr, "Error: compressed file is corrupt or truncated\n");
+	error();
+}
+
+static size_t zf_read(struct zfile *zf)
+{
+	size_t n = fread(zf->in, 1, sizeof(zf->in), zf->file);
+
+	if (!n && ferror(zf->file))
+		zf->err = errno ? errno : EIO;
+	zf->in_pos += n;
+
+	return n;
+}
+
+/* Number of compressed bytes the decompressor has consumed */
+static int64_t zf_consumed(struct zfile *zf)
+{
+	switch (zf->type) {
+#if HAVE_LIBBZ2
+	case ZF_BZIP2:
+		return zf->in_pos - zf->s.bz.avail_in;
+#endif
+#if HAVE_LIBLZMA
+	case ZF_XZ:
+		return zf->in_pos - zf->s.xz.avail_in;
+#endif
+	default:
+		return zf->in_pos - zf->s.gz.avail_in;
+	}
+}
+
+/* Decompression restarts from the beginning of the file */
+static void zf_rewind(struct zfile *zf)
+{
+	if (jtr_fseek64(zf->file, 0, SEEK_SET))
+		pexit("fseek");
+
+	zf->eof = zf->err = zf->in_end = zf->member_end = 0;
+	zf->raw = zf->skip = 0;
+	zf->in_pos = zf->out_pos = 0;
+	zf->next_point = ZFILE_CHECKPOINT_SPAN;
+
+	switch (zf->type) {
+	case ZF_GZIP:
+		zf->s.gz.avail_in = 0;
+		if (zf->ready ? inflateReset2(&zf->s.gz, 31) :
+		    inflateInit2(&zf->s.gz, 31)) {
+			fprintf(stderr, "inflateInit2() failed\n");
+			error();
+		}
+		break;
+
+#if HAVE_LIBBZ2
+	case ZF_BZIP2:
+		if (zf->ready)
+			BZ2_bzDecompressEnd(&zf->s.bz);
+		zf->s.bz.avail_in = 0;
+		if (BZ2_bzDecompressInit(&zf->s.bz, 0, 0) != BZ_OK) {
+			fprintf(stderr, "BZ2_bzDecompressInit() failed\n");
+			error();
+		}
+		break;
+#endif
+
+#if HAVE_LIBLZMA
+	case ZF_XZ:
+		zf->s.xz.avail_in = 0;
+		if (lzma_stream_decoder(&zf->s.xz, UINT64_MAX,
+		    LZMA_CONCATENATED) != LZMA_OK) {
+			fprintf(stderr, "lzma_stream_decoder() failed\n");
+			error();
+		}
+		break;
+#endif
+	}
+
+	zf->ready = 1;
+}
+
+/* Decompression resumes from a gzip checkpoint */
+static void zf_resume(struct zfile *zf, struct zf_point *pt)
+{
+	z_stream *s = &zf->s.gz;
+	int64_t pos = pt->in_pos - (pt->bits ? 1 : 0);
+
+	if (jtr_fseek64(zf->file, pos, SEEK_SET))
+		pexit("fseek");
+
+	zf->eof = zf->err = zf->member_end = zf->skip = 0;
+	zf->raw = 1;
+	zf->in_pos = pos;
+	zf->out_pos = pt->pos;
+	zf->next_point = pt->pos + ZFILE_CHECKPOINT_SPAN;
+
+	s->avail_in = 0;
+	inflateReset2(s, -15);
+	if (pt->bits) {
+		int c = getc(zf->file);
+
+		if (c == EOF)
+			zf_fail(ferror(zf->file) ? errno : ZF_CORRUPT);
+		zf->in_pos++;
+		inflatePrime(s, pt->bits, c >> (8 - pt->bits));
+	}
+	inflateSetDictionary(s, pt->window + ZF_WINDOW - pt->have, pt->have);
+	memcpy(zf->hist, pt->window, ZF_WINDOW);
+}
+
+static struct zf_point *zf_find_point(struct zfile *zf, int64_t pos)
+{
+	struct zf_point *pt = NULL;
+	int i;
+
+	if (zf->point)
+	for (i = 0; i < ZF_POINTS; i++)
+	if (zf->point[i].pos >= 0 && zf->point[i].pos <= pos &&
+	    (!pt || zf->point[i].pos > pt->pos))
+		pt = &zf->point[i];
+
+	return pt;
+}
+
+/*
+ * Records a checkpoint at the current gzip block boundary.  The window is
+ * made of the done bytes just decompressed to out, preceded by the history.
+ */
+static void zf_add_point(struct zfile *zf, int bits,
+	unsigned char *out, size_t done)
+{
+	struct zf_point *pt;
+	int i;
+
+	zf->next_point = zf->out_pos + ZFILE_CHECKPOINT_SPAN;
+
+/* We may have been here before, such as for the previous rule */
+	for (i = 0; i < ZF_POINTS; i++)
+	if (zf->point[i].pos == zf->out_pos)
+		return;
+
+#if HAVE_PTHREAD
+	pthread_mutex_lock(&zf->mutex);
+#endif
+	pt = &zf->point[zf->point_next];
+	zf->point_next = (zf->point_next + 1) % ZF_POINTS;
+
+	pt->pos = zf->out_pos;
+	pt->in_pos = zf_consumed(zf);
+	pt->bits = bits;
+	pt->have = zf->out_pos < ZF_WINDOW ? zf->out_pos : ZF_WINDOW;
+	if (done >= ZF_WINDOW)
+		memcpy(pt->window, out + done - ZF_WINDOW, ZF_WINDOW);
+	else {
+		memcpy(pt->window, zf->hist + done, ZF_WINDOW - done);
+		memcpy(pt->window + ZF_WINDOW - done, out, done);
+	}
+#if HAVE_PTHREAD
+	pthread_mutex_unlock(&zf->mutex);
+#endif
+}
+
+static void zf_history(struct zfile *zf, unsigned char *out, size_t done)
+{
+	if (done >= ZF_WINDOW)
+		memcpy(zf->hist, out + done - ZF_WINDOW, ZF_WINDOW);
+	else {
+		memmove(zf->hist, zf->hist + done, ZF_WINDOW - done);
+		memcpy(zf->hist + ZF_WINDOW - done, out, done);
+	}
+}
+
+static size_t zf_gz_decode(struct zfile *zf, unsigned char *out, size_t size)
+{
+	z_stream *s = &zf->s.gz;
+	int64_t base = zf->out_pos;
+	size_t done;
+	int ret;
+
+	s->next_out = out;
+	s->avail_out = size;
+
+	while (s->avail_out && !zf->eof && !zf->err) {
+		if (!s->avail_in) {
+			s->next_in = zf->in;
+			if (!(s->avail_in = zf_read(zf))) {
+				if (zf->err)
+					break;
+				if (!zf->member_end || zf->skip)
+					zf->err = ZF_CORRUPT;
+				zf->eof = 1;
+				break;
+			}
+		}
+
+/* The trailer of a member we've decompressed raw from a checkpoint */
+		if (zf->skip) {
+			unsigned int n = zf->skip < s->avail_in ?
+				zf->skip : s->avail_in;
+
+			s->next_in += n;
+			s->avail_in -= n;
+			zf->skip -= n;
+			continue;
+		}
+
+/* Anything but another gzip member after the end of one is ignored */
+		if (zf->member_end) {
+			if (s->next_in[0] != 0x1f) {
+				zf->eof = 1;
+				break;
+			}
+			zf->member_end = 0;
+		}
+
+		ret = inflate(s, Z_BLOCK);
+		zf->out_pos = base + (s->next_out - out);
+
+		if (ret == Z_STREAM_END) {
+			zf->skip = zf->raw ? 8 : 0;
+			zf->raw = 0;
+			zf->member_end = 1;
+			inflateReset2(s, 31);
+		} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			zf->err = ZF_CORRUPT;
+		} else if ((s->data_type & 128) && !(s->data_type & 64) &&
+		    zf->out_pos >= zf->next_point)
+			zf_add_point(zf, s->data_type & 7,
+			    out, s->next_out - out);
+	}
+
+	done = s->next_out - out;
+	zf_history(zf, out, done);
+
+	return done;
+}
+
+#if HAVE_LIBBZ2
+static size_t zf_bz_decode(struct zfile *zf, unsigned char *out, size_t size)
+{
+	bz_stream *s = &zf->s.bz;
+	int ret;
+
+	s->next_out = (char *)out;
+	s->avail_out = size;
+
+	while (s->avail_out && !zf->eof && !zf->err) {
+		if (!s->avail_in) {
+			s->next_in = (char *)zf->in;
+			if (!(s->avail_in = zf_read(zf))) {
+				if (zf->err)
+					break;
+				if (!zf->member_end)
+					zf->err = ZF_CORRUPT;
+				zf->eof = 1;
+				break;
+			}
+		}
+
+/* Like bzip2 itself, we accept concatenated streams */
+		if (zf->member_end) {
+			char *next_in = s->next_in;
+			unsigned int avail_in = s->avail_in;
+
+			if (next_in[0] != 'B') {
+				zf->eof = 1;
+				break;
+			}
+			BZ2_bzDecompressEnd(s);
+			if (BZ2_bzDecompressInit(s, 0, 0) != BZ_OK) {
+				zf->err = ZF_CORRUPT;
+				break;
+			}
+			s->next_in = next_in;
+			s->avail_in = avail_in;
+			zf->member_end = 0;
+		}
+
+		ret = BZ2_bzDecompress(s);
+		if (ret == BZ_STREAM_END)
+			zf->member_end = 1;
+		else if (ret != BZ_OK)
+			zf->err = ZF_CORRUPT;
+	}
+
+	zf->out_pos += (unsigned char *)s->next_out - out;
+
+	return (unsigned char *)s->next_out - out;
+}
+#endif
+
+#if HAVE_LIBLZMA
+static size_t zf_xz_decode(struct zfile *zf, unsigned char *out, size_t size)
+{
+	lzma_stream *s = &zf->s.xz;
+	lzma_ret ret;
+
+	s->next_out = out;
+	s->avail_out = size;
+
+	while (s->avail_out && !zf->eof && !zf->err) {
+		if (!s->avail_in && !zf->in_end) {
+			s->next_in = zf->in;
+			if (!(s->avail_in = zf_read(zf))) {
+				if (zf->err)
+					break;
+				zf->in_end = 1;
+			}
+		}
+
+		ret = lzma_code(s, zf->in_end ? LZMA_FINISH : LZMA_RUN);
+		if (ret == LZMA_STREAM_END)
+			zf->eof = 1;
+		else if (ret != LZMA_OK)
+			zf->err = ZF_CORRUPT;
+	}
+
+	zf->out_pos += s->next_out - out;
+
+	return s->next_out - out;
+}
+#endif
+
+static size_t zf_decode(struct zfile *zf, char *out, size_t size)
+{
+	switch (zf->type) {
+#if HAVE_LIBBZ2
+	case ZF_BZIP2:
+		return zf_bz_decode(zf, (unsigned char *)out, size);
+#endif
+#if HAVE_LIBLZMA
+	case ZF_XZ:
+		return zf_xz_decode(zf, (unsigned char *)out, size);
+#endif
+	default:
+		return zf_gz_decode(zf, (unsigned char *)out, size);
+	}
+}
+
+/* Drops the rest of a line that didn't fit in a chunk */
+static void zf_skip_line(struct zfile *zf)
+{
+	size_t n;
+	char *p;
+
+	do {
+		n = zf_decode(zf, zf->carry, ZFILE_CHUNK_SIZE);
+		if ((p = memchr(zf->carry, '\n', n))) {
+			p++;
+			zf->carry_len = zf->carry + n - p;
+			memmove(zf->carry, p, zf->carry_len);
+			return;
+		}
+	} while (n);
+}
+
+static void zf_fill(struct zfile *zf, struct zf_chunk *c)
+{
+	size_t len = zf->carry_len;
+	char *p;
+
+	memcpy(c->data, zf->carry, len);
+	c->pos = zf->out_pos - len;
+	len += zf_decode(zf, c->data + len, ZFILE_CHUNK_SIZE - len);
+	zf->carry_len = 0;
+
+	if (!zf->eof && !zf->err) {
+		p = c->data + len;
+		while (p > c->data && p[-1] != '\n')
+			p--;
+		if (p > c->data) {
+			zf->carry_len = c->data + len - p;
+			memcpy(zf->carry, p, zf->carry_len);
+			len = p - c->data;
+		} else
+			zf_skip_line(zf);
+	}
+
+	c->len = len;
+	c->end_pos = zf->out_pos - zf->carry_len;
+	c->in_pos = zf_consumed(zf);
+	c->eof = zf->eof && !zf->carry_len;
+	c->err = zf->err;
+}
+
+#if HAVE_PTHREAD
+static void *zf_producer(void *arg)
+{
+	struct zfile *zf = arg;
+	int i;
+
+	pthread_mutex_lock(&zf->mutex);
+	i = zf->fill;
+	while (!zf->stop) {
+		if (zf->full[i]) {
+			pthread_cond_wait(&zf->cond, &zf->mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&zf->mutex);
+		zf_fill(zf, &zf->chunk[i]);
+		pthread_mutex_lock(&zf->mutex);
+		zf->full[i] = 1;
+		pthread_cond_broadcast(&zf->cond);
+		if (zf->chunk[i].eof || zf->chunk[i].err)
+			break;
+		i ^= 1;
+	}
+	pthread_mutex_unlock(&zf->mutex);
+
+	return NULL;
+}
+#endif
+
+static void zf_stop(struct zfile *zf)
+{
+#if HAVE_PTHREAD
+	if (!zf->running)
+		return;
+
+	pthread_mutex_lock(&zf->mutex);
+	zf->stop = 1;
+	pthread_cond_broadcast(&zf->cond);
+	pthread_mutex_unlock(&zf->mutex);
+	pthread_join(zf->thread, NULL);
+	zf->running = zf->stop = 0;
+#endif
+}
+
+/*
+ * Moves on to the next chunk.  The thread is only started here rather than
+ * on open or seek, which keeps it out of the way of any processes forked in
+ * between.
+ */
+static struct zf_chunk *zf_next(struct zfile *zf)
+{
+	struct zf_chunk *c;
+	int i = zf->next;
+
+	if (zf->cur >= 0 && zf->chunk[zf->cur].eof)
+		return NULL;
+
+#if HAVE_PTHREAD
+	if (!zf->sync) {
+		pthread_mutex_lock(&zf->mutex);
+		if (zf->cur >= 0) {
+			zf->full[zf->cur] = 0;
+			pthread_cond_broadcast(&zf->cond);
+		}
+		if (!zf->running) {
+			zf->fill = i;
+			if (pthread_create(&zf->thread, NULL, zf_producer, zf))
+				zf->sync = 1;
+			else
+				zf->running = 1;
+		}
+		if (zf->running)
+		while (!zf->full[i])
+			pthread_cond_wait(&zf->cond, &zf->mutex);
+		pthread_mutex_unlock(&zf->mutex);
+	}
+	if (zf->sync)
+#endif
+	zf_fill(zf, &zf->chunk[i]);
+
+	c = &zf->chunk[i];
+	if (c->err)
+		zf_fail(c->err);
+
+	zf->cur = i;
+	zf->next = i ^ 1;
+	zf->ptr = c->data;
+
+	return c;
+}
+
+struct zfile *zf_open(FILE *file, int type)
+{
+	struct zfile *zf;
+	int i;
+
+	switch (type) {
+	case ZF_GZIP:
+#if HAVE_LIBBZ2
+	case ZF_BZIP2:
+#endif
+#if HAVE_LIBLZMA
+	case ZF_XZ:
+#endif
+		break;
+	default:
+		fprintf(stderr, "Error: %s compressed files are not supported "
+		    "by this build\n", zf_name(type));
+		error();
+	}
+
+	zf = mem_calloc(sizeof(*zf));
+	zf->file = file;
+	zf->type = type;
+
+	jtr_fseek64(file, 0, SEEK_END);
+	if ((zf->size = jtr_ftell64(file)) < 0)
+		pexit("ftell");
+
+	zf->carry = mem_alloc(ZFILE_CHUNK_SIZE);
+	for (i = 0; i < 2; i++)
+		zf->chunk[i].data = mem_alloc(ZFILE_CHUNK_SIZE);
+
+	if (type == ZF_GZIP) {
+		zf->point = mem_alloc(ZF_POINTS * sizeof(*zf->point));
+		for (i = 0; i < ZF_POINTS; i++)
+			zf->point[i].pos = -1;
+	}
+
+#if HAVE_PTHREAD
+	pthread_mutex_init(&zf->mutex, NULL);
+	pthread_cond_init(&zf->cond, NULL);
+#endif
+
+	zf->cur = -1;
+	zf_rewind(zf);
+
+	return zf;
+}
+
+char *zf_getl(char *s, int size, struct zfile *zf)
+{
+	struct zf_chunk *c;
+	char *p, *end, *nl;
+	size_t len;
+
+	while (zf->cur < 0 ||
+	    zf->ptr >= zf->chunk[zf->cur].data + zf->chunk[zf->cur].len)
+		if (!zf_next(zf))
+			return NULL;
+
+	c = &zf->chunk[zf->cur];
+	p = zf->ptr;
+	end = c->data + c->len;
+
+	if ((nl = memchr(p, '\n', end - p))) {
+		zf->ptr = nl + 1;
+		if (nl > p && nl[-1] == '\r')
+			nl--;
+	} else
+		nl = zf->ptr = end;
+
+	len = nl - p;
+	if (len >= size)
+		len = size - 1;
+	memcpy(s, p, len);
+	s[len] = 0;
+
+	return s;
+}
+
+int64_t zf_tell(struct zfile *zf)
+{
+	struct zf_chunk *c;
+
+	if (zf->cur < 0)
+		return zf->seek_pos;
+
+	c = &zf->chunk[zf->cur];
+	if (zf->ptr < c->data + c->len)
+		return c->pos + (zf->ptr - c->data);
+
+	return c->end_pos;
+}
+
+void zf_seek(struct zfile *zf, int64_t pos)
+{
+	struct zf_point *pt;
+
+	zf_stop(zf);
+
+/* Decompress from where we are if no checkpoint is any closer */
+	pt = zf_find_point(zf, pos);
+	if (pos < zf->out_pos || (pt && pt->pos > zf->out_pos)) {
+		if (pt)
+			zf_resume(zf, pt);
+		else
+			zf_rewind(zf);
+	}
+
+	while (zf->out_pos < pos && !zf->eof && !zf->err)
+		zf_decode(zf, zf->carry, pos - zf->out_pos < ZFILE_CHUNK_SIZE ?
+		    pos - zf->out_pos : ZFILE_CHUNK_SIZE);
+	if (zf->err)
+		zf_fail(zf->err);
+	if (zf->out_pos < pos) {
+		fprintf(stderr, "Error: position "LLd" is past the end of "
+		    "compressed file\n", (long long)pos);
+		error();
+	}
+
+	zf->carry_len = 0;
+	zf->cur = -1;
+	zf->next = 0;
+#if HAVE_PTHREAD
+	zf->full[0] = zf->full[1] = 0;
+#endif
+	zf->seek_pos = pos;
+	zf->seek_in_pos = zf_consumed(zf);
+}
+
+int64_t zf_in_tell(struct zfile *zf)
+{
+	if (zf->cur < 0)
+		return zf->seek_in_pos;
+
+	return zf->chunk[zf->cur].in_pos;
+}
+
+int64_t zf_in_size(struct zfile *zf)
+{
+	return zf->size;
+}
+
+char *zf_load(struct zfile *zf, size_t max, int64_t *size)
+{
+	size_t alloc = ZFILE_CHUNK_SIZE, len = 0, n;
+	char *buf;
+
+	zf_seek(zf, 0);
+
+	buf = mem_alloc(alloc + LINE_BUFFER_SIZE + 1);
+	while (1) {
+		n = alloc - len;
+		if (n > ZFILE_CHUNK_SIZE)
+			n = ZFILE_CHUNK_SIZE;
+		len += zf_decode(zf, buf + len, n);
+		if (zf->err)
+			zf_fail(zf->err);
+		if (zf->eof)
+			break;
+		if (len < alloc)
+			continue;
+		if (max && alloc >= max) {
+			MEM_FREE(buf);
+			zf_seek(zf, 0);
+			return NULL;
+		}
+		alloc *= 2;
+		if (max && alloc > max)
+			alloc = max;
+		if (!(buf = realloc(buf, alloc + LINE_BUFFER_SIZE + 1)))
+			pexit("realloc");
+	}
+
+	*size = len;
+
+	return zf->loaded = buf;
+}
+
+void zf_save(struct zfile *zf, FILE *file, int64_t pos)
+{
+	struct zf_point *pt;
+	unsigned int i;
+
+#if HAVE_PTHREAD
+	pthread_mutex_lock(&zf->mutex);
+#endif
+	if ((pt = zf_find_point(zf, pos))) {
+		fprintf(file, LLd" "LLd" %d %u\n", (long long)pt->pos,
+		    (long long)pt->in_pos, pt->bits, pt->have);
+		for (i = ZF_WINDOW - pt->have; i < ZF_WINDOW; i++)
+			fprintf(file, "%02x", pt->window[i]);
+		fputc('\n', file);
+	} else
+		fprintf(file, "-1 0 0 0\n");
+#if HAVE_PTHREAD
+	pthread_mutex_unlock(&zf->mutex);
+#endif
+}
+
+int zf_restore(struct zfile *zf, FILE *file)
+{
+	struct zf_point *pt;
+	long long pos, in_pos;
+	int bits;
+	unsigned int have, i, c;
+
+	if (fscanf(file, LLd" "LLd" %d %u\n", &pos, &in_pos, &bits, &have) != 4)
+		return 1;
+	if (pos < 0)
+		return 0;
+	if (!zf->point || in_pos < 1 || in_pos > zf->size ||
+	    bits < 0 || bits > 7 || have > ZF_WINDOW)
+		return 1;
+
+	pt = &zf->point[zf->point_next];
+	zf->point_next = (zf->point_next + 1) % ZF_POINTS;
+
+	for (i = ZF_WINDOW - have; i < ZF_WINDOW; i++) {
+		if (fscanf(file, "%2x", &c) != 1)
+			return 1;
+		pt->window[i] = c;
+	}
+	pt->pos = pos;
+	pt->in_pos = in_pos;
+	pt->bits = bits;
+	pt->have = have;
+
+	return 0;
+}
+
+void zf_close(struct zfile *zf)
+{
+	int i;
+
+	zf_stop(zf);
+
+	switch (zf->type) {
+	case ZF_GZIP:
+		inflateEnd(&zf->s.gz);
+		break;
+#if HAVE_LIBBZ2
+	case ZF_BZIP2:
+		BZ2_bzDecompressEnd(&zf->s.bz);
+		break;
+#endif
+#if HAVE_LIBLZMA
+	case ZF_XZ:
+		lzma_end(&zf->s.xz);
+		break;
+#endif
+	}
+
+#if HAVE_PTHREAD
+	pthread_cond_destroy(&zf->cond);
+	pthread_mutex_destroy(&zf->mutex);
+#endif
+
+	MEM_FREE(zf->loaded);
+	MEM_FREE(zf->point);
+	for (i = 0; i < 2; i++)
+		MEM_FREE(zf->chunk[i].data);
+	MEM_FREE(zf->carry);
+	MEM_FREE(zf);
+}
@@ -0,0 +1,98 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+/*
+ * Line by line reading of compressed (gzip, bzip2 or xz) files.
+ *
+ * Where threads are available, the file is decompressed in a background
+ * thread, one chunk of whole lines ahead of the one being read.  Positions
+ * are offsets into the uncompressed data.  Seeking means decompressing from
+ * the start, or from the nearest checkpoint of the decompressor's state
+ * where the format allows for such checkpoints; the most recent ones are
+ * kept in memory and one can be saved to a crash recovery file.
+ */
+
+#ifndef _JOHN_ZFILE_H
+#define _JOHN_ZFILE_H
+
+#include <stdio.h>
+
+#include "jumbo.h"
+
+/*
+ * Compression formats, as recognized by zf_type().
+ */
+#define ZF_NONE				0
+#define ZF_GZIP				1
+#define ZF_BZIP2			2
+#define ZF_XZ				3
+#define ZF_ZSTD				4
+
+struct zfile;
+
+/*
+ * Returns the compression format of the file by its magic bytes, or ZF_NONE
+ * if it's not compressed.  The file is rewound.
+ */
+extern int zf_type(FILE *file);
+
+/*
+ * Returns the name of a compression format.
+ */
+extern const char *zf_name(int type);
+
+/*
+ * Starts decompressing a file of the given format.  The FILE remains owned
+ * by the caller.  Doesn't return if the format isn't supported by this build.
+ */
+extern struct zfile *zf_open(FILE *file, int type);
+
+/*
+ * Like fgetl(), but for the uncompressed data.  Doesn't return on errors.
+ */
+extern char *zf_getl(char *s, int size, struct zfile *zf);
+
+/*
+ * Returns the position of the next line.
+ */
+extern int64_t zf_tell(struct zfile *zf);
+
+/*
+ * Moves to a position previously returned by zf_tell().  Doesn't return if
+ * the position is past the end of data.
+ */
+extern void zf_seek(struct zfile *zf, int64_t pos);
+
+/*
+ * Returns the number of compressed bytes decompressed so far, for progress
+ * reporting, and the size of the compressed file.
+ */
+extern int64_t zf_in_tell(struct zfile *zf);
+extern int64_t zf_in_size(struct zfile *zf);
+
+/*
+ * Decompresses the whole file into memory, unless it would exceed max bytes
+ * (if non-zero), in which case NULL is returned and the file is rewound.
+ * The buffer has LINE_BUFFER_SIZE + 1 bytes to spare after the data, and is
+ * freed by zf_close().
+ */
+extern char *zf_load(struct zfile *zf, size_t max, int64_t *size);
+
+/*
+ * Save and restore the latest checkpoint at or before pos, if any.
+ */
+extern void zf_save(struct zfile *zf, FILE *file, int64_t pos);
+extern int zf_restore(struct zfile *zf, FILE *file);
+
+/*
+ * Stops decompressing and frees everything but the FILE.
+ */
+extern void zf_close(struct zfile *zf);
+
+#endif